@@ -90,8 +90,12 @@
 #define NV50TIC_0_1_OFFSET_LOW_SHIFT                                       0
 
 #define NV50TIC_0_2_UNKNOWN_MASK                                  0xffffffff
+#define NV50TIC_0_2_TARGET_2D                                     0x00004000
+#define NV50TIC_0_2_TARGET_RECT                                   0x0001c000
+#define NV50TIC_0_2_LINEAR                                        0x00040000
 
 #define NV50TIC_0_3_UNKNOWN_MASK                                  0xffffffff
+#define NV50TIC_0_3_PITCH_MASK                                    0x000fffff
 
 #define NV50TIC_0_4_WIDTH_MASK                                    0x0000ffff
 #define NV50TIC_0_4_WIDTH_SHIFT                                            0
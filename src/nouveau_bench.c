@@ -0,0 +1,217 @@
+/*
+ * Copyright 2012 Nouveau Project
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF
+ * OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/* nouveau-bench: CPU cost and push buffer usage of the common accelerated
+ * operations, per architecture.  Runs against nouveau_mock.c, so needs no
+ * GPU and measures only the driver's own work.
+ *
+ *   nouveau-bench [iterations]
+ */
+
+#include "nv_include.h"
+#include "fourcc.h"
+
+#include <time.h>
+#include "nouveau_mock.h"
+
+#ifndef ARRAY_SIZE
+#define ARRAY_SIZE(a)  (sizeof(a) / sizeof((a)[0]))
+#endif
+
+#define BENCH_W 64
+#define BENCH_H 64
+
+struct bench {
+	ScrnInfoPtr pScrn;
+	ExaDriverPtr exa;
+	PixmapPtr src, dst;
+	PicturePtr src_pict, dst_pict;
+	char *data;
+};
+
+static void
+bench_solid(struct bench *b, int i)
+{
+	int x = (i * 8) & 255;
+
+	b->exa->PrepareSolid(b->dst, GXcopy, ~0, 0xff00ff00 + i);
+	b->exa->Solid(b->dst, x, x, x + BENCH_W, x + BENCH_H);
+	b->exa->DoneSolid(b->dst);
+}
+
+static void
+bench_copy(struct bench *b, int i)
+{
+	int x = (i * 8) & 255;
+
+	b->exa->PrepareCopy(b->src, b->dst, 1, 1, GXcopy, ~0);
+	b->exa->Copy(b->dst, x, x, 256 - x, x, BENCH_W, BENCH_H);
+	b->exa->DoneCopy(b->dst);
+}
+
+static void
+bench_composite(struct bench *b, int i)
+{
+	int x = (i * 8) & 255;
+
+	if (b->exa->CheckComposite(PictOpOver, b->src_pict, NULL,
+				   b->dst_pict) &&
+	    b->exa->PrepareComposite(PictOpOver, b->src_pict, NULL,
+				     b->dst_pict, b->src, NULL, b->dst)) {
+		b->exa->Composite(b->dst, x, x, 0, 0, 256 - x, x,
+				  BENCH_W, BENCH_H);
+		b->exa->DoneComposite(b->dst);
+	}
+}
+
+static void
+bench_upload_sifc(struct bench *b, int i)
+{
+	int x = (i * 8) & 255;
+
+	b->exa->UploadToScreen(b->dst, x, x, 16, 16, b->data, 16 * 4);
+}
+
+static void
+bench_put_image(struct bench *b, int i)
+{
+	NVPtr pNv = NVPTR(b->pScrn);
+	NVPortPrivRec port = {};
+	RegionRec clip = {};
+	BoxRec box = { 0, 0, 2 * BENCH_W, 2 * BENCH_H };
+	struct nouveau_bo *bo = nouveau_pixmap_bo(b->src);
+
+	clip.extents = box;
+
+	if (pNv->Architecture == NV_ARCH_50) {
+		nv50_xv_image_put(b->pScrn, bo, 0, BENCH_W * BENCH_H,
+				  FOURCC_YV12, BENCH_W, &box,
+				  0, 0, BENCH_W << 16, BENCH_H << 16,
+				  BENCH_W, BENCH_H, BENCH_W, BENCH_H,
+				  2 * BENCH_W, 2 * BENCH_H, &clip, b->dst,
+				  &port);
+	} else {
+		nvc0_xv_image_put(b->pScrn, bo, 0, BENCH_W * BENCH_H,
+				  FOURCC_YV12, BENCH_W, &box,
+				  0, 0, BENCH_W << 16, BENCH_H << 16,
+				  BENCH_W, BENCH_H, BENCH_W, BENCH_H,
+				  2 * BENCH_W, 2 * BENCH_H, &clip, b->dst,
+				  &port);
+	}
+}
+
+static const struct {
+	const char *name;
+	void (*func)(struct bench *, int);
+} bench_ops[] = {
+	{ "Solid", bench_solid },
+	{ "Copy", bench_copy },
+	{ "Composite", bench_composite },
+	{ "UploadSIFC", bench_upload_sifc },
+	{ "PutImage", bench_put_image },
+};
+
+static const int bench_chipsets[] = { 0x50, 0xa8, 0xc0, 0xe4 };
+
+static uint64_t
+bench_nsec(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void
+bench_run(int chipset, int iterations)
+{
+	struct nouveau_mock_stats stats;
+	struct bench b = {};
+	uint64_t start, nsec;
+	NVPtr pNv;
+	unsigned op;
+	int i;
+
+	b.pScrn = nouveau_mock_screen_init(chipset, 1024, 768);
+	pNv = NVPTR(b.pScrn);
+	b.exa = pNv->EXADriverPtr;
+	b.src = nouveau_mock_pixmap(b.pScrn, 512, 512, 24, 0);
+	b.dst = nouveau_mock_pixmap(b.pScrn, 512, 512, 24, 0);
+	b.data = calloc(16 * 16, 4);
+	if (!b.src || !b.dst || !b.data) {
+		fprintf(stderr, "NV%02x: out of memory\n", chipset);
+		exit(1);
+	}
+
+	/* created up front so only the operations themselves are timed */
+	b.src_pict = nouveau_mock_picture(b.src, PICT_a8r8g8b8);
+	b.dst_pict = nouveau_mock_picture(b.dst, PICT_a8r8g8b8);
+	if (!b.src_pict || !b.dst_pict) {
+		fprintf(stderr, "NV%02x: out of memory\n", chipset);
+		exit(1);
+	}
+
+	for (op = 0; op < ARRAY_SIZE(bench_ops); op++) {
+		/* once to emit the state the rest will reuse */
+		bench_ops[op].func(&b, 0);
+		PUSH_KICK(pNv->pushbuf);
+		nouveau_mock_reset();
+
+		start = bench_nsec();
+		for (i = 0; i < iterations; i++)
+			bench_ops[op].func(&b, i);
+		PUSH_KICK(pNv->pushbuf);
+		nsec = bench_nsec() - start;
+
+		nouveau_mock_stats(&stats);
+		printf("NV%02x %-12s %10.1f ns/op %8.1f dwords/op %6u stalls\n",
+		       chipset, bench_ops[op].name,
+		       (double)nsec / iterations,
+		       (double)stats.dwords / iterations, stats.stalls);
+	}
+
+	nouveau_mock_picture_destroy(b.dst_pict);
+	nouveau_mock_picture_destroy(b.src_pict);
+	free(b.data);
+	nouveau_mock_pixmap_destroy(b.dst);
+	nouveau_mock_pixmap_destroy(b.src);
+	nouveau_mock_screen_fini(b.pScrn);
+}
+
+int
+main(int argc, char *argv[])
+{
+	int iterations = argc > 1 ? atoi(argv[1]) : 100000;
+	unsigned i;
+
+	if (iterations <= 0) {
+		fprintf(stderr, "usage: %s [iterations]\n", argv[0]);
+		return 1;
+	}
+
+	/* the cost model would calibrate against the mock, pin the path */
+	nouveau_mock_option(OPTION_INLINE_UPLOAD_LIMIT, "65536");
+
+	for (i = 0; i < ARRAY_SIZE(bench_chipsets); i++)
+		bench_run(bench_chipsets[i], iterations);
+	return 0;
+}
@@ -0,0 +1,235 @@
+/*
+ * Copyright 2012 Nouveau Project
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF
+ * OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "nv_include.h"
+
+/* Pixmap storage is parked here for a short while after the pixmap is
+ * destroyed, so that the constant churn of short-lived pixmaps doesn't
+ * cost a kernel allocation (and the page-table setup that goes with it)
+ * each time.  BOs are only ever handed back out for a surface with an
+ * identical layout, so nothing but the contents can differ.
+ */
+#define BO_CACHE_BUCKETS 16
+#define BO_CACHE_EXPIRE  1000 /* ms */
+#define BO_CACHE_MAX     (32 * 1024 * 1024)
+
+struct nouveau_bo_cache_entry {
+	struct nouveau_bo_cache_entry *next;
+	struct nouveau_surface surf;
+	struct nouveau_bo *bo;
+	CARD32 time;
+};
+
+struct nouveau_bo_cache {
+	/* most recently freed first */
+	struct nouveau_bo_cache_entry *bucket[BO_CACHE_BUCKETS];
+	uint64_t size;
+	uint64_t max_size;
+	CARD32 last_trim;
+
+	unsigned hits;
+	unsigned misses;
+	unsigned expired;
+};
+
+static inline uint32_t
+bo_cache_size(struct nouveau_surface *surf)
+{
+	return surf->pitch * surf->height;
+}
+
+static inline int
+bo_cache_bucket(struct nouveau_surface *surf)
+{
+	int b = log2i(bo_cache_size(surf) >> 12);
+
+	return (b < BO_CACHE_BUCKETS) ? b : BO_CACHE_BUCKETS - 1;
+}
+
+static inline Bool
+bo_cache_match(struct nouveau_surface *a, struct nouveau_surface *b)
+{
+	return a->flags == b->flags && a->pitch == b->pitch &&
+	       a->height == b->height &&
+	       !memcmp(&a->cfg, &b->cfg, sizeof(a->cfg));
+}
+
+/* Free every entry in the chain starting at *pentry */
+static void
+bo_cache_free_chain(struct nouveau_bo_cache *cache,
+		    struct nouveau_bo_cache_entry **pentry)
+{
+	struct nouveau_bo_cache_entry *entry = *pentry, *next;
+
+	*pentry = NULL;
+	while (entry) {
+		next = entry->next;
+		cache->size -= bo_cache_size(&entry->surf);
+		cache->expired++;
+		nouveau_bo_ref(NULL, &entry->bo);
+		free(entry);
+		entry = next;
+	}
+}
+
+static void
+bo_cache_expire(struct nouveau_bo_cache *cache, CARD32 now)
+{
+	struct nouveau_bo_cache_entry **pentry;
+	int i;
+
+	for (i = 0; i < BO_CACHE_BUCKETS; i++) {
+		/* entries are sorted by age, everything after is older */
+		pentry = &cache->bucket[i];
+		while (*pentry && (now - (*pentry)->time) < BO_CACHE_EXPIRE)
+			pentry = &(*pentry)->next;
+		bo_cache_free_chain(cache, pentry);
+	}
+
+	cache->last_trim = now;
+}
+
+Bool
+nouveau_bo_cache_new(ScrnInfoPtr pScrn, struct nouveau_surface *surf,
+		     struct nouveau_bo **pbo)
+{
+	NVPtr pNv = NVPTR(pScrn);
+	struct nouveau_bo_cache *cache = pNv->bo_cache;
+	struct nouveau_bo_cache_entry **pentry, *entry;
+
+	if (cache && !(surf->flags & NOUVEAU_BO_CONTIG)) {
+		pentry = &cache->bucket[bo_cache_bucket(surf)];
+		while ((entry = *pentry)) {
+			if (bo_cache_match(&entry->surf, surf)) {
+				*pentry = entry->next;
+				cache->size -= bo_cache_size(surf);
+				cache->hits++;
+
+				*pbo = entry->bo;
+				free(entry);
+				return TRUE;
+			}
+			pentry = &entry->next;
+		}
+
+		cache->misses++;
+	}
+
+	return nouveau_bo_new(pNv->dev, surf->flags, 0, bo_cache_size(surf),
+			      &surf->cfg, pbo) == 0;
+}
+
+void
+nouveau_bo_cache_put(ScrnInfoPtr pScrn, struct nouveau_surface *surf,
+		     struct nouveau_bo **pbo)
+{
+	NVPtr pNv = NVPTR(pScrn);
+	struct nouveau_bo_cache *cache = pNv->bo_cache;
+	struct nouveau_bo_cache_entry *entry;
+	int b;
+
+	/* pixmaps created without storage may have had some other BO
+	 * (scanout, etc) attached to them since, never cache those
+	 */
+	if (!cache || !*pbo || !surf->pitch ||
+	    (surf->flags & NOUVEAU_BO_CONTIG) ||
+	    bo_cache_size(surf) > cache->max_size / 4)
+		goto out;
+
+	if (cache->size + bo_cache_size(surf) > cache->max_size) {
+		bo_cache_expire(cache, GetTimeInMillis());
+		if (cache->size + bo_cache_size(surf) > cache->max_size)
+			goto out;
+	}
+
+	entry = malloc(sizeof(*entry));
+	if (!entry)
+		goto out;
+
+	b = bo_cache_bucket(surf);
+	entry->surf = *surf;
+	entry->bo = *pbo;
+	entry->time = GetTimeInMillis();
+	entry->next = cache->bucket[b];
+	cache->bucket[b] = entry;
+	cache->size += bo_cache_size(surf);
+
+	*pbo = NULL;
+	return;
+out:
+	nouveau_bo_ref(NULL, pbo);
+}
+
+/* Called from the block handler, drops anything that's been idle for
+ * longer than BO_CACHE_EXPIRE.
+ */
+void
+nouveau_bo_cache_trim(ScrnInfoPtr pScrn)
+{
+	NVPtr pNv = NVPTR(pScrn);
+	struct nouveau_bo_cache *cache = pNv->bo_cache;
+	CARD32 now;
+
+	if (!cache || !cache->size)
+		return;
+
+	now = GetTimeInMillis();
+	if ((now - cache->last_trim) >= BO_CACHE_EXPIRE / 4)
+		bo_cache_expire(cache, now);
+}
+
+Bool
+nouveau_bo_cache_init(ScrnInfoPtr pScrn)
+{
+	NVPtr pNv = NVPTR(pScrn);
+	struct nouveau_bo_cache *cache;
+
+	cache = calloc(1, sizeof(*cache));
+	if (!cache)
+		return FALSE;
+
+	cache->max_size = min(BO_CACHE_MAX, pNv->dev->vram_size / 16);
+	cache->last_trim = GetTimeInMillis();
+	pNv->bo_cache = cache;
+	return TRUE;
+}
+
+void
+nouveau_bo_cache_fini(ScrnInfoPtr pScrn)
+{
+	NVPtr pNv = NVPTR(pScrn);
+	struct nouveau_bo_cache *cache = pNv->bo_cache;
+	int i;
+
+	if (!cache)
+		return;
+
+	xf86DrvMsgVerb(pScrn->scrnIndex, X_INFO, 3,
+		       "BO cache: %u hits, %u misses, %u expired\n",
+		       cache->hits, cache->misses, cache->expired);
+
+	for (i = 0; i < BO_CACHE_BUCKETS; i++)
+		bo_cache_free_chain(cache, &cache->bucket[i]);
+
+	free(cache);
+	pNv->bo_cache = NULL;
+}
@@ -0,0 +1,291 @@
+/*
+ * Copyright 2012 Nouveau Project
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF
+ * OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "nv_include.h"
+
+/* Option "PushBufferCapture": everything kicked on the channel is written
+ * to a trace file for nouveau-pushdec, see nouveau_capture.h.
+ *
+ * The dwords of a submission are those between where the last one ended
+ * and push->cur when the kick notify hook is called.  Buffers and EXA
+ * operations are noted as they're queued and written out ahead of the
+ * submission they belong to.  If a new push buffer was started somewhere
+ * we didn't see, such as inside libdrm, there's no telling where the
+ * submission began and a GAP is written in its place.
+ */
+
+struct nouveau_capture {
+	FILE *file;
+	Bool failed;
+
+	struct nv_capture_bo *bos;
+	int nr_bos, max_bos;
+	struct nv_capture_op *ops;
+	int nr_ops, max_ops;
+
+	unsigned pushes;
+	unsigned gaps;
+	uint64_t dwords;
+};
+
+static void
+capture_write(struct nouveau_capture *cap, uint32_t type,
+	      const void *data, uint32_t size,
+	      const void *extra, uint32_t extra_size)
+{
+	struct nv_capture_record rec = {
+		.type = type,
+		.size = size + extra_size,
+		.usec = nouveau_time_usec(),
+	};
+
+	if (cap->failed)
+		return;
+
+	if (fwrite(&rec, sizeof(rec), 1, cap->file) != 1 ||
+	    (size && fwrite(data, size, 1, cap->file) != 1) ||
+	    (extra_size && fwrite(extra, extra_size, 1, cap->file) != 1))
+		cap->failed = TRUE;
+}
+
+static void *
+capture_grow(void *array, int *max, int size)
+{
+	int nr = *max ? *max * 2 : 64;
+
+	array = realloc(array, nr * size);
+	if (array)
+		*max = nr;
+	return array;
+}
+
+/* Where the next dword written will land in the submission being built,
+ * NV_CAPTURE_NO_RELOC if we've lost track.
+ */
+static uint32_t
+capture_dword(struct nouveau_pushbuf *push)
+{
+	struct nouveau_pushbuf_priv *priv = push->user_priv;
+
+	if (!priv->captured || priv->captured_end != push->end ||
+	    push->cur < priv->captured)
+		return NV_CAPTURE_NO_RELOC;
+	return push->cur - priv->captured;
+}
+
+void
+nouveau_capture_bo(struct nouveau_pushbuf *push, struct nouveau_bo *bo,
+		   uint32_t flags, int reloc)
+{
+	struct nouveau_pushbuf_priv *priv = push->user_priv;
+	struct nouveau_capture *cap = priv->capture;
+	struct nv_capture_bo *rec;
+	int i;
+
+	/* one entry per buffer is enough, unless it's a relocation */
+	if (!reloc) {
+		for (i = 0; i < cap->nr_bos; i++) {
+			if (cap->bos[i].handle == bo->handle &&
+			    cap->bos[i].reloc == NV_CAPTURE_NO_RELOC) {
+				cap->bos[i].flags |= flags;
+				return;
+			}
+		}
+	}
+
+	if (cap->nr_bos == cap->max_bos) {
+		rec = capture_grow(cap->bos, &cap->max_bos, sizeof(*rec));
+		if (!rec)
+			return;
+		cap->bos = rec;
+	}
+
+	rec = &cap->bos[cap->nr_bos++];
+	rec->handle = bo->handle;
+	rec->flags = flags;
+	rec->offset = bo->offset;
+	rec->size = bo->size;
+	rec->reloc = reloc ? capture_dword(push) : NV_CAPTURE_NO_RELOC;
+	rec->pad = 0;
+}
+
+void
+nouveau_capture_op(struct nouveau_pushbuf *push, uint32_t op)
+{
+	struct nouveau_pushbuf_priv *priv = push->user_priv;
+	struct nouveau_capture *cap = priv->capture;
+	struct nv_capture_op *rec;
+
+	if (cap->nr_ops == cap->max_ops) {
+		rec = capture_grow(cap->ops, &cap->max_ops, sizeof(*rec));
+		if (!rec)
+			return;
+		cap->ops = rec;
+	}
+
+	rec = &cap->ops[cap->nr_ops++];
+	rec->op = op;
+	rec->dword = capture_dword(push);
+}
+
+/* Called by the kick notify hook, just before the submission is made */
+void
+nouveau_capture_push(struct nouveau_pushbuf *push, int wrap)
+{
+	struct nouveau_pushbuf_priv *priv = push->user_priv;
+	struct nouveau_capture *cap = priv->capture;
+	struct nv_capture_push rec;
+	int i;
+
+	if (capture_dword(push) == NV_CAPTURE_NO_RELOC) {
+		capture_write(cap, NV_CAPTURE_GAP, NULL, 0, NULL, 0);
+		cap->gaps++;
+	} else {
+		rec.wrap = wrap;
+		rec.nr = push->cur - priv->captured;
+
+		for (i = 0; i < cap->nr_bos; i++) {
+			capture_write(cap, NV_CAPTURE_BO, &cap->bos[i],
+				      sizeof(cap->bos[i]), NULL, 0);
+		}
+		for (i = 0; i < cap->nr_ops; i++) {
+			capture_write(cap, NV_CAPTURE_OP, &cap->ops[i],
+				      sizeof(cap->ops[i]), NULL, 0);
+		}
+		capture_write(cap, NV_CAPTURE_PUSH, &rec, sizeof(rec),
+			      priv->captured, rec.nr * 4);
+		cap->pushes++;
+		cap->dwords += rec.nr;
+	}
+
+	cap->nr_bos = 0;
+	cap->nr_ops = 0;
+	priv->captured = push->cur;
+	priv->captured_end = push->end;
+}
+
+void
+nouveau_capture_init(ScrnInfoPtr pScrn)
+{
+	NVPtr pNv = NVPTR(pScrn);
+	struct nouveau_pushbuf_priv *priv = &pNv->pushbuf_priv;
+	struct nv_capture_header hdr = {
+		.magic = NV_CAPTURE_MAGIC,
+		.version = NV_CAPTURE_VERSION,
+		.chipset = pNv->dev->chipset,
+	};
+	struct nouveau_capture *cap;
+	const char *path;
+
+	path = xf86GetOptValString(pNv->Options, OPTION_PUSH_BUFFER_CAPTURE);
+	if (!path)
+		return;
+
+	cap = calloc(1, sizeof(*cap));
+	if (!cap)
+		return;
+
+	cap->file = fopen(path, "wb");
+	if (!cap->file) {
+		xf86DrvMsg(pScrn->scrnIndex, X_WARNING,
+			   "Couldn't open push buffer capture \"%s\": %s\n",
+			   path, strerror(errno));
+		free(cap);
+		return;
+	}
+
+	if (fwrite(&hdr, sizeof(hdr), 1, cap->file) != 1)
+		cap->failed = TRUE;
+
+	priv->capture = cap;
+	priv->captured = pNv->pushbuf->cur;
+	priv->captured_end = pNv->pushbuf->end;
+	xf86DrvMsg(pScrn->scrnIndex, X_CONFIG,
+		   "Capturing push buffers to \"%s\"\n", path);
+}
+
+static void
+capture_object(struct nouveau_capture *cap, struct nouveau_object *obj)
+{
+	struct nv_capture_object rec;
+
+	if (!obj)
+		return;
+
+	rec.handle = obj->handle;
+	rec.oclass = obj->oclass;
+	capture_write(cap, NV_CAPTURE_OBJECT, &rec, sizeof(rec), NULL, 0);
+}
+
+/* Note the objects created by NVAccelCommonInit(), so the decoder can tell
+ * what's bound to each subchannel.
+ */
+void
+nouveau_capture_objects(ScrnInfoPtr pScrn)
+{
+	NVPtr pNv = NVPTR(pScrn);
+	struct nouveau_capture *cap = pNv->pushbuf_priv.capture;
+
+	if (!cap)
+		return;
+
+	capture_object(cap, pNv->notify0);
+	capture_object(cap, pNv->vblank_sem);
+	capture_object(cap, pNv->NvNull);
+	capture_object(cap, pNv->NvContextSurfaces);
+	capture_object(cap, pNv->NvContextBeta1);
+	capture_object(cap, pNv->NvContextBeta4);
+	capture_object(cap, pNv->NvImagePattern);
+	capture_object(cap, pNv->NvRop);
+	capture_object(cap, pNv->NvRectangle);
+	capture_object(cap, pNv->NvImageBlit);
+	capture_object(cap, pNv->NvScaledImage);
+	capture_object(cap, pNv->NvClipRectangle);
+	capture_object(cap, pNv->NvMemFormat);
+	capture_object(cap, pNv->NvImageFromCpu);
+	capture_object(cap, pNv->Nv2D);
+	capture_object(cap, pNv->Nv3D);
+	capture_object(cap, pNv->NvSW);
+	capture_object(cap, pNv->NvCopy);
+}
+
+void
+nouveau_capture_fini(ScrnInfoPtr pScrn)
+{
+	NVPtr pNv = NVPTR(pScrn);
+	struct nouveau_capture *cap = pNv->pushbuf_priv.capture;
+
+	if (!cap)
+		return;
+
+	xf86DrvMsgVerb(pScrn->scrnIndex, X_INFO, 3,
+		       "Push buffer capture: %u submissions, %llu dwords, "
+		       "%u lost%s\n", cap->pushes,
+		       (unsigned long long)cap->dwords, cap->gaps,
+		       cap->failed ? ", write failed" : "");
+
+	fclose(cap->file);
+	free(cap->bos);
+	free(cap->ops);
+	free(cap);
+	pNv->pushbuf_priv.capture = NULL;
+}
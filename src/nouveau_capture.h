@@ -0,0 +1,107 @@
+/*
+ * Copyright 2012 Nouveau Project
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF
+ * OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef __NOUVEAU_CAPTURE_H__
+#define __NOUVEAU_CAPTURE_H__
+
+#include <stdint.h>
+
+/* Command stream traces, written by the driver with Option
+ * "PushBufferCapture" and read by nouveau-pushdec.  Everything's in host
+ * byte order.  The file starts with a header, followed by records:
+ *
+ *   OBJECT  a channel object the commands may bind, handle and class
+ *   BO      a buffer referenced by the next PUSH, and if it's a
+ *           relocation, the dword in it that holds the address
+ *   OP      an EXA operation started at a dword of the next PUSH
+ *   PUSH    the dwords submitted in one go
+ *   GAP     commands were submitted that couldn't be captured
+ */
+#define NV_CAPTURE_MAGIC   0x4352564e /* "NVRC" */
+#define NV_CAPTURE_VERSION 1
+
+struct nv_capture_header {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t chipset;
+	uint32_t reserved;
+};
+
+enum {
+	NV_CAPTURE_OBJECT = 1,
+	NV_CAPTURE_BO,
+	NV_CAPTURE_OP,
+	NV_CAPTURE_PUSH,
+	NV_CAPTURE_GAP,
+};
+
+struct nv_capture_record {
+	uint32_t type;
+	uint32_t size; /* of the payload that follows, in bytes */
+	uint64_t usec;
+};
+
+struct nv_capture_object {
+	uint32_t handle;
+	uint32_t oclass;
+};
+
+#define NV_CAPTURE_NO_RELOC 0xffffffff
+
+struct nv_capture_bo {
+	uint32_t handle;
+	uint32_t flags;  /* NOUVEAU_BO_* */
+	uint64_t offset; /* at the time it was referenced */
+	uint64_t size;
+	uint32_t reloc;  /* dword in the next PUSH, or NV_CAPTURE_NO_RELOC */
+	uint32_t pad;
+};
+
+enum {
+	NV_CAPTURE_OP_SOLID = 1,
+	NV_CAPTURE_OP_COPY,
+	NV_CAPTURE_OP_COMPOSITE,
+	NV_CAPTURE_OP_UPLOAD,
+	NV_CAPTURE_OP_DOWNLOAD,
+	NV_CAPTURE_OPS
+};
+
+struct nv_capture_op {
+	uint32_t op;
+	uint32_t dword; /* in the next PUSH */
+};
+
+struct nv_capture_push {
+	uint32_t wrap; /* not kicked by the driver, usually because the push
+			* buffer was full */
+	uint32_t nr;   /* dwords that follow */
+};
+
+/* in nouveau_capture.c */
+struct nouveau_pushbuf;
+struct nouveau_bo;
+void nouveau_capture_bo(struct nouveau_pushbuf *, struct nouveau_bo *,
+			uint32_t flags, int reloc);
+void nouveau_capture_op(struct nouveau_pushbuf *, uint32_t op);
+void nouveau_capture_push(struct nouveau_pushbuf *, int wrap);
+
+#endif
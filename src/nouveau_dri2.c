@@ -69,6 +69,7 @@ nouveau_dri2_create_buffer(DrawablePtr pDraw, unsigned int attachment,
 
 	pNv->exa_force_cp = TRUE;
 	exaMoveInPixmap(ppix);
+	nouveau_exa_pixmap_touch(ppix);
 	pNv->exa_force_cp = FALSE;
 
 	nvbuf->base.attachment = attachment;
@@ -81,11 +82,13 @@ nouveau_dri2_create_buffer(DrawablePtr pDraw, unsigned int attachment,
 
 	nvpix = nouveau_pixmap(ppix);
 	if (!nvpix || !nvpix->bo ||
+	    !nouveau_slab_detach(xf86Screens[pScreen->myNum], nvpix) ||
 	    nouveau_bo_name_get(nvpix->bo, &nvbuf->base.name)) {
 		pScreen->DestroyPixmap(nvbuf->ppix);
 		free(nvbuf);
 		return NULL;
 	}
+	nvpix->shared = TRUE;
 
 	return &nvbuf->base;
 }
@@ -163,11 +166,18 @@ update_front(DrawablePtr draw, DRI2BufferPtr front)
 	pixmap->refcnt++;
 
 	exaMoveInPixmap(pixmap);
+	nouveau_exa_pixmap_touch(pixmap);
+	if (!nouveau_slab_detach(xf86Screens[draw->pScreen->myNum],
+				 nouveau_pixmap(pixmap))) {
+		(*draw->pScreen->DestroyPixmap)(pixmap);
+		return FALSE;
+	}
 	r = nouveau_bo_name_get(nouveau_pixmap_bo(pixmap), &front->name);
 	if (r) {
 		(*draw->pScreen->DestroyPixmap)(pixmap);
 		return FALSE;
 	}
+	nouveau_pixmap(pixmap)->shared = TRUE;
 
 	(*draw->pScreen->DestroyPixmap)(nvbuf->ppix);
 	front->pitch = pixmap->devKind;
@@ -311,9 +321,10 @@ nouveau_dri2_finish_swap(DrawablePtr draw, unsigned int frame,
 
 	if (can_sync_to_vblank(draw)) {
 		/* Reference the back buffer to sync it to vblank */
-		nouveau_pushbuf_refn(push, &(struct nouveau_pushbuf_refn) {
+		PUSH_REFS(push, &(struct nouveau_pushbuf_refn) {
 					   src_bo,
-					   NOUVEAU_BO_VRAM | NOUVEAU_BO_RD
+					   nouveau_pixmap_domain(src_pix) |
+					   NOUVEAU_BO_RD
 				     }, 1);
 
 		if (pNv->Architecture >= NV_ARCH_50)
@@ -321,7 +332,7 @@ nouveau_dri2_finish_swap(DrawablePtr draw, unsigned int frame,
 		else
 			NV11SyncToVBlank(dst_pix, REGION_EXTENTS(0, &reg));
 
-		nouveau_pushbuf_kick(push, push->channel);
+		PUSH_KICK(push);
 	}
 
 	if (front_updated && can_exchange(draw, dst_pix, src_pix)) {
@@ -350,13 +361,15 @@ nouveau_dri2_finish_swap(DrawablePtr draw, unsigned int frame,
 
 		/* Reference the front buffer to let throttling work
 		 * on occluded drawables. */
-		nouveau_pushbuf_refn(push, &(struct nouveau_pushbuf_refn) {
+		PUSH_REFS(push, &(struct nouveau_pushbuf_refn) {
 					   dst_bo,
 					   NOUVEAU_BO_VRAM | NOUVEAU_BO_RD
 				     }, 1);
 
 		REGION_TRANSLATE(0, &reg, -draw->x, -draw->y);
+		nouveau_profile_begin(pNv, NV_PROFILE_SWAP);
 		nouveau_dri2_copy_region(draw, &reg, s->dst, s->src);
+		nouveau_profile_end(pNv, TRUE);
 
 		if (can_sync_to_vblank(draw) && !violate_oml(draw)) {
 			/* Request a vblank event one vblank from now, the most
@@ -47,55 +47,799 @@ NVAccelM2MF(NVPtr pNv, int w, int h, int cpp, uint32_t srcoff, uint32_t dstoff,
 	    struct nouveau_bo *src, int sd, int sp, int sh, int sx, int sy,
 	    struct nouveau_bo *dst, int dd, int dp, int dh, int dx, int dy)
 {
+	struct nouveau_pushbuf *push = pNv->pushbuf;
+	Bool profile, ret;
+
+	/* see NVInitDmaTransfer(), anything on the main channel that
+	 * depends on the copy waits for it, so it goes out straight away
+	 */
+	if (pNv->xfer_pushbuf)
+		push = pNv->xfer_pushbuf;
+
+	/* only M2MF on the main channel runs in order with PGRAPH, which is
+	 * what nouveau_profile.c takes its timestamps from
+	 */
+	profile = push == pNv->pushbuf && !pNv->NvCopy &&
+		  pNv->Architecture < NV_ARCH_E0;
+	if (profile)
+		nouveau_profile_begin(pNv, NV_PROFILE_M2MF);
+
+	/* the copy engines don't wait for PGRAPH on their own */
+	if (push == pNv->pushbuf &&
+	    (pNv->NvCopy || pNv->Architecture >= NV_ARCH_E0) &&
+	    !NVC0EXACopyWait(pNv))
+		ret = FALSE;
+	else
 	if (pNv->Architecture >= NV_ARCH_E0)
-		return NVE0EXARectCopy(pNv, w, h, cpp,
-				       src, srcoff, sd, sp, sh, sx, sy,
-				       dst, dstoff, dd, dp, dh, dx, dy);
+		ret = NVE0EXARectCopy(push, w, h, cpp,
+				      src, srcoff, sd, sp, sh, sx, sy,
+				      dst, dstoff, dd, dp, dh, dx, dy);
+	else
+	if (pNv->NvCopy)
+		ret = NVC0EXARectCopy(push, w, h, cpp,
+				      src, srcoff, sd, sp, sh, sx, sy,
+				      dst, dstoff, dd, dp, dh, dx, dy);
 	else
 	if (pNv->Architecture >= NV_ARCH_C0)
-		return NVC0EXARectM2MF(pNv, w, h, cpp,
-				       src, srcoff, sd, sp, sh, sx, sy,
-				       dst, dstoff, dd, dp, dh, dx, dy);
+		ret = NVC0EXARectM2MF(push, w, h, cpp,
+				      src, srcoff, sd, sp, sh, sx, sy,
+				      dst, dstoff, dd, dp, dh, dx, dy);
 	else
 	if (pNv->Architecture >= NV_ARCH_50)
-		return NV50EXARectM2MF(pNv, w, h, cpp,
-				       src, srcoff, sd, sp, sh, sx, sy,
-				       dst, dstoff, dd, dp, dh, dx, dy);
+		ret = NV50EXARectM2MF(push, w, h, cpp,
+				      src, srcoff, sd, sp, sh, sx, sy,
+				      dst, dstoff, dd, dp, dh, dx, dy);
 	else
-		return NV04EXARectM2MF(pNv, w, h, cpp,
-				       src, srcoff, sd, sp, sh, sx, sy,
-				       dst, dstoff, dd, dp, dh, dx, dy);
-	return FALSE;
+		ret = NV04EXARectM2MF(pNv, w, h, cpp,
+				      src, srcoff, sd, sp, sh, sx, sy,
+				      dst, dstoff, dd, dp, dh, dx, dy);
+
+	if (profile)
+		nouveau_profile_end(pNv, ret);
+	if (push != pNv->pushbuf) {
+		pNv->xfer_copies++;
+		PUSH_KICK(push);
+	}
+	return ret;
+}
+
+/* The prefetched copy is stale.  If nothing was served from it, the
+ * pixmap isn't read back after each render, so stop watching it.
+ */
+static void
+nouveau_exa_readback_drop(NVPtr pNv)
+{
+	struct nouveau_readback *rb = &pNv->readback;
+
+	if (!rb->used)
+		rb->watch = NULL;
+	rb->nvpix = NULL;
+}
+
+/* Each EXA batch (the operations between two MarkSync calls) gets its own
+ * sequence number, and the pixmaps it touches are tagged with it through
+ * nouveau_exa_pixmap_gpu_access().  There's no global CPU/GPU sync point,
+ * PrepareAccess only waits for GPU access that conflicts with what the CPU
+ * is about to do to that particular pixmap.
+ */
+void
+nouveau_exa_pixmap_gpu_access(PixmapPtr ppix, uint32_t access)
+{
+	NVPtr pNv = NVPTR(xf86Screens[ppix->drawable.pScreen->myNum]);
+	struct nouveau_pixmap *nvpix = nouveau_pixmap(ppix);
+
+	if (!nvpix)
+		return;
+
+	if (access & NOUVEAU_BO_RD)
+		nvpix->gpu_read = pNv->exa_seq;
+	if (access & NOUVEAU_BO_WR) {
+		nvpix->gpu_write = pNv->exa_seq;
+		if (pNv->readback.nvpix == nvpix)
+			nouveau_exa_readback_drop(pNv);
+	}
+}
+
+/* Called before the GPU is asked to touch a pixmap, moves it back into
+ * VRAM if it's been demoted to GART to make room for other pixmaps.
+ */
+void
+nouveau_exa_pixmap_touch(PixmapPtr ppix)
+{
+	ScrnInfoPtr pScrn = xf86Screens[ppix->drawable.pScreen->myNum];
+	struct nouveau_pixmap *nvpix = nouveau_pixmap(ppix);
+
+	if (nvpix)
+		nouveau_vram_touch(pScrn, nvpix);
+}
+
+/* Called when a pixmap's storage has been swapped for another bo, state
+ * the GPU was left with that points at the old one can't be reused.  The
+ * copy may have gone through the transfer channel, in which case nothing
+ * on the main one shows that anything happened, so forget what's bound
+ * there explicitly.
+ */
+void
+nouveau_exa_pixmap_moved(NVPtr pNv)
+{
+	pNv->pixmap_moves++;
+	PUSH_SHADOW_RESET(pNv->pushbuf);
+}
+
+/* Operations are timed from before their Prepare hook to after their
+ * Done hook, and the dwords they add to the push buffer counted, unless
+ * a new push buffer was started in the middle.  With GPUProfile, the
+ * GPU's time on them is measured as well.
+ */
+static void
+nouveau_exa_op_begin(NVPtr pNv, int kind, int op, PicturePtr pspict,
+		     PicturePtr pmpict, PicturePtr pdpict)
+{
+	nouveau_fallback_context(kind, op, pspict, pmpict, pdpict);
+	nouveau_profile_begin(pNv, kind);
+	PUSH_CAPTURE_OP(pNv->pushbuf, kind);
+	pNv->op_current = kind;
+	pNv->op_push_cur = pNv->pushbuf->cur;
+	pNv->op_push_end = pNv->pushbuf->end;
+	pNv->op_start = nouveau_time_nsec();
+}
+
+static void
+nouveau_exa_op_end(NVPtr pNv, Bool done)
+{
+	struct nouveau_pushbuf *push = pNv->pushbuf;
+	struct nouveau_op_stats *stats = &pNv->op_stats[pNv->op_current];
+
+	if (!pNv->op_current)
+		return;
+	pNv->op_current = 0;
+	nouveau_fallback_context(0, 0, NULL, NULL, NULL);
+	if (!done) {
+		nouveau_profile_end(pNv, FALSE);
+		return;
+	}
+
+	stats->ops++;
+	stats->nsecs += nouveau_time_nsec() - pNv->op_start;
+	if (push->end == pNv->op_push_end && push->cur >= pNv->op_push_cur)
+		stats->dwords += push->cur - pNv->op_push_cur;
+	else
+		stats->lost++;
+	nouveau_profile_end(pNv, TRUE);
+}
+
+static Bool
+nouveau_exa_prepare_solid(PixmapPtr ppix, int alu, Pixel planemask, Pixel fg)
+{
+	NVPtr pNv = NVPTR(xf86Screens[ppix->drawable.pScreen->myNum]);
+	Bool ret;
+
+	nouveau_exa_op_begin(pNv, NV_CAPTURE_OP_SOLID, alu, NULL, NULL, NULL);
+	nouveau_exa_pixmap_touch(ppix);
+	ret = pNv->PrepareSolid(ppix, alu, planemask, fg);
+	if (!ret)
+		nouveau_exa_op_end(pNv, FALSE);
+	return ret;
+}
+
+static void
+nouveau_exa_solid(PixmapPtr ppix, int x1, int y1, int x2, int y2)
+{
+	NVPtr pNv = NVPTR(xf86Screens[ppix->drawable.pScreen->myNum]);
+
+	pNv->op_stats[NV_CAPTURE_OP_SOLID].rects++;
+	pNv->Solid(ppix, x1, y1, x2, y2);
+}
+
+static void
+nouveau_exa_done_solid(PixmapPtr ppix)
+{
+	NVPtr pNv = NVPTR(xf86Screens[ppix->drawable.pScreen->myNum]);
+
+	pNv->DoneSolid(ppix);
+	nouveau_exa_op_end(pNv, TRUE);
+}
+
+static Bool
+nouveau_exa_prepare_copy(PixmapPtr pspix, PixmapPtr pdpix, int dx, int dy,
+			 int alu, Pixel planemask)
+{
+	NVPtr pNv = NVPTR(xf86Screens[pdpix->drawable.pScreen->myNum]);
+	Bool ret;
+
+	nouveau_exa_op_begin(pNv, NV_CAPTURE_OP_COPY, alu, NULL, NULL, NULL);
+	nouveau_exa_pixmap_touch(pspix);
+	nouveau_exa_pixmap_touch(pdpix);
+	ret = pNv->PrepareCopy(pspix, pdpix, dx, dy, alu, planemask);
+	if (!ret)
+		nouveau_exa_op_end(pNv, FALSE);
+	return ret;
+}
+
+static void
+nouveau_exa_copy(PixmapPtr pdpix, int srcX, int srcY, int dstX, int dstY,
+		 int width, int height)
+{
+	NVPtr pNv = NVPTR(xf86Screens[pdpix->drawable.pScreen->myNum]);
+
+	pNv->op_stats[NV_CAPTURE_OP_COPY].rects++;
+	pNv->Copy(pdpix, srcX, srcY, dstX, dstY, width, height);
+}
+
+static void
+nouveau_exa_done_copy(PixmapPtr pdpix)
+{
+	NVPtr pNv = NVPTR(xf86Screens[pdpix->drawable.pScreen->myNum]);
+
+	pNv->DoneCopy(pdpix);
+	nouveau_exa_op_end(pNv, TRUE);
+}
+
+static Bool
+nouveau_exa_check_composite(int op, PicturePtr pspict, PicturePtr pmpict,
+			    PicturePtr pdpict)
+{
+	NVPtr pNv = NVPTR(xf86Screens[pdpict->pDrawable->pScreen->myNum]);
+	Bool ret;
+
+	nouveau_fallback_context(NV_CAPTURE_OP_COMPOSITE, op,
+				 pspict, pmpict, pdpict);
+	ret = pNv->CheckComposite(op, pspict, pmpict, pdpict);
+	nouveau_fallback_context(0, 0, NULL, NULL, NULL);
+	return ret;
+}
+
+static Bool
+nouveau_exa_prepare_composite(int op, PicturePtr pspict, PicturePtr pmpict,
+			      PicturePtr pdpict, PixmapPtr pspix,
+			      PixmapPtr pmpix, PixmapPtr pdpix)
+{
+	NVPtr pNv = NVPTR(xf86Screens[pdpix->drawable.pScreen->myNum]);
+	Bool ret;
+
+	nouveau_exa_op_begin(pNv, NV_CAPTURE_OP_COMPOSITE, op,
+			     pspict, pmpict, pdpict);
+	if (pspix)
+		nouveau_exa_pixmap_touch(pspix);
+	if (pmpix)
+		nouveau_exa_pixmap_touch(pmpix);
+	nouveau_exa_pixmap_touch(pdpix);
+	ret = pNv->PrepareComposite(op, pspict, pmpict, pdpict,
+				    pspix, pmpix, pdpix);
+	if (!ret)
+		nouveau_exa_op_end(pNv, FALSE);
+	return ret;
+}
+
+static void
+nouveau_exa_composite(PixmapPtr pdpix, int srcX, int srcY, int maskX,
+		      int maskY, int dstX, int dstY, int width, int height)
+{
+	NVPtr pNv = NVPTR(xf86Screens[pdpix->drawable.pScreen->myNum]);
+
+	pNv->op_stats[NV_CAPTURE_OP_COMPOSITE].rects++;
+	pNv->Composite(pdpix, srcX, srcY, maskX, maskY, dstX, dstY,
+		       width, height);
+}
+
+static void
+nouveau_exa_done_composite(PixmapPtr pdpix)
+{
+	NVPtr pNv = NVPTR(xf86Screens[pdpix->drawable.pScreen->myNum]);
+
+	pNv->DoneComposite(pdpix);
+	nouveau_exa_op_end(pNv, TRUE);
+}
+
+static void
+nouveau_exa_composite_key_pix(struct nouveau_composite_key *key, int i,
+			      PixmapPtr ppix)
+{
+	if (!ppix)
+		return;
+
+	key->pix[i].pix = ppix;
+	key->pix[i].bo = nouveau_pixmap_bo(ppix);
+	key->pix[i].addr = key->pix[i].bo->offset +
+			   nouveau_pixmap_offset(ppix);
+}
+
+static void
+nouveau_exa_composite_key_pict(struct nouveau_composite_key *key, int i,
+			       PicturePtr ppict)
+{
+	if (!ppict)
+		return;
+
+	key->pict[i].pict = ppict;
+	key->pict[i].format = ppict->format;
+	key->pict[i].repeat = ppict->repeat;
+	key->pict[i].repeat_type = ppict->repeatType;
+	key->pict[i].filter = ppict->filter;
+	key->pict[i].component_alpha = ppict->componentAlpha;
+	if (ppict->transform) {
+		key->pict[i].transformed = TRUE;
+		key->pict[i].transform = *ppict->transform;
+	}
+}
+
+/* Text arrives as a long run of identical PrepareComposite/Composite/
+ * DoneComposite sequences, one for each flush of EXA's glyph cache or
+ * each glyph.  When nothing has been submitted on the channel since the
+ * last one, nothing has been mapped for the CPU and no pixmap has moved
+ * to another bo, all the 3D state it set up is still in place and can be
+ * used again.  The bo and address behind each pixmap are part of the key
+ * too, so storage that changed some other way is caught as well.  So is
+ * each picture's transform, by value, though the caller still has to pick
+ * up the pointer to it again.  A picture that's destroyed ends the run,
+ * see nouveau_exa_destroy_picture(), another could be given its address.
+ *
+ * Updates *last to describe this composite, the caller fills in push_cur
+ * once it's done.
+ */
+Bool
+nouveau_exa_composite_reuse(NVPtr pNv, struct nouveau_composite_key *last,
+			    int op, PicturePtr pspict, PicturePtr pmpict,
+			    PicturePtr pdpict, PixmapPtr pspix,
+			    PixmapPtr pmpix, PixmapPtr pdpix)
+{
+	struct nouveau_pushbuf_priv *priv = pNv->pushbuf->user_priv;
+	struct nouveau_composite_key key;
+	Bool reuse;
+
+	memset(&key, 0, sizeof(key));
+	key.op = op;
+	nouveau_exa_composite_key_pix(&key, 0, pspix);
+	nouveau_exa_composite_key_pix(&key, 1, pmpix);
+	nouveau_exa_composite_key_pix(&key, 2, pdpix);
+	nouveau_exa_composite_key_pict(&key, 0, pspict);
+	nouveau_exa_composite_key_pict(&key, 1, pmpict);
+	nouveau_exa_composite_key_pict(&key, 2, pdpict);
+	key.cpu_access = pNv->cpu_access;
+	key.pixmap_moves = pNv->pixmap_moves;
+	key.shadow_resets = priv->shadow_resets;
+	key.push_cur = pNv->pushbuf->cur;
+
+	reuse = !memcmp(&key, last, sizeof(key));
+	*last = key;
+	last->push_cur = NULL;
+	pNv->composite_key = last;
+
+	pNv->composite_prepares++;
+	if (reuse)
+		pNv->composite_reused++;
+	return reuse;
+}
+
+static void
+nouveau_exa_destroy_picture(PicturePtr ppict)
+{
+	ScreenPtr pScreen = ppict->pDrawable->pScreen;
+	PictureScreenPtr ps = GetPictureScreen(pScreen);
+	NVPtr pNv = NVPTR(xf86Screens[pScreen->myNum]);
+	struct nouveau_composite_key *key = pNv->composite_key;
+	int i;
+
+	for (i = 0; key && i < 3; i++) {
+		if (key->pict[i].pict == ppict)
+			key->push_cur = NULL;
+	}
+
+	ps->DestroyPicture = pNv->DestroyPicture;
+	ps->DestroyPicture(ppict);
+	ps->DestroyPicture = nouveau_exa_destroy_picture;
+}
+
+/* Called by DoneComposite when some of the batch couldn't be drawn, even
+ * after submitting to make room.  EXA has no way to hear about it, so it
+ * goes in the log, once, and the count in the stats at exit.
+ */
+void
+nouveau_exa_composite_failed(NVPtr pNv)
+{
+	if (!pNv->composite_failed++)
+		NOUVEAU_ERR("composite rects lost, out of push buffer space\n");
+}
+
+/* Slot in the TIC/TSC cache holding desc, or if none does, the least
+ * recently used one with *write set to say desc needs writing to it.
+ * Descriptors are matched by content, so a slot's only ever reused for a
+ * texture that'd be described the same way.
+ */
+int
+nouveau_exa_texture_slot(NVPtr pNv, const uint32_t *desc, Bool *write)
+{
+	struct nouveau_tex_cache *cache = &pNv->tex_cache;
+	int i, lru = NV_TEX_SLOT_FIRST;
+
+	if (!++cache->stamp) {
+		memset(cache, 0, sizeof(*cache));
+		cache->stamp = 1;
+	}
+
+	for (i = NV_TEX_SLOT_FIRST; i < NV_TEX_SLOTS; i++) {
+		if (cache->slot[i].used &&
+		    !memcmp(cache->slot[i].desc, desc,
+			    sizeof(cache->slot[i].desc))) {
+			cache->slot[i].used = cache->stamp;
+			cache->hits++;
+			*write = FALSE;
+			return i;
+		}
+
+		if (cache->slot[i].used < cache->slot[lru].used)
+			lru = i;
+	}
+
+	memcpy(cache->slot[lru].desc, desc, sizeof(cache->slot[lru].desc));
+	cache->slot[lru].used = cache->stamp;
+	cache->writes++;
+	*write = TRUE;
+	return lru;
 }
 
 static int
 nouveau_exa_mark_sync(ScreenPtr pScreen)
 {
-	return 0;
+	NVPtr pNv = NVPTR(xf86Screens[pScreen->myNum]);
+	struct nouveau_readback *rb = &pNv->readback;
+	int marker = pNv->exa_seq;
+
+	/* the batch rendered to what was last read back, get the copy going
+	 * now so the next download doesn't have to wait for it
+	 */
+	if (rb->watch && !rb->nvpix &&
+	    rb->watch_nvpix->gpu_write == marker)
+		nouveau_exa_prefetch(rb->watch, rb->wx, rb->wy,
+				     rb->ww, rb->wh);
+
+	if (!++pNv->exa_seq)
+		pNv->exa_seq = 1;
+	return marker;
 }
 
 static void
 nouveau_exa_wait_marker(ScreenPtr pScreen, int marker)
 {
+	NVPtr pNv = NVPTR(xf86Screens[pScreen->myNum]);
+
+	/* EXA calls this before any CPU access that follows accelerated
+	 * rendering, so it must not stall.  Just get the batch to the GPU
+	 * so it runs alongside the fallback, PrepareAccess does any waiting
+	 * that's actually required.
+	 */
+	PUSH_KICK(pNv->pushbuf);
 }
 
+/* Map a pixmap for CPU access, waiting only for GPU access to it that
+ * conflicts with what the CPU is going to do.
+ */
 static Bool
-nouveau_exa_prepare_access(PixmapPtr ppix, int index)
+nouveau_exa_pixmap_map(PixmapPtr ppix, Bool write)
 {
+	struct nouveau_pixmap *nvpix = nouveau_pixmap(ppix);
 	struct nouveau_bo *bo = nouveau_pixmap_bo(ppix);
 	NVPtr pNv = NVPTR(xf86Screens[ppix->drawable.pScreen->myNum]);
+	uint32_t access;
+
+	if (!write) {
+		access = nvpix->gpu_write ? NOUVEAU_BO_RD : 0;
+	} else {
+		access = (nvpix->gpu_read || nvpix->gpu_write) ?
+			 NOUVEAU_BO_RDWR : 0;
+		if (pNv->readback.nvpix == nvpix)
+			nouveau_exa_readback_drop(pNv);
+	}
+
+	/* we've no idea what anyone else is doing with storage that isn't
+	 * ours, always wait for it
+	 */
+	if (nvpix->shared || !nvpix->surf.pitch)
+		access = NOUVEAU_BO_RDWR;
 
-	if (nv50_style_tiled_pixmap(ppix) && !pNv->wfb_enabled)
+	if (nouveau_bo_map(bo, access, pNv->client))
 		return FALSE;
-	if (nouveau_bo_map(bo, NOUVEAU_BO_RDWR, pNv->client))
+
+	if (access & NOUVEAU_BO_RD)
+		nvpix->gpu_write = 0;
+	if (access & NOUVEAU_BO_WR)
+		nvpix->gpu_read = 0;
+	return TRUE;
+}
+
+/* Without WrappedFB, fb can't deal with tiled pixmaps.  Instead the CPU
+ * gets a linear copy in GART, written back to the pixmap in FinishAccess
+ * if it was prepared for writing.
+ *
+ * EXA doesn't tell us which part of the pixmap the fallback is going to
+ * touch, but rendering to the pixmap is reported to a Damage registered
+ * on it.  The copy is kept after FinishAccess, in sync with the pixmap,
+ * and only what's been rendered to the pixmap since is copied in and back
+ * out next time.  That includes the fallback's own drawing, which is
+ * reported before it starts.
+ *
+ * A shadow that can't be kept would be copied in full on every access.
+ * EXA moves just the region it needs through Download/UploadToScreen when
+ * it keeps a system memory copy itself, so those pixmaps are left to that.
+ */
+#define NV_SHADOW_KEEP (64 * 1024 * 1024) /* default ShadowCacheSize */
+
+static void
+nouveau_exa_shadow_surface(PixmapPtr ppix, struct nouveau_surface *surf)
+{
+	memset(surf, 0, sizeof(*surf));
+	surf->flags = NOUVEAU_BO_GART | NOUVEAU_BO_MAP;
+	surf->pitch = exaGetPixmapPitch(ppix);
+	surf->height = ppix->drawable.height;
+}
+
+/* What's been rendered to the pixmap since the shadow was last in sync,
+ * clipped to the pixmap.  FALSE if that isn't being tracked, and box is
+ * the whole pixmap.
+ */
+static Bool
+nouveau_exa_shadow_damage(PixmapPtr ppix, BoxPtr box)
+{
+	struct nouveau_pixmap *nvpix = nouveau_pixmap(ppix);
+	RegionPtr reg;
+	BoxPtr ext;
+
+	box->x1 = box->y1 = 0;
+	box->x2 = ppix->drawable.width;
+	box->y2 = ppix->drawable.height;
+	if (!nvpix->damage)
 		return FALSE;
-	ppix->devPrivate.ptr = bo->map;
+
+	reg = DamageRegion(nvpix->damage);
+	if (!REGION_NOTEMPTY(ppix->drawable.pScreen, reg)) {
+		box->x2 = box->y2 = 0;
+		return TRUE;
+	}
+
+	ext = REGION_EXTENTS(ppix->drawable.pScreen, reg);
+	box->x1 = max(ext->x1, box->x1);
+	box->y1 = max(ext->y1, box->y1);
+	box->x2 = min(ext->x2, box->x2);
+	box->y2 = min(ext->y2, box->y2);
+	if (box->x1 >= box->x2 || box->y1 >= box->y2)
+		box->x2 = box->y2 = 0;
+	return TRUE;
+}
+
+static void
+nouveau_exa_shadow_damage_destroy(DamagePtr damage, void *closure)
+{
+	PixmapPtr ppix = closure;
+	NVPtr pNv = NVPTR(xf86Screens[ppix->drawable.pScreen->myNum]);
+	struct nouveau_pixmap *nvpix = nouveau_pixmap(ppix);
+
+	nvpix->damage = NULL;
+	if (nvpix->shadow)
+		pNv->shadow_kept -= nvpix->shadow->size;
+}
+
+/* Whether a shadow of size bytes could be kept after FinishAccess.
+ * Storage that isn't ours can change without any rendering being
+ * reported, so that never is.
+ */
+static Bool
+nouveau_exa_shadow_fits(PixmapPtr ppix, uint64_t size)
+{
+	NVPtr pNv = NVPTR(xf86Screens[ppix->drawable.pScreen->myNum]);
+	struct nouveau_pixmap *nvpix = nouveau_pixmap(ppix);
+
+	return !nvpix->shared && nvpix->surf.pitch &&
+	       pNv->shadow_kept + size <= pNv->shadow_kept_max;
+}
+
+static Bool
+nouveau_exa_shadow_keep(PixmapPtr ppix)
+{
+	NVPtr pNv = NVPTR(xf86Screens[ppix->drawable.pScreen->myNum]);
+	struct nouveau_pixmap *nvpix = nouveau_pixmap(ppix);
+
+	if (!nouveau_exa_shadow_fits(ppix, nvpix->shadow->size))
+		return FALSE;
+
+	nvpix->damage = DamageCreate(NULL, nouveau_exa_shadow_damage_destroy,
+				     DamageReportNone, TRUE,
+				     ppix->drawable.pScreen, ppix);
+	if (!nvpix->damage)
+		return FALSE;
+
+	DamageRegister(&ppix->drawable, nvpix->damage);
+	pNv->shadow_kept += nvpix->shadow->size;
+	return TRUE;
+}
+
+static void
+nouveau_exa_shadow_release(PixmapPtr ppix)
+{
+	ScrnInfoPtr pScrn = xf86Screens[ppix->drawable.pScreen->myNum];
+	struct nouveau_pixmap *nvpix = nouveau_pixmap(ppix);
+	struct nouveau_surface surf;
+
+	if (nvpix->damage) {
+		DamageUnregister(&ppix->drawable, nvpix->damage);
+		DamageDestroy(nvpix->damage);
+	}
+
+	nouveau_exa_shadow_surface(ppix, &surf);
+	nouveau_bo_cache_put(pScrn, &surf, &nvpix->shadow);
+}
+
+/* Log the part of ppix a CPU access was given, see struct nouveau_cpu_box */
+static void
+nouveau_exa_cpu_box(PixmapPtr ppix, int op, Bool write, BoxPtr box)
+{
+	NVPtr pNv = NVPTR(xf86Screens[ppix->drawable.pScreen->myNum]);
+	struct nouveau_cpu_box *b;
+
+	b = &pNv->cpu_box[pNv->cpu_boxes++ % NV_CPU_BOXES];
+	b->op = op;
+	b->write = write;
+	b->x = box->x1;
+	b->y = box->y1;
+	b->w = box->x2 - box->x1;
+	b->h = box->y2 - box->y1;
+	b->width = ppix->drawable.width;
+	b->height = ppix->drawable.height;
+}
+
+static Bool
+nouveau_exa_shadow_copy(PixmapPtr ppix, Bool to_shadow, BoxPtr box)
+{
+	NVPtr pNv = NVPTR(xf86Screens[ppix->drawable.pScreen->myNum]);
+	struct nouveau_pixmap *nvpix = nouveau_pixmap(ppix);
+	int pitch = exaGetPixmapPitch(ppix);
+	int w = box->x2 - box->x1;
+	int h = box->y2 - box->y1;
+	int ph = ppix->drawable.height;
+	int cpp = ppix->drawable.bitsPerPixel >> 3;
+
+	if (w <= 0 || h <= 0)
+		return TRUE;
+
+	pNv->cpu_access_bytes += w * h * cpp;
+	if (to_shadow)
+		return NVAccelM2MF(pNv, w, h, cpp, nvpix->offset, 0,
+				   nvpix->bo, nouveau_pixmap_domain(ppix),
+				   pitch, ph, box->x1, box->y1,
+				   nvpix->shadow, NOUVEAU_BO_GART, pitch, ph,
+				   box->x1, box->y1);
+	return NVAccelM2MF(pNv, w, h, cpp, 0, nvpix->offset,
+			   nvpix->shadow, NOUVEAU_BO_GART, pitch, ph,
+			   box->x1, box->y1,
+			   nvpix->bo, nouveau_pixmap_domain(ppix), pitch, ph,
+			   box->x1, box->y1);
+}
+
+static Bool
+nouveau_exa_shadow_prepare(PixmapPtr ppix, Bool write)
+{
+	ScrnInfoPtr pScrn = xf86Screens[ppix->drawable.pScreen->myNum];
+	NVPtr pNv = NVPTR(pScrn);
+	struct nouveau_pixmap *nvpix = nouveau_pixmap(ppix);
+	struct nouveau_surface surf;
+	BoxRec box;
+
+	if (!nvpix->shadow) {
+		nouveau_exa_shadow_surface(ppix, &surf);
+		if (!nouveau_exa_shadow_fits(ppix, surf.pitch * surf.height) ||
+		    !nouveau_bo_cache_new(pScrn, &surf, &nvpix->shadow))
+			return FALSE;
+		if (!nouveau_exa_shadow_keep(ppix)) {
+			nouveau_exa_shadow_release(ppix);
+			return FALSE;
+		}
+		box.x1 = box.y1 = 0;
+		box.x2 = ppix->drawable.width;
+		box.y2 = ppix->drawable.height;
+	} else {
+		nouveau_exa_shadow_damage(ppix, &box);
+	}
+
+	if (!nouveau_exa_shadow_copy(ppix, TRUE, &box) ||
+	    nouveau_bo_map(nvpix->shadow, NOUVEAU_BO_RDWR, pNv->client)) {
+		nouveau_exa_shadow_release(ppix);
+		return FALSE;
+	}
+	nouveau_exa_cpu_box(ppix, NV_CPU_BOX_IN, write, &box);
+
+	if (write && pNv->readback.nvpix == nvpix)
+		nouveau_exa_readback_drop(pNv);
+	nvpix->shadow_dirty = write;
+	ppix->devPrivate.ptr = nvpix->shadow->map;
+	return TRUE;
+}
+
+static void
+nouveau_exa_shadow_finish(PixmapPtr ppix)
+{
+	ScrnInfoPtr pScrn = xf86Screens[ppix->drawable.pScreen->myNum];
+	NVPtr pNv = NVPTR(pScrn);
+	struct nouveau_pixmap *nvpix = nouveau_pixmap(ppix);
+	BoxRec box;
+
+	if (nvpix->shadow_dirty) {
+		/* nothing reported, the shadow's new or whatever wrote to it
+		 * didn't go through Damage, so all of it goes back
+		 */
+		if (!nouveau_exa_shadow_damage(ppix, &box) || !box.x2) {
+			box.x1 = box.y1 = 0;
+			box.x2 = ppix->drawable.width;
+			box.y2 = ppix->drawable.height;
+		}
+
+		if (nouveau_exa_shadow_copy(ppix, FALSE, &box)) {
+			nouveau_exa_cpu_box(ppix, NV_CPU_BOX_OUT, TRUE, &box);
+			nouveau_exa_pixmap_gpu_access(ppix, NOUVEAU_BO_WR);
+			PUSH_KICK(pNv->pushbuf);
+		}
+		nvpix->shadow_dirty = FALSE;
+	}
+
+	if (nvpix->damage)
+		DamageEmpty(nvpix->damage);
+	else
+		nouveau_exa_shadow_release(ppix);
+}
+
+static Bool
+nouveau_exa_prepare_access(PixmapPtr ppix, int index)
+{
+	NVPtr pNv = NVPTR(xf86Screens[ppix->drawable.pScreen->myNum]);
+	BoxRec box;
+	Bool write;
+
+	switch (index) {
+	case EXA_PREPARE_SRC:
+	case EXA_PREPARE_MASK:
+#ifdef EXA_SUPPORTS_PREPARE_AUX
+	case EXA_PREPARE_AUX_SRC:
+	case EXA_PREPARE_AUX_MASK:
+#endif
+		write = FALSE;
+		break;
+	default:
+		write = TRUE;
+		break;
+	}
+
+	pNv->cpu_access++;
+
+	if (nv50_style_tiled_pixmap(ppix) && !pNv->wfb_enabled) {
+		if (!nouveau_exa_shadow_prepare(ppix, write))
+			return FALSE;
+	} else {
+		if (!nouveau_exa_pixmap_map(ppix, write))
+			return FALSE;
+		ppix->devPrivate.ptr = (char *)nouveau_pixmap_bo(ppix)->map +
+				       nouveau_pixmap_offset(ppix);
+
+		box.x1 = box.y1 = 0;
+		box.x2 = ppix->drawable.width;
+		box.y2 = ppix->drawable.height;
+		nouveau_exa_cpu_box(ppix, NV_CPU_BOX_MAP, write, &box);
+	}
+
+	/* the storage mustn't be moved around under the CPU */
+	nouveau_pixmap(ppix)->prepared++;
 	return TRUE;
 }
 
 static void
 nouveau_exa_finish_access(PixmapPtr ppix, int index)
 {
+	struct nouveau_pixmap *nvpix = nouveau_pixmap(ppix);
+
+	if (!nvpix)
+		return;
+
+	if (nvpix->shadow)
+		nouveau_exa_shadow_finish(ppix);
+	if (nvpix->prepared)
+		nvpix->prepared--;
 }
 
 static Bool
@@ -111,37 +855,56 @@ nouveau_exa_create_pixmap(ScreenPtr pScreen, int width, int height, int depth,
 	ScrnInfoPtr scrn = xf86Screens[pScreen->myNum];
 	NVPtr pNv = NVPTR(scrn);
 	struct nouveau_pixmap *nvpix;
-	int ret;
 
 	if (!width || !height)
 		return calloc(1, sizeof(*nvpix));
 
-	if (!pNv->exa_force_cp && pNv->dev->vram_size <= 32 * 1024 * 1024)
-		return NULL;
-
 	nvpix = calloc(1, sizeof(*nvpix));
 	if (!nvpix)
 		return NULL;
 
-	ret = nouveau_allocate_surface(scrn, width, height, bitsPerPixel,
-				       usage_hint, new_pitch, &nvpix->bo);
-	if (!ret) {
+	if (nouveau_slab_new(scrn, nvpix, width, height, bitsPerPixel,
+			     usage_hint))
+		goto out;
+
+	/* if it doesn't fit in the VRAM budget EXA keeps it in system
+	 * memory, unless we've been told to put everything in VRAM
+	 */
+	nouveau_surface_layout(scrn, width, height, bitsPerPixel, usage_hint,
+			       &nvpix->surf);
+	if (!nouveau_vram_alloc(scrn, nvpix, pNv->exa_force_cp)) {
 		free(nvpix);
 		return NULL;
 	}
 
+out:
+	/* a recycled bo or slab slot may still be in use by the GPU */
+	nvpix->gpu_read = nvpix->gpu_write = pNv->exa_seq;
+
+	*new_pitch = nvpix->surf.pitch;
 	return nvpix;
 }
 
 static void
 nouveau_exa_destroy_pixmap(ScreenPtr pScreen, void *priv)
 {
+	ScrnInfoPtr scrn = xf86Screens[pScreen->myNum];
+	NVPtr pNv = NVPTR(scrn);
 	struct nouveau_pixmap *nvpix = priv;
 
 	if (!nvpix)
 		return;
 
-	nouveau_bo_ref(NULL, &nvpix->bo);
+	if (pNv->readback.nvpix == nvpix)
+		pNv->readback.nvpix = NULL;
+	if (pNv->readback.watch_nvpix == nvpix)
+		pNv->readback.watch = NULL;
+
+	if (nvpix->slab)
+		nouveau_slab_put(scrn, nvpix);
+	else
+		nouveau_vram_free(scrn, nvpix);
+	nouveau_bo_ref(NULL, &nvpix->shadow);
 	free(nvpix);
 }
 
@@ -155,50 +918,158 @@ nv50_style_tiled_pixmap(PixmapPtr ppix)
 	       nouveau_pixmap_bo(ppix)->config.nv50.memtype;
 }
 
+/* Hands out the GART staging buffers round-robin.  Mapping one only waits
+ * for the transfer that last used it, NV_STAGING_SLOTS transfers ago.
+ */
+static struct nouveau_bo *
+nouveau_exa_staging_next(NVPtr pNv)
+{
+	struct nouveau_bo *bo = pNv->staging[pNv->staging_next];
+
+	if (!bo)
+		return pNv->GART;
+
+	pNv->staging_next = (pNv->staging_next + 1) % NV_STAGING_SLOTS;
+	return bo;
+}
+
+/* Copies a chunk that's been read back into a GART buffer out to the
+ * caller, waiting for the GPU copy into it to complete if necessary.
+ */
+static void
+nouveau_exa_readback_copy(NVPtr pNv, struct nouveau_bo *bo, int offset,
+			  int pitch, int lines, int line_len,
+			  char *dst, int dst_pitch)
+{
+	nouveau_bo_map(bo, NOUVEAU_BO_RD, pNv->client);
+	NVAccelMemcpyRect(dst, (char *)bo->map + offset, lines, dst_pitch,
+			  pitch, line_len);
+}
+
+/* Start reading back a region of a pixmap into GART ahead of time.  A
+ * later DownloadFromScreen of any part of it is then served from there,
+ * without having to wait for the copy, as long as the pixmap hasn't been
+ * written to in the meantime.
+ */
+Bool
+nouveau_exa_prefetch(PixmapPtr ppix, int x, int y, int w, int h)
+{
+	ScrnInfoPtr pScrn = xf86Screens[ppix->drawable.pScreen->myNum];
+	NVPtr pNv = NVPTR(pScrn);
+	struct nouveau_readback *rb = &pNv->readback;
+	struct nouveau_pixmap *nvpix = nouveau_pixmap(ppix);
+	int cpp = ppix->drawable.bitsPerPixel >> 3;
+	int pitch = w * cpp;
+
+	if (!nvpix || !nvpix->bo || nvpix->shared || !nvpix->surf.pitch ||
+	    !pNv->GART || pitch * h > pNv->GART->size)
+		return FALSE;
+
+	if (rb->bo && rb->bo->size < pitch * h)
+		nouveau_bo_ref(NULL, &rb->bo);
+	if (!rb->bo && nouveau_bo_new(pNv->dev, NOUVEAU_BO_GART |
+				      NOUVEAU_BO_MAP, 0, pitch * h, NULL,
+				      &rb->bo))
+		return FALSE;
+
+	rb->nvpix = NULL;
+	if (!NVAccelM2MF(pNv, w, h, cpp, nvpix->offset, 0,
+			 nvpix->bo, nouveau_pixmap_domain(ppix),
+			 exaGetPixmapPitch(ppix), ppix->drawable.height, x, y,
+			 rb->bo, NOUVEAU_BO_GART, pitch, h, 0, 0))
+		return FALSE;
+	PUSH_KICK(pNv->pushbuf);
+	nouveau_exa_pixmap_gpu_access(ppix, NOUVEAU_BO_RD);
+
+	rb->nvpix = nvpix;
+	rb->used = FALSE;
+	rb->prefetches++;
+	rb->x = x;
+	rb->y = y;
+	rb->w = w;
+	rb->h = h;
+	rb->pitch = pitch;
+	return TRUE;
+}
+
 static Bool
 nouveau_exa_download_from_screen(PixmapPtr pspix, int x, int y, int w, int h,
 				 char *dst, int dst_pitch)
 {
 	ScrnInfoPtr pScrn = xf86Screens[pspix->drawable.pScreen->myNum];
 	NVPtr pNv = NVPTR(pScrn);
-	struct nouveau_bo *bo;
+	struct nouveau_readback *rb = &pNv->readback;
+	struct nouveau_bo *bo, *pending = NULL;
 	int src_pitch, tmp_pitch, cpp, offset;
-	int max_lines, lines, i;
+	int lines, pending_lines = 0;
+	uint64_t start;
 	const char *src;
 	Bool ret;
 
 	src_pitch  = exaGetPixmapPitch(pspix);
 	cpp = pspix->drawable.bitsPerPixel >> 3;
-	offset = (y * src_pitch) + (x * cpp);
+	tmp_pitch = w * cpp;
+	pNv->cpu_access_bytes += tmp_pitch * h;
+
+	if (rb->nvpix && rb->nvpix == nouveau_pixmap(pspix) &&
+	    x >= rb->x && x + w <= rb->x + rb->w &&
+	    y >= rb->y && y + h <= rb->y + rb->h) {
+		offset = (y - rb->y) * rb->pitch + (x - rb->x) * cpp;
+		nouveau_exa_readback_copy(pNv, rb->bo, offset, rb->pitch, h,
+					  tmp_pitch, dst, dst_pitch);
+		rb->used = TRUE;
+		rb->hits++;
+		return TRUE;
+	}
 
 	if (!pNv->GART)
 		goto memcpy;
 
-	tmp_pitch = w * cpp;
-	max_lines = pNv->GART->size / tmp_pitch;
+	rb->watch = pspix;
+	rb->watch_nvpix = nouveau_pixmap(pspix);
+	rb->wx = x;
+	rb->wy = y;
+	rb->ww = w;
+	rb->wh = h;
+
+	/* double-buffered, the next chunk is copied into GART by the GPU
+	 * while the CPU copies the previous one out
+	 */
+	start = nouveau_time_usec();
 	while (h) {
-		lines = max_lines;
+		bo = nouveau_exa_staging_next(pNv);
+		lines = bo->size / tmp_pitch;
 		if (lines > h)
 			lines = h;
 
-		if (!NVAccelM2MF(pNv, w, lines, cpp, 0, 0,
-				 nouveau_pixmap_bo(pspix), NOUVEAU_BO_VRAM,
-				 src_pitch, pspix->drawable.height, x, y,
-				 pNv->GART, NOUVEAU_BO_GART, tmp_pitch,
+		PUSH_CAPTURE_OP(pNv->pushbuf, NV_CAPTURE_OP_DOWNLOAD);
+		if (!lines ||
+		    !NVAccelM2MF(pNv, w, lines, cpp,
+				 nouveau_pixmap_offset(pspix), 0,
+				 nouveau_pixmap_bo(pspix),
+				 nouveau_pixmap_domain(pspix), src_pitch, pspix->drawable.height, x, y,
+				 bo, NOUVEAU_BO_GART, tmp_pitch,
 				 lines, 0, 0))
-			goto memcpy;
-
-		nouveau_bo_map(pNv->GART, NOUVEAU_BO_RD, pNv->client);
-		if (src_pitch == tmp_pitch) {
-			memcpy(dst, pNv->GART->map, dst_pitch * lines);
-			dst += dst_pitch * lines;
-		} else {
-			src = pNv->GART->map;
-			for (i = 0; i < lines; i++) {
-				memcpy(dst, src, tmp_pitch);
-				src += tmp_pitch;
-				dst += dst_pitch;
-			}
+			break;
+		PUSH_KICK(pNv->pushbuf);
+
+		if (pending) {
+			nouveau_exa_readback_copy(pNv, pending, 0, tmp_pitch,
+						  pending_lines, tmp_pitch,
+						  dst, dst_pitch);
+			dst += dst_pitch * pending_lines;
+		}
+		pending = bo;
+		pending_lines = lines;
+		pNv->download.bytes += tmp_pitch * lines;
+
+		/* a single buffer can't be refilled until it's been read */
+		if (!pNv->staging[0]) {
+			nouveau_exa_readback_copy(pNv, pending, 0, tmp_pitch,
+						  pending_lines, tmp_pitch,
+						  dst, dst_pitch);
+			dst += dst_pitch * pending_lines;
+			pending = NULL;
 		}
 
 		/* next! */
@@ -206,101 +1077,491 @@ nouveau_exa_download_from_screen(PixmapPtr pspix, int x, int y, int w, int h,
 		y += lines;
 	}
 
+	if (pending) {
+		nouveau_exa_readback_copy(pNv, pending, 0, tmp_pitch,
+					  pending_lines, tmp_pitch,
+					  dst, dst_pitch);
+		dst += dst_pitch * pending_lines;
+	}
+	pNv->download.usecs += nouveau_time_usec() - start;
+
+	if (!h)
+		return TRUE;
+
 memcpy:
 	bo = nouveau_pixmap_bo(pspix);
-	if (nouveau_bo_map(bo, NOUVEAU_BO_RD, pNv->client))
+	if (!nouveau_exa_pixmap_map(pspix, FALSE))
 		return FALSE;
+	offset = nouveau_pixmap_offset(pspix) + (y * src_pitch) + (x * cpp);
 	src = (char *)bo->map + offset;
 	ret = NVAccelMemcpyRect(dst, src, h, dst_pitch, src_pitch, w*cpp);
 	return ret;
 }
 
 static Bool
-nouveau_exa_upload_to_screen(PixmapPtr pdpix, int x, int y, int w, int h,
-			     char *src, int src_pitch)
+nouveau_exa_upload_inline(PixmapPtr pdpix, int x, int y, int w, int h,
+			  char *src, int src_pitch)
+{
+	ScrnInfoPtr pScrn = xf86Screens[pdpix->drawable.pScreen->myNum];
+	NVPtr pNv = NVPTR(pScrn);
+	int cpp = pdpix->drawable.bitsPerPixel >> 3;
+
+	nouveau_exa_pixmap_gpu_access(pdpix, NOUVEAU_BO_WR);
+	if (pNv->Architecture < NV_ARCH_50)
+		return NV04EXAUploadIFC(pScrn, src, src_pitch, pdpix,
+					x, y, w, h, cpp);
+	else
+	if (pNv->Architecture < NV_ARCH_C0)
+		return NV50EXAUploadSIFC(src, src_pitch, pdpix,
+					 x, y, w, h, cpp);
+	else
+		return NVC0EXAUploadSIFC(src, src_pitch, pdpix,
+					 x, y, w, h, cpp);
+}
+
+/* Returns the number of lines transferred */
+static int
+nouveau_exa_upload_gart(PixmapPtr pdpix, int x, int y, int w, int h,
+			char *src, int src_pitch)
 {
 	ScrnInfoPtr pScrn = xf86Screens[pdpix->drawable.pScreen->myNum];
 	NVPtr pNv = NVPTR(pScrn);
 	int dst_pitch, tmp_pitch, cpp;
-	int max_lines, lines, i;
+	int max_lines, lines, done = 0;
 	struct nouveau_bo *bo;
-	char *dst;
-	Bool ret;
+	uint64_t start;
+
+	if (!pNv->GART)
+		return 0;
 
 	dst_pitch  = exaGetPixmapPitch(pdpix);
 	cpp = pdpix->drawable.bitsPerPixel >> 3;
+	nouveau_exa_pixmap_gpu_access(pdpix, NOUVEAU_BO_WR);
 
-	/* try hostdata transfer */
-	if (w * h * cpp < 16*1024) /* heuristic */
-	{
-		if (pNv->Architecture < NV_ARCH_50) {
-			if (NV04EXAUploadIFC(pScrn, src, src_pitch, pdpix,
-					     x, y, w, h, cpp)) {
-				exaMarkSync(pdpix->drawable.pScreen);
-				return TRUE;
-			}
-		} else
-		if (pNv->Architecture < NV_ARCH_C0) {
-			if (NV50EXAUploadSIFC(src, src_pitch, pdpix,
-					      x, y, w, h, cpp)) {
-				exaMarkSync(pdpix->drawable.pScreen);
-				return TRUE;
-			}
-		} else {
-			if (NVC0EXAUploadSIFC(src, src_pitch, pdpix,
-					      x, y, w, h, cpp)) {
-				exaMarkSync(pdpix->drawable.pScreen);
-				return TRUE;
-			}
-		}
-	}
-
-	/* try gart-based transfer */
-	if (!pNv->GART)
-		goto memcpy;
-
+	/* streamed through the staging buffers */
+	start = nouveau_time_usec();
 	tmp_pitch = w * cpp;
-	max_lines = pNv->GART->size / tmp_pitch;
 	while (h) {
+		bo = nouveau_exa_staging_next(pNv);
+		max_lines = bo->size / tmp_pitch;
+		if (!max_lines)
+			break;
+
 		lines = max_lines;
 		if (lines > h)
 			lines = h;
 
-		nouveau_bo_map(pNv->GART, NOUVEAU_BO_WR, pNv->client);
-		if (src_pitch == tmp_pitch) {
-			memcpy(pNv->GART->map, src, src_pitch * lines);
-			src += src_pitch * lines;
-		} else {
-			dst = pNv->GART->map;
-			for (i = 0; i < lines; i++) {
-				memcpy(dst, src, tmp_pitch);
-				src += src_pitch;
-				dst += tmp_pitch;
-			}
-		}
+		if (nouveau_bo_map(bo, NOUVEAU_BO_WR, pNv->client))
+			break;
+		NVAccelMemcpyRect(bo->map, src, lines, tmp_pitch, src_pitch,
+				  tmp_pitch);
 
-		if (!NVAccelM2MF(pNv, w, lines, cpp, 0, 0, pNv->GART,
+		if (!NVAccelM2MF(pNv, w, lines, cpp,
+				 0, nouveau_pixmap_offset(pdpix), bo,
 				 NOUVEAU_BO_GART, tmp_pitch, lines, 0, 0,
-				 nouveau_pixmap_bo(pdpix), NOUVEAU_BO_VRAM,
-				 dst_pitch, pdpix->drawable.height, x, y))
-			goto memcpy;
+				 nouveau_pixmap_bo(pdpix),
+				 nouveau_pixmap_domain(pdpix), dst_pitch, pdpix->drawable.height, x, y))
+			break;
+
+		/* get the copy going while we fill the next buffer */
+		PUSH_KICK(pNv->pushbuf);
+
+		pNv->upload.bytes += tmp_pitch * lines;
 
 		/* next! */
+		src += src_pitch * lines;
+		done += lines;
 		h -= lines;
 		y += lines;
 	}
+	pNv->upload.usecs += nouveau_time_usec() - start;
 
-	exaMarkSync(pdpix->drawable.pScreen);
-	return TRUE;
+	return done;
+}
 
-	/* fallback to memcpy-based transfer */
-memcpy:
-	bo = nouveau_pixmap_bo(pdpix);
-	if (nouveau_bo_map(bo, NOUVEAU_BO_WR, pNv->client))
+static Bool
+nouveau_exa_upload_direct(PixmapPtr pdpix, int x, int y, int w, int h,
+			  char *src, int src_pitch)
+{
+	struct nouveau_bo *bo = nouveau_pixmap_bo(pdpix);
+	int dst_pitch = exaGetPixmapPitch(pdpix);
+	int cpp = pdpix->drawable.bitsPerPixel >> 3;
+	char *dst;
+
+	if (!nouveau_exa_pixmap_map(pdpix, TRUE))
 		return FALSE;
-	dst = (char *)bo->map + (y * dst_pitch) + (x * cpp);
-	ret = NVAccelMemcpyRect(dst, src, h, dst_pitch, src_pitch, w*cpp);
-	return ret;
+
+	dst = (char *)bo->map + nouveau_pixmap_offset(pdpix) +
+	      (y * dst_pitch) + (x * cpp);
+	return NVAccelMemcpyRect(dst, src, h, dst_pitch, src_pitch, w * cpp);
+}
+
+/* Upload path selection.  The cost of each path is modelled as a fixed
+ * part plus per-byte and per-line parts, measured at startup by
+ * nouveau_exa_calibrate() and then scaled by how uploads actually do.
+ * Only CPU time is accounted, that's what the server is blocked on.
+ */
+static const char *nouveau_upload_path_name[NV_UPLOAD_PATHS] = {
+	[NV_UPLOAD_INLINE] = "inline",
+	[NV_UPLOAD_GART]   = "GART",
+	[NV_UPLOAD_DIRECT] = "direct",
+};
+
+static Bool
+nouveau_exa_upload_usable(NVPtr pNv, PixmapPtr pdpix, int path)
+{
+	switch (path) {
+	case NV_UPLOAD_GART:
+		return pNv->GART != NULL;
+	case NV_UPLOAD_DIRECT:
+		/* can't write tiled layouts with a plain memcpy */
+		return !pdpix || !nv50_style_tiled_pixmap(pdpix);
+	default:
+		return TRUE;
+	}
+}
+
+static double
+nouveau_exa_upload_cost(NVPtr pNv, int path, int bytes, int lines)
+{
+	struct nouveau_transfer_cost *cost = &pNv->upload_cost[path];
+
+	return cost->scale * (cost->fixed + cost->per_byte * bytes +
+			      cost->per_line * lines);
+}
+
+static int
+nouveau_exa_upload_path(NVPtr pNv, PixmapPtr pdpix, int bytes, int lines)
+{
+	int path, best = NV_UPLOAD_GART;
+	double cost, best_cost = 0.0;
+
+	if (pNv->inline_upload_max >= 0)
+		return (bytes < pNv->inline_upload_max) ? NV_UPLOAD_INLINE :
+							   NV_UPLOAD_GART;
+
+	for (path = 0; path < NV_UPLOAD_PATHS; path++) {
+		if (!pNv->upload_cost[path].valid ||
+		    !nouveau_exa_upload_usable(pNv, pdpix, path))
+			continue;
+
+		cost = nouveau_exa_upload_cost(pNv, path, bytes, lines);
+		if (best_cost == 0.0 || cost < best_cost) {
+			best_cost = cost;
+			best = path;
+		}
+	}
+
+	return best;
+}
+
+/* Fold a measured upload back into the model */
+static void
+nouveau_exa_upload_refine(NVPtr pNv, int path, int bytes, int lines,
+			  uint64_t usecs)
+{
+	struct nouveau_transfer_cost *cost = &pNv->upload_cost[path];
+	double predicted, ratio;
+
+	if (!cost->valid)
+		return;
+
+	/* anything shorter is lost in the timer resolution */
+	predicted = nouveau_exa_upload_cost(pNv, path, bytes, lines);
+	if (predicted < 20.0)
+		return;
+
+	ratio = cost->scale * usecs / predicted;
+	cost->scale = (cost->scale * 15.0 + ratio) / 16.0;
+	if (cost->scale < 0.25)
+		cost->scale = 0.25;
+	if (cost->scale > 4.0)
+		cost->scale = 4.0;
+}
+
+static Bool
+nouveau_exa_upload_to_screen(PixmapPtr pdpix, int x, int y, int w, int h,
+			     char *src, int src_pitch)
+{
+	ScreenPtr pScreen = pdpix->drawable.pScreen;
+	NVPtr pNv = NVPTR(xf86Screens[pScreen->myNum]);
+	int cpp = pdpix->drawable.bitsPerPixel >> 3;
+	int path, lines;
+	uint64_t start;
+
+	nouveau_exa_op_begin(pNv, NV_CAPTURE_OP_UPLOAD, 0, NULL, NULL, NULL);
+	path = nouveau_exa_upload_path(pNv, pdpix, w * h * cpp, h);
+	pNv->cpu_access_bytes += w * h * cpp;
+	start = nouveau_time_usec();
+
+	if (path == NV_UPLOAD_INLINE) {
+		if (nouveau_exa_upload_inline(pdpix, x, y, w, h,
+					      src, src_pitch)) {
+			exaMarkSync(pScreen);
+			goto done;
+		}
+		path = NV_UPLOAD_GART;
+	}
+
+	if (path == NV_UPLOAD_GART) {
+		lines = nouveau_exa_upload_gart(pdpix, x, y, w, h,
+						src, src_pitch);
+		if (lines)
+			exaMarkSync(pScreen);
+		if (lines == h)
+			goto done;
+
+		/* fallback to memcpy-based transfer */
+		src += lines * src_pitch;
+		y += lines;
+		h -= lines;
+		path = NV_UPLOAD_PATHS;
+	}
+
+	if (!nouveau_exa_upload_direct(pdpix, x, y, w, h, src, src_pitch)) {
+		nouveau_exa_op_end(pNv, FALSE);
+		return FALSE;
+	}
+
+done:
+	if (path < NV_UPLOAD_PATHS)
+		nouveau_exa_upload_refine(pNv, path, w * h * cpp, h,
+					  nouveau_time_usec() - start);
+	nouveau_exa_op_end(pNv, TRUE);
+	return TRUE;
+}
+
+/* Run a few uploads of each shape through a path, keeping the fastest */
+static double
+nouveau_exa_calibrate_probe(PixmapPtr ppix, int path, int w, int h,
+			    char *data)
+{
+	NVPtr pNv = NVPTR(xf86Screens[ppix->drawable.pScreen->myNum]);
+	struct nouveau_bo *bo = nouveau_pixmap_bo(ppix);
+	uint64_t start, usecs, best = ~0ULL;
+	Bool ret = FALSE;
+	int i;
+
+	for (i = 0; i < 4; i++) {
+		start = nouveau_time_usec();
+		switch (path) {
+		case NV_UPLOAD_INLINE:
+			ret = nouveau_exa_upload_inline(ppix, 0, 0, w, h,
+							data, w * 4);
+			break;
+		case NV_UPLOAD_GART:
+			ret = nouveau_exa_upload_gart(ppix, 0, 0, w, h,
+						      data, w * 4) == h;
+			break;
+		case NV_UPLOAD_DIRECT:
+			ret = nouveau_exa_upload_direct(ppix, 0, 0, w, h,
+							data, w * 4);
+			break;
+		}
+		usecs = nouveau_time_usec() - start;
+
+		/* start each probe with an idle GPU */
+		PUSH_KICK(pNv->pushbuf);
+		nouveau_bo_wait(bo, NOUVEAU_BO_RDWR, pNv->client);
+		if (!ret)
+			return -1.0;
+
+		if (usecs < best)
+			best = usecs;
+	}
+
+	return best;
+}
+
+void
+nouveau_exa_calibrate(ScreenPtr pScreen)
+{
+	ScrnInfoPtr pScrn = xf86Screens[pScreen->myNum];
+	NVPtr pNv = NVPTR(pScrn);
+	struct nouveau_transfer_cost *cost;
+	int path, best, prev = -1, size;
+	double t[3];
+	PixmapPtr ppix;
+	char *data, msg[128];
+	int len;
+
+	if (xf86GetOptValInteger(pNv->Options, OPTION_INLINE_UPLOAD_LIMIT,
+				 &pNv->inline_upload_max)) {
+		if (pNv->inline_upload_max < 0)
+			pNv->inline_upload_max = 0;
+		xf86DrvMsg(pScrn->scrnIndex, X_CONFIG,
+			   "Inline uploads below %d bytes\n",
+			   pNv->inline_upload_max);
+		return;
+	}
+
+	/* shapes: 4KiB and 64KiB with few lines, 64KiB with many lines */
+	ppix = pScreen->CreatePixmap(pScreen, 256, 1024, 24, 0);
+	if (!ppix)
+		return;
+	exaMoveInPixmap(ppix);
+
+	data = calloc(1, 64 * 1024);
+	if (!data || !nouveau_pixmap_bo(ppix) ||
+	    ppix->drawable.bitsPerPixel != 32)
+		goto out;
+
+	for (path = 0; path < NV_UPLOAD_PATHS; path++) {
+		cost = &pNv->upload_cost[path];
+		cost->valid = FALSE;
+
+		if (!nouveau_exa_upload_usable(pNv, ppix, path))
+			continue;
+
+		t[0] = nouveau_exa_calibrate_probe(ppix, path, 64, 16, data);
+		t[1] = nouveau_exa_calibrate_probe(ppix, path, 256, 64, data);
+		t[2] = nouveau_exa_calibrate_probe(ppix, path, 16, 1024, data);
+		if (t[0] < 0.0 || t[1] < 0.0 || t[2] < 0.0)
+			continue;
+
+		cost->per_line = max(t[2] - t[1], 0.0) / (1024 - 64);
+		cost->per_byte = max(t[1] - t[0] - cost->per_line * (64 - 16),
+				     0.0) / (65536 - 4096);
+		cost->fixed = max(t[0] - cost->per_byte * 4096 -
+				  cost->per_line * 16, 0.0);
+		cost->scale = 1.0;
+		cost->valid = TRUE;
+	}
+
+	if (!pNv->upload_cost[NV_UPLOAD_GART].valid &&
+	    !pNv->upload_cost[NV_UPLOAD_DIRECT].valid)
+		goto out;
+	pNv->inline_upload_max = -1;
+	memset(&pNv->upload, 0, sizeof(pNv->upload));
+
+	/* report the crossover points for uploads with 1KiB lines */
+	len = snprintf(msg, sizeof(msg), "Upload paths:");
+	for (size = 256; size <= 16 * 1024 * 1024; size <<= 1) {
+		best = nouveau_exa_upload_path(pNv, NULL, size,
+					       max(size >> 10, 1));
+		if (best == prev || len >= sizeof(msg))
+			continue;
+
+		len += snprintf(msg + len, sizeof(msg) - len,
+				prev < 0 ? " %s" : ", %s from %dKiB",
+				nouveau_upload_path_name[best], size >> 10);
+		prev = best;
+	}
+	xf86DrvMsg(pScrn->scrnIndex, X_PROBED, "%s\n", msg);
+
+out:
+	free(data);
+	pScreen->DestroyPixmap(ppix);
+}
+
+static void
+nouveau_exa_dump_transfer(ScrnInfoPtr pScrn, const char *name,
+			  struct nouveau_transfer_stats *stats)
+{
+	if (!stats->usecs)
+		return;
+
+	xf86DrvMsgVerb(pScrn->scrnIndex, X_INFO, 3,
+		       "%s: %llu KiB in %llu ms, %llu MiB/s\n", name,
+		       (unsigned long long)(stats->bytes >> 10),
+		       (unsigned long long)(stats->usecs / 1000),
+		       (unsigned long long)((stats->bytes * 1000000 /
+					     stats->usecs) >> 20));
+}
+
+static void
+nouveau_exa_dump_op(ScrnInfoPtr pScrn, const char *name,
+		    struct nouveau_op_stats *stats)
+{
+	unsigned counted = stats->ops - stats->lost;
+
+	if (!stats->ops)
+		return;
+
+	xf86DrvMsgVerb(pScrn->scrnIndex, X_INFO, 3,
+		       "EXA %s: %u ops, %llu rects, %llu ns/op, "
+		       "%llu dwords/op\n",
+		       name, stats->ops, (unsigned long long)stats->rects,
+		       (unsigned long long)(stats->nsecs / stats->ops),
+		       counted ? (unsigned long long)(stats->dwords / counted) :
+		       0ULL);
+}
+
+static void
+nouveau_exa_dump_cpu_boxes(ScrnInfoPtr pScrn)
+{
+	static const char *op[] = { "mapped", "copied in", "copied out" };
+	NVPtr pNv = NVPTR(pScrn);
+	struct nouveau_cpu_box *b;
+	unsigned i;
+
+	i = pNv->cpu_boxes > NV_CPU_BOXES ? pNv->cpu_boxes - NV_CPU_BOXES : 0;
+	for (; i < pNv->cpu_boxes; i++) {
+		b = &pNv->cpu_box[i % NV_CPU_BOXES];
+		xf86DrvMsgVerb(pScrn->scrnIndex, X_INFO, 3,
+			       "CPU access %u: %dx%d+%d+%d of %dx%d %s%s\n",
+			       i, b->w, b->h, b->x, b->y, b->width, b->height,
+			       op[b->op], b->write ? ", written" : "");
+	}
+}
+
+void
+nouveau_exa_dump_stats(ScrnInfoPtr pScrn)
+{
+	NVPtr pNv = NVPTR(pScrn);
+
+	nouveau_exa_dump_op(pScrn, "Solid",
+			    &pNv->op_stats[NV_CAPTURE_OP_SOLID]);
+	nouveau_exa_dump_op(pScrn, "Copy", &pNv->op_stats[NV_CAPTURE_OP_COPY]);
+	nouveau_exa_dump_op(pScrn, "Composite",
+			    &pNv->op_stats[NV_CAPTURE_OP_COMPOSITE]);
+	nouveau_exa_dump_op(pScrn, "UploadToScreen",
+			    &pNv->op_stats[NV_CAPTURE_OP_UPLOAD]);
+
+	nouveau_exa_dump_transfer(pScrn, "GART uploads", &pNv->upload);
+	nouveau_exa_dump_transfer(pScrn, "GART downloads", &pNv->download);
+	if (pNv->readback.prefetches) {
+		xf86DrvMsgVerb(pScrn->scrnIndex, X_INFO, 3,
+			       "Readback prefetch: %u started, %u downloads "
+			       "served\n", pNv->readback.prefetches,
+			       pNv->readback.hits);
+	}
+
+	if (pNv->cpu_access) {
+		xf86DrvMsgVerb(pScrn->scrnIndex, X_INFO, 3,
+			       "CPU access: %u prepares, %llu KiB moved to or "
+			       "from VRAM, %llu bytes per prepare\n",
+			       pNv->cpu_access,
+			       (unsigned long long)(pNv->cpu_access_bytes >> 10),
+			       (unsigned long long)(pNv->cpu_access_bytes /
+						    pNv->cpu_access));
+	}
+	nouveau_exa_dump_cpu_boxes(pScrn);
+
+	if (pNv->composite_draws) {
+		xf86DrvMsgVerb(pScrn->scrnIndex, X_INFO, 3,
+			       "Composite: %u prepares, %u reused, %u rects "
+			       "in %u draws, %u vertex buffer wraps, %u "
+			       "component-alpha in two passes, %u batches "
+			       "failed\n",
+			       pNv->composite_prepares, pNv->composite_reused,
+			       pNv->composite_rects, pNv->composite_draws,
+			       pNv->composite_vtx_wraps,
+			       pNv->composite_two_pass, pNv->composite_failed);
+	}
+
+	if (pNv->tex_cache.writes) {
+		xf86DrvMsgVerb(pScrn->scrnIndex, X_INFO, 3,
+			       "Texture descriptors: %u cache hits, %u written\n",
+			       pNv->tex_cache.hits, pNv->tex_cache.writes);
+	}
+
+	xf86DrvMsgVerb(pScrn->scrnIndex, X_INFO, 3,
+		       "Pixmap VRAM: %llu/%llu KiB used, %u demotions, "
+		       "%u promotions\n",
+		       (unsigned long long)(pNv->vram_used >> 10),
+		       (unsigned long long)(pNv->vram_budget >> 10),
+		       pNv->vram_demotions, pNv->vram_promotions);
 }
 
 Bool
@@ -320,6 +1581,7 @@ nouveau_exa_init(ScreenPtr pScreen)
 	ScrnInfoPtr pScrn = xf86Screens[pScreen->myNum];
 	NVPtr pNv = NVPTR(pScrn);
 	ExaDriverPtr exa;
+	int i;
 
 	exa = exaDriverAlloc();
 	if (!exa) {
@@ -358,6 +1620,16 @@ nouveau_exa_init(ScreenPtr pScreen)
 		exa->maxY = 2048;
 	}
 
+	pNv->exa_seq = 1;
+	pNv->inline_upload_max = 16 * 1024; /* until calibrated */
+
+	pNv->shadow_kept_max = NV_SHADOW_KEEP;
+	if (xf86GetOptValInteger(pNv->Options, OPTION_SHADOW_CACHE_SIZE, &i)) {
+		pNv->shadow_kept_max = (uint64_t)max(i, 0) << 10;
+		xf86DrvMsg(pScrn->scrnIndex, X_CONFIG,
+			   "Keeping up to %d KiB of tiled pixmap shadows\n",
+			   max(i, 0));
+	}
 	exa->MarkSync = nouveau_exa_mark_sync;
 	exa->WaitMarker = nouveau_exa_wait_marker;
 
@@ -428,9 +1700,68 @@ nouveau_exa_init(ScreenPtr pScreen)
 		break;
 	}
 
+	/* everything the GPU touches goes through a Prepare hook first,
+	 * which is where demoted pixmaps are brought back into VRAM
+	 */
+	pNv->PrepareSolid = exa->PrepareSolid;
+	exa->PrepareSolid = nouveau_exa_prepare_solid;
+	pNv->PrepareCopy = exa->PrepareCopy;
+	exa->PrepareCopy = nouveau_exa_prepare_copy;
+	if (exa->PrepareComposite) {
+		pNv->CheckComposite = exa->CheckComposite;
+		exa->CheckComposite = nouveau_exa_check_composite;
+		pNv->PrepareComposite = exa->PrepareComposite;
+		exa->PrepareComposite = nouveau_exa_prepare_composite;
+	}
+
+	/* and are accounted for on the way out, see nouveau_exa_op_end() */
+	pNv->Solid = exa->Solid;
+	exa->Solid = nouveau_exa_solid;
+	pNv->DoneSolid = exa->DoneSolid;
+	exa->DoneSolid = nouveau_exa_done_solid;
+	pNv->Copy = exa->Copy;
+	exa->Copy = nouveau_exa_copy;
+	pNv->DoneCopy = exa->DoneCopy;
+	exa->DoneCopy = nouveau_exa_done_copy;
+	if (exa->Composite) {
+		pNv->Composite = exa->Composite;
+		exa->Composite = nouveau_exa_composite;
+		pNv->DoneComposite = exa->DoneComposite;
+		exa->DoneComposite = nouveau_exa_done_composite;
+	}
+	nouveau_vram_init(pScrn);
+
 	if (!exaDriverInit(pScreen, exa))
 		return FALSE;
 
+	/* composite state outlives the pictures it was set up for, see
+	 * nouveau_exa_composite_reuse()
+	 */
+	if (pNv->Architecture >= NV_ARCH_50) {
+		PictureScreenPtr ps = GetPictureScreenIfSet(pScreen);
+
+		if (ps) {
+			pNv->DestroyPicture = ps->DestroyPicture;
+			ps->DestroyPicture = nouveau_exa_destroy_picture;
+		}
+	}
+
+	if (!nouveau_bo_cache_init(pScrn))
+		xf86DrvMsg(pScrn->scrnIndex, X_WARNING,
+			   "Failed to allocate BO cache\n");
+	nouveau_slab_init(pScrn);
+
 	pNv->EXADriverPtr = exa;
 	return TRUE;
 }
+
+void
+nouveau_exa_fini(ScreenPtr pScreen)
+{
+	NVPtr pNv = NVPTR(xf86Screens[pScreen->myNum]);
+
+	if (pNv->DestroyPicture) {
+		GetPictureScreen(pScreen)->DestroyPicture = pNv->DestroyPicture;
+		pNv->DestroyPicture = NULL;
+	}
+}
@@ -0,0 +1,275 @@
+/*
+ * Copyright 2012 Nouveau Project
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF
+ * OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "nv_include.h"
+
+#include <stdarg.h>
+
+#include "property.h"
+#include <X11/Xatom.h>
+
+/* Each NOUVEAU_FALLBACK() site has its own counter, linked into a list the
+ * first time it's hit.  The EXA wrappers in nouveau_exa.c say which
+ * operation is being tried, so each site also keeps the first few
+ * combinations of operation and picture formats that hit it.
+ *
+ * At most every FALLBACK_REPORT_MS, the block handler logs the sites hit
+ * most since the last report, and replaces the _NOUVEAU_FALLBACKS property
+ * on the root window with the totals for every site, which can be read
+ * with "xprop -root _NOUVEAU_FALLBACKS".
+ */
+#define FALLBACK_REPORT_MS  10000
+#define FALLBACK_REPORT_TOP 5
+
+static struct nouveau_fallback *fallback_list;
+static struct nouveau_fallback_ctx fallback_ctx;
+
+static const char *fallback_kind_names[NV_CAPTURE_OPS] = {
+	[NV_CAPTURE_OP_SOLID]     = "Solid",
+	[NV_CAPTURE_OP_COPY]      = "Copy",
+	[NV_CAPTURE_OP_COMPOSITE] = "Composite",
+	[NV_CAPTURE_OP_UPLOAD]    = "Upload",
+	[NV_CAPTURE_OP_DOWNLOAD]  = "Download",
+};
+
+/* What the fallbacks hit from now on are attributed to, kind 0 to stop */
+void
+nouveau_fallback_context(uint32_t kind, uint32_t op, PicturePtr src,
+			 PicturePtr mask, PicturePtr dst)
+{
+	fallback_ctx.kind = kind;
+	fallback_ctx.op = op;
+	fallback_ctx.format[0] = src ? src->format : 0;
+	fallback_ctx.format[1] = mask ? mask->format : 0;
+	fallback_ctx.format[2] = dst ? dst->format : 0;
+}
+
+void
+nouveau_fallback(struct nouveau_fallback *fb)
+{
+	int i;
+
+	if (!fb->count++) {
+		fb->next = fallback_list;
+		fallback_list = fb;
+	}
+
+	for (i = 0; i < NV_FALLBACK_CTX; i++) {
+		if (!fb->ctx[i].count) {
+			fb->ctx[i].ctx = fallback_ctx;
+			fb->ctx[i].count = 1;
+			return;
+		}
+
+		if (!memcmp(&fb->ctx[i].ctx, &fallback_ctx,
+			    sizeof(fallback_ctx))) {
+			fb->ctx[i].count++;
+			return;
+		}
+	}
+
+	fb->other++;
+}
+
+/* "reason (func, file:line)" without the reason's newline */
+static int
+fallback_name(struct nouveau_fallback *fb, char *buf, int size)
+{
+	int len = strcspn(fb->reason, "\n");
+
+	return snprintf(buf, size, "%.*s (%s, %s:%d)", len, fb->reason,
+			fb->func, fb->file, fb->line);
+}
+
+static int
+fallback_ctx_name(struct nouveau_fallback_ctx *ctx, char *buf, int size)
+{
+	const char *kind = ctx->kind < NV_CAPTURE_OPS ?
+			   fallback_kind_names[ctx->kind] : NULL;
+
+	if (!kind)
+		return snprintf(buf, size, "other");
+
+	if (ctx->kind != NV_CAPTURE_OP_COMPOSITE)
+		return snprintf(buf, size, "%s alu %u", kind, ctx->op);
+
+	return snprintf(buf, size, "%s op %u, 0x%08x/0x%08x/0x%08x", kind,
+			ctx->op, ctx->format[0], ctx->format[1],
+			ctx->format[2]);
+}
+
+static int
+fallback_cmp_total(const void *a, const void *b)
+{
+	const struct nouveau_fallback *fa = *(void * const *)a;
+	const struct nouveau_fallback *fb = *(void * const *)b;
+
+	return fb->count > fa->count ? 1 : fb->count < fa->count ? -1 : 0;
+}
+
+static int
+fallback_cmp_recent(const void *a, const void *b)
+{
+	const struct nouveau_fallback *fa = *(void * const *)a;
+	const struct nouveau_fallback *fb = *(void * const *)b;
+	unsigned ra = fa->count - fa->reported;
+	unsigned rb = fb->count - fb->reported;
+
+	return rb > ra ? 1 : rb < ra ? -1 : 0;
+}
+
+/* Appends to what's at *pos, stopping at end.  FALSE once it's full. */
+static Bool
+fallback_printf(char **pos, char *end, const char *fmt, ...)
+{
+	va_list ap;
+	int len;
+
+	va_start(ap, fmt);
+	len = vsnprintf(*pos, end - *pos, fmt, ap);
+	va_end(ap);
+
+	if (len < 0 || len >= end - *pos) {
+		*pos += strlen(*pos);
+		return FALSE;
+	}
+
+	*pos += len;
+	return TRUE;
+}
+
+static void
+fallback_property(ScreenPtr pScreen, struct nouveau_fallback **sites, int nr)
+{
+	static Atom atom;
+	WindowPtr root;
+	char *text, *pos, *end;
+	char name[256], ctx[128];
+	int i, j, size;
+
+#if XORG_VERSION_CURRENT >= XORG_VERSION_NUMERIC(1,9,99,1,0)
+	root = pScreen->root;
+#else
+	root = WindowTable[pScreen->myNum];
+#endif
+	if (!root)
+		return;
+
+	if (!atom) {
+		atom = MakeAtom("_NOUVEAU_FALLBACKS",
+				strlen("_NOUVEAU_FALLBACKS"), TRUE);
+	}
+
+	/* one line per site, and one for each context it was hit in */
+	size = nr * (NV_FALLBACK_CTX + 2) * 256 + 1;
+	text = pos = malloc(size);
+	if (!text)
+		return;
+	end = text + size;
+	*pos = '\0';
+
+	for (i = 0; i < nr; i++) {
+		fallback_name(sites[i], name, sizeof(name));
+		if (!fallback_printf(&pos, end, "%u %s\n", sites[i]->count,
+				     name))
+			break;
+
+		for (j = 0; j < NV_FALLBACK_CTX && sites[i]->ctx[j].count;
+		     j++) {
+			fallback_ctx_name(&sites[i]->ctx[j].ctx, ctx,
+					  sizeof(ctx));
+			if (!fallback_printf(&pos, end, "    %u %s\n",
+					     sites[i]->ctx[j].count, ctx))
+				goto done;
+		}
+
+		if (sites[i]->other &&
+		    !fallback_printf(&pos, end, "    %u elsewhere\n",
+				     sites[i]->other))
+			break;
+	}
+
+done:
+	dixChangeWindowProperty(serverClient, root, atom, XA_STRING, 8,
+				PropModeReplace, pos - text, text, TRUE);
+	free(text);
+}
+
+/* Called from the block handler, and with force set at exit */
+void
+nouveau_fallback_report(ScrnInfoPtr pScrn, Bool force)
+{
+	static CARD32 last;
+	CARD32 now = GetTimeInMillis();
+	struct nouveau_fallback *fb, **sites;
+	unsigned total = 0;
+	char name[256], ctx[128];
+	int i, j, top, nr = 0;
+
+	if (!force && now - last < FALLBACK_REPORT_MS)
+		return;
+	last = now;
+
+	for (fb = fallback_list; fb; fb = fb->next) {
+		total += fb->count - fb->reported;
+		nr++;
+	}
+
+	if (!total)
+		return;
+
+	sites = malloc(nr * sizeof(*sites));
+	if (!sites)
+		return;
+
+	for (fb = fallback_list, i = 0; fb; fb = fb->next)
+		sites[i++] = fb;
+
+	qsort(sites, nr, sizeof(*sites), fallback_cmp_recent);
+	xf86DrvMsgVerb(pScrn->scrnIndex, X_INFO, 3,
+		       "%u acceleration fallbacks since the last report, "
+		       "most frequent:\n", total);
+	for (i = 0; i < nr && i < FALLBACK_REPORT_TOP; i++) {
+		if (sites[i]->count == sites[i]->reported)
+			break;
+
+		fb = sites[i];
+		for (j = 1, top = 0; j < NV_FALLBACK_CTX; j++) {
+			if (fb->ctx[j].count > fb->ctx[top].count)
+				top = j;
+		}
+
+		fallback_name(fb, name, sizeof(name));
+		fallback_ctx_name(&fb->ctx[top].ctx, ctx, sizeof(ctx));
+		xf86DrvMsgVerb(pScrn->scrnIndex, X_INFO, 3,
+			       "  %u: %s, mostly for %s\n",
+			       fb->count - fb->reported, name, ctx);
+	}
+
+	for (i = 0; i < nr; i++)
+		sites[i]->reported = sites[i]->count;
+
+	qsort(sites, nr, sizeof(*sites), fallback_cmp_total);
+	if (!force)
+		fallback_property(pScrn->pScreen, sites, nr);
+	free(sites);
+}
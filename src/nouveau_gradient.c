@@ -0,0 +1,425 @@
+/*
+ * Copyright 2012 Nouveau Project
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF
+ * OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "nv_include.h"
+
+/* Solid fill and gradient pictures have no pixmap behind them.  The
+ * colour of a linear gradient only depends on how far along the vector
+ * from p1 to p2 a point is, which is an affine function of its position.
+ * So NV50+ composite samples it like any other source picture: from a
+ * one-texel-high ramp of its colours, with texture coordinates worked
+ * out from the rect's position by nouveau_gradient_coord().  A solid fill
+ * is a one-texel ramp, sampled in the middle everywhere.
+ *
+ * pixman draws each ramp into a small GART buffer of its own, and it
+ * stays there.  Later pictures with the same colour or stops use the same
+ * ramp again.  Replacing one only has to wait for the GPU to be done with
+ * that ramp, not every other one still in use.
+ *
+ * The colour of a radial gradient whose circles share a centre only
+ * depends on a point's distance from it, which isn't affine.  Its ramp is
+ * a table of that colour over a quarter of the plane instead, from the
+ * centre out to a little past the larger circle, and the sampler mirrors
+ * it about the centre and clamps it beyond.  Past the larger circle the
+ * colour doesn't change with either Pad or no repeat, so clamping is
+ * exact.  Other radial gradients, ones that repeat, and conical ones
+ * still fall back.
+ */
+#define GRADIENT_RAMPS 64
+
+struct gradient_ramp {
+	struct nouveau_bo *bo; /* NULL until first drawn */
+	uint32_t used; /* 0 if empty */
+	unsigned type;
+	CARD32 color;  /* solid fill */
+	int nstops;    /* gradients */
+	PictGradientStop *stops;
+	pixman_fixed_t radius[2]; /* radial, in texels */
+	Bool pad;                 /* radial, not transparent outside */
+};
+
+struct nouveau_gradient_cache {
+	struct gradient_ramp ramp[GRADIENT_RAMPS];
+	uint32_t stamp;
+	unsigned hits;
+	unsigned writes;
+};
+
+static void
+gradient_clear(struct nouveau_gradient_cache *cache)
+{
+	int i;
+
+	for (i = 0; i < GRADIENT_RAMPS; i++) {
+		nouveau_bo_ref(NULL, &cache->ramp[i].bo);
+		free(cache->ramp[i].stops);
+		memset(&cache->ramp[i], 0, sizeof(cache->ramp[i]));
+	}
+}
+
+static struct nouveau_gradient_cache *
+gradient_cache(NVPtr pNv)
+{
+	struct nouveau_gradient_cache *cache = pNv->gradients;
+
+	if (cache)
+		return cache;
+
+	cache = calloc(1, sizeof(*cache));
+	if (!cache)
+		return NULL;
+
+	pNv->gradients = cache;
+	return cache;
+}
+
+/* How far out from the centre a radial gradient's table goes, as a
+ * multiple of the larger radius.  The last texel is past it, so what's
+ * interpolated at the edge is all the colour outside.
+ */
+#define GRADIENT_RADIAL_EDGE ((double)NV_RADIAL_SIZE / (NV_RADIAL_SIZE - 2))
+
+/* The radii of a radial gradient's circles in texels of its table, the
+ * table only depends on those and the stops
+ */
+static void
+gradient_radii(PictRadialGradient *radial, pixman_fixed_t radius[2])
+{
+	double r1 = pixman_fixed_to_double(radial->c1.radius);
+	double r2 = pixman_fixed_to_double(radial->c2.radius);
+	double scale = NV_RADIAL_SIZE / (max(r1, r2) * GRADIENT_RADIAL_EDGE);
+
+	radius[0] = pixman_double_to_fixed(r1 * scale);
+	radius[1] = pixman_double_to_fixed(r2 * scale);
+}
+
+static Bool
+gradient_match(struct gradient_ramp *ramp, PicturePtr ppict)
+{
+	SourcePictPtr src = ppict->pSourcePict;
+	pixman_fixed_t radius[2];
+
+	if (!ramp->used || ramp->type != src->type)
+		return FALSE;
+
+	if (src->type == SourcePictTypeSolidFill)
+		return ramp->color == src->solidFill.color;
+
+	if (src->type == SourcePictTypeRadial) {
+		gradient_radii(&src->radial, radius);
+		if (ramp->radius[0] != radius[0] ||
+		    ramp->radius[1] != radius[1] || ramp->pad != ppict->repeat)
+			return FALSE;
+	}
+
+	return ramp->nstops == src->gradient.nstops &&
+	       !memcmp(ramp->stops, src->gradient.stops,
+		       ramp->nstops * sizeof(*ramp->stops));
+}
+
+/* Colours of the radial gradient's table, its centre at texel 0,0 */
+static pixman_image_t *
+gradient_radial(struct gradient_ramp *ramp, PicturePtr ppict)
+{
+	SourcePictPtr src = ppict->pSourcePict;
+	pixman_point_fixed_t c = { 0, 0 };
+	pixman_image_t *grad;
+
+	gradient_radii(&src->radial, ramp->radius);
+	ramp->pad = ppict->repeat;
+
+	grad = pixman_image_create_radial_gradient(&c, &c,
+				ramp->radius[0], ramp->radius[1],
+				(pixman_gradient_stop_t *)src->gradient.stops,
+				src->gradient.nstops);
+	if (grad)
+		pixman_image_set_repeat(grad, ramp->pad ? PIXMAN_REPEAT_PAD :
+						PIXMAN_REPEAT_NONE);
+	return grad;
+}
+
+static Bool
+gradient_write(NVPtr pNv, struct nouveau_gradient_cache *cache,
+	       struct gradient_ramp *ramp, PicturePtr ppict)
+{
+	SourcePictPtr src = ppict->pSourcePict;
+	Bool radial = src->type == SourcePictTypeRadial;
+	int w = radial ? NV_RADIAL_SIZE : NV_GRADIENT_WIDTH;
+	int h = radial ? NV_RADIAL_SIZE : 1;
+	int pitch = radial ? NV_RADIAL_PITCH : NV_GRADIENT_PITCH;
+	pixman_point_fixed_t p1 = { 0, 0 };
+	pixman_point_fixed_t p2 = { pixman_int_to_fixed(NV_GRADIENT_WIDTH), 0 };
+	pixman_image_t *grad, *bits;
+	struct nouveau_bo *bo;
+	uint32_t *map;
+	int size;
+
+	/* a linear ramp fits in a radial one's buffer, not the other way */
+	if (ramp->bo && ramp->bo->size < pitch * h) {
+		nouveau_bo_ref(NULL, &ramp->bo);
+		free(ramp->stops);
+		memset(ramp, 0, sizeof(*ramp));
+	}
+	bo = ramp->bo;
+
+	/* nothing's used an empty slot yet, its buffer is new.  Otherwise
+	 * the GPU may still be sampling the ramp being replaced, which only
+	 * happens once more than GRADIENT_RAMPS different ones are in use,
+	 * and then only waits for work that used this particular one.
+	 */
+	if (!bo) {
+		if (nouveau_bo_new(pNv->dev, NOUVEAU_BO_GART | NOUVEAU_BO_MAP,
+				   0, pitch * h, NULL, &bo))
+			return FALSE;
+	}
+
+	if (nouveau_bo_map(bo, NOUVEAU_BO_WR, pNv->client)) {
+		if (bo != ramp->bo)
+			nouveau_bo_ref(NULL, &bo);
+		return FALSE;
+	}
+	map = bo->map;
+
+	free(ramp->stops);
+	memset(ramp, 0, sizeof(*ramp));
+	ramp->bo = bo;
+
+	if (src->type == SourcePictTypeSolidFill) {
+		/* already premultiplied a8r8g8b8 */
+		map[0] = src->solidFill.color;
+		ramp->color = src->solidFill.color;
+	} else {
+		size = src->gradient.nstops * sizeof(*ramp->stops);
+		ramp->stops = malloc(size);
+		if (!ramp->stops)
+			return FALSE;
+		memcpy(ramp->stops, src->gradient.stops, size);
+		ramp->nstops = src->gradient.nstops;
+
+		/* texel i is the colour at t = (i + 0.5) / width, which is
+		 * where the sampler puts it
+		 */
+		if (radial) {
+			grad = gradient_radial(ramp, ppict);
+		} else {
+			grad = pixman_image_create_linear_gradient(&p1, &p2,
+				(pixman_gradient_stop_t *)src->gradient.stops,
+				src->gradient.nstops);
+			if (grad)
+				pixman_image_set_repeat(grad,
+							PIXMAN_REPEAT_PAD);
+		}
+		bits = pixman_image_create_bits(PIXMAN_a8r8g8b8, w, h, map,
+						pitch);
+		if (grad && bits) {
+			pixman_image_composite32(PIXMAN_OP_SRC, grad, NULL,
+						 bits, 0, 0, 0, 0, 0, 0, w, h);
+		}
+		if (grad)
+			pixman_image_unref(grad);
+		if (bits)
+			pixman_image_unref(bits);
+		if (!grad || !bits) {
+			free(ramp->stops);
+			ramp->stops = NULL;
+			return FALSE;
+		}
+	}
+
+	ramp->type = src->type;
+	cache->writes++;
+	return TRUE;
+}
+
+/* Picture space to normalised ramp coordinates.  s is how far along p1
+ * to p2 the point is, after the picture's transform, and t the middle
+ * of the ramp's only row.
+ */
+static Bool
+gradient_coords(PicturePtr ppict, struct nouveau_gradient *grad)
+{
+	PictTransformPtr pt = ppict->transform;
+	PictLinearGradient *linear = &ppict->pSourcePict->linear;
+	double x1 = pixman_fixed_to_double(linear->p1.x);
+	double y1 = pixman_fixed_to_double(linear->p1.y);
+	double dx = pixman_fixed_to_double(linear->p2.x) - x1;
+	double dy = pixman_fixed_to_double(linear->p2.y) - y1;
+	double l2 = dx * dx + dy * dy;
+	double a, b;
+	int i;
+
+	if (l2 == 0.0)
+		return FALSE;
+
+	for (i = 0; i < 3; i++) {
+		a = pt ? pixman_fixed_to_double(pt->matrix[0][i]) : (i == 0);
+		b = pt ? pixman_fixed_to_double(pt->matrix[1][i]) : (i == 1);
+		grad->st[0][i] = (dx * a + dy * b) / l2;
+		grad->st[1][i] = 0.0;
+	}
+	grad->st[0][2] -= (x1 * dx + y1 * dy) / l2;
+	grad->st[1][2] = 0.5;
+	return TRUE;
+}
+
+/* For a radial gradient, s and t are the offset from the centre after the
+ * picture's transform, normalised to the table's size.  Either can be
+ * negative, the sampler mirrors them.
+ */
+static void
+gradient_radial_coords(PicturePtr ppict, struct nouveau_gradient *grad)
+{
+	PictTransformPtr pt = ppict->transform;
+	PictRadialGradient *radial = &ppict->pSourcePict->radial;
+	double r1 = pixman_fixed_to_double(radial->c1.radius);
+	double r2 = pixman_fixed_to_double(radial->c2.radius);
+	double size = max(r1, r2) * GRADIENT_RADIAL_EDGE;
+	double a, b;
+	int i;
+
+	for (i = 0; i < 3; i++) {
+		a = pt ? pixman_fixed_to_double(pt->matrix[0][i]) : (i == 0);
+		b = pt ? pixman_fixed_to_double(pt->matrix[1][i]) : (i == 1);
+		grad->st[0][i] = a / size;
+		grad->st[1][i] = b / size;
+	}
+	grad->st[0][2] -= pixman_fixed_to_double(radial->c1.x) / size;
+	grad->st[1][2] -= pixman_fixed_to_double(radial->c1.y) / size;
+}
+
+/* CheckComposite for a picture without a drawable */
+Bool
+nouveau_gradient_check(PicturePtr ppict)
+{
+	SourcePictPtr src = ppict->pSourcePict;
+	PictTransformPtr pt = ppict->transform;
+
+	if (!src)
+		NOUVEAU_FALLBACK("picture has no drawable or source\n");
+
+	switch (src->type) {
+	case SourcePictTypeSolidFill:
+		return TRUE;
+	case SourcePictTypeLinear:
+		break;
+	case SourcePictTypeRadial:
+		if (src->radial.c1.x != src->radial.c2.x ||
+		    src->radial.c1.y != src->radial.c2.y)
+			NOUVEAU_FALLBACK("radial gradient with two centres\n");
+		if (src->radial.c1.radius == src->radial.c2.radius)
+			NOUVEAU_FALLBACK("radial gradient with r1 == r2\n");
+		if (ppict->repeat && ppict->repeatType != RepeatPad)
+			NOUVEAU_FALLBACK("repeating radial gradient\n");
+		break;
+	default:
+		NOUVEAU_FALLBACK("conical gradients unsupported\n");
+	}
+
+	if (src->gradient.nstops < 1)
+		NOUVEAU_FALLBACK("gradient without stops\n");
+
+	if (pt && (pt->matrix[2][0] || pt->matrix[2][1] ||
+		   pt->matrix[2][2] != xFixed1))
+		NOUVEAU_FALLBACK("projective gradient transform\n");
+
+	return TRUE;
+}
+
+/* Fills in grad for sampling ppict, drawing its ramp if it's not already
+ * there.  Called from PrepareComposite before anything's emitted, as it
+ * may have to wait for the GPU.  A ramp that moved or was redrawn means
+ * the last composite's state can't be reused, even if the picture looks
+ * the same.
+ */
+Bool
+nouveau_gradient_get(NVPtr pNv, PicturePtr ppict, struct nouveau_gradient *grad)
+{
+	SourcePictPtr src = ppict->pSourcePict;
+	struct nouveau_gradient_cache *cache;
+	struct gradient_ramp *ramp = NULL;
+	int i;
+
+	grad->height = 1;
+	grad->pitch = NV_GRADIENT_PITCH;
+	grad->radial = FALSE;
+	if (src->type == SourcePictTypeSolidFill) {
+		memset(grad->st, 0, sizeof(grad->st));
+		grad->st[0][2] = grad->st[1][2] = 0.5;
+		grad->width = 1;
+	} else
+	if (src->type == SourcePictTypeRadial) {
+		gradient_radial_coords(ppict, grad);
+		grad->width = grad->height = NV_RADIAL_SIZE;
+		grad->pitch = NV_RADIAL_PITCH;
+		grad->radial = TRUE;
+	} else {
+		if (!gradient_coords(ppict, grad))
+			NOUVEAU_FALLBACK("gradient with p1 == p2\n");
+		grad->width = NV_GRADIENT_WIDTH;
+	}
+
+	cache = gradient_cache(pNv);
+	if (!cache)
+		NOUVEAU_FALLBACK("gradient ramp buffer\n");
+
+	if (!++cache->stamp) {
+		gradient_clear(cache);
+		cache->stamp = 1;
+	}
+
+	for (i = 0; i < GRADIENT_RAMPS; i++) {
+		if (gradient_match(&cache->ramp[i], ppict)) {
+			ramp = &cache->ramp[i];
+			cache->hits++;
+			break;
+		}
+
+		if (!ramp || cache->ramp[i].used < ramp->used)
+			ramp = &cache->ramp[i];
+	}
+
+	if (i == GRADIENT_RAMPS && !gradient_write(pNv, cache, ramp, ppict))
+		NOUVEAU_FALLBACK("gradient ramp\n");
+
+	ramp->used = cache->stamp;
+	grad->moved = i == GRADIENT_RAMPS || grad->bo != ramp->bo;
+	grad->bo = ramp->bo;
+	return TRUE;
+}
+
+void
+nouveau_gradient_fini(ScrnInfoPtr pScrn)
+{
+	NVPtr pNv = NVPTR(pScrn);
+	struct nouveau_gradient_cache *cache = pNv->gradients;
+
+	if (!cache)
+		return;
+
+	xf86DrvMsgVerb(pScrn->scrnIndex, X_INFO, 3,
+		       "Solid/gradient pictures: %u ramp hits, %u drawn\n",
+		       cache->hits, cache->writes);
+
+	gradient_clear(cache);
+	free(cache);
+	pNv->gradients = NULL;
+}
@@ -27,21 +27,58 @@
 #include "xf86_OSproc.h"
 
 #include <nouveau.h>
+#include <sys/time.h>
+#include <time.h>
+
+#include "nouveau_capture.h"
 
 /* Debug output */
 #define NOUVEAU_MSG(fmt,args...) ErrorF(fmt, ##args)
 #define NOUVEAU_ERR(fmt,args...) \
 	ErrorF("%s:%d - "fmt, __func__, __LINE__, ##args)
+
+/* Every NOUVEAU_FALLBACK() site counts how often it's hit, and for which
+ * operations, see nouveau_fallback.c.
+ */
+#define NV_FALLBACK_CTX 4
+
+struct nouveau_fallback_ctx {
+	uint32_t kind;      /* NV_CAPTURE_OP_*, 0 if not an EXA operation */
+	uint32_t op;        /* render op, or alu for solid and copy */
+	uint32_t format[3]; /* src, mask and dst picture formats, or 0 */
+};
+
+struct nouveau_fallback {
+	const char *file;
+	const char *func;
+	int line;
+	const char *reason;
+
+	struct nouveau_fallback *next; /* linked in when first hit */
+	unsigned count;
+	unsigned reported; /* count as of the last summary */
+	struct {
+		struct nouveau_fallback_ctx ctx;
+		unsigned count;
+	} ctx[NV_FALLBACK_CTX];
+	unsigned other; /* hits that didn't fit in ctx[] */
+};
+
+void nouveau_fallback(struct nouveau_fallback *);
+
 #if 0
-#define NOUVEAU_FALLBACK(fmt,args...) do {    \
-	NOUVEAU_ERR("FALLBACK: "fmt, ##args); \
-	return FALSE;                         \
-} while(0)
+#define NOUVEAU_FALLBACK_LOG(fmt,args...) NOUVEAU_ERR("FALLBACK: "fmt, ##args)
 #else
-#define NOUVEAU_FALLBACK(fmt,args...) do {    \
-	return FALSE;                         \
-} while(0)
+#define NOUVEAU_FALLBACK_LOG(fmt,args...)
 #endif
+#define NOUVEAU_FALLBACK(fmt,args...) do {                              \
+	static struct nouveau_fallback nv_fallback_site = {             \
+		__FILE__, __func__, __LINE__, fmt                       \
+	};                                                              \
+	NOUVEAU_FALLBACK_LOG(fmt, ##args);                              \
+	nouveau_fallback(&nv_fallback_site);                            \
+	return FALSE;                                                   \
+} while(0)
 
 #define NOUVEAU_ALIGN(x,bytes) (((x) + ((bytes) - 1)) & ~((bytes) - 1))
 
@@ -50,6 +87,22 @@
 #define NVC0_TILE_PITCH(m) (64 << ((m) & 0xf))
 #define NVC0_TILE_HEIGHT(m) (8 << ((m) >> 4))
 
+static inline uint64_t nouveau_time_usec(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return (uint64_t)tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+static inline uint64_t nouveau_time_nsec(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
 static inline int log2i(int i)
 {
 	int r = 0;
@@ -95,17 +148,87 @@ static inline int round_up_pow2(int x)
 		(y) = __z;		\
 	} while (0)
 
+/* Last value written to each method below NV_SHADOW_MTHDS on every
+ * subchannel, so state that's set over and over to the same thing can be
+ * skipped, see PUSH_SHADOW_NV04() and PUSH_SHADOW_NVC0().
+ */
+#define NV_SHADOW_SUBC  8
+#define NV_SHADOW_MTHDS (0x2000 / 4)
+
+struct nouveau_shadow {
+	uint32_t valid[NV_SHADOW_SUBC][NV_SHADOW_MTHDS / 32];
+	uint32_t data[NV_SHADOW_SUBC][NV_SHADOW_MTHDS];
+	uint64_t emitted; /* dwords */
+	uint64_t skipped;
+};
+
+/* Hung off pushbuf->user_priv, see nv_dma.c */
+struct nouveau_pushbuf_priv {
+	struct nouveau_bufctx *bufctx;
+	uint32_t *start; /* of what's not been submitted yet, NULL if unknown */
+	uint32_t words;  /* in each push buffer */
+	Bool kicking;
+	Bool spacing;    /* in PUSH_SPACE_RELOC() */
+
+	unsigned wraps;  /* submitted because a push buffer filled up */
+	unsigned kicks;  /* submitted on request, by PUSH_KICK */
+	unsigned idle;   /* submitted from the block handler */
+	unsigned queued; /* submitted by NVDmaQueued() */
+	unsigned implicit; /* submitted by libdrm for a bo wait or map */
+	uint64_t fill;   /* dwords in the kicks above where it's known */
+	unsigned fill_kicks;
+	uint32_t peak;   /* largest of those, since the last resize check */
+
+	/* referenced by every submission, idle once the GPU's caught up */
+	struct nouveau_bo *fence;
+	Bool busy;
+	uint64_t polled;    /* last time fence was checked */
+	uint64_t submitted; /* time of the last submission */
+	unsigned pixels;    /* queued since then, see NVDmaQueued() */
+
+	struct nouveau_shadow *shadow; /* NULL if not tracking state */
+	unsigned shadow_resets; /* PUSH_SHADOW_RESET() calls */
+
+	/* PushBufferCapture, see nouveau_capture.c */
+	struct nouveau_capture *capture; /* NULL if not capturing */
+	uint32_t *captured;     /* start of what's not been captured yet */
+	uint32_t *captured_end; /* push->end as of then */
+};
+
 static inline uint32_t
 PUSH_AVAIL(struct nouveau_pushbuf *push)
 {
 	return push->end - push->cur;
 }
 
+/* Make room for size dwords and relocs relocations.  When that starts a
+ * new push buffer, anything being captured picks up from there.
+ */
+static inline Bool
+PUSH_SPACE_RELOC(struct nouveau_pushbuf *push, uint32_t size, uint32_t relocs)
+{
+	struct nouveau_pushbuf_priv *priv = push->user_priv;
+	int ret;
+
+	/* any submission this makes is a wrap, see NVDmaKickNotify() */
+	priv->spacing = TRUE;
+	ret = nouveau_pushbuf_space(push, size, relocs, 0);
+	priv->spacing = FALSE;
+	if (ret)
+		return FALSE;
+
+	if (priv->capture && priv->captured_end != push->end) {
+		priv->captured = push->cur;
+		priv->captured_end = push->end;
+	}
+	return TRUE;
+}
+
 static inline Bool
 PUSH_SPACE(struct nouveau_pushbuf *push, uint32_t size)
 {
 	if (PUSH_AVAIL(push) < size)
-		return nouveau_pushbuf_space(push, size, 0, 0) == 0;
+		return PUSH_SPACE_RELOC(push, size, 0);
 	return TRUE;
 }
 
@@ -122,23 +245,121 @@ PUSH_DATAp(struct nouveau_pushbuf *push, const void *data, uint32_t size)
 	push->cur += size;
 }
 
+/* Note a buffer used by the commands that follow in any capture, and
+ * whether the next dword written holds its address.
+ */
+static inline void
+PUSH_CAPTURE_BO(struct nouveau_pushbuf *push, struct nouveau_bo *bo,
+		uint32_t flags, Bool reloc)
+{
+	struct nouveau_pushbuf_priv *priv = push->user_priv;
+
+	if (priv->capture)
+		nouveau_capture_bo(push, bo, flags, reloc);
+}
+
+/* Mark the start of an EXA operation in any capture */
+static inline void
+PUSH_CAPTURE_OP(struct nouveau_pushbuf *push, uint32_t op)
+{
+	struct nouveau_pushbuf_priv *priv = push->user_priv;
+
+	if (priv->capture)
+		nouveau_capture_op(push, op);
+}
+
 static inline void
 PUSH_RELOC(struct nouveau_pushbuf *push, struct nouveau_bo *bo, uint32_t offset,
 	   uint32_t flags, uint32_t vor, uint32_t tor)
 {
+	PUSH_CAPTURE_BO(push, bo, flags, TRUE);
 	nouveau_pushbuf_reloc(push, bo, offset, flags, vor, tor);
 }
 
+/* nouveau_pushbuf_refn(), with the buffers noted in any capture */
+static inline int
+PUSH_REFS(struct nouveau_pushbuf *push, struct nouveau_pushbuf_refn *refs,
+	  int nr)
+{
+	int i;
+
+	for (i = 0; i < nr; i++)
+		PUSH_CAPTURE_BO(push, refs[i].bo, refs[i].flags, FALSE);
+	return nouveau_pushbuf_refn(push, refs, nr);
+}
+
+/* Forget what the hardware state is, for when commands may have been lost
+ * or someone else might have touched it.
+ */
+static inline void
+PUSH_SHADOW_RESET(struct nouveau_pushbuf *push)
+{
+	struct nouveau_pushbuf_priv *priv = push->user_priv;
+
+	priv->shadow_resets++;
+	if (priv->shadow)
+		memset(priv->shadow->valid, 0, sizeof(priv->shadow->valid));
+}
+
+/* Submit everything queued so far, counted against *kicks */
+static inline void
+PUSH_SUBMIT(struct nouveau_pushbuf *push, unsigned *kicks)
+{
+	struct nouveau_pushbuf_priv *priv = push->user_priv;
+	uint32_t *start = priv->start;
+
+	if (push->cur != start) {
+		(*kicks)++;
+		if (start && push->cur > start &&
+		    push->cur - start <= priv->words) {
+			priv->fill += push->cur - start;
+			priv->fill_kicks++;
+			if (push->cur - start > priv->peak)
+				priv->peak = push->cur - start;
+		}
+
+		if (priv->fence) {
+			nouveau_pushbuf_refn(push, &(struct nouveau_pushbuf_refn) {
+					     priv->fence, NOUVEAU_BO_GART |
+					     NOUVEAU_BO_RD }, 1);
+		}
+		priv->busy = TRUE;
+		priv->submitted = nouveau_time_usec();
+		priv->pixels = 0;
+	}
+
+	priv->kicking = TRUE;
+	if (nouveau_pushbuf_kick(push, push->channel))
+		PUSH_SHADOW_RESET(push);
+	priv->kicking = FALSE;
+	priv->start = push->cur;
+}
+
 static inline void
 PUSH_KICK(struct nouveau_pushbuf *push)
 {
-	nouveau_pushbuf_kick(push, push->channel);
+	struct nouveau_pushbuf_priv *priv = push->user_priv;
+
+	PUSH_SUBMIT(push, &priv->kicks);
+}
+
+/* PUSH_SPACE(), submitting what's queued and trying again if it fails */
+static inline Bool
+PUSH_SPACE_RETRY(struct nouveau_pushbuf *push, uint32_t size)
+{
+	if (PUSH_SPACE(push, size))
+		return TRUE;
+
+	PUSH_KICK(push);
+	return PUSH_SPACE(push, size);
 }
 
 static inline struct nouveau_bufctx *
 BUFCTX(struct nouveau_pushbuf *push)
 {
-	return push->user_priv;
+	struct nouveau_pushbuf_priv *priv = push->user_priv;
+
+	return priv->bufctx;
 }
 
 static inline void
@@ -150,6 +371,7 @@ PUSH_RESET(struct nouveau_pushbuf *push)
 static inline void
 PUSH_REFN(struct nouveau_pushbuf *push, struct nouveau_bo *bo, uint32_t access)
 {
+	PUSH_CAPTURE_BO(push, bo, access, FALSE);
 	nouveau_bufctx_refn(BUFCTX(push), 0, bo, access);
 }
 
@@ -157,6 +379,7 @@ static inline void
 PUSH_MTHDl(struct nouveau_pushbuf *push, int subc, int mthd,
 	   struct nouveau_bo *bo, uint32_t offset, uint32_t access)
 {
+	PUSH_CAPTURE_BO(push, bo, access, TRUE);
 	nouveau_bufctx_mthd(BUFCTX(push), 0, (1 << 18) | (subc << 13) | mthd,
 			    bo, offset, access | NOUVEAU_BO_LOW, 0, 0);
 	PUSH_DATA (push, bo->offset + offset);
@@ -166,6 +389,7 @@ static inline void
 PUSH_MTHDo(struct nouveau_pushbuf *push, int subc, int mthd,
 	   struct nouveau_bo *bo, uint32_t access, uint32_t vor, uint32_t tor)
 {
+	PUSH_CAPTURE_BO(push, bo, access, TRUE);
 	nouveau_bufctx_mthd(BUFCTX(push), 0, (1 << 18) | (subc << 13) | mthd,
 			    bo, 0, access | NOUVEAU_BO_OR, vor, tor);
 	if (bo->flags & NOUVEAU_BO_VRAM)
@@ -179,6 +403,7 @@ PUSH_MTHDs(struct nouveau_pushbuf *push, int subc, int mthd,
 	   struct nouveau_bo *bo, uint32_t data, uint32_t access,
 	   uint32_t vor, uint32_t tor)
 {
+	PUSH_CAPTURE_BO(push, bo, access, TRUE);
 	nouveau_bufctx_mthd(BUFCTX(push), 0, (1 << 18) | (subc << 13) | mthd,
 			    bo, data, access | NOUVEAU_BO_OR, vor, tor);
 	if (bo->flags & NOUVEAU_BO_VRAM)
@@ -192,6 +417,7 @@ PUSH_MTHD(struct nouveau_pushbuf *push, int subc, int mthd,
 	  struct nouveau_bo *bo, uint32_t data, uint32_t access,
 	  uint32_t vor, uint32_t tor)
 {
+	PUSH_CAPTURE_BO(push, bo, access, TRUE);
 	nouveau_bufctx_mthd(BUFCTX(push), 0, (1 << 18) | (subc << 13) | mthd,
 			    bo, data, access | NOUVEAU_BO_OR, vor, tor);
 	if (access & NOUVEAU_BO_LOW)
@@ -248,6 +474,60 @@ BEGIN_1IC0(struct nouveau_pushbuf *push, int subc, int mthd, int size)
 	PUSH_DATA (push, 0xa0000000 | (size << 16) | (subc << 13) | (mthd / 4));
 }
 
+/* Returns TRUE if size methods from mthd already hold data.  Otherwise
+ * the shadow is updated to say they do, and the caller must emit them.
+ */
+static inline Bool
+PUSH_SHADOWED(struct nouveau_pushbuf *push, int subc, int mthd,
+	      const uint32_t *data, int size)
+{
+	struct nouveau_pushbuf_priv *priv = push->user_priv;
+	struct nouveau_shadow *shadow = priv->shadow;
+	uint32_t *valid, *shadowed;
+	int i, m = mthd / 4;
+	Bool match = TRUE;
+
+	if (!shadow || m + size > NV_SHADOW_MTHDS)
+		return FALSE;
+
+	valid = shadow->valid[subc];
+	shadowed = shadow->data[subc];
+	for (i = 0; i < size; i++, m++) {
+		if (!(valid[m / 32] & (1 << (m % 32))) ||
+		    shadowed[m] != data[i]) {
+			valid[m / 32] |= (1 << (m % 32));
+			shadowed[m] = data[i];
+			match = FALSE;
+		}
+	}
+
+	if (match)
+		shadow->skipped += size + 1;
+	else
+		shadow->emitted += size + 1;
+	return match;
+}
+
+static inline void
+PUSH_SHADOW_NV04(struct nouveau_pushbuf *push, int subc, int mthd,
+		 const uint32_t *data, int size)
+{
+	if (!PUSH_SHADOWED(push, subc, mthd, data, size)) {
+		BEGIN_NV04(push, subc, mthd, size);
+		PUSH_DATAp(push, data, size);
+	}
+}
+
+static inline void
+PUSH_SHADOW_NVC0(struct nouveau_pushbuf *push, int subc, int mthd,
+		 const uint32_t *data, int size)
+{
+	if (!PUSH_SHADOWED(push, subc, mthd, data, size)) {
+		BEGIN_NVC0(push, subc, mthd, size);
+		PUSH_DATAp(push, data, size);
+	}
+}
+
 #define NV01_SUBC(subc, mthd) SUBC_##subc((NV01_SUBCHAN_##mthd))
 #define NV11_SUBC(subc, mthd) SUBC_##subc((NV11_SUBCHAN_##mthd))
 
@@ -0,0 +1,1502 @@
+/*
+ * Copyright 2012 Nouveau Project
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF
+ * OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/* The server's prototypes for these have changed over time, the ones
+ * below are what they all link against
+ */
+#define xf86GetOptValString nouveau_mock_unused_xf86GetOptValString
+#define dixChangeWindowProperty nouveau_mock_unused_dixChangeWindowProperty
+#include "nv_include.h"
+#undef xf86GetOptValString
+#undef dixChangeWindowProperty
+
+#include <stdarg.h>
+#include <time.h>
+#include "hwdefs/nvc0_m2mf.xml.h"
+#include "nouveau_mock.h"
+
+/* Linked in place of libdrm_nouveau and the X server, so the acceleration
+ * code can be run without either.  Nothing reaches a GPU: buffer objects
+ * are malloc()ed when first mapped, and push buffers are kept in memory.
+ *
+ * The submission model follows libdrm closely enough for the driver's
+ * bookkeeping to behave as it would for real.  Submitted work stays busy
+ * until the CPU waits for it, which counts as a stall, so anything that
+ * would wait on real hardware is visible.  Like libdrm, waiting for a
+ * buffer that's still referenced by unsubmitted commands kicks them off
+ * first.
+ */
+
+#define MOCK_MAX_OPTIONS 32
+#define MOCK_MAX_CLASSES 8
+
+struct mock_bo {
+	struct nouveau_bo base;
+	int refcount;
+	struct nouveau_pushbuf *push; /* has it in unsubmitted commands */
+	uint32_t access;              /* by those commands */
+	uint32_t busy;                /* by submitted commands */
+	struct mock_bo *next;         /* on mock.bos while push is set */
+	struct mock_bo *link;         /* on mock.all */
+};
+
+struct mock_bufref {
+	struct nouveau_bufref base;
+	int bin;
+	struct nouveau_pushbuf *push; /* validated into, NULL if pending */
+	struct mock_bufref *next;
+};
+
+struct mock_bufctx {
+	struct nouveau_bufctx base;
+	struct mock_bufref *refs;
+	struct mock_bufctx *next;
+};
+
+struct mock_pushbuf {
+	struct nouveau_pushbuf base;
+	uint32_t **buf;
+	Bool *busy;
+	int nr;
+	int words;
+	int next;
+	uint32_t *bgn;      /* of what's not been submitted yet */
+	uint32_t *rec;      /* everything submitted, if recording */
+	size_t rec_nr;
+	size_t rec_max;
+	struct mock_pushbuf *prev, *chain;
+};
+
+struct mock_pixmap {
+	PixmapRec pixmap;
+	void *priv;
+};
+
+/* Only the extents of what's been reported are kept */
+struct mock_damage {
+	RegionRec region;
+	DrawablePtr drawable; /* registered on, if any */
+	DamageDestroyFunc destroy;
+	void *closure;
+	struct mock_damage *next;
+};
+
+static struct {
+	const char *option[MOCK_MAX_OPTIONS];
+	uint32_t fail_class[MOCK_MAX_CLASSES];
+	int fail_classes;
+	int fail_space; /* new push buffers to refuse */
+
+	uint64_t offset[2]; /* next VRAM and GART address */
+	uint32_t handle;
+	int channel;
+	struct mock_bo *bos;
+	struct mock_bo *all;
+	struct mock_bufctx *bufctxs;
+	struct mock_pushbuf *pushbufs;
+	struct mock_damage *damages;
+	Bool record;
+	struct nouveau_mock_stats stats;
+
+	ExaDriverPtr exa;
+	ScrnInfoPtr screens[1];
+	ScreenRec screen;
+	void *screen_privates[1]; /* just the PictureScreen */
+	PictureScreenRec picture_screen;
+	PixmapPtr screen_pixmap;
+} mock;
+
+/*****************************************************************************
+ * libdrm_nouveau
+ ****************************************************************************/
+
+int
+nouveau_object_new(struct nouveau_object *parent, uint64_t handle,
+		   uint32_t oclass, void *data, uint32_t length,
+		   struct nouveau_object **pobj)
+{
+	struct nouveau_object *obj;
+	int i;
+
+	for (i = 0; i < mock.fail_classes; i++) {
+		if (mock.fail_class[i] == oclass)
+			return -ENODEV;
+	}
+
+	obj = calloc(1, sizeof(*obj));
+	if (!obj)
+		return -ENOMEM;
+
+	obj->parent = parent;
+	obj->handle = handle;
+	obj->oclass = oclass;
+	if (length) {
+		obj->data = malloc(length);
+		if (!obj->data) {
+			free(obj);
+			return -ENOMEM;
+		}
+		memcpy(obj->data, data, length);
+		obj->length = length;
+	}
+
+	if (oclass == NOUVEAU_FIFO_CHANNEL_CLASS) {
+		struct nouveau_fifo *fifo = obj->data;
+
+		fifo->object = obj;
+		fifo->channel = mock.channel++;
+	}
+
+	*pobj = obj;
+	return 0;
+}
+
+void
+nouveau_object_del(struct nouveau_object **pobj)
+{
+	struct nouveau_object *obj = *pobj;
+
+	if (!obj)
+		return;
+
+	free(obj->data);
+	free(obj);
+	*pobj = NULL;
+}
+
+int
+nouveau_bo_new(struct nouveau_device *dev, uint32_t flags, uint32_t align,
+	       uint64_t size, union nouveau_bo_config *config,
+	       struct nouveau_bo **pbo)
+{
+	struct mock_bo *nvbo = calloc(1, sizeof(*nvbo));
+	int gart = !(flags & NOUVEAU_BO_VRAM);
+
+	if (!nvbo)
+		return -ENOMEM;
+
+	/* above 4GiB, so the high halves of addresses are tested too */
+	if (!mock.offset[gart])
+		mock.offset[gart] = (gart + 1ULL) << 32;
+
+	nvbo->base.device = dev;
+	nvbo->base.handle = ++mock.handle;
+	nvbo->base.size = size;
+	nvbo->base.flags = flags;
+	nvbo->base.offset = mock.offset[gart];
+	if (config)
+		nvbo->base.config = *config;
+	nvbo->refcount = 1;
+	nvbo->link = mock.all;
+	mock.all = nvbo;
+
+	mock.offset[gart] += (size + 0xffff) & ~0xffffULL;
+	*pbo = &nvbo->base;
+	return 0;
+}
+
+void
+nouveau_bo_ref(struct nouveau_bo *bo, struct nouveau_bo **pref)
+{
+	struct mock_bo *ref = (struct mock_bo *)*pref;
+
+	if (bo)
+		((struct mock_bo *)bo)->refcount++;
+	if (ref && !--ref->refcount) {
+		struct mock_bo **plink = &mock.all;
+
+		while (*plink != ref)
+			plink = &(*plink)->link;
+		*plink = ref->link;
+		free(ref->base.map);
+		free(ref);
+	}
+	*pref = bo;
+}
+
+int
+nouveau_bo_wait(struct nouveau_bo *bo, uint32_t access,
+		struct nouveau_client *client)
+{
+	struct mock_bo *nvbo = (struct mock_bo *)bo;
+
+	if (!(access & NOUVEAU_BO_RDWR))
+		return 0;
+
+	if (nvbo->push) {
+		mock.stats.waits++;
+		nouveau_pushbuf_kick(nvbo->push, nvbo->push->channel);
+	}
+
+	if (!(nvbo->busy & NOUVEAU_BO_WR) && !(access & NOUVEAU_BO_WR))
+		return 0;
+	if (!nvbo->busy)
+		return 0;
+
+	if (access & NOUVEAU_BO_NOBLOCK)
+		return -EBUSY;
+
+	mock.stats.stalls++;
+	nvbo->busy = 0;
+	return 0;
+}
+
+int
+nouveau_bo_map(struct nouveau_bo *bo, uint32_t access,
+	       struct nouveau_client *client)
+{
+	if (!bo->map) {
+		bo->map = calloc(1, bo->size);
+		if (!bo->map)
+			return -ENOMEM;
+	}
+
+	return nouveau_bo_wait(bo, access, client);
+}
+
+/* Buffers referenced by a push buffer's unsubmitted commands.  The kernel
+ * refuses the submission if a buffer isn't in any of the domains it's
+ * referenced in, that's counted.
+ */
+static void
+mock_pushbuf_ref(struct nouveau_pushbuf *push, struct nouveau_bo *bo,
+		 uint32_t flags)
+{
+	struct mock_bo *nvbo = (struct mock_bo *)bo;
+	uint32_t domain = NOUVEAU_BO_VRAM | NOUVEAU_BO_GART;
+
+	if (!(bo->flags & flags & domain))
+		mock.stats.domains++;
+	if (!nvbo->push) {
+		nvbo->push = push;
+		nvbo->access = 0;
+		nvbo->next = mock.bos;
+		mock.bos = nvbo;
+		nvbo->refcount++;
+	}
+	nvbo->access |= flags & NOUVEAU_BO_RDWR;
+}
+
+/* Drops them once submitted, or thrown away */
+static void
+mock_pushbuf_unref(struct nouveau_pushbuf *push, Bool submitted)
+{
+	struct mock_bo **pnext = &mock.bos, *nvbo;
+	struct nouveau_bo *bo;
+
+	while ((nvbo = *pnext)) {
+		if (nvbo->push != push) {
+			pnext = &nvbo->next;
+			continue;
+		}
+
+		*pnext = nvbo->next;
+		if (submitted)
+			nvbo->busy |= nvbo->access;
+		nvbo->push = NULL;
+		bo = &nvbo->base;
+		nouveau_bo_ref(NULL, &bo);
+	}
+}
+
+int
+nouveau_bufctx_new(struct nouveau_client *client, int bins,
+		   struct nouveau_bufctx **pctx)
+{
+	struct mock_bufctx *ctx = calloc(1, sizeof(*ctx));
+
+	if (!ctx)
+		return -ENOMEM;
+
+	ctx->base.client = client;
+	ctx->next = mock.bufctxs;
+	mock.bufctxs = ctx;
+	*pctx = &ctx->base;
+	return 0;
+}
+
+void
+nouveau_bufctx_del(struct nouveau_bufctx **pctx)
+{
+	struct mock_bufctx *ctx = (struct mock_bufctx *)*pctx, **pnext;
+	struct mock_bufref *ref;
+
+	if (!ctx)
+		return;
+
+	for (pnext = &mock.bufctxs; *pnext; pnext = &(*pnext)->next) {
+		if (*pnext == ctx) {
+			*pnext = ctx->next;
+			break;
+		}
+	}
+
+	while ((ref = ctx->refs)) {
+		ctx->refs = ref->next;
+		free(ref);
+	}
+	free(ctx);
+	*pctx = NULL;
+}
+
+struct nouveau_bufref *
+nouveau_bufctx_refn(struct nouveau_bufctx *bctx, int bin,
+		    struct nouveau_bo *bo, uint32_t flags)
+{
+	struct mock_bufctx *ctx = (struct mock_bufctx *)bctx;
+	struct mock_bufref *ref = calloc(1, sizeof(*ref)), **pnext;
+
+	if (!ref)
+		return NULL;
+
+	/* in order, validation emits them in the order they were added */
+	for (pnext = &ctx->refs; *pnext; pnext = &(*pnext)->next)
+		;
+	*pnext = ref;
+
+	ref->bin = bin;
+	ref->base.bo = bo;
+	ref->base.flags = flags;
+	return &ref->base;
+}
+
+struct nouveau_bufref *
+nouveau_bufctx_mthd(struct nouveau_bufctx *bctx, int bin, uint32_t packet,
+		    struct nouveau_bo *bo, uint64_t data, uint32_t flags,
+		    uint32_t vor, uint32_t tor)
+{
+	struct nouveau_bufref *ref = nouveau_bufctx_refn(bctx, bin, bo, flags);
+
+	if (!ref)
+		return NULL;
+
+	ref->packet = packet;
+	ref->data = data;
+	ref->vor = vor;
+	ref->tor = tor;
+	bctx->relocs++;
+	return ref;
+}
+
+void
+nouveau_bufctx_reset(struct nouveau_bufctx *bctx, int bin)
+{
+	struct mock_bufctx *ctx = (struct mock_bufctx *)bctx;
+	struct mock_bufref **pnext = &ctx->refs, *ref;
+
+	while ((ref = *pnext)) {
+		if (ref->bin != bin) {
+			pnext = &ref->next;
+			continue;
+		}
+
+		if (ref->base.packet)
+			bctx->relocs--;
+		*pnext = ref->next;
+		free(ref);
+	}
+}
+
+static uint32_t
+mock_reloc(struct nouveau_bo *bo, uint32_t data, uint32_t flags,
+	   uint32_t vor, uint32_t tor)
+{
+	uint64_t addr = bo->offset + data;
+	uint32_t value = data;
+
+	if (flags & NOUVEAU_BO_LOW)
+		value = addr;
+	else
+	if (flags & NOUVEAU_BO_HIGH)
+		value = addr >> 32;
+
+	if (flags & NOUVEAU_BO_OR)
+		value |= (bo->flags & NOUVEAU_BO_VRAM) ? vor : tor;
+	return value;
+}
+
+int
+nouveau_pushbuf_new(struct nouveau_client *client, struct nouveau_object *chan,
+		    int nr, uint32_t size, bool immediate,
+		    struct nouveau_pushbuf **ppush)
+{
+	struct mock_pushbuf *nvpb = calloc(1, sizeof(*nvpb));
+	int i;
+
+	if (!nvpb)
+		return -ENOMEM;
+
+	nvpb->buf = calloc(nr, sizeof(*nvpb->buf));
+	nvpb->busy = calloc(nr, sizeof(*nvpb->busy));
+	nvpb->nr = nr;
+	nvpb->words = size / 4;
+	for (i = 0; nvpb->buf && i < nr; i++) {
+		nvpb->buf[i] = malloc(size);
+		if (!nvpb->buf[i])
+			break;
+	}
+
+	if (!nvpb->busy || i < nr) {
+		nvpb->nr = i;
+		nouveau_pushbuf_del((struct nouveau_pushbuf **)&nvpb);
+		return -ENOMEM;
+	}
+
+	nvpb->base.client = client;
+	nvpb->base.channel = immediate ? chan : NULL;
+	nvpb->base.cur = nvpb->bgn = nvpb->buf[0];
+	nvpb->base.end = nvpb->buf[0] + nvpb->words;
+	nvpb->next = 1 % nr;
+
+	nvpb->chain = mock.pushbufs;
+	if (mock.pushbufs)
+		mock.pushbufs->prev = nvpb;
+	mock.pushbufs = nvpb;
+	*ppush = &nvpb->base;
+	return 0;
+}
+
+void
+nouveau_pushbuf_del(struct nouveau_pushbuf **ppush)
+{
+	struct mock_pushbuf *nvpb = (struct mock_pushbuf *)*ppush;
+	struct mock_bufctx *ctx;
+	struct mock_bufref *ref;
+	int i;
+
+	if (!nvpb)
+		return;
+
+	mock_pushbuf_unref(&nvpb->base, FALSE);
+
+	for (ctx = mock.bufctxs; ctx; ctx = ctx->next) {
+		for (ref = ctx->refs; ref; ref = ref->next) {
+			if (ref->push == &nvpb->base)
+				ref->push = NULL;
+		}
+	}
+
+	if (nvpb->prev)
+		nvpb->prev->chain = nvpb->chain;
+	else
+	if (mock.pushbufs == nvpb)
+		mock.pushbufs = nvpb->chain;
+	if (nvpb->chain)
+		nvpb->chain->prev = nvpb->prev;
+
+	for (i = 0; i < nvpb->nr; i++)
+		free(nvpb->buf[i]);
+	free(nvpb->buf);
+	free(nvpb->busy);
+	free(nvpb->rec);
+	free(nvpb);
+	*ppush = NULL;
+}
+
+/* Hands what's been written since the last submission to the "GPU" */
+static void
+mock_pushbuf_submit(struct mock_pushbuf *nvpb)
+{
+	struct nouveau_pushbuf *push = &nvpb->base;
+	struct mock_bufctx *ctx;
+	struct mock_bufref *ref;
+	size_t size;
+
+	if (push->kick_notify)
+		push->kick_notify(push);
+
+	size = push->cur - nvpb->bgn;
+	if (size && mock.record) {
+		if (nvpb->rec_nr + size > nvpb->rec_max) {
+			size_t max = (nvpb->rec_nr + size) * 2;
+			uint32_t *rec = realloc(nvpb->rec, max * 4);
+
+			if (rec) {
+				nvpb->rec = rec;
+				nvpb->rec_max = max;
+			}
+		}
+
+		if (nvpb->rec_nr + size <= nvpb->rec_max) {
+			memcpy(nvpb->rec + nvpb->rec_nr, nvpb->bgn, size * 4);
+			nvpb->rec_nr += size;
+		}
+	}
+
+	if (size) {
+		nvpb->busy[(nvpb->next + nvpb->nr - 1) % nvpb->nr] = TRUE;
+		mock.stats.dwords += size;
+		mock.stats.submits++;
+	}
+	nvpb->bgn = push->cur;
+
+	mock_pushbuf_unref(push, TRUE);
+
+	/* like libdrm, what was validated has to be again */
+	for (ctx = mock.bufctxs; ctx; ctx = ctx->next) {
+		for (ref = ctx->refs; ref; ref = ref->next) {
+			if (ref->push == push)
+				ref->push = NULL;
+		}
+	}
+}
+
+static int
+mock_pushbuf_validate(struct mock_pushbuf *nvpb, Bool retry);
+
+/* Moves on to the next push buffer, which has to wait for the GPU if it
+ * hasn't got through it since it was last submitted
+ */
+static int
+mock_pushbuf_space(struct mock_pushbuf *nvpb, uint32_t dwords)
+{
+	struct nouveau_pushbuf *push = &nvpb->base;
+	int i = nvpb->next;
+
+	if (push->cur + dwords < push->end)
+		return 0;
+
+	if (mock.fail_space) {
+		mock.fail_space--;
+		return -ENOMEM;
+	}
+
+	mock_pushbuf_submit(nvpb);
+
+	if (dwords >= (uint32_t)nvpb->words) {
+		uint32_t *buf = realloc(nvpb->buf[i], (dwords + 1) * 4);
+
+		if (!buf)
+			return -ENOMEM;
+		nvpb->buf[i] = buf;
+		nvpb->words = dwords + 1;
+	}
+
+	if (nvpb->busy[i]) {
+		mock.stats.stalls++;
+		nvpb->busy[i] = FALSE;
+	}
+
+	push->cur = nvpb->bgn = nvpb->buf[i];
+	push->end = nvpb->buf[i] + nvpb->words;
+	nvpb->next = (i + 1) % nvpb->nr;
+	return mock_pushbuf_validate(nvpb, TRUE);
+}
+
+/* Whatever in the bound buffer context hasn't been validated since the
+ * last submission is referenced, and relocations for methods emitted
+ */
+static int
+mock_pushbuf_validate(struct mock_pushbuf *nvpb, Bool retry)
+{
+	struct nouveau_pushbuf *push = &nvpb->base;
+	struct mock_bufctx *ctx = (struct mock_bufctx *)push->bufctx;
+	struct mock_bufref *ref;
+	int ret;
+
+	if (!ctx)
+		return 0;
+
+	if (!retry && push->cur + ctx->base.relocs * 2 >= push->end) {
+		ret = mock_pushbuf_space(nvpb, ctx->base.relocs * 2);
+		if (ret)
+			return ret;
+	}
+
+	for (ref = ctx->refs; ref; ref = ref->next) {
+		if (ref->push)
+			continue;
+
+		mock_pushbuf_ref(push, ref->base.bo, ref->base.flags);
+		if (ref->base.packet) {
+			*push->cur++ = ref->base.packet;
+			*push->cur++ = mock_reloc(ref->base.bo, ref->base.data,
+						  ref->base.flags,
+						  ref->base.vor,
+						  ref->base.tor);
+		}
+		ref->push = push;
+	}
+
+	return 0;
+}
+
+int
+nouveau_pushbuf_space(struct nouveau_pushbuf *push, uint32_t dwords,
+		      uint32_t relocs, uint32_t pushes)
+{
+	struct mock_pushbuf *nvpb = (struct mock_pushbuf *)push;
+
+	if (push->bufctx)
+		dwords += push->bufctx->relocs * 2;
+	return mock_pushbuf_space(nvpb, dwords);
+}
+
+int
+nouveau_pushbuf_refn(struct nouveau_pushbuf *push,
+		     struct nouveau_pushbuf_refn *refs, int nr)
+{
+	int i;
+
+	for (i = 0; i < nr; i++)
+		mock_pushbuf_ref(push, refs[i].bo, refs[i].flags);
+	return 0;
+}
+
+void
+nouveau_pushbuf_reloc(struct nouveau_pushbuf *push, struct nouveau_bo *bo,
+		      uint32_t data, uint32_t flags, uint32_t vor, uint32_t tor)
+{
+	mock_pushbuf_ref(push, bo, flags);
+	*push->cur++ = mock_reloc(bo, data, flags, vor, tor);
+}
+
+int
+nouveau_pushbuf_validate(struct nouveau_pushbuf *push)
+{
+	return mock_pushbuf_validate((struct mock_pushbuf *)push, FALSE);
+}
+
+struct nouveau_bufctx *
+nouveau_pushbuf_bufctx(struct nouveau_pushbuf *push, struct nouveau_bufctx *ctx)
+{
+	struct nouveau_bufctx *prev = push->bufctx;
+
+	push->bufctx = ctx;
+	return prev;
+}
+
+int
+nouveau_pushbuf_kick(struct nouveau_pushbuf *push, struct nouveau_object *chan)
+{
+	struct mock_pushbuf *nvpb = (struct mock_pushbuf *)push;
+
+	mock_pushbuf_submit(nvpb);
+	return mock_pushbuf_validate(nvpb, FALSE);
+}
+
+/*****************************************************************************
+ * X server
+ ****************************************************************************/
+
+ScrnInfoPtr *xf86Screens = mock.screens;
+ClientPtr serverClient;
+
+#if XORG_VERSION_CURRENT < XORG_VERSION_NUMERIC(1,9,99,1,0)
+static WindowPtr mock_windows[1];
+WindowPtr *WindowTable = mock_windows;
+#endif
+
+/* The screen's only private is the PictureScreen, at offset 0 */
+#if XORG_VERSION_CURRENT >= XORG_VERSION_NUMERIC(1,9,99,1,0)
+DevPrivateKeyRec PictureScreenPrivateKeyRec = { .initialized = TRUE };
+#else
+static int mock_picture_key;
+DevPrivateKey PictureScreenPrivateKey = &mock_picture_key;
+
+void *
+dixLookupPrivate(PrivateRec **privates, const DevPrivateKey key)
+{
+	return key == PictureScreenPrivateKey ? *(void **)*privates : NULL;
+}
+#endif
+
+static RegDataRec mock_region_empty;
+
+DamagePtr
+DamageCreate(DamageReportFunc report, DamageDestroyFunc destroy,
+	     DamageReportLevel level, Bool internal, ScreenPtr pScreen,
+	     void *closure)
+{
+	struct mock_damage *damage = calloc(1, sizeof(*damage));
+
+	if (!damage)
+		return NULL;
+
+	damage->region.data = &mock_region_empty;
+	damage->destroy = destroy;
+	damage->closure = closure;
+	damage->next = mock.damages;
+	mock.damages = damage;
+	return (DamagePtr)damage;
+}
+
+void
+DamageRegister(DrawablePtr pDrawable, DamagePtr pDamage)
+{
+	((struct mock_damage *)pDamage)->drawable = pDrawable;
+}
+
+void
+DamageUnregister(DrawablePtr pDrawable, DamagePtr pDamage)
+{
+	((struct mock_damage *)pDamage)->drawable = NULL;
+}
+
+void
+DamageDestroy(DamagePtr pDamage)
+{
+	struct mock_damage *damage = (struct mock_damage *)pDamage;
+	struct mock_damage **pnext = &mock.damages;
+
+	if (damage->destroy)
+		damage->destroy(pDamage, damage->closure);
+
+	while (*pnext != damage)
+		pnext = &(*pnext)->next;
+	*pnext = damage->next;
+	free(damage);
+}
+
+RegionPtr
+DamageRegion(DamagePtr pDamage)
+{
+	return &((struct mock_damage *)pDamage)->region;
+}
+
+void
+DamageEmpty(DamagePtr pDamage)
+{
+	struct mock_damage *damage = (struct mock_damage *)pDamage;
+
+	memset(&damage->region.extents, 0, sizeof(damage->region.extents));
+	damage->region.data = &mock_region_empty;
+}
+
+/* defined by nouveau_xv.c, which isn't linked */
+Atom xvBrightness, xvContrast, xvColorKey, xvSaturation, xvHue;
+Atom xvAutopaintColorKey, xvSetDefaults, xvDoubleBuffer, xvITURBT709;
+Atom xvSyncToVBlank;
+
+unsigned int
+nv_window_belongs_to_crtc(ScrnInfoPtr pScrn, int x, int y, int w, int h)
+{
+	return 0;
+}
+
+static void
+mock_vmsg(const char *format, va_list ap)
+{
+	if (getenv("NOUVEAU_MOCK_VERBOSE"))
+		vfprintf(stderr, format, ap);
+}
+
+void
+ErrorF(const char *format, ...)
+{
+	va_list ap;
+
+	va_start(ap, format);
+	mock_vmsg(format, ap);
+	va_end(ap);
+}
+
+void
+xf86DrvMsg(int scrnIndex, MessageType type, const char *format, ...)
+{
+	va_list ap;
+
+	va_start(ap, format);
+	mock_vmsg(format, ap);
+	va_end(ap);
+}
+
+void
+xf86DrvMsgVerb(int scrnIndex, MessageType type, int verb,
+	       const char *format, ...)
+{
+	va_list ap;
+
+	va_start(ap, format);
+	mock_vmsg(format, ap);
+	va_end(ap);
+}
+
+CARD32
+GetTimeInMillis(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+Atom
+MakeAtom(const char *string, unsigned len, Bool makeit)
+{
+	return None;
+}
+
+int
+dixChangeWindowProperty(ClientPtr client, WindowPtr pWin, Atom property,
+			Atom type, int format, int mode, unsigned long len,
+			const void *value, Bool sendevent)
+{
+	return Success;
+}
+
+#ifndef PictureTransformPoint
+Bool
+PictureTransformPoint(PictTransformPtr transform, PictVector *vector)
+{
+	return pixman_transform_point(transform, vector);
+}
+#endif
+
+const char *
+xf86GetOptValString(const OptionInfoRec *table, int token)
+{
+	return token < MOCK_MAX_OPTIONS ? mock.option[token] : NULL;
+}
+
+Bool
+xf86GetOptValInteger(const OptionInfoRec *table, int token, int *value)
+{
+	const char *s = xf86GetOptValString(table, token);
+
+	if (!s)
+		return FALSE;
+	*value = strtol(s, NULL, 0);
+	return TRUE;
+}
+
+Bool
+xf86ReturnOptValBool(const OptionInfoRec *table, int token, Bool def)
+{
+	const char *s = xf86GetOptValString(table, token);
+
+	if (!s)
+		return def;
+	return !strcmp(s, "on") || !strcmp(s, "true") || !strcmp(s, "1");
+}
+
+ExaDriverPtr
+exaDriverAlloc(void)
+{
+	return calloc(1, sizeof(ExaDriverRec));
+}
+
+Bool
+exaDriverInit(ScreenPtr pScreen, ExaDriverPtr exa)
+{
+	mock.exa = exa;
+	return TRUE;
+}
+
+void *
+exaGetPixmapDriverPrivate(PixmapPtr ppix)
+{
+	return ((struct mock_pixmap *)ppix)->priv;
+}
+
+unsigned long
+exaGetPixmapPitch(PixmapPtr ppix)
+{
+	return ppix->devKind;
+}
+
+void
+exaMarkSync(ScreenPtr pScreen)
+{
+	mock.exa->MarkSync(pScreen);
+}
+
+void
+exaMoveInPixmap(PixmapPtr ppix)
+{
+}
+
+/* EXA's CreatePixmap for EXA_MIXED_PIXMAPS, minus the system memory copy */
+static PixmapPtr
+mock_create_pixmap(ScreenPtr pScreen, int width, int height, int depth,
+		   unsigned usage_hint)
+{
+	struct mock_pixmap *mpix = calloc(1, sizeof(*mpix));
+	PixmapPtr ppix = &mpix->pixmap;
+	int bpp = depth > 16 ? 32 : depth > 8 ? 16 : depth > 1 ? 8 : 1;
+	int pitch = 0;
+
+	if (!mpix)
+		return NULL;
+
+	mpix->priv = mock.exa->CreatePixmap2(pScreen, width, height, depth,
+					     usage_hint, bpp, &pitch);
+	if (!mpix->priv) {
+		free(mpix);
+		return NULL;
+	}
+
+	ppix->drawable.type = DRAWABLE_PIXMAP;
+	ppix->drawable.pScreen = pScreen;
+	ppix->drawable.depth = depth;
+	ppix->drawable.bitsPerPixel = bpp;
+	ppix->drawable.width = width;
+	ppix->drawable.height = height;
+	ppix->devKind = pitch;
+	ppix->refcnt = 1;
+	ppix->usage_hint = usage_hint;
+	return ppix;
+}
+
+static Bool
+mock_destroy_pixmap(PixmapPtr ppix)
+{
+	struct mock_pixmap *mpix = (struct mock_pixmap *)ppix;
+
+	struct mock_damage *damage, *next;
+
+	if (--ppix->refcnt)
+		return TRUE;
+
+	/* like the damage layer, which wraps DestroyPixmap */
+	for (damage = mock.damages; damage; damage = next) {
+		next = damage->next;
+		if (damage->drawable == &ppix->drawable)
+			DamageDestroy((DamagePtr)damage);
+	}
+
+	mock.exa->DestroyPixmap(ppix->drawable.pScreen, mpix->priv);
+	free(mpix);
+	return TRUE;
+}
+
+static PixmapPtr
+mock_get_screen_pixmap(ScreenPtr pScreen)
+{
+	return mock.screen_pixmap;
+}
+
+static void
+mock_destroy_picture(PicturePtr ppict)
+{
+}
+
+/*****************************************************************************
+ * Harness
+ ****************************************************************************/
+
+void
+nouveau_mock_damage(PixmapPtr ppix, int x, int y, int w, int h)
+{
+	BoxRec box = { x, y, x + w, y + h };
+	struct mock_damage *damage;
+	BoxPtr ext;
+
+	for (damage = mock.damages; damage; damage = damage->next) {
+		if (damage->drawable != &ppix->drawable)
+			continue;
+
+		ext = &damage->region.extents;
+		if (damage->region.data) {
+			*ext = box;
+			damage->region.data = NULL;
+			continue;
+		}
+
+		ext->x1 = min(ext->x1, box.x1);
+		ext->y1 = min(ext->y1, box.y1);
+		ext->x2 = max(ext->x2, box.x2);
+		ext->y2 = max(ext->y2, box.y2);
+	}
+}
+
+void
+nouveau_mock_option(int token, const char *value)
+{
+	if (token < MOCK_MAX_OPTIONS)
+		mock.option[token] = value;
+}
+
+void
+nouveau_mock_fail_class(uint32_t oclass)
+{
+	if (mock.fail_classes < MOCK_MAX_CLASSES)
+		mock.fail_class[mock.fail_classes++] = oclass;
+}
+
+void
+nouveau_mock_fail_space(int nr)
+{
+	mock.fail_space = nr;
+}
+
+void
+nouveau_mock_clear(void)
+{
+	memset(mock.option, 0, sizeof(mock.option));
+	mock.fail_classes = 0;
+	mock.fail_space = 0;
+}
+
+/* NVPreInit(), NVScreenInit() and NVCreateScreenResources(), without the
+ * modesetting and everything else that needs a server
+ */
+ScrnInfoPtr
+nouveau_mock_screen_init(int chipset, int width, int height)
+{
+	ScreenPtr pScreen = &mock.screen;
+	ScrnInfoPtr pScrn;
+	struct nouveau_pixmap *nvpix;
+	NVPtr pNv;
+	int pitch, size, i;
+
+	pScrn = calloc(1, sizeof(*pScrn));
+	pNv = calloc(1, sizeof(*pNv));
+	if (!pScrn || !pNv)
+		goto fail;
+
+	pScrn->driverPrivate = pNv;
+	pScrn->pScreen = pScreen;
+	pScrn->virtualX = width;
+	pScrn->virtualY = height;
+	pScrn->depth = 24;
+	pScrn->bitsPerPixel = 32;
+	mock.screens[0] = pScrn;
+
+	memset(pScreen, 0, sizeof(*pScreen));
+	pScreen->CreatePixmap = mock_create_pixmap;
+	pScreen->DestroyPixmap = mock_destroy_pixmap;
+	pScreen->GetScreenPixmap = mock_get_screen_pixmap;
+
+	/* what fbPictureInit() would have done */
+	memset(&mock.picture_screen, 0, sizeof(mock.picture_screen));
+	mock.picture_screen.DestroyPicture = mock_destroy_picture;
+	mock.screen_privates[0] = &mock.picture_screen;
+	pScreen->devPrivates = (PrivateRec *)mock.screen_privates;
+
+	pNv->dev = calloc(1, sizeof(*pNv->dev));
+	pNv->client = calloc(1, sizeof(*pNv->client));
+	if (!pNv->dev || !pNv->client)
+		goto fail;
+	pNv->dev->chipset = chipset;
+	pNv->dev->vram_size = 1024 * 1024 * 1024;
+	pNv->dev->gart_size = 512 * 1024 * 1024;
+	pNv->client->device = pNv->dev;
+
+	switch (chipset & 0xf0) {
+	case 0x50:
+	case 0x80:
+	case 0x90:
+	case 0xa0:
+		pNv->Architecture = NV_ARCH_50;
+		break;
+	case 0xc0:
+	case 0xd0:
+		pNv->Architecture = NV_ARCH_C0;
+		break;
+	case 0xe0:
+		pNv->Architecture = NV_ARCH_E0;
+		break;
+	default:
+		goto fail;
+	}
+	pNv->tiled_scanout = TRUE;
+
+	if (!NVInitDma(pScrn) || !NVAccelCommonInit(pScrn))
+		goto fail;
+
+	/* NVMapMem() */
+	if (!nouveau_allocate_surface(pScrn, width, height, 32,
+				      NOUVEAU_CREATE_PIXMAP_SCANOUT,
+				      &pitch, &pNv->scanout))
+		goto fail;
+	pScrn->displayWidth = pitch / 4;
+
+	size = 16 * 1024 * 1024;
+	if (nouveau_bo_new(pNv->dev, NOUVEAU_BO_GART | NOUVEAU_BO_MAP, 0,
+			   size, NULL, &pNv->GART))
+		goto fail;
+	for (i = 0; i < NV_STAGING_SLOTS; i++) {
+		if (nouveau_bo_new(pNv->dev, NOUVEAU_BO_GART | NOUVEAU_BO_MAP,
+				   0, size / 8, NULL, &pNv->staging[i]))
+			goto fail;
+	}
+
+	if (!nouveau_exa_init(pScreen))
+		goto fail;
+
+	/* what fb's CreateScreenResources would have done */
+	mock.screen_pixmap = pScreen->CreatePixmap(pScreen, 0, 0, 24, 0);
+	if (!mock.screen_pixmap)
+		goto fail;
+	mock.screen_pixmap->drawable.width = width;
+	mock.screen_pixmap->drawable.height = height;
+	mock.screen_pixmap->drawable.bitsPerPixel = 32;
+	mock.screen_pixmap->devKind = pitch;
+	nvpix = nouveau_pixmap(mock.screen_pixmap);
+	nouveau_bo_ref(pNv->scanout, &nvpix->bo);
+
+	pScrn->vtSema = TRUE;
+	return pScrn;
+
+fail:
+	fprintf(stderr, "NV%02x: screen init failed\n", chipset);
+	exit(1);
+}
+
+/* NVCloseScreen() */
+void
+nouveau_mock_screen_fini(ScrnInfoPtr pScrn)
+{
+	NVPtr pNv = NVPTR(pScrn);
+	int i;
+
+	nouveau_mock_pixmap_destroy(mock.screen_pixmap);
+	mock.screen_pixmap = NULL;
+
+	nouveau_exa_dump_stats(pScrn);
+	nouveau_fallback_report(pScrn, TRUE);
+	nouveau_profile_fini(pScrn);
+	nouveau_gradient_fini(pScrn);
+	nouveau_slab_fini(pScrn);
+	nouveau_bo_cache_fini(pScrn);
+	NVAccelFree(pScrn);
+	NVTakedownDma(pScrn);
+
+	nouveau_bo_ref(NULL, &pNv->scanout);
+	nouveau_bo_ref(NULL, &pNv->GART);
+	for (i = 0; i < NV_STAGING_SLOTS; i++)
+		nouveau_bo_ref(NULL, &pNv->staging[i]);
+
+	nouveau_exa_fini(pScrn->pScreen);
+	free(pNv->EXADriverPtr);
+	mock.exa = NULL;
+	free(pNv->client);
+	free(pNv->dev);
+	free(pNv);
+	free(pScrn);
+	mock.screens[0] = NULL;
+}
+
+PixmapPtr
+nouveau_mock_pixmap(ScrnInfoPtr pScrn, int width, int height, int depth,
+		    int usage_hint)
+{
+	ScreenPtr pScreen = pScrn->pScreen;
+
+	return pScreen->CreatePixmap(pScreen, width, height, depth,
+				     usage_hint);
+}
+
+PixmapPtr
+nouveau_mock_screen_pixmap(ScrnInfoPtr pScrn)
+{
+	return mock.screen_pixmap;
+}
+
+void
+nouveau_mock_pixmap_destroy(PixmapPtr ppix)
+{
+	ScreenPtr pScreen = ppix->drawable.pScreen;
+
+	pScreen->DestroyPixmap(ppix);
+}
+
+PicturePtr
+nouveau_mock_picture(PixmapPtr ppix, PictFormatShort format)
+{
+	PicturePtr ppict = calloc(1, sizeof(*ppict));
+
+	if (!ppict)
+		return NULL;
+
+	ppict->pDrawable = &ppix->drawable;
+	ppict->format = format;
+	ppict->filter = PictFilterNearest;
+	return ppict;
+}
+
+PicturePtr
+nouveau_mock_solid(CARD32 color)
+{
+	PicturePtr ppict = calloc(1, sizeof(*ppict));
+
+	if (!ppict)
+		return NULL;
+
+	ppict->pSourcePict = calloc(1, sizeof(*ppict->pSourcePict));
+	if (!ppict->pSourcePict) {
+		free(ppict);
+		return NULL;
+	}
+
+	ppict->pSourcePict->type = SourcePictTypeSolidFill;
+	ppict->pSourcePict->solidFill.color = color;
+	ppict->format = PICT_a8r8g8b8;
+	ppict->filter = PictFilterNearest;
+	return ppict;
+}
+
+/* FreePicture(), which only tells the screen about drawable pictures */
+void
+nouveau_mock_picture_destroy(PicturePtr ppict)
+{
+	if (ppict->pDrawable)
+		GetPictureScreen(ppict->pDrawable->pScreen)->DestroyPicture(ppict);
+	free(ppict->pSourcePict);
+	free(ppict);
+}
+
+void
+nouveau_mock_record(Bool enable)
+{
+	mock.record = enable;
+}
+
+void
+nouveau_mock_reset(void)
+{
+	struct mock_pushbuf *nvpb;
+
+	for (nvpb = mock.pushbufs; nvpb; nvpb = nvpb->chain)
+		nvpb->rec_nr = 0;
+	memset(&mock.stats, 0, sizeof(mock.stats));
+}
+
+void
+nouveau_mock_stats(struct nouveau_mock_stats *stats)
+{
+	struct mock_pushbuf *nvpb;
+
+	*stats = mock.stats;
+	for (nvpb = mock.pushbufs; nvpb; nvpb = nvpb->chain)
+		stats->dwords += nvpb->base.cur - nvpb->bgn;
+}
+
+/* The NV04 style headers, which NV50 only has, and Fermi's own */
+int
+nouveau_mock_mthds(struct nouveau_pushbuf *push,
+		   struct nouveau_mock_mthd **mthds)
+{
+	struct mock_pushbuf *nvpb = (struct mock_pushbuf *)push;
+	Bool nvc0 = push->client->device->chipset >= 0xc0;
+	struct nouveau_mock_mthd *m;
+	uint32_t *p, *end, hdr, mthd;
+	int subc, size, incr, nr = 0;
+
+	PUSH_KICK(push);
+
+	m = *mthds = malloc(nvpb->rec_nr * sizeof(*m) + 1);
+	if (!m)
+		return 0;
+
+	for (p = nvpb->rec, end = p + nvpb->rec_nr; p < end; ) {
+		hdr = *p++;
+		subc = (hdr >> 13) & 7;
+
+		if (nvc0 && (hdr >> 29) != 0 && (hdr >> 29) != 2) {
+			mthd = (hdr & 0x1fff) << 2;
+			size = (hdr >> 16) & 0x1fff;
+			switch (hdr >> 29) {
+			case 1: incr = size; break;
+			case 3: incr = 0; break;
+			case 4:
+				m[nr].subc = subc;
+				m[nr].mthd = mthd;
+				m[nr].data = size;
+				nr++;
+				continue;
+			case 5: incr = 1; break;
+			default:
+				continue;
+			}
+		} else {
+			mthd = hdr & 0x1ffc;
+			size = (hdr >> 18) & 0x7ff;
+			incr = (hdr & 0x40000000) ? 0 : size;
+		}
+
+		for (; size && p < end; size--, p++) {
+			m[nr].subc = subc;
+			m[nr].mthd = mthd;
+			m[nr].data = *p;
+			nr++;
+			if (incr) {
+				mthd += 4;
+				incr--;
+			}
+		}
+	}
+
+	return nr;
+}
+
+/* A surface as the copy engines see it.  Tiled ones are made of blocks
+ * 64 bytes wide and 8 << (tile_mode >> 4) lines high, left to right and
+ * then down.  Within a block the lines simply follow each other, which
+ * isn't the hardware's layout but is the same for every engine.
+ */
+struct mock_surface {
+	uint64_t addr;
+	Bool linear;
+	uint32_t tile_mode;
+	uint32_t pitch;
+	uint32_t x, y; /* x in bytes, tiled only */
+};
+
+static uint8_t *
+mock_surface_byte(struct mock_surface *surf, uint32_t x, uint32_t y)
+{
+	uint32_t bh = 8 << ((surf->tile_mode >> 4) & 0xf);
+	uint64_t addr = surf->addr;
+	struct mock_bo *nvbo;
+
+	if (surf->linear) {
+		addr += (uint64_t)y * surf->pitch + x;
+	} else {
+		x += surf->x;
+		y += surf->y;
+		addr += ((uint64_t)(y / bh) * (surf->pitch / 64) + x / 64) *
+			64 * bh + (y % bh) * 64 + x % 64;
+	}
+
+	for (nvbo = mock.all; nvbo; nvbo = nvbo->link) {
+		struct nouveau_bo *bo = &nvbo->base;
+
+		if (addr < bo->offset || addr >= bo->offset + bo->size)
+			continue;
+		if (!bo->map && nouveau_bo_map(bo, 0, NULL))
+			return NULL;
+		return (uint8_t *)bo->map + (addr - bo->offset);
+	}
+
+	return NULL;
+}
+
+static int
+mock_surface_copy(struct mock_surface *src, struct mock_surface *dst,
+		  uint32_t w, uint32_t h)
+{
+	uint8_t *s, *d;
+	uint32_t x, y;
+
+	for (y = 0; y < h; y++) {
+		for (x = 0; x < w; x++) {
+			s = mock_surface_byte(src, x, y);
+			d = mock_surface_byte(dst, x, y);
+			if (!s || !d)
+				return -EFAULT;
+			*d = *s;
+		}
+	}
+
+	return 0;
+}
+
+int
+nouveau_mock_copy(struct nouveau_mock_mthd *mthds, int nr, int subc,
+		  uint32_t oclass)
+{
+#define M2MF(mthd) reg[NVC0_M2MF_##mthd / 4]
+	struct mock_surface src, dst;
+	uint32_t reg[0x400 / 4] = {};
+	int i, ret;
+
+	for (i = 0; i < nr; i++) {
+		struct nouveau_mock_mthd *m = &mthds[i];
+
+		if (m->subc != subc || m->mthd >= 0x400)
+			continue;
+		reg[m->mthd / 4] = m->data;
+		if (m->mthd != 0x0300)
+			continue;
+
+		switch (oclass) {
+		case 0x9039:
+			/* inline data isn't a copy */
+			if (m->data & NVC0_M2MF_EXEC_PUSH)
+				continue;
+			src = (struct mock_surface) {
+				.addr = (uint64_t)M2MF(OFFSET_IN_HIGH) << 32 |
+					M2MF(OFFSET_IN_LOW),
+				.linear = m->data & NVC0_M2MF_EXEC_LINEAR_IN,
+				.tile_mode = M2MF(TILING_MODE_IN),
+				.pitch = (m->data & NVC0_M2MF_EXEC_LINEAR_IN) ?
+					 M2MF(PITCH_IN) : M2MF(TILING_PITCH_IN),
+				.x = M2MF(TILING_POSITION_IN_X),
+				.y = M2MF(TILING_POSITION_IN_Y),
+			};
+			dst = (struct mock_surface) {
+				.addr = (uint64_t)M2MF(OFFSET_OUT_HIGH) << 32 |
+					M2MF(OFFSET_OUT_LOW),
+				.linear = m->data & NVC0_M2MF_EXEC_LINEAR_OUT,
+				.tile_mode = M2MF(TILING_MODE_OUT),
+				.pitch = (m->data & NVC0_M2MF_EXEC_LINEAR_OUT) ?
+					 M2MF(PITCH_OUT) :
+					 M2MF(TILING_PITCH_OUT),
+				.x = M2MF(TILING_POSITION_OUT_X),
+				.y = M2MF(TILING_POSITION_OUT_Y),
+			};
+			ret = mock_surface_copy(&src, &dst,
+						M2MF(LINE_LENGTH_IN),
+						M2MF(LINE_COUNT));
+			break;
+		case 0x90b5:
+			/* the tiling blocks at 0x200 and 0x220 are mode,
+			 * pitch, height, depth, z, x and y, then 0x30c has
+			 * both addresses, both pitches, line length and count
+			 */
+			src = (struct mock_surface) {
+				.addr = (uint64_t)reg[0x30c / 4] << 32 |
+					reg[0x310 / 4],
+				.linear = m->data & 0x00000010,
+				.tile_mode = reg[0x200 / 4],
+				.pitch = reg[0x31c / 4],
+				.x = reg[0x214 / 4], .y = reg[0x218 / 4],
+			};
+			dst = (struct mock_surface) {
+				.addr = (uint64_t)reg[0x314 / 4] << 32 |
+					reg[0x318 / 4],
+				.linear = m->data & 0x00000100,
+				.tile_mode = reg[0x220 / 4],
+				.pitch = reg[0x320 / 4],
+				.x = reg[0x234 / 4], .y = reg[0x238 / 4],
+			};
+			ret = mock_surface_copy(&src, &dst, reg[0x324 / 4],
+						reg[0x328 / 4]);
+			break;
+		default:
+			return -EINVAL;
+		}
+
+		if (ret)
+			return ret;
+	}
+
+	return 0;
+#undef M2MF
+}
+
+/* Index of the first subc/mthd at or after start, -1 if there's none */
+int
+nouveau_mock_find(struct nouveau_mock_mthd *mthds, int nr, int start,
+		  int subc, uint32_t mthd)
+{
+	int i;
+
+	for (i = start; i < nr; i++) {
+		if (mthds[i].subc == subc && mthds[i].mthd == mthd)
+			return i;
+	}
+
+	return -1;
+}
@@ -0,0 +1,92 @@
+/*
+ * Copyright 2012 Nouveau Project
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF
+ * OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef __NOUVEAU_MOCK_H__
+#define __NOUVEAU_MOCK_H__
+
+/* Runs the acceleration code outside the X server, against an in-memory
+ * stand-in for libdrm_nouveau and the few server functions it calls, see
+ * nouveau_mock.c.  Used by nouveau-bench and the method stream tests.
+ */
+
+/* One method as the GPU would see it, after decoding the push buffer */
+struct nouveau_mock_mthd {
+	int subc;
+	uint32_t mthd;
+	uint32_t data;
+};
+
+struct nouveau_mock_stats {
+	uint64_t dwords;   /* written to push buffers, submitted or not */
+	unsigned submits;  /* push buffers handed to the "GPU" */
+	unsigned stalls;   /* CPU waits for work that hadn't completed */
+	unsigned waits;    /* nouveau_bo_wait()s that had to kick first */
+	unsigned domains;  /* bos referenced outside their domain, -EINVAL */
+};
+
+/* Bring-up and teardown of an accelerated screen on chipset, in the same
+ * order NVScreenInit() does it.  Options and classes that can't be
+ * created are set beforehand, and stay set until nouveau_mock_clear().
+ * nouveau_mock_fail_space() refuses the next nr requests for push buffer
+ * space that need a new buffer.
+ */
+void nouveau_mock_option(int token, const char *value);
+void nouveau_mock_fail_class(uint32_t oclass);
+void nouveau_mock_fail_space(int nr);
+void nouveau_mock_clear(void);
+ScrnInfoPtr nouveau_mock_screen_init(int chipset, int width, int height);
+void nouveau_mock_screen_fini(ScrnInfoPtr pScrn);
+
+PixmapPtr nouveau_mock_pixmap(ScrnInfoPtr pScrn, int width, int height,
+			      int depth, int usage_hint);
+PixmapPtr nouveau_mock_screen_pixmap(ScrnInfoPtr pScrn);
+void nouveau_mock_pixmap_destroy(PixmapPtr ppix);
+PicturePtr nouveau_mock_picture(PixmapPtr ppix, PictFormatShort format);
+PicturePtr nouveau_mock_solid(CARD32 color);
+void nouveau_mock_picture_destroy(PicturePtr ppict);
+
+/* Rendering to ppix, reported to the Damages registered on it the way the
+ * server's damage layer would before carrying it out
+ */
+void nouveau_mock_damage(PixmapPtr ppix, int x, int y, int w, int h);
+
+/* What the GPU has been sent on push.  Recording is off until enabled,
+ * the stats are always kept.  nouveau_mock_mthds() submits anything not
+ * yet submitted first, and returns how many methods went to *mthds since
+ * the last nouveau_mock_reset(), which the caller frees.
+ */
+void nouveau_mock_record(Bool enable);
+void nouveau_mock_reset(void);
+int nouveau_mock_mthds(struct nouveau_pushbuf *push,
+		       struct nouveau_mock_mthd **mthds);
+int nouveau_mock_find(struct nouveau_mock_mthd *mthds, int nr, int start,
+		      int subc, uint32_t mthd);
+void nouveau_mock_stats(struct nouveau_mock_stats *stats);
+
+/* Carries out the copies in mthds that went to oclass, 0x9039 (M2MF) or
+ * 0x90b5 (PCOPY), on subc.  What's copied is read from and written to the
+ * buffer objects' memory.  Returns -EFAULT if an address isn't in one.
+ */
+int nouveau_mock_copy(struct nouveau_mock_mthd *mthds, int nr, int subc,
+		      uint32_t oclass);
+
+#endif
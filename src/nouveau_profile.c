@@ -0,0 +1,296 @@
+/*
+ * Copyright 2012 Nouveau Project
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF
+ * OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "nv_include.h"
+
+/* Option "GPUProfile": each operation between nouveau_profile_begin() and
+ * nouveau_profile_end() is bracketed by a pair of 3D engine query reports,
+ * which hold the GPU's timestamp once the commands before them have gone
+ * through PGRAPH.  Reports land in a ring of slots in a GART buffer, and
+ * are picked up from the block handler without waiting for the GPU.
+ *
+ * Only the outermost operation is timed, so the copy done for a DRI2 swap
+ * counts as a swap and not as an EXA copy.  The CPU time between begin and
+ * end is kept too, which tells what the driver spent building the commands
+ * apart from what the GPU spent running them.
+ */
+#define PROFILE_PAIRS   512
+#define PROFILE_BUCKETS 16  /* powers of two in microseconds */
+
+struct profile_report {
+	uint32_t sequence;
+	uint32_t value;
+	uint64_t timestamp; /* nanoseconds */
+};
+
+struct profile_pair {
+	int kind;
+	uint32_t sequence;
+	uint64_t cpu_nsecs;
+};
+
+struct profile_stats {
+	unsigned ops;
+	uint64_t gpu_nsecs;
+	uint64_t gpu_max;
+	uint64_t cpu_nsecs;
+	unsigned hist[PROFILE_BUCKETS];
+};
+
+struct nouveau_profile {
+	struct nouveau_bo *bo; /* a begin and an end report per pair */
+	Bool (*report)(NVPtr, struct nouveau_bo *, uint32_t offset,
+		       uint32_t sequence);
+
+	int depth;
+	int kind;  /* being timed, 0 if the begin report was lost */
+	uint64_t start;
+	uint32_t sequence;
+
+	struct profile_pair pairs[PROFILE_PAIRS];
+	unsigned head; /* next pair to use */
+	unsigned tail; /* oldest pair still in flight */
+	unsigned dropped;
+
+	struct profile_stats stats[NV_PROFILE_KINDS];
+};
+
+static const char *profile_kind_names[NV_PROFILE_KINDS] = {
+	[NV_CAPTURE_OP_SOLID]     = "Solid",
+	[NV_CAPTURE_OP_COPY]      = "Copy",
+	[NV_CAPTURE_OP_COMPOSITE] = "Composite",
+	[NV_CAPTURE_OP_UPLOAD]    = "UploadToScreen",
+	[NV_CAPTURE_OP_DOWNLOAD]  = "DownloadFromScreen",
+	[NV_PROFILE_M2MF]         = "M2MF",
+	[NV_PROFILE_XV]           = "Xv",
+	[NV_PROFILE_SWAP]         = "DRI2 swap",
+};
+
+static void
+profile_collect(struct nouveau_profile *prof)
+{
+	volatile struct profile_report *report = prof->bo->map;
+	struct profile_pair *pair;
+	struct profile_stats *stats;
+	uint64_t nsecs, usecs;
+	int slot, bucket;
+
+	while (prof->tail != prof->head) {
+		slot = prof->tail % PROFILE_PAIRS;
+		pair = &prof->pairs[slot];
+
+		/* reports land in order, if this one's not there yet, none
+		 * of the later ones are either
+		 */
+		if (report[slot * 2 + 1].sequence != pair->sequence)
+			break;
+
+		nsecs = report[slot * 2 + 1].timestamp -
+			report[slot * 2].timestamp;
+		usecs = nsecs / 1000;
+		if (usecs >= 1 << (PROFILE_BUCKETS - 2))
+			bucket = PROFILE_BUCKETS - 1;
+		else
+			bucket = usecs ? log2i(usecs) + 1 : 0;
+
+		stats = &prof->stats[pair->kind];
+		stats->ops++;
+		stats->gpu_nsecs += nsecs;
+		if (nsecs > stats->gpu_max)
+			stats->gpu_max = nsecs;
+		stats->cpu_nsecs += pair->cpu_nsecs;
+		stats->hist[bucket]++;
+		prof->tail++;
+	}
+}
+
+void
+nouveau_profile_begin(NVPtr pNv, int kind)
+{
+	struct nouveau_profile *prof = pNv->profile;
+	int slot;
+
+	if (!prof || prof->depth++)
+		return;
+
+	prof->kind = 0;
+	if (prof->head - prof->tail == PROFILE_PAIRS) {
+		profile_collect(prof);
+		if (prof->head - prof->tail == PROFILE_PAIRS) {
+			prof->dropped++;
+			return;
+		}
+	}
+
+	if (!++prof->sequence)
+		prof->sequence = 1;
+
+	slot = prof->head % PROFILE_PAIRS;
+	if (!prof->report(pNv, prof->bo,
+			  slot * 2 * sizeof(struct profile_report),
+			  prof->sequence))
+		return;
+
+	prof->kind = kind;
+	prof->start = nouveau_time_nsec();
+}
+
+/* done is FALSE if the operation was abandoned, it isn't counted and its
+ * pair is used again by the next one
+ */
+void
+nouveau_profile_end(NVPtr pNv, Bool done)
+{
+	struct nouveau_profile *prof = pNv->profile;
+	struct profile_pair *pair;
+	int slot;
+
+	if (!prof || --prof->depth || !prof->kind)
+		return;
+
+	slot = prof->head % PROFILE_PAIRS;
+	pair = &prof->pairs[slot];
+	pair->kind = prof->kind;
+	pair->sequence = prof->sequence;
+	pair->cpu_nsecs = nouveau_time_nsec() - prof->start;
+	prof->kind = 0;
+
+	if (!done ||
+	    !prof->report(pNv, prof->bo,
+			  (slot * 2 + 1) * sizeof(struct profile_report),
+			  prof->sequence))
+		return;
+
+	prof->head++;
+}
+
+/* Called from the block handler */
+void
+nouveau_profile_collect(ScrnInfoPtr pScrn)
+{
+	NVPtr pNv = NVPTR(pScrn);
+
+	if (pNv->profile)
+		profile_collect(pNv->profile);
+}
+
+void
+nouveau_profile_init(ScrnInfoPtr pScrn)
+{
+	NVPtr pNv = NVPTR(pScrn);
+	struct nouveau_profile *prof;
+	uint32_t size = PROFILE_PAIRS * 2 * sizeof(struct profile_report);
+
+	if (!xf86ReturnOptValBool(pNv->Options, OPTION_GPU_PROFILE, FALSE))
+		return;
+
+	if (pNv->Architecture < NV_ARCH_50) {
+		xf86DrvMsg(pScrn->scrnIndex, X_WARNING,
+			   "GPUProfile isn't supported on this chipset\n");
+		return;
+	}
+
+	prof = calloc(1, sizeof(*prof));
+	if (!prof)
+		return;
+
+	if (nouveau_bo_new(pNv->dev, NOUVEAU_BO_GART | NOUVEAU_BO_MAP, 0,
+			   size, NULL, &prof->bo) ||
+	    nouveau_bo_map(prof->bo, NOUVEAU_BO_RDWR, pNv->client)) {
+		xf86DrvMsg(pScrn->scrnIndex, X_ERROR,
+			   "Couldn't allocate GPU profiling buffer\n");
+		nouveau_bo_ref(NULL, &prof->bo);
+		free(prof);
+		return;
+	}
+	memset(prof->bo->map, 0, size);
+
+	if (pNv->Architecture >= NV_ARCH_C0)
+		prof->report = NVC0EXAQueryTimestamp;
+	else
+		prof->report = NV50EXAQueryTimestamp;
+
+	pNv->profile = prof;
+	xf86DrvMsg(pScrn->scrnIndex, X_CONFIG,
+		   "Profiling GPU time of accelerated operations\n");
+}
+
+static void
+profile_dump(ScrnInfoPtr pScrn, int kind, struct profile_stats *stats)
+{
+	char hist[PROFILE_BUCKETS * 24], *pos = hist;
+	int i;
+
+	for (i = 0; i < PROFILE_BUCKETS; i++) {
+		if (!stats->hist[i])
+			continue;
+
+		if (i == PROFILE_BUCKETS - 1) {
+			pos += sprintf(pos, " >=%uus %u",
+				       1 << (PROFILE_BUCKETS - 2),
+				       stats->hist[i]);
+		} else {
+			pos += sprintf(pos, " <%uus %u", 1 << i,
+				       stats->hist[i]);
+		}
+	}
+
+	xf86DrvMsg(pScrn->scrnIndex, X_INFO,
+		   "GPU profile %s: %u ops, %llu us/op on the GPU (max %llu), "
+		   "%llu us/op on the CPU\n", profile_kind_names[kind],
+		   stats->ops,
+		   (unsigned long long)(stats->gpu_nsecs / stats->ops / 1000),
+		   (unsigned long long)(stats->gpu_max / 1000),
+		   (unsigned long long)(stats->cpu_nsecs / stats->ops / 1000));
+	xf86DrvMsg(pScrn->scrnIndex, X_INFO,
+		   "GPU profile %s:%s\n", profile_kind_names[kind], hist);
+}
+
+void
+nouveau_profile_fini(ScrnInfoPtr pScrn)
+{
+	NVPtr pNv = NVPTR(pScrn);
+	struct nouveau_profile *prof = pNv->profile;
+	int i;
+
+	if (!prof)
+		return;
+
+	PUSH_KICK(pNv->pushbuf);
+	nouveau_bo_wait(prof->bo, NOUVEAU_BO_RD, pNv->client);
+	profile_collect(prof);
+
+	for (i = 0; i < NV_PROFILE_KINDS; i++) {
+		if (prof->stats[i].ops)
+			profile_dump(pScrn, i, &prof->stats[i]);
+	}
+
+	if (prof->dropped) {
+		xf86DrvMsg(pScrn->scrnIndex, X_INFO,
+			   "GPU profile: %u ops not timed, too many were "
+			   "in flight\n", prof->dropped);
+	}
+
+	nouveau_bo_ref(NULL, &prof->bo);
+	free(prof);
+	pNv->profile = NULL;
+}
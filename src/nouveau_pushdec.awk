@@ -0,0 +1,99 @@
+# Builds nouveau-pushdec's class and method tables from the rnndb headers
+# in hwdefs/.  Every define that isn't a bitfield, an enum value or a
+# domain is taken to be a method.  Values of a method are named after it,
+# so anything prefixed with the last method's name is skipped unless it
+# looks like the next method along.
+
+function hex(s,    i, c, v) {
+	v = 0
+	s = tolower(s)
+	sub(/^0x/, "", s)
+	for (i = 1; i <= length(s); i++) {
+		c = index("0123456789abcdef", substr(s, i, 1))
+		if (!c)
+			break
+		v = v * 16 + c - 1
+	}
+	return v
+}
+
+function method(name, base, stride) {
+	if (last != "" && index(name, last "_") == 1 &&
+	    (base % 4 || base <= last_base || base > last_base + 64))
+		return
+	if (base >= 16384)
+		return
+
+	last = name
+	last_base = base
+	mthds[nr_mthds] = name
+	mthd_base[nr_mthds] = base
+	mthd_stride[nr_mthds] = stride
+	nr_mthds++
+}
+
+FNR == 1 {
+	last = ""
+	domain = ""
+}
+
+!/^#define / {
+	next
+}
+
+$2 ~ /__/ {
+	name = $2
+	if (name ~ /__SIZE$/) {
+		sub(/__SIZE$/, "", name)
+		domain = name
+	} else
+	if (name ~ /__LEN$/) {
+		sub(/__LEN$/, "", name)
+		mthd_len[name] = $3
+	}
+	next
+}
+
+$2 ~ /_CLASS$/ && $3 ~ /^0x/ {
+	name = $2
+	sub(/_CLASS$/, "", name)
+	classes[nr_classes++] = sprintf("\t{ %s, \"%s\" },", $3, name)
+	next
+}
+
+$2 ~ /^NV[0-9A-F][0-9A-F]_[A-Z0-9_]+\(i0/ {
+	line = $0
+	name = $2
+	sub(/\(.*/, "", name)
+	sub(/^[^(]*\([^)]*\)[ \t]*\(/, "", line)
+	split(line, parts, /[ \t]*\+[ \t]*/)
+	stride = parts[2]
+	sub(/\*.*/, "", stride)
+	method(name, hex(parts[1]), hex(stride))
+	next
+}
+
+$2 ~ /^NV[0-9A-F][0-9A-F]_[A-Z0-9_]+$/ && $3 ~ /^0x/ {
+	if ($2 == domain)
+		next
+	method($2, hex($3), 0)
+}
+
+END {
+	print "/* generated by nouveau_pushdec.awk, do not edit */"
+	print ""
+	print "static const struct pushdec_class pushdec_classes[] = {"
+	for (i = 0; i < nr_classes; i++)
+		print classes[i]
+	print "};"
+	print ""
+	print "static const struct pushdec_mthd pushdec_mthds[] = {"
+	for (i = 0; i < nr_mthds; i++) {
+		len = mthd_stride[i] ? mthd_len[mthds[i]] : ""
+		if (len == "")
+			len = mthd_stride[i] ? 1 : 0
+		printf("\t{ \"%s\", 0x%04x, 0x%x, %s },\n", mthds[i],
+		       mthd_base[i], mthd_stride[i], len)
+	}
+	print "};"
+}
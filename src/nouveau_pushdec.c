@@ -0,0 +1,734 @@
+/*
+ * Copyright 2012 Nouveau Project
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF
+ * OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/* nouveau-pushdec: decodes the traces written with Option
+ * "PushBufferCapture", naming methods from the hwdefs headers, and
+ * summarises where the dwords went.
+ *
+ *   nouveau-pushdec [-v] [-n count] trace
+ *
+ * -v dumps every method as well, -n sets how many of the most frequent
+ * methods are listed for each class and in the redundant state report.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+
+#include "nouveau_capture.h"
+
+typedef int Bool;
+#define TRUE  1
+#define FALSE 0
+
+struct pushdec_class {
+	uint32_t oclass;
+	const char *name;
+};
+
+struct pushdec_mthd {
+	const char *name;
+	uint32_t base;
+	uint32_t stride;
+	uint32_t len;
+};
+
+#include "nouveau_pushdec_mthds.h"
+
+#define ARRAY_SIZE(a)  (sizeof(a) / sizeof((a)[0]))
+#define PUSHDEC_MTHDS  (0x4000 / 4)
+#define PUSHDEC_SUBC   8
+
+/* A class seen bound to a subchannel, with what was sent to it */
+struct pushdec_obj {
+	uint32_t oclass;
+	const char *name;
+	int gen;    /* from the NVxx prefix of the name, -1 if unknown */
+	int family; /* pre-NV50, NV50 or NVC0 */
+	const char *obj; /* name after the NVxx_ */
+	int names[PUSHDEC_MTHDS]; /* index into pushdec_mthds + 1, -1 none */
+	unsigned long long count[PUSHDEC_MTHDS];
+	unsigned long long redundant[PUSHDEC_MTHDS];
+	unsigned long long dwords;
+	struct pushdec_obj *next;
+};
+
+struct pushdec_subc {
+	struct pushdec_obj *obj;
+	uint32_t valid[PUSHDEC_MTHDS / 32];
+	uint32_t data[PUSHDEC_MTHDS];
+};
+
+static const char *pushdec_op_names[NV_CAPTURE_OPS] = {
+	[0]                       = "(none)",
+	[NV_CAPTURE_OP_SOLID]     = "Solid",
+	[NV_CAPTURE_OP_COPY]      = "Copy",
+	[NV_CAPTURE_OP_COMPOSITE] = "Composite",
+	[NV_CAPTURE_OP_UPLOAD]    = "Upload",
+	[NV_CAPTURE_OP_DOWNLOAD]  = "Download",
+};
+
+static struct {
+	int verbose;
+	int top;
+	uint32_t chipset;
+
+	struct nv_capture_object *objects;
+	int nr_objects;
+	struct pushdec_obj *classes;
+	struct pushdec_subc subc[PUSHDEC_SUBC];
+
+	unsigned pushes, wraps, gaps;
+	unsigned long long dwords, bos, relocs, unknown;
+	unsigned long long op_count[NV_CAPTURE_OPS];
+	unsigned long long op_dwords[NV_CAPTURE_OPS];
+} dec;
+
+static void *
+xcalloc(size_t nr, size_t size)
+{
+	void *ptr = calloc(nr, size);
+
+	if (!ptr) {
+		fprintf(stderr, "nouveau-pushdec: out of memory\n");
+		exit(1);
+	}
+	return ptr;
+}
+
+/* NVxx_ prefix of a name, as a number */
+static int
+pushdec_gen(const char *name)
+{
+	char hex[3];
+
+	if (strncmp(name, "NV", 2) || !name[2] || !name[3] || name[4] != '_')
+		return -1;
+	hex[0] = name[2];
+	hex[1] = name[3];
+	hex[2] = 0;
+	return strtol(hex, NULL, 16);
+}
+
+static int
+pushdec_family(int gen)
+{
+	if (gen < 0x50)
+		return 0;
+	if (gen < 0xc0)
+		return 1;
+	return 2;
+}
+
+static struct pushdec_obj *
+pushdec_class(uint32_t oclass)
+{
+	struct pushdec_obj *obj;
+	char *name;
+	size_t i;
+
+	for (obj = dec.classes; obj; obj = obj->next) {
+		if (obj->oclass == oclass)
+			return obj;
+	}
+
+	obj = xcalloc(1, sizeof(*obj));
+	obj->oclass = oclass;
+	for (i = 0; i < ARRAY_SIZE(pushdec_classes); i++) {
+		if (pushdec_classes[i].oclass == oclass) {
+			obj->name = pushdec_classes[i].name;
+			break;
+		}
+	}
+
+	if (!obj->name) {
+		name = xcalloc(1, 16);
+		snprintf(name, 16, "0x%04x", oclass);
+		obj->name = name;
+	}
+
+	obj->gen = pushdec_gen(obj->name);
+	obj->family = pushdec_family(obj->gen);
+	obj->obj = obj->gen >= 0 ? obj->name + 5 : obj->name;
+	obj->next = dec.classes;
+	dec.classes = obj;
+	return obj;
+}
+
+static Bool
+pushdec_mthd_match(const struct pushdec_mthd *m, uint32_t mthd)
+{
+	uint32_t len = m->len ? m->len : 1;
+
+	if (!m->stride)
+		return m->base == mthd;
+	return mthd >= m->base && mthd < m->base + m->stride * len &&
+	       !((mthd - m->base) % m->stride);
+}
+
+/* Find the entry naming mthd for a class.  Methods are listed under the
+ * generation that introduced them, so the newest one that's no newer than
+ * the class wins, otherwise the methods common to every class are tried.
+ */
+static int
+pushdec_lookup(struct pushdec_obj *obj, uint32_t mthd)
+{
+	const struct pushdec_mthd *m;
+	size_t i, len = strlen(obj->obj);
+	int gen, best = -1, best_gen = -1;
+
+	for (i = 0; i < ARRAY_SIZE(pushdec_mthds); i++) {
+		m = &pushdec_mthds[i];
+		gen = pushdec_gen(m->name);
+		if (gen < 0 || gen > obj->gen || gen <= best_gen ||
+		    pushdec_family(gen) != obj->family ||
+		    strncmp(m->name + 5, obj->obj, len) || m->name[5 + len] != '_')
+			continue;
+		if (pushdec_mthd_match(m, mthd)) {
+			best = i;
+			best_gen = gen;
+		}
+	}
+
+	if (best >= 0)
+		return best;
+
+	for (i = 0; i < ARRAY_SIZE(pushdec_mthds); i++) {
+		m = &pushdec_mthds[i];
+		gen = pushdec_gen(m->name);
+		if (gen < 0 || gen > obj->gen || gen <= best_gen ||
+		    (strncmp(m->name + 5, "SUBCHAN_", 8) &&
+		     strncmp(m->name + 5, "GRAPH_", 6)))
+			continue;
+		if (pushdec_mthd_match(m, mthd)) {
+			best = i;
+			best_gen = gen;
+		}
+	}
+
+	return best;
+}
+
+static const char *
+pushdec_mthd_name(struct pushdec_obj *obj, uint32_t mthd)
+{
+	static char name[128];
+	const struct pushdec_mthd *m;
+	int *idx = &obj->names[mthd / 4];
+	int len = strlen(obj->obj);
+	const char *base;
+
+	if (!*idx) {
+		*idx = pushdec_lookup(obj, mthd) + 1;
+		if (!*idx)
+			*idx = -1;
+	}
+
+	if (mthd == 0) {
+		snprintf(name, sizeof(name), "OBJECT");
+	} else
+	if (*idx < 0) {
+		snprintf(name, sizeof(name), "0x%04x", mthd);
+	} else {
+		/* drop the class from the name, leave SUBCHAN_ and GRAPH_ */
+		m = &pushdec_mthds[*idx - 1];
+		base = m->name + 5;
+		if (!strncmp(base, obj->obj, len) && base[len] == '_')
+			base += len + 1;
+
+		if (m->stride) {
+			snprintf(name, sizeof(name), "%s(%u)", base,
+				 (mthd - m->base) / m->stride);
+		} else {
+			snprintf(name, sizeof(name), "%s", base);
+		}
+	}
+
+	return name;
+}
+
+static void
+pushdec_bind(struct pushdec_subc *subc, uint32_t data)
+{
+	uint32_t oclass = data;
+	int i;
+
+	/* NV04-style channels bind by handle, NVC0 by class */
+	for (i = 0; i < dec.nr_objects; i++) {
+		if (dec.objects[i].handle == data) {
+			oclass = dec.objects[i].oclass;
+			break;
+		}
+	}
+
+	subc->obj = pushdec_class(oclass);
+	memset(subc->valid, 0, sizeof(subc->valid));
+}
+
+/* One dword sent to a method.  Only incrementing writes are checked for
+ * redundancy, non-incrementing ones are streams of data.
+ */
+static void
+pushdec_method(int s, uint32_t mthd, uint32_t data, Bool state,
+	       const char *reloc)
+{
+	struct pushdec_subc *subc = &dec.subc[s];
+	struct pushdec_obj *obj;
+	uint32_t i = mthd / 4;
+
+	if (mthd == 0)
+		pushdec_bind(subc, data);
+	if (!subc->obj)
+		subc->obj = pushdec_class(0);
+	obj = subc->obj;
+
+	obj->count[i]++;
+	obj->dwords++;
+
+	if (state && mthd) {
+		if ((subc->valid[i / 32] & (1 << (i % 32))) &&
+		    subc->data[i] == data)
+			obj->redundant[i]++;
+		subc->valid[i / 32] |= 1 << (i % 32);
+		subc->data[i] = data;
+	}
+
+	if (dec.verbose) {
+		printf("    %d:%s.%s = 0x%08x%s\n", s, obj->name,
+		       pushdec_mthd_name(obj, mthd), data, reloc);
+	}
+}
+
+static const char *
+pushdec_reloc(const struct nv_capture_bo *bos, int nr_bos, uint32_t dword)
+{
+	static char desc[64];
+	int i;
+
+	if (!dec.verbose)
+		return "";
+
+	for (i = 0; i < nr_bos; i++) {
+		if (bos[i].reloc == dword) {
+			snprintf(desc, sizeof(desc), " (bo %u + 0x%llx)",
+				 bos[i].handle, (unsigned long long)
+				 bos[i].offset);
+			return desc;
+		}
+	}
+
+	return "";
+}
+
+static void
+pushdec_push(const uint32_t *push, uint32_t nr,
+	     const struct nv_capture_op *ops, int nr_ops,
+	     const struct nv_capture_bo *bos, int nr_bos)
+{
+	uint32_t hdr, size, subc, mthd, mode, i = 0, j;
+	int op = 0, next = 0;
+
+	while (i < nr) {
+		/* commands belong to the EXA op marked before them */
+		while (next < nr_ops && ops[next].dword <= i) {
+			op = ops[next++].op;
+			if (op >= NV_CAPTURE_OPS)
+				op = 0;
+		}
+
+		hdr = push[i++];
+		if (dec.chipset >= 0xc0) {
+			mode = hdr >> 29;
+			size = (hdr >> 16) & 0x1fff;
+			subc = (hdr >> 13) & 7;
+			mthd = (hdr & 0xfff) << 2;
+		} else {
+			if ((hdr & 0xa0000003))
+				mode = 0;
+			else
+				mode = (hdr & 0x40000000) ? 3 : 1;
+			size = (hdr >> 18) & 0x7ff;
+			subc = (hdr >> 13) & 7;
+			mthd = hdr & 0x1ffc;
+		}
+
+		if (mode == 4) {
+			pushdec_method(subc, mthd, size, TRUE, "");
+			dec.op_dwords[op]++;
+			continue;
+		}
+
+		if ((mode != 1 && mode != 3 && mode != 5) || i + size > nr) {
+			if (dec.verbose)
+				printf("    unknown 0x%08x\n", hdr);
+			dec.unknown++;
+			dec.op_dwords[op]++;
+			continue;
+		}
+
+		for (j = 0; j < size; j++, i++) {
+			pushdec_method(subc, mthd, push[i], mode == 1 ||
+				       (mode == 5 && !j),
+				       pushdec_reloc(bos, nr_bos, i));
+			if (mode == 1 || (mode == 5 && !j))
+				mthd += 4;
+		}
+		dec.op_dwords[op] += size + 1;
+	}
+}
+
+static Bool
+pushdec_read(const char *path, char **pdata, size_t *psize)
+{
+	FILE *file = fopen(path, "rb");
+	size_t size = 0, max = 0, ret;
+	char *data = NULL;
+
+	if (!file) {
+		fprintf(stderr, "nouveau-pushdec: %s: %s\n", path,
+			strerror(errno));
+		return FALSE;
+	}
+
+	do {
+		if (size == max) {
+			max = max ? max * 2 : 1 << 20;
+			data = realloc(data, max);
+			if (!data) {
+				fprintf(stderr, "nouveau-pushdec: out of "
+					"memory\n");
+				fclose(file);
+				return FALSE;
+			}
+		}
+		ret = fread(data + size, 1, max - size, file);
+		size += ret;
+	} while (ret);
+
+	fclose(file);
+	*pdata = data;
+	*psize = size;
+	return TRUE;
+}
+
+/* Calls fn for each record, stops at the first truncated one */
+static void
+pushdec_records(const char *data, size_t size,
+		void (*fn)(const struct nv_capture_record *, const char *))
+{
+	struct nv_capture_record rec;
+	size_t pos = sizeof(struct nv_capture_header);
+
+	while (pos + sizeof(rec) <= size) {
+		memcpy(&rec, data + pos, sizeof(rec));
+		pos += sizeof(rec);
+		if (rec.size > size - pos) {
+			fprintf(stderr, "nouveau-pushdec: trace truncated\n");
+			return;
+		}
+		fn(&rec, data + pos);
+		pos += rec.size;
+	}
+}
+
+static void
+pushdec_object(const struct nv_capture_record *rec, const char *payload)
+{
+	struct nv_capture_object *obj;
+
+	if (rec->type != NV_CAPTURE_OBJECT || rec->size < sizeof(*obj))
+		return;
+
+	dec.objects = realloc(dec.objects, (dec.nr_objects + 1) *
+			      sizeof(*dec.objects));
+	if (!dec.objects) {
+		fprintf(stderr, "nouveau-pushdec: out of memory\n");
+		exit(1);
+	}
+	memcpy(&dec.objects[dec.nr_objects++], payload, sizeof(*obj));
+}
+
+static void
+pushdec_record(const struct nv_capture_record *rec, const char *payload)
+{
+	static struct nv_capture_bo *bos;
+	static struct nv_capture_op *ops;
+	static int nr_bos, max_bos, nr_ops, max_ops;
+	static unsigned long long first_usec;
+	struct nv_capture_push push;
+	uint32_t *dwords;
+	int i;
+
+	if (!first_usec)
+		first_usec = rec->usec;
+
+	switch (rec->type) {
+	case NV_CAPTURE_BO:
+		if (nr_bos == max_bos) {
+			max_bos = max_bos ? max_bos * 2 : 64;
+			bos = realloc(bos, max_bos * sizeof(*bos));
+			if (!bos)
+				exit(1);
+		}
+		memcpy(&bos[nr_bos++], payload, sizeof(*bos));
+		break;
+	case NV_CAPTURE_OP:
+		if (nr_ops == max_ops) {
+			max_ops = max_ops ? max_ops * 2 : 64;
+			ops = realloc(ops, max_ops * sizeof(*ops));
+			if (!ops)
+				exit(1);
+		}
+		memcpy(&ops[nr_ops++], payload, sizeof(*ops));
+		break;
+	case NV_CAPTURE_PUSH:
+		memcpy(&push, payload, sizeof(push));
+		if (push.nr > (rec->size - sizeof(push)) / 4)
+			break;
+
+		dwords = xcalloc(push.nr + 1, 4);
+		memcpy(dwords, payload + sizeof(push), push.nr * 4);
+
+		if (dec.verbose) {
+			printf("push %u at %.6fs, %u dwords%s\n", dec.pushes,
+			       (rec->usec - first_usec) / 1000000.0, push.nr,
+			       push.wrap ? ", wrapped" : "");
+			for (i = 0; i < nr_bos; i++) {
+				printf("  bo %u, 0x%llx bytes at 0x%llx, "
+				       "flags 0x%x\n", bos[i].handle,
+				       (unsigned long long)bos[i].size,
+				       (unsigned long long)bos[i].offset,
+				       bos[i].flags);
+			}
+		}
+
+		for (i = 0; i < nr_bos; i++) {
+			if (bos[i].reloc != NV_CAPTURE_NO_RELOC)
+				dec.relocs++;
+		}
+		for (i = 0; i < nr_ops; i++) {
+			if (ops[i].op < NV_CAPTURE_OPS)
+				dec.op_count[ops[i].op]++;
+		}
+
+		pushdec_push(dwords, push.nr, ops, nr_ops, bos, nr_bos);
+		free(dwords);
+
+		dec.pushes++;
+		dec.wraps += !!push.wrap;
+		dec.dwords += push.nr;
+		dec.bos += nr_bos;
+		nr_bos = nr_ops = 0;
+		break;
+	case NV_CAPTURE_GAP:
+		if (dec.verbose)
+			printf("gap\n");
+		/* whatever state was set up went by unseen */
+		for (i = 0; i < PUSHDEC_SUBC; i++)
+			memset(dec.subc[i].valid, 0, sizeof(dec.subc[i].valid));
+		dec.gaps++;
+		nr_bos = nr_ops = 0;
+		break;
+	default:
+		break;
+	}
+}
+
+struct pushdec_entry {
+	struct pushdec_obj *obj;
+	uint32_t mthd;
+	unsigned long long count;
+};
+
+static int
+pushdec_entry_cmp(const void *a, const void *b)
+{
+	const struct pushdec_entry *ea = a, *eb = b;
+
+	if (ea->count != eb->count)
+		return ea->count < eb->count ? 1 : -1;
+	return ea->mthd < eb->mthd ? -1 : ea->mthd > eb->mthd;
+}
+
+static void
+pushdec_report_classes(void)
+{
+	struct pushdec_entry *entries = xcalloc(PUSHDEC_MTHDS,
+						sizeof(*entries));
+	struct pushdec_obj *obj;
+	int i, nr;
+
+	printf("\nMethods by class:\n");
+	for (obj = dec.classes; obj; obj = obj->next) {
+		if (!obj->dwords)
+			continue;
+
+		nr = 0;
+		for (i = 0; i < PUSHDEC_MTHDS; i++) {
+			if (!obj->count[i])
+				continue;
+			entries[nr].obj = obj;
+			entries[nr].mthd = i * 4;
+			entries[nr].count = obj->count[i];
+			nr++;
+		}
+		qsort(entries, nr, sizeof(*entries), pushdec_entry_cmp);
+
+		printf("  %s (0x%04x): %llu dwords, %d methods\n", obj->name,
+		       obj->oclass, obj->dwords, nr);
+		for (i = 0; i < nr && i < dec.top; i++) {
+			printf("    %10llu  %s\n", entries[i].count,
+			       pushdec_mthd_name(obj, entries[i].mthd));
+		}
+	}
+
+	free(entries);
+}
+
+static void
+pushdec_report_ops(void)
+{
+	int i;
+
+	printf("\nDwords by EXA operation:\n");
+	printf("  %-10s %10s %12s %10s\n", "", "count", "dwords", "average");
+	for (i = 0; i < NV_CAPTURE_OPS; i++) {
+		if (!dec.op_count[i] && !dec.op_dwords[i])
+			continue;
+		printf("  %-10s %10llu %12llu %10.1f\n", pushdec_op_names[i],
+		       dec.op_count[i], dec.op_dwords[i], dec.op_count[i] ?
+		       (double)dec.op_dwords[i] / dec.op_count[i] : 0.0);
+	}
+}
+
+static void
+pushdec_report_redundant(void)
+{
+	struct pushdec_entry *entries = NULL;
+	unsigned long long total = 0;
+	struct pushdec_obj *obj;
+	int i, nr = 0, max = 0;
+
+	for (obj = dec.classes; obj; obj = obj->next) {
+		for (i = 0; i < PUSHDEC_MTHDS; i++) {
+			if (!obj->redundant[i])
+				continue;
+			if (nr == max) {
+				max = max ? max * 2 : 256;
+				entries = realloc(entries,
+						  max * sizeof(*entries));
+				if (!entries)
+					exit(1);
+			}
+			entries[nr].obj = obj;
+			entries[nr].mthd = i * 4;
+			entries[nr].count = obj->redundant[i];
+			total += obj->redundant[i];
+			nr++;
+		}
+	}
+	qsort(entries, nr, sizeof(*entries), pushdec_entry_cmp);
+
+	printf("\nRedundant state, %llu writes of the value already set "
+	       "(%.1f%% of dwords):\n", total, dec.dwords ?
+	       total * 100.0 / dec.dwords : 0.0);
+	for (i = 0; i < nr && i < dec.top; i++) {
+		printf("    %10llu  %s.%s\n", entries[i].count,
+		       entries[i].obj->name,
+		       pushdec_mthd_name(entries[i].obj, entries[i].mthd));
+	}
+
+	free(entries);
+}
+
+static void
+usage(void)
+{
+	fprintf(stderr, "usage: nouveau-pushdec [-v] [-n count] trace\n");
+	exit(2);
+}
+
+int
+main(int argc, char **argv)
+{
+	struct nv_capture_header hdr;
+	size_t size;
+	char *data;
+	int c;
+
+	dec.top = 20;
+	while ((c = getopt(argc, argv, "vn:")) != -1) {
+		switch (c) {
+		case 'v':
+			dec.verbose = TRUE;
+			break;
+		case 'n':
+			dec.top = atoi(optarg);
+			break;
+		default:
+			usage();
+		}
+	}
+
+	if (optind + 1 != argc)
+		usage();
+
+	if (!pushdec_read(argv[optind], &data, &size))
+		return 1;
+
+	if (size < sizeof(hdr)) {
+		fprintf(stderr, "nouveau-pushdec: %s: not a trace\n",
+			argv[optind]);
+		return 1;
+	}
+
+	memcpy(&hdr, data, sizeof(hdr));
+	if (hdr.magic != NV_CAPTURE_MAGIC) {
+		fprintf(stderr, "nouveau-pushdec: %s: not a trace\n",
+			argv[optind]);
+		return 1;
+	}
+
+	if (hdr.version != NV_CAPTURE_VERSION) {
+		fprintf(stderr, "nouveau-pushdec: %s: version %u, expected "
+			"%u\n", argv[optind], hdr.version, NV_CAPTURE_VERSION);
+		return 1;
+	}
+
+	dec.chipset = hdr.chipset;
+	pushdec_records(data, size, pushdec_object);
+	pushdec_records(data, size, pushdec_record);
+
+	printf("%sTrace of NV%02X: %u submissions (%u wrapped), %u lost, "
+	       "%llu dwords, %llu buffers, %llu relocations, %llu unknown "
+	       "commands\n", dec.verbose ? "\n" : "", hdr.chipset,
+	       dec.pushes, dec.wraps, dec.gaps, dec.dwords, dec.bos,
+	       dec.relocs, dec.unknown);
+	pushdec_report_classes();
+	pushdec_report_ops();
+	pushdec_report_redundant();
+
+	free(data);
+	return 0;
+}
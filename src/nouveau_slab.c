@@ -0,0 +1,295 @@
+/*
+ * Copyright 2012 Nouveau Project
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF
+ * OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "nv_include.h"
+
+/* Tiny pixmaps (glyphs, 1x1 solid sources, small masks) are packed into
+ * shared BOs instead of getting one each, which saves a kernel object per
+ * pixmap and lets a batch of glyph composites validate a handful of BOs
+ * rather than one per glyph.
+ *
+ * Only done on NV50 and up, where the emit paths take the pixmap's offset
+ * into account.  Slabs are tiled with the smallest tile mode, a surface
+ * can start anywhere in them that's aligned to a tile, and every slot is.
+ */
+#define SLAB_SIZE    (64 * 1024)
+#define SLAB_MIN     512 /* 64 bytes by 8 lines, one NVC0 tile */
+#define SLAB_CLASSES 6   /* 512 bytes to 16KiB */
+#define SLAB_MAX     (SLAB_MIN << (SLAB_CLASSES - 1))
+
+struct nouveau_slab {
+	struct nouveau_slab *next;
+	struct nouveau_bo *bo;
+	int slot_size;
+	int nr_slots;
+	int nr_free;
+	uint32_t used[SLAB_SIZE / SLAB_MIN / 32];
+};
+
+struct nouveau_slab_heap {
+	struct nouveau_slab *slabs[SLAB_CLASSES];
+	union nouveau_bo_config cfg;
+	int tile_height;
+	int max_dim;
+
+	unsigned pixmaps;
+	unsigned slabs_allocated;
+};
+
+static int
+slab_class(uint32_t size)
+{
+	int c = 0;
+
+	while ((SLAB_MIN << c) < size)
+		c++;
+	return c;
+}
+
+static struct nouveau_slab *
+slab_new(ScrnInfoPtr pScrn, struct nouveau_slab_heap *heap, int c)
+{
+	NVPtr pNv = NVPTR(pScrn);
+	struct nouveau_slab *slab;
+
+	slab = calloc(1, sizeof(*slab));
+	if (!slab)
+		return NULL;
+
+	if (nouveau_bo_new(pNv->dev, NOUVEAU_BO_VRAM | NOUVEAU_BO_MAP, 0,
+			   SLAB_SIZE, &heap->cfg, &slab->bo)) {
+		free(slab);
+		return NULL;
+	}
+
+	slab->slot_size = SLAB_MIN << c;
+	slab->nr_slots = SLAB_SIZE / slab->slot_size;
+	slab->nr_free = slab->nr_slots;
+	slab->next = heap->slabs[c];
+	heap->slabs[c] = slab;
+	heap->slabs_allocated++;
+	return slab;
+}
+
+static int
+slab_get_slot(struct nouveau_slab *slab)
+{
+	int i;
+
+	for (i = 0; i < slab->nr_slots; i++) {
+		if (!(slab->used[i / 32] & (1 << (i % 32)))) {
+			slab->used[i / 32] |= (1 << (i % 32));
+			slab->nr_free--;
+			return i;
+		}
+	}
+
+	return -1;
+}
+
+/* Place a pixmap in a slab if it's small enough, fills in its surface,
+ * bo and offset.  Returns FALSE if the pixmap needs a bo of its own.
+ */
+Bool
+nouveau_slab_new(ScrnInfoPtr pScrn, struct nouveau_pixmap *nvpix,
+		 int width, int height, int bpp, int usage_hint)
+{
+	NVPtr pNv = NVPTR(pScrn);
+	struct nouveau_slab_heap *heap = pNv->slab_heap;
+	struct nouveau_surface *surf = &nvpix->surf;
+	struct nouveau_slab *slab;
+	int c, slot;
+
+	if (!heap || bpp < 8 || width > heap->max_dim ||
+	    height > heap->max_dim)
+		return FALSE;
+
+	/* nothing that might end up shared or scanned out */
+	if (usage_hint && usage_hint != CREATE_PIXMAP_USAGE_SCRATCH &&
+	    usage_hint != CREATE_PIXMAP_USAGE_GLYPH_PICTURE)
+		return FALSE;
+
+	surf->flags = NOUVEAU_BO_VRAM | NOUVEAU_BO_MAP;
+	surf->pitch = NOUVEAU_ALIGN(width * (bpp / 8), 64);
+	surf->height = NOUVEAU_ALIGN(height, heap->tile_height);
+	surf->cfg = heap->cfg;
+	if (surf->pitch * surf->height > SLAB_MAX)
+		return FALSE;
+
+	c = slab_class(surf->pitch * surf->height);
+	for (slab = heap->slabs[c]; slab; slab = slab->next) {
+		if (slab->nr_free)
+			break;
+	}
+
+	if (!slab && !(slab = slab_new(pScrn, heap, c)))
+		return FALSE;
+
+	slot = slab_get_slot(slab);
+	nouveau_bo_ref(slab->bo, &nvpix->bo);
+	nvpix->offset = slot * slab->slot_size;
+	nvpix->slab = slab;
+	heap->pixmaps++;
+	return TRUE;
+}
+
+void
+nouveau_slab_put(ScrnInfoPtr pScrn, struct nouveau_pixmap *nvpix)
+{
+	NVPtr pNv = NVPTR(pScrn);
+	struct nouveau_slab_heap *heap = pNv->slab_heap;
+	struct nouveau_slab *slab = nvpix->slab, **pslab;
+	int slot = nvpix->offset / slab->slot_size;
+	int c = slab_class(slab->slot_size);
+
+	slab->used[slot / 32] &= ~(1 << (slot % 32));
+	slab->nr_free++;
+	nouveau_bo_ref(NULL, &nvpix->bo);
+	nvpix->slab = NULL;
+	nvpix->offset = 0;
+
+	if (slab->nr_free != slab->nr_slots)
+		return;
+
+	/* orphaned by nouveau_slab_fini() */
+	if (!heap) {
+		nouveau_bo_ref(NULL, &slab->bo);
+		free(slab);
+		return;
+	}
+
+	/* keep a single empty slab around per class */
+	for (pslab = &heap->slabs[c]; *pslab; pslab = &(*pslab)->next) {
+		if (*pslab != slab && (*pslab)->nr_free == (*pslab)->nr_slots)
+			break;
+	}
+
+	if (*pslab) {
+		for (pslab = &heap->slabs[c]; *pslab != slab;
+		     pslab = &(*pslab)->next);
+		*pslab = slab->next;
+		nouveau_bo_ref(NULL, &slab->bo);
+		free(slab);
+	}
+}
+
+/* Move a pixmap out of its slab into a bo of its own, for when the bo
+ * has to be handed to someone else.
+ */
+Bool
+nouveau_slab_detach(ScrnInfoPtr pScrn, struct nouveau_pixmap *nvpix)
+{
+	NVPtr pNv = NVPTR(pScrn);
+	struct nouveau_surface *surf = &nvpix->surf;
+	struct nouveau_bo *bo = NULL;
+
+	if (!nvpix->slab)
+		return TRUE;
+
+	if (nouveau_bo_new(pNv->dev, surf->flags, 0, surf->pitch * surf->height,
+			   &surf->cfg, &bo))
+		return FALSE;
+
+	if (!NVAccelM2MF(pNv, surf->pitch / 4, surf->height, 4,
+			 nvpix->offset, 0,
+			 nvpix->bo, NOUVEAU_BO_VRAM, surf->pitch, surf->height,
+			 0, 0,
+			 bo, NOUVEAU_BO_VRAM, surf->pitch, surf->height, 0, 0)) {
+		nouveau_bo_ref(NULL, &bo);
+		return FALSE;
+	}
+	PUSH_KICK(pNv->pushbuf);
+
+	nouveau_slab_put(pScrn, nvpix);
+	nvpix->bo = bo;
+	nouveau_exa_pixmap_moved(pNv);
+	nvpix->gpu_write = pNv->exa_seq;
+	nouveau_vram_track(pScrn, nvpix);
+	return TRUE;
+}
+
+void
+nouveau_slab_init(ScrnInfoPtr pScrn)
+{
+	NVPtr pNv = NVPTR(pScrn);
+	struct nouveau_slab_heap *heap;
+	int max_dim = 64;
+
+	if (pNv->Architecture < NV_ARCH_50)
+		return;
+
+	if (xf86GetOptValInteger(pNv->Options, OPTION_SLAB_PIXMAP_SIZE,
+				 &max_dim))
+		xf86DrvMsg(pScrn->scrnIndex, X_CONFIG,
+			   "Sharing storage between pixmaps up to %dx%d\n",
+			   max_dim, max_dim);
+	if (max_dim <= 0)
+		return;
+
+	heap = calloc(1, sizeof(*heap));
+	if (!heap)
+		return;
+
+	if (pNv->Architecture >= NV_ARCH_C0) {
+		heap->cfg.nvc0.memtype = 0xfe;
+		heap->cfg.nvc0.tile_mode = 0x000;
+		heap->tile_height = NVC0_TILE_HEIGHT(0x000);
+	} else {
+		heap->cfg.nv50.memtype = 0x070;
+		heap->cfg.nv50.tile_mode = 0x000;
+		heap->tile_height = NV50_TILE_HEIGHT(0x000);
+	}
+	heap->max_dim = max_dim;
+	pNv->slab_heap = heap;
+}
+
+void
+nouveau_slab_fini(ScrnInfoPtr pScrn)
+{
+	NVPtr pNv = NVPTR(pScrn);
+	struct nouveau_slab_heap *heap = pNv->slab_heap;
+	struct nouveau_slab *slab;
+	int i;
+
+	if (!heap)
+		return;
+
+	xf86DrvMsgVerb(pScrn->scrnIndex, X_INFO, 3,
+		       "Pixmap slabs: %u pixmaps in %u slabs\n",
+		       heap->pixmaps, heap->slabs_allocated);
+
+	/* pixmaps can outlive us, slabs they're still in get freed once
+	 * the last of them is destroyed
+	 */
+	for (i = 0; i < SLAB_CLASSES; i++) {
+		while ((slab = heap->slabs[i])) {
+			heap->slabs[i] = slab->next;
+			if (slab->nr_free == slab->nr_slots) {
+				nouveau_bo_ref(NULL, &slab->bo);
+				free(slab);
+			}
+		}
+	}
+
+	free(heap);
+	pNv->slab_heap = NULL;
+}
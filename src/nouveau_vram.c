@@ -0,0 +1,285 @@
+/*
+ * Copyright 2012 Nouveau Project
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF
+ * OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "nv_include.h"
+
+/* Pixmaps in VRAM are kept within a budget.  When a new one doesn't fit,
+ * the least recently used pixmaps are moved out to linear GART storage,
+ * where the CPU can still get at them directly, and moved back in the next
+ * time the GPU is asked to touch them.  Pixmaps that can't be made to fit
+ * at all are left to EXA to keep in system memory.
+ */
+
+static inline uint32_t
+vram_size(struct nouveau_surface *surf)
+{
+	return surf->pitch * surf->height;
+}
+
+static inline Bool
+vram_tracked(struct nouveau_pixmap *nvpix)
+{
+	return nvpix->surf.pitch && (nvpix->surf.flags & NOUVEAU_BO_VRAM) &&
+	       !nvpix->slab;
+}
+
+/* Same size and pitch as the VRAM layout, so the pixmap's devKind stays
+ * valid while it's out in GART, but never tiled.
+ */
+static void
+vram_gart_surface(struct nouveau_surface *vram, struct nouveau_surface *surf)
+{
+	memset(surf, 0, sizeof(*surf));
+	surf->flags = NOUVEAU_BO_GART | NOUVEAU_BO_MAP;
+	surf->pitch = vram->pitch;
+	surf->height = vram->height;
+}
+
+static void
+vram_lru_unlink(NVPtr pNv, struct nouveau_pixmap *nvpix)
+{
+	if (nvpix->lru_prev)
+		nvpix->lru_prev->lru_next = nvpix->lru_next;
+	else
+		pNv->vram_lru_head = nvpix->lru_next;
+	if (nvpix->lru_next)
+		nvpix->lru_next->lru_prev = nvpix->lru_prev;
+	else
+		pNv->vram_lru_tail = nvpix->lru_prev;
+	nvpix->lru_prev = nvpix->lru_next = NULL;
+}
+
+static void
+vram_lru_link(NVPtr pNv, struct nouveau_pixmap *nvpix)
+{
+	nvpix->lru_prev = NULL;
+	nvpix->lru_next = pNv->vram_lru_head;
+	if (pNv->vram_lru_head)
+		pNv->vram_lru_head->lru_prev = nvpix;
+	else
+		pNv->vram_lru_tail = nvpix;
+	pNv->vram_lru_head = nvpix;
+}
+
+/* Copies the whole of one bo to the other, detiling or tiling on the way
+ * as necessary.  The pitch is a multiple of 64 bytes, so moving it as
+ * 32bpp works whatever the pixmap's real format is.
+ */
+static Bool
+vram_copy(NVPtr pNv, struct nouveau_surface *surf,
+	  struct nouveau_bo *src, int sd, struct nouveau_bo *dst, int dd)
+{
+	if (!NVAccelM2MF(pNv, surf->pitch / 4, surf->height, 4, 0, 0,
+			 src, sd, surf->pitch, surf->height, 0, 0,
+			 dst, dd, surf->pitch, surf->height, 0, 0))
+		return FALSE;
+
+	PUSH_KICK(pNv->pushbuf);
+	return TRUE;
+}
+
+static Bool
+vram_demote(ScrnInfoPtr pScrn, struct nouveau_pixmap *nvpix)
+{
+	NVPtr pNv = NVPTR(pScrn);
+	struct nouveau_surface surf;
+	struct nouveau_bo *bo = NULL;
+
+	vram_gart_surface(&nvpix->surf, &surf);
+	if (!nouveau_bo_cache_new(pScrn, &surf, &bo))
+		return FALSE;
+
+	if (!vram_copy(pNv, &nvpix->surf, nvpix->bo, NOUVEAU_BO_VRAM,
+		       bo, NOUVEAU_BO_GART)) {
+		nouveau_bo_cache_put(pScrn, &surf, &bo);
+		return FALSE;
+	}
+
+	/* the point is to give the VRAM back, don't cache it */
+	nouveau_bo_ref(bo, &nvpix->bo);
+	nouveau_bo_ref(NULL, &bo);
+	nouveau_exa_pixmap_moved(pNv);
+	nvpix->demoted = TRUE;
+	nvpix->gpu_write = pNv->exa_seq;
+
+	vram_lru_unlink(pNv, nvpix);
+	pNv->vram_used -= vram_size(&nvpix->surf);
+	pNv->vram_demotions++;
+	return TRUE;
+}
+
+/* Demote cold pixmaps until size more bytes fit in the budget.  Anything
+ * used by the current EXA batch, prepared for CPU access or shared with
+ * another process stays where it is.  Before NV50, 2D surfaces are only
+ * reached through the VRAM DMA object, so nothing can be demoted there.
+ */
+static Bool
+vram_reserve(ScrnInfoPtr pScrn, uint32_t size)
+{
+	NVPtr pNv = NVPTR(pScrn);
+	struct nouveau_pixmap *nvpix = pNv->vram_lru_tail, *prev;
+
+	if (pNv->Architecture < NV_ARCH_50)
+		nvpix = NULL;
+
+	while (pNv->vram_used + size > pNv->vram_budget && nvpix) {
+		prev = nvpix->lru_prev;
+		if (nvpix->lru_seq != pNv->exa_seq && !nvpix->prepared &&
+		    !nvpix->shared && !nvpix->shadow)
+			vram_demote(pScrn, nvpix);
+		nvpix = prev;
+	}
+
+	return pNv->vram_used + size <= pNv->vram_budget;
+}
+
+static Bool
+vram_promote(ScrnInfoPtr pScrn, struct nouveau_pixmap *nvpix)
+{
+	NVPtr pNv = NVPTR(pScrn);
+	struct nouveau_surface surf;
+	struct nouveau_bo *bo = NULL;
+
+	if (!vram_reserve(pScrn, vram_size(&nvpix->surf)) &&
+	    !pNv->exa_force_cp)
+		return FALSE;
+
+	if (!nouveau_bo_cache_new(pScrn, &nvpix->surf, &bo))
+		return FALSE;
+
+	if (!vram_copy(pNv, &nvpix->surf, nvpix->bo, NOUVEAU_BO_GART,
+		       bo, NOUVEAU_BO_VRAM)) {
+		nouveau_bo_cache_put(pScrn, &nvpix->surf, &bo);
+		return FALSE;
+	}
+
+	vram_gart_surface(&nvpix->surf, &surf);
+	nouveau_bo_cache_put(pScrn, &surf, &nvpix->bo);
+	nvpix->bo = bo;
+	nouveau_exa_pixmap_moved(pNv);
+	nvpix->demoted = FALSE;
+	nvpix->gpu_read = 0;
+	nvpix->gpu_write = pNv->exa_seq;
+
+	vram_lru_link(pNv, nvpix);
+	pNv->vram_used += vram_size(&nvpix->surf);
+	pNv->vram_promotions++;
+	return TRUE;
+}
+
+/* Allocate storage for a pixmap whose surface has been laid out already.
+ * Fails if it doesn't fit in VRAM even after demoting everything we can,
+ * unless force is set.
+ */
+Bool
+nouveau_vram_alloc(ScrnInfoPtr pScrn, struct nouveau_pixmap *nvpix,
+		   Bool force)
+{
+	if (!vram_tracked(nvpix))
+		return nouveau_bo_cache_new(pScrn, &nvpix->surf, &nvpix->bo);
+
+	if (!vram_reserve(pScrn, vram_size(&nvpix->surf)) && !force)
+		return FALSE;
+
+	if (!nouveau_bo_cache_new(pScrn, &nvpix->surf, &nvpix->bo))
+		return FALSE;
+
+	nouveau_vram_track(pScrn, nvpix);
+	return TRUE;
+}
+
+/* Start accounting for a pixmap that's been given VRAM storage */
+void
+nouveau_vram_track(ScrnInfoPtr pScrn, struct nouveau_pixmap *nvpix)
+{
+	NVPtr pNv = NVPTR(pScrn);
+
+	nvpix->lru_seq = pNv->exa_seq;
+	vram_lru_link(pNv, nvpix);
+	pNv->vram_used += vram_size(&nvpix->surf);
+}
+
+void
+nouveau_vram_free(ScrnInfoPtr pScrn, struct nouveau_pixmap *nvpix)
+{
+	NVPtr pNv = NVPTR(pScrn);
+	struct nouveau_surface surf;
+
+	if (nvpix->shared) {
+		nouveau_bo_ref(NULL, &nvpix->bo);
+	} else
+	if (nvpix->demoted) {
+		vram_gart_surface(&nvpix->surf, &surf);
+		nouveau_bo_cache_put(pScrn, &surf, &nvpix->bo);
+	} else {
+		nouveau_bo_cache_put(pScrn, &nvpix->surf, &nvpix->bo);
+	}
+
+	if (vram_tracked(nvpix) && !nvpix->demoted) {
+		vram_lru_unlink(pNv, nvpix);
+		pNv->vram_used -= vram_size(&nvpix->surf);
+	}
+}
+
+/* The GPU is about to use the pixmap, bring it back into VRAM if it was
+ * demoted and mark it as recently used.  That can fail, leaving it in GART
+ * for this operation, so the bo is always referenced in the domain given
+ * by nouveau_pixmap_domain().
+ */
+void
+nouveau_vram_touch(ScrnInfoPtr pScrn, struct nouveau_pixmap *nvpix)
+{
+	NVPtr pNv = NVPTR(pScrn);
+
+	if (!vram_tracked(nvpix) || nvpix->shared || nvpix->prepared)
+		return;
+
+	nvpix->lru_seq = pNv->exa_seq;
+	if (nvpix->demoted) {
+		vram_promote(pScrn, nvpix);
+		return;
+	}
+
+	if (pNv->vram_lru_head != nvpix) {
+		vram_lru_unlink(pNv, nvpix);
+		vram_lru_link(pNv, nvpix);
+	}
+}
+
+void
+nouveau_vram_init(ScrnInfoPtr pScrn)
+{
+	NVPtr pNv = NVPTR(pScrn);
+	uint64_t budget = pNv->dev->vram_size / 4 * 3;
+
+	/* leave room for the scanout, cursors, and whatever else */
+	if (pNv->scanout && pNv->scanout->size < budget)
+		budget -= pNv->scanout->size;
+
+	pNv->vram_budget = budget;
+	pNv->vram_used = 0;
+	pNv->vram_lru_head = pNv->vram_lru_tail = NULL;
+
+	xf86DrvMsgVerb(pScrn->scrnIndex, X_INFO, 3,
+		       "Pixmap VRAM budget: %lluKiB\n",
+		       (unsigned long long)(budget >> 10));
+}
@@ -170,7 +170,11 @@ nouveau_wfb_setup_wrap(ReadMemoryProcPtr *pRead, WriteMemoryProcPtr *pWrite,
 
 	wfb->ppix = ppix;
 	wfb->base = (unsigned long)ppix->devPrivate.ptr;
-	wfb->end = wfb->base + bo->size;
+	if (nouveau_pixmap(ppix)->slab)
+		wfb->end = wfb->base + nouveau_pixmap(ppix)->surf.pitch *
+				       nouveau_pixmap(ppix)->surf.height;
+	else
+		wfb->end = wfb->base + bo->size;
 	if (!nv50_style_tiled_pixmap(ppix)) {
 		wfb->pitch = 0;
 	} else {
@@ -1210,10 +1210,12 @@ CPU_copy:
 		/* Ensure pixmap is in offscreen memory */
 		pNv->exa_force_cp = TRUE;
 		exaMoveInPixmap(ppix);
+		nouveau_exa_pixmap_touch(ppix);
 		pNv->exa_force_cp = FALSE;
 
 		if (!exaGetPixmapDriverPrivate(ppix))
 			return BadAlloc;
+		nouveau_exa_pixmap_gpu_access(ppix, NOUVEAU_BO_WR);
 
 #ifdef COMPOSITE
 		/* Convert screen coords to pixmap coords */
@@ -1248,6 +1250,7 @@ CPU_copy:
 	if (action_flags & USE_TEXTURE) {
 		int ret = BadImplementation;
 
+		nouveau_profile_begin(pNv, NV_PROFILE_XV);
 		if (pNv->Architecture == NV_ARCH_30) {
 			ret = NV30PutTextureImage(pScrn, pPriv->video_mem,
 						  offset, uv_offset,
@@ -1279,6 +1282,7 @@ CPU_copy:
 						src_w, src_h, drw_w, drw_h,
 						clipBoxes, ppix, pPriv);
 		}
+		nouveau_profile_end(pNv, ret == Success);
 
 		if (ret != Success)
 			return ret;
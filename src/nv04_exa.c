@@ -133,6 +133,7 @@ NV04EXAPrepareSolid(PixmapPtr ppix, int alu, Pixel planemask, Pixel fg)
 		return FALSE;
 	}
 
+	nouveau_exa_pixmap_gpu_access(ppix, NOUVEAU_BO_WR);
 	pNv->fg_colour = fg;
 	return TRUE;
 }
@@ -154,8 +155,7 @@ NV04EXASolid (PixmapPtr pPixmap, int x, int y, int x2, int y2)
 	BEGIN_NV04(push, NV04_RECT(UNCLIPPED_RECTANGLE_POINT(0)), 2);
 	PUSH_DATA (push, (x << 16) | y);
 	PUSH_DATA (push, (w << 16) | h);
-	if ((w * h) >= 512)
-		PUSH_KICK(push);
+	NVDmaQueued(push, w * h);
 }
 
 void
@@ -204,6 +204,8 @@ NV04EXAPrepareCopy(PixmapPtr pspix, PixmapPtr pdpix, int dx, int dy,
 		return FALSE;
 	}
 
+	nouveau_exa_pixmap_gpu_access(pspix, NOUVEAU_BO_RD);
+	nouveau_exa_pixmap_gpu_access(pdpix, NOUVEAU_BO_WR);
 	pNv->pspix = pspix;
 	pNv->pmpix = NULL;
 	pNv->pdpix = pdpix;
@@ -220,7 +222,7 @@ NV04EXACopy(PixmapPtr pdpix, int srcX, int srcY, int dstX, int dstY,
 	int split_dstY = NOUVEAU_ALIGN(dstY + 1, 64);
 	int split_height = split_dstY - dstY;
 
-	if (nouveau_pushbuf_space(push, 16, 1, 0))
+	if (!PUSH_SPACE_RELOC(push, 16, 1))
 		return;
 
 	if ((width * height) >= 200000 && pNv->pspix != pNv->pdpix &&
@@ -263,8 +265,7 @@ NV04EXACopy(PixmapPtr pdpix, int srcX, int srcY, int dstX, int dstY,
 	PUSH_DATA (push, (dstY << 16) | dstX);
 	PUSH_DATA (push, (height  << 16) | width);
 
-	if ((width * height) >= 512)
-		PUSH_KICK(push);
+	NVDmaQueued(push, width * height);
 }
 
 void
@@ -279,7 +280,6 @@ NV04EXAUploadIFC(ScrnInfoPtr pScrn, const char *src, int src_pitch,
 		 PixmapPtr pdpix, int x, int y, int w, int h, int cpp)
 {
 	NVPtr pNv = NVPTR(pScrn);
-	ScreenPtr pScreen = pdpix->drawable.pScreen;
 	struct nouveau_bo *bo = nouveau_pixmap_bo(pdpix);
 	struct nouveau_pushbuf *push = pNv->pushbuf;
 	int line_len = w * cpp;
@@ -375,8 +375,7 @@ NV04EXAUploadIFC(ScrnInfoPtr pScrn, const char *src, int src_pitch,
 	ret = TRUE;
 out:
 	nouveau_pushbuf_bufctx(push, NULL);
-	if (pdpix == pScreen->GetScreenPixmap(pScreen))
-		PUSH_KICK(push);
+	NVDmaQueued(push, w * h);
 	return ret;
 }
 
@@ -403,8 +402,8 @@ NV04EXARectM2MF(NVPtr pNv, int w, int h, int cpp,
 			line_count = 2047;
 		h -= line_count;
 
-		if (nouveau_pushbuf_space(push, 16, 4, 0) ||
-		    nouveau_pushbuf_refn (push, refs, 2))
+		if (!PUSH_SPACE_RELOC(push, 16, 4) ||
+		    PUSH_REFS(push, refs, 2))
 			return FALSE;
 
 		BEGIN_NV04(push, NV03_M2MF(DMA_BUFFER_IN), 2);
@@ -199,176 +199,27 @@ check_pict_op(int op)
 	return op < PictOpSaturate;
 }
 
-#if 0
-static void
-print_fallback_info(char *reason, int op, PicturePtr src, PicturePtr mask,
-		    PicturePtr dst)
-{
-	char out2[4096];
-	char *out = out2;
-
-	sprintf(out, "%s  ", reason);
-	out += strlen(out);
-
-	switch (op) {
-	case PictOpClear:
-		sprintf(out, "PictOpClear ");
-		break;
-	case PictOpSrc:
-		sprintf(out, "PictOpSrc ");
-		break;
-	case PictOpDst:
-		sprintf(out, "PictOpDst ");
-		break;
-	case PictOpOver:
-		sprintf(out, "PictOpOver ");
-		break;
-	case PictOpOutReverse:
-		sprintf(out, "PictOpOutReverse ");
-		break;
-	case PictOpAdd:
-		sprintf(out, "PictOpAdd ");
-		break;
-	default:
-		sprintf(out, "PictOp%d ", op);
-	}
-	out += strlen(out);
-
-	switch (src->format) {
-	case PICT_a8r8g8b8:
-		sprintf(out, "A8R8G8B8 ");
-		break;
-	case PICT_x8r8g8b8:
-		sprintf(out, "X8R8G8B8 ");
-		break;
-	case PICT_x8b8g8r8:
-		sprintf(out, "X8B8G8R8 ");
-		break;
-	case PICT_r5g6b5:
-		sprintf(out, "R5G6B5 ");
-		break;
-	case PICT_a8:
-		sprintf(out, "A8 ");
-		break;
-	case PICT_a1:
-		sprintf(out, "A1 ");
-		break;
-	default:
-		sprintf(out, "%x ", src->format);
-	}
-	out += strlen(out);
-
-	sprintf(out, "(%dx%d) ", src->pDrawable->width,
-		src->pDrawable->height);
-	if (src->repeat != RepeatNone)
-		strcat(out, "R ");
-	strcat(out, "-> ");
-	out += strlen(out);
-
-	switch (dst->format) {
-	case PICT_a8r8g8b8:
-		sprintf(out, "A8R8G8B8 ");
-		break;
-	case PICT_x8r8g8b8:
-		sprintf(out, "X8R8G8B8  ");
-		break;
-	case PICT_x8b8g8r8:
-		sprintf(out, "X8B8G8R8  ");
-		break;
-	case PICT_r5g6b5:
-		sprintf(out, "R5G6B5 ");
-		break;
-	case PICT_a8:
-		sprintf(out, "A8  ");
-		break;
-	case PICT_a1:
-		sprintf(out, "A1  ");
-		break;
-	default:
-		sprintf(out, "%x  ", dst->format);
-	}
-	out += strlen(out);
-
-	sprintf(out, "(%dx%d) ", dst->pDrawable->width,
-		dst->pDrawable->height);
-	if (dst->repeat != RepeatNone)
-		strcat(out, "R ");
-	out += strlen(out);
-
-	if (!mask)
-		sprintf(out, "& NONE");
-	else {
-		switch (mask->format) {
-		case PICT_a8r8g8b8:
-			sprintf(out, "& A8R8G8B8 ");
-			break;
-		case PICT_x8r8g8b8:
-			sprintf(out, "& X8R8G8B8  ");
-			break;
-		case PICT_x8b8g8r8:
-			sprintf(out, "& X8B8G8R8  ");
-			break;
-		case PICT_a8:
-			sprintf(out, "& A8  ");
-			break;
-		case PICT_a1:
-			sprintf(out, "& A1  ");
-			break;
-		default:
-			sprintf(out, "& %x  ", mask->format);
-		}
-		out += strlen(out);
-
-		sprintf(out, "(%dx%d) ", mask->pDrawable->width,
-			mask->pDrawable->height);
-		if (mask->repeat != RepeatNone)
-			strcat(out, "R ");
-		if (mask->componentAlpha)
-			strcat(out, "C ");
-		out += strlen(out);
-	}
-	strcat(out, "\n");
-
-	xf86DrvMsg(0, X_INFO, "%s", out2);
-}
-#else
-#define print_fallback_info(...)
-#endif
-
 Bool
 NV10EXACheckComposite(int op, PicturePtr src, PicturePtr mask, PicturePtr dst)
 {
-	if (!check_pict_op(op)) {
-		print_fallback_info("pictop", op, src, mask, dst);
-		return FALSE;
-	}
+	if (!check_pict_op(op))
+		NOUVEAU_FALLBACK("unsupported blend op 0x%x\n", op);
 
-	if (!check_render_target(dst)) {
-		print_fallback_info("dst", op, src, mask, dst);
-		return FALSE;
-	}
+	if (!check_render_target(dst))
+		NOUVEAU_FALLBACK("dst picture\n");
 
-	if (!check_texture(src)) {
-		print_fallback_info("src", op, src, mask, dst);
-		return FALSE;
-	}
+	if (!check_texture(src))
+		NOUVEAU_FALLBACK("src picture\n");
 
 	if (mask) {
-		if (!check_texture(mask)) {
-			print_fallback_info("mask", op, src,
-					    mask, dst);
-			return FALSE;
-		}
+		if (!check_texture(mask))
+			NOUVEAU_FALLBACK("mask picture\n");
 
 		if (effective_component_alpha(mask) &&
-		    needs_src(op) && needs_src_alpha(op)) {
-			print_fallback_info("ca-mask", op, src,
-					    mask, dst);
-			return FALSE;
-		}
+		    needs_src(op) && needs_src_alpha(op))
+			NOUVEAU_FALLBACK("mask CA + SA\n");
 	}
 
-	print_fallback_info("Accelerating", op, src, mask, dst);
 	return TRUE;
 }
 
@@ -382,6 +233,8 @@ setup_texture(NVPtr pNv, int unit, PicturePtr pict, PixmapPtr pixmap)
 	unsigned w = pict->pDrawable->width;
 	unsigned format;
 
+	nouveau_exa_pixmap_gpu_access(pixmap, NOUVEAU_BO_RD);
+
 	format = NV10_3D_TEX_FORMAT_WRAP_T_CLAMP_TO_EDGE |
 		 NV10_3D_TEX_FORMAT_WRAP_S_CLAMP_TO_EDGE |
 		 log2i(w) << 20 | log2i(h) << 16 |
@@ -426,6 +279,8 @@ setup_render_target(NVPtr pNv, PicturePtr pict, PixmapPtr pixmap)
 	struct nouveau_pushbuf *push = pNv->pushbuf;
 	struct nouveau_bo *bo = nouveau_pixmap_bo(pixmap);
 
+	nouveau_exa_pixmap_gpu_access(pixmap, NOUVEAU_BO_RDWR);
+
 	BEGIN_NV04(push, NV10_3D(RT_FORMAT), 3);
 	PUSH_DATA (push, get_rt_format(pict));
 	PUSH_DATA (push, (exaGetPixmapPitch(pixmap) << 16 |
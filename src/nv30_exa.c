@@ -319,6 +319,8 @@ NV30EXATexture(ScrnInfoPtr pScrn, PixmapPtr pPix, PicturePtr pPict, int unit)
 	if (!fmt)
 		return FALSE;
 
+	nouveau_exa_pixmap_gpu_access(pPix, NOUVEAU_BO_RD);
+
 	card_repeat = 3; /* repeatNone */
 
 	if (pPict->filter == PictFilterBilinear)
@@ -370,6 +372,8 @@ NV30_SetupSurface(ScrnInfoPtr pScrn, PixmapPtr pPix, PicturePtr pPict)
 		return FALSE;
 	}
 
+	nouveau_exa_pixmap_gpu_access(pPix, NOUVEAU_BO_RDWR);
+
 	BEGIN_NV04(push, NV30_3D(RT_FORMAT), 3);
 	PUSH_DATA (push, fmt->card_fmt); /* format */
 	PUSH_DATA (push, pitch << 16 | pitch);
@@ -249,6 +249,8 @@ NV40EXATexture(ScrnInfoPtr pScrn, PixmapPtr pPix, PicturePtr pPict, int unit)
 	if (!fmt)
 		return FALSE;
 
+	nouveau_exa_pixmap_gpu_access(pPix, NOUVEAU_BO_RD);
+
 	BEGIN_NV04(push, NV30_3D(TEX_OFFSET(unit)), 8);
 	PUSH_MTHDl(push, NV30_3D(TEX_OFFSET(unit)), bo, 0, reloc);
 	PUSH_MTHDs(push, NV30_3D(TEX_FORMAT(unit)), bo, fmt->card_fmt |
@@ -317,6 +319,8 @@ NV40_SetupSurface(ScrnInfoPtr pScrn, PixmapPtr pPix, PictFormatShort format)
 		return FALSE;
 	}
 
+	nouveau_exa_pixmap_gpu_access(pPix, NOUVEAU_BO_RDWR);
+
 	BEGIN_NV04(push, NV30_3D(RT_FORMAT), 3);
 	PUSH_DATA (push, NV30_3D_RT_FORMAT_TYPE_LINEAR |
 			 NV30_3D_RT_FORMAT_ZETA_Z24S8 | fmt->card_fmt);
@@ -80,6 +80,29 @@ NVAccelInitM2MF_NV50(ScrnInfoPtr pScrn)
 	return TRUE;
 }
 
+/* M2MF on the transfer channel, see NVInitDmaTransfer() */
+Bool
+NVAccelInitTransfer_NV50(ScrnInfoPtr pScrn)
+{
+	NVPtr pNv = NVPTR(pScrn);
+	struct nouveau_pushbuf *push = pNv->xfer_pushbuf;
+	struct nv04_fifo *fifo = pNv->xfer_channel->data;
+
+	if (nouveau_object_new(pNv->xfer_channel, NvMemFormat, NV50_M2MF_CLASS,
+			       NULL, 0, &pNv->NvXfer))
+		return FALSE;
+
+	if (!PUSH_SPACE(push, 8))
+		return FALSE;
+
+	BEGIN_NV04(push, NV01_SUBC(M2MF, OBJECT), 1);
+	PUSH_DATA (push, pNv->NvXfer->handle);
+	BEGIN_NV04(push, NV03_M2MF(DMA_BUFFER_IN), 2);
+	PUSH_DATA (push, fifo->vram);
+	PUSH_DATA (push, fifo->vram);
+	return TRUE;
+}
+
 Bool
 NVAccelInit2D_NV50(ScrnInfoPtr pScrn)
 {
@@ -179,8 +202,8 @@ NVAccelInitNV50TCL(ScrnInfoPtr pScrn)
 	}
 	bo = pNv->tesla_scratch;
 
-	if (nouveau_pushbuf_space(push, 512, 0, 0) ||
-	    nouveau_pushbuf_refn (push, &(struct nouveau_pushbuf_refn) {
+	if (!PUSH_SPACE(push, 512) ||
+	    PUSH_REFS(push, &(struct nouveau_pushbuf_refn) {
 					bo, NOUVEAU_BO_VRAM | NOUVEAU_BO_WR
 					}, 1))
 		return FALSE;
@@ -222,6 +245,7 @@ NVAccelInitNV50TCL(ScrnInfoPtr pScrn)
 	PUSH_DATA (push, 0x00000000);
 	BEGIN_NV04(push, NV50_3D(LINKED_TSC), 1);
 	PUSH_DATA (push, 1);
+	memset(pNv->tex_cache.slot, 0, sizeof(pNv->tex_cache.slot));
 	BEGIN_NV04(push, NV50_3D(TEX_LIMITS(2)), 1);
 	PUSH_DATA (push, 0x54);
 
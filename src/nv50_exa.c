@@ -26,14 +26,41 @@
 
 #include "nv50_accel.h"
 
+/* Over with a component-alpha mask, see NV50EXAComponentAlphaPass() */
+#define NV50_CA_RECTS 64
+#define NV50_CA_RECT_DWORDS (4 * 7) /* VTX2s() for each vertex */
+#define NV50_CA_PASS_DWORDS 16      /* switching between the passes */
+
+struct nv50_vertex {
+	float src[2];
+	float mask[2];
+	unsigned dx, dy;
+};
+
 struct nv50_exa_state {
 	Bool have_mask;
+	Bool tex_flush; /* TIC entries written since the last flush */
+	Bool in_draw;
+	struct nouveau_composite_key key;
+
+	Bool ca_two_pass;
+	PixmapPtr ca_pix;   /* destination, for switching passes */
+	PicturePtr ca_pict;
+	struct nv50_vertex ca_vtx[NV50_CA_RECTS * 4]; /* not drawn yet */
+	int ca_rects;
+	Bool failed; /* rects were lost, see NV50EXADoneComposite() */
+
+	Bool copy_self;    /* source and destination are the same storage */
+	BoxRec copy_dirty; /* written since the last serialise, if so */
+	BoxRec copy_read;  /* and read since then */
 
 	struct {
 		PictTransformPtr transform;
 		float width;
 		float height;
+		struct nouveau_gradient *gradient; /* NULL for a pixmap */
 	} unit[2];
+	struct nouveau_gradient grad[2];
 };
 static struct nv50_exa_state exa_state;
 
@@ -94,11 +121,8 @@ static void NV50EXASetClip(PixmapPtr ppix, int x, int y, int w, int h)
 {
 	NV50EXA_LOCALS(ppix);
 
-	BEGIN_NV04(push, NV50_2D(CLIP_X), 4);
-	PUSH_DATA (push, x);
-	PUSH_DATA (push, y);
-	PUSH_DATA (push, w);
-	PUSH_DATA (push, h);
+	PUSH_SHADOW_NV04(push, NV50_2D(CLIP_X), (uint32_t []) {
+			 x, y, w, h }, 4);
 }
 
 static void
@@ -106,32 +130,27 @@ NV50EXAAcquireSurface2D(PixmapPtr ppix, int is_src, uint32_t fmt)
 {
 	NV50EXA_LOCALS(ppix);
 	struct nouveau_bo *bo = nouveau_pixmap_bo(ppix);
+	uint64_t addr = bo->offset + nouveau_pixmap_offset(ppix);
 	int mthd = is_src ? NV50_2D_SRC_FORMAT : NV50_2D_DST_FORMAT;
 	uint32_t bo_flags;
 
-	bo_flags  = NOUVEAU_BO_VRAM;
+	bo_flags  = nouveau_pixmap_domain(ppix);
 	bo_flags |= is_src ? NOUVEAU_BO_RD : NOUVEAU_BO_WR;
+	nouveau_exa_pixmap_gpu_access(ppix, bo_flags);
 
 	if (!nv50_style_tiled_pixmap(ppix)) {
-		BEGIN_NV04(push, SUBC_2D(mthd), 2);
-		PUSH_DATA (push, fmt);
-		PUSH_DATA (push, 1);
-		BEGIN_NV04(push, SUBC_2D(mthd + 0x14), 1);
-		PUSH_DATA (push, (uint32_t)exaGetPixmapPitch(ppix));
+		PUSH_SHADOW_NV04(push, SUBC_2D(mthd), (uint32_t []) {
+				 fmt, 1 }, 2);
+		PUSH_SHADOW_NV04(push, SUBC_2D(mthd + 0x14), (uint32_t []) {
+				 exaGetPixmapPitch(ppix) }, 1);
 	} else {
-		BEGIN_NV04(push, SUBC_2D(mthd), 5);
-		PUSH_DATA (push, fmt);
-		PUSH_DATA (push, 0);
-		PUSH_DATA (push, bo->config.nv50.tile_mode);
-		PUSH_DATA (push, 1);
-		PUSH_DATA (push, 0);
+		PUSH_SHADOW_NV04(push, SUBC_2D(mthd), (uint32_t []) {
+				 fmt, 0, bo->config.nv50.tile_mode, 1, 0 }, 5);
 	}
 
-	BEGIN_NV04(push, SUBC_2D(mthd + 0x18), 4);
-	PUSH_DATA (push, ppix->drawable.width);
-	PUSH_DATA (push, ppix->drawable.height);
-	PUSH_DATA (push, bo->offset >> 32);
-	PUSH_DATA (push, bo->offset);
+	PUSH_SHADOW_NV04(push, SUBC_2D(mthd + 0x18), (uint32_t []) {
+			 ppix->drawable.width, ppix->drawable.height,
+			 addr >> 32, addr }, 4);
 
 	if (is_src == 0)
 		NV50EXASetClip(ppix, 0, 0, ppix->drawable.width, ppix->drawable.height);
@@ -162,12 +181,13 @@ NV50EXASetROP(PixmapPtr pdpix, int alu, Pixel planemask)
 	else
 		rop = NVROP[alu].copy;
 
-	BEGIN_NV04(push, NV50_2D(OPERATION), 1);
 	if (alu == GXcopy && EXA_PM_IS_SOLID(&pdpix->drawable, planemask)) {
-		PUSH_DATA (push, NV50_2D_OPERATION_SRCCOPY);
+		PUSH_SHADOW_NV04(push, NV50_2D(OPERATION), (uint32_t []) {
+				 NV50_2D_OPERATION_SRCCOPY }, 1);
 		return;
 	} else {
-		PUSH_DATA (push, NV50_2D_OPERATION_ROP);
+		PUSH_SHADOW_NV04(push, NV50_2D(OPERATION), (uint32_t []) {
+				 NV50_2D_OPERATION_ROP }, 1);
 	}
 
 	BEGIN_NV04(push, NV50_2D(PATTERN_COLOR_FORMAT), 2);
@@ -247,8 +267,7 @@ NV50EXASolid(PixmapPtr pdpix, int x1, int y1, int x2, int y2)
 	PUSH_DATA (push, x2);
 	PUSH_DATA (push, y2);
 
-	if ((x2 - x1) * (y2 - y1) >= 512)
-		PUSH_KICK(push);
+	NVDmaQueued(push, (x2 - x1) * (y2 - y1));
 }
 
 void
@@ -278,6 +297,26 @@ NV50EXAPrepareCopy(PixmapPtr pspix, PixmapPtr pdpix, int dx, int dy,
 	NV50EXAAcquireSurface2D(pdpix, 0, dst);
 	NV50EXASetROP(pdpix, alu, planemask);
 
+	/* the blits mustn't start before earlier rendering to the source
+	 * has landed, after that it only matters between the rects of a
+	 * copy within the one pixmap, see NV50EXACopy()
+	 */
+	BEGIN_NV04(push, SUBC_2D(0x0110), 1);
+	PUSH_DATA (push, 0);
+	BEGIN_NV04(push, NV50_2D(BLIT_CONTROL), 1);
+	PUSH_DATA (push, 0);
+	BEGIN_NV04(push, NV50_2D(BLIT_DU_DX_FRACT), 4);
+	PUSH_DATA (push, 0);
+	PUSH_DATA (push, 1);
+	PUSH_DATA (push, 0);
+	PUSH_DATA (push, 1);
+
+	state->copy_self =
+		nouveau_pixmap_bo(pspix) == nouveau_pixmap_bo(pdpix) &&
+		nouveau_pixmap_offset(pspix) == nouveau_pixmap_offset(pdpix);
+	state->copy_dirty.x1 = state->copy_dirty.x2 = 0;
+	state->copy_read.x1 = state->copy_read.x2 = 0;
+
 	nouveau_pushbuf_bufctx(push, pNv->bufctx);
 	if (nouveau_pushbuf_validate(push)) {
 		nouveau_pushbuf_bufctx(push, NULL);
@@ -287,6 +326,28 @@ NV50EXAPrepareCopy(PixmapPtr pspix, PixmapPtr pdpix, int dx, int dy,
 	return TRUE;
 }
 
+/* Boxes of copied rects, empty while x1 >= x2 */
+static Bool
+NV50EXABoxOverlap(BoxPtr a, BoxPtr b)
+{
+	return a->x1 < a->x2 &&
+	       b->x1 < a->x2 && b->x2 > a->x1 &&
+	       b->y1 < a->y2 && b->y2 > a->y1;
+}
+
+static void
+NV50EXABoxUnion(BoxPtr a, BoxPtr b)
+{
+	if (a->x1 < a->x2) {
+		a->x1 = min(a->x1, b->x1);
+		a->y1 = min(a->y1, b->y1);
+		a->x2 = max(a->x2, b->x2);
+		a->y2 = max(a->y2, b->y2);
+	} else {
+		*a = *b;
+	}
+}
+
 void
 NV50EXACopy(PixmapPtr pdpix, int srcX , int srcY,
 			     int dstX , int dstY,
@@ -294,29 +355,40 @@ NV50EXACopy(PixmapPtr pdpix, int srcX , int srcY,
 {
 	NV50EXA_LOCALS(pdpix);
 
-	if (!PUSH_SPACE(push, 32))
+	if (!PUSH_SPACE(push, 16))
 		return;
 
-	BEGIN_NV04(push, SUBC_2D(0x0110), 1);
-	PUSH_DATA (push, 0);
-	BEGIN_NV04(push, SUBC_2D(0x088c), 1);
-	PUSH_DATA (push, 0);
-	BEGIN_NV04(push, NV50_2D(BLIT_DST_X), 12);
+	/* a rect reading what an earlier one wrote, or writing over what
+	 * an earlier one read, has to wait for it
+	 */
+	if (state->copy_self) {
+		BoxRec src = { srcX, srcY, srcX + width, srcY + height };
+		BoxRec dst = { dstX, dstY, dstX + width, dstY + height };
+
+		if (NV50EXABoxOverlap(&state->copy_dirty, &src) ||
+		    NV50EXABoxOverlap(&state->copy_read, &dst)) {
+			BEGIN_NV04(push, SUBC_2D(0x0110), 1);
+			PUSH_DATA (push, 0);
+			state->copy_dirty.x2 = state->copy_dirty.x1;
+			state->copy_read.x2 = state->copy_read.x1;
+		}
+
+		NV50EXABoxUnion(&state->copy_dirty, &dst);
+		NV50EXABoxUnion(&state->copy_read, &src);
+	}
+
+	BEGIN_NV04(push, NV50_2D(BLIT_DST_X), 4);
 	PUSH_DATA (push, dstX);
 	PUSH_DATA (push, dstY);
 	PUSH_DATA (push, width);
 	PUSH_DATA (push, height);
-	PUSH_DATA (push, 0);
-	PUSH_DATA (push, 1);
-	PUSH_DATA (push, 0);
-	PUSH_DATA (push, 1);
+	BEGIN_NV04(push, NV50_2D(BLIT_SRC_X_FRACT), 4);
 	PUSH_DATA (push, 0);
 	PUSH_DATA (push, srcX);
 	PUSH_DATA (push, 0);
 	PUSH_DATA (push, srcY);
 
-	if (width * height >= 512)
-		PUSH_KICK(push);
+	NVDmaQueued(push, width * height);
 }
 
 void
@@ -331,8 +403,8 @@ NV50EXAUploadSIFC(const char *src, int src_pitch,
 		  PixmapPtr pdpix, int x, int y, int w, int h, int cpp)
 {
 	NV50EXA_LOCALS(pdpix);
-	ScreenPtr pScreen = pdpix->drawable.pScreen;
 	int line_dwords = (w * cpp + 3) / 4;
+	int ph;
 	uint32_t sifc_fmt;
 	Bool ret = FALSE;
 
@@ -346,8 +418,8 @@ NV50EXAUploadSIFC(const char *src, int src_pitch,
 	NV50EXAAcquireSurface2D(pdpix, 0, sifc_fmt);
 	NV50EXASetClip(pdpix, x, y, w, h);
 
-	BEGIN_NV04(push, NV50_2D(OPERATION), 1);
-	PUSH_DATA (push, NV50_2D_OPERATION_SRCCOPY);
+	PUSH_SHADOW_NV04(push, NV50_2D(OPERATION), (uint32_t []) {
+			 NV50_2D_OPERATION_SRCCOPY }, 1);
 	BEGIN_NV04(push, NV50_2D(SIFC_BITMAP_ENABLE), 2);
 	PUSH_DATA (push, 0);
 	PUSH_DATA (push, sifc_fmt);
@@ -367,7 +439,8 @@ NV50EXAUploadSIFC(const char *src, int src_pitch,
 	if (nouveau_pushbuf_validate(push))
 		goto out;
 
-	while (h--) {
+	ph = h;
+	while (ph--) {
 		int count = line_dwords;
 		const char *p = src;
 
@@ -389,8 +462,7 @@ NV50EXAUploadSIFC(const char *src, int src_pitch,
 	ret = TRUE;
 out:
 	nouveau_pushbuf_bufctx(push, NULL);
-	if (pdpix == pScreen->GetScreenPixmap(pScreen))
-		PUSH_KICK(push);
+	NVDmaQueued(push, w * h);
 	return ret;
 }
 
@@ -428,12 +500,15 @@ NV50EXARenderTarget(PixmapPtr ppix, PicturePtr ppict)
 {
 	NV50EXA_LOCALS(ppix);
 	struct nouveau_bo *bo = nouveau_pixmap_bo(ppix);
+	uint64_t addr = bo->offset + nouveau_pixmap_offset(ppix);
 	unsigned format;
 
 	/*XXX: Scanout buffer not tiled, someone needs to figure it out */
 	if (!nv50_style_tiled_pixmap(ppix))
 		NOUVEAU_FALLBACK("pixmap is scanout buffer\n");
 
+	nouveau_exa_pixmap_gpu_access(ppix, NOUVEAU_BO_RDWR);
+
 	switch (ppict->format) {
 	case PICT_a8r8g8b8: format = NV50_SURFACE_FORMAT_BGRA8_UNORM; break;
 	case PICT_x8r8g8b8: format = NV50_SURFACE_FORMAT_BGRX8_UNORM; break;
@@ -456,26 +531,37 @@ NV50EXARenderTarget(PixmapPtr ppix, PicturePtr ppict)
 		NOUVEAU_FALLBACK("invalid picture format\n");
 	}
 
-	BEGIN_NV04(push, NV50_3D(RT_ADDRESS_HIGH(0)), 5);
-	PUSH_DATA (push, bo->offset >> 32);
-	PUSH_DATA (push, bo->offset);
-	PUSH_DATA (push, format);
-	PUSH_DATA (push, bo->config.nv50.tile_mode);
-	PUSH_DATA (push, 0x00000000);
-	BEGIN_NV04(push, NV50_3D(RT_HORIZ(0)), 2);
-	PUSH_DATA (push, ppix->drawable.width);
-	PUSH_DATA (push, ppix->drawable.height);
-	BEGIN_NV04(push, NV50_3D(RT_ARRAY_MODE), 1);
-	PUSH_DATA (push, 0x00000001);
+	PUSH_SHADOW_NV04(push, NV50_3D(RT_ADDRESS_HIGH(0)), (uint32_t []) {
+			 addr >> 32, addr, format,
+			 bo->config.nv50.tile_mode, 0x00000000 }, 5);
+	PUSH_SHADOW_NV04(push, NV50_3D(RT_HORIZ(0)), (uint32_t []) {
+			 ppix->drawable.width, ppix->drawable.height }, 2);
+	PUSH_SHADOW_NV04(push, NV50_3D(RT_ARRAY_MODE), (uint32_t []) {
+			 0x00000001 }, 1);
 
 	return TRUE;
 }
 
+/* A linear texture's pitch goes in the TIC, which needs it 32-byte aligned
+ * and has 20 bits for it
+ */
+static Bool
+NV50EXACheckPitch(PixmapPtr ppix)
+{
+	unsigned pitch = exaGetPixmapPitch(ppix);
+
+	if (nv50_style_tiled_pixmap(ppix))
+		return TRUE;
+	return !(pitch & 31) && pitch <= NV50TIC_0_3_PITCH_MASK;
+}
+
 static Bool
 NV50EXACheckTexture(PicturePtr ppict, PicturePtr pdpict, int op)
 {
+	PixmapPtr ppix;
+
 	if (!ppict->pDrawable)
-		NOUVEAU_FALLBACK("Solid and gradient pictures unsupported\n");
+		return nouveau_gradient_check(ppict);
 
 	if (ppict->pDrawable->width > 8192 ||
 	    ppict->pDrawable->height > 8192)
@@ -483,6 +569,12 @@ NV50EXACheckTexture(PicturePtr ppict, PicturePtr pdpict, int op)
 				 ppict->pDrawable->width,
 				 ppict->pDrawable->height);
 
+	/* one that's not in a bo yet is checked again when it's bound */
+	ppix = NVGetDrawablePixmap(ppict->pDrawable);
+	if (nouveau_pixmap_bo(ppix) && !NV50EXACheckPitch(ppix))
+		NOUVEAU_FALLBACK("linear pitch %lu\n",
+				 exaGetPixmapPitch(ppix));
+
 	switch (ppict->format) {
 	case PICT_a8r8g8b8:
 	case PICT_a8b8g8r8:
@@ -531,6 +623,75 @@ NV50EXACheckTexture(PicturePtr ppict, PicturePtr pdpict, int op)
 	return TRUE;
 }
 
+static uint32_t
+NV50EXAWrap(PicturePtr ppict)
+{
+	if (!ppict->repeat) {
+		return NV50TSC_1_0_WRAPS_CLAMP_TO_BORDER |
+		       NV50TSC_1_0_WRAPT_CLAMP_TO_BORDER |
+		       NV50TSC_1_0_WRAPR_CLAMP_TO_BORDER | 0x00024000;
+	}
+
+	switch (ppict->repeatType) {
+	case RepeatPad:
+		return NV50TSC_1_0_WRAPS_CLAMP |
+		       NV50TSC_1_0_WRAPT_CLAMP |
+		       NV50TSC_1_0_WRAPR_CLAMP | 0x00024000;
+	case RepeatReflect:
+		return NV50TSC_1_0_WRAPS_MIRROR_REPEAT |
+		       NV50TSC_1_0_WRAPT_MIRROR_REPEAT |
+		       NV50TSC_1_0_WRAPR_MIRROR_REPEAT | 0x00024000;
+	case RepeatNormal:
+	default:
+		return NV50TSC_1_0_WRAPS_REPEAT |
+		       NV50TSC_1_0_WRAPT_REPEAT |
+		       NV50TSC_1_0_WRAPR_REPEAT | 0x00024000;
+	}
+}
+
+/* desc is written, and the TIC cache flushed, only if it wasn't already
+ * in a slot
+ */
+static void
+NV50EXATextureBind(NVPtr pNv, unsigned unit, const uint32_t *desc)
+{
+	struct nouveau_pushbuf *push = pNv->pushbuf;
+	struct nouveau_bo *scratch = pNv->tesla_scratch;
+	Bool write;
+	int slot;
+
+	slot = nouveau_exa_texture_slot(pNv, desc, &write);
+	if (write) {
+		BEGIN_NV04(push, NV50_3D(CB_DEF_ADDRESS_HIGH), 3);
+		PUSH_DATA (push, (scratch->offset + TIC_OFFSET) >> 32);
+		PUSH_DATA (push, (scratch->offset + TIC_OFFSET));
+		PUSH_DATA (push, (CB_TIC << NV50_3D_CB_DEF_SET_BUFFER__SHIFT) |
+				 0x4000);
+		BEGIN_NV04(push, NV50_3D(CB_ADDR), 1);
+		PUSH_DATA (push, CB_TIC |
+				 ((slot * 8) << NV50_3D_CB_ADDR_ID__SHIFT));
+		BEGIN_NI04(push, NV50_3D(CB_DATA(0)), 8);
+		PUSH_DATAp(push, &desc[0], 8);
+
+		BEGIN_NV04(push, NV50_3D(CB_DEF_ADDRESS_HIGH), 3);
+		PUSH_DATA (push, (scratch->offset + TSC_OFFSET) >> 32);
+		PUSH_DATA (push, (scratch->offset + TSC_OFFSET));
+		PUSH_DATA (push, (CB_TSC << NV50_3D_CB_DEF_SET_BUFFER__SHIFT) |
+				 0x4000);
+		BEGIN_NV04(push, NV50_3D(CB_ADDR), 1);
+		PUSH_DATA (push, CB_TSC |
+				 ((slot * 8) << NV50_3D_CB_ADDR_ID__SHIFT));
+		BEGIN_NI04(push, NV50_3D(CB_DATA(0)), 8);
+		PUSH_DATAp(push, &desc[8], 8);
+		exa_state.tex_flush = TRUE;
+	}
+
+	BEGIN_NV04(push, NV50_3D(BIND_TIC(2)), 1);
+	PUSH_DATA (push, (slot << NV50_3D_BIND_TIC_TIC__SHIFT) |
+			 (unit << NV50_3D_BIND_TIC_TEXTURE__SHIFT) |
+			 NV50_3D_BIND_TIC_VALID);
+}
+
 #define _(X1,X2,X3,X4,FMT) (NV50TIC_0_0_TYPER_UNORM | NV50TIC_0_0_TYPEG_UNORM | NV50TIC_0_0_TYPEB_UNORM | NV50TIC_0_0_TYPEA_UNORM | \
 			    NV50TIC_0_0_MAP##X1 | NV50TIC_0_0_MAP##X2 | NV50TIC_0_0_MAP##X3 | NV50TIC_0_0_MAP##X4 | \
 			    NV50TIC_0_0_FMT_##FMT)
@@ -540,147 +701,165 @@ NV50EXATexture(PixmapPtr ppix, PicturePtr ppict, unsigned unit)
 {
 	NV50EXA_LOCALS(ppix);
 	struct nouveau_bo *bo = nouveau_pixmap_bo(ppix);
+	uint64_t addr = bo->offset + nouveau_pixmap_offset(ppix);
+	uint32_t desc[16];
 
-	/*XXX: Scanout buffer not tiled, someone needs to figure it out */
-	if (!nv50_style_tiled_pixmap(ppix))
-		NOUVEAU_FALLBACK("pixmap is scanout buffer\n");
+	if (!NV50EXACheckPitch(ppix))
+		NOUVEAU_FALLBACK("linear pitch %lu\n",
+				 exaGetPixmapPitch(ppix));
+
+	nouveau_exa_pixmap_gpu_access(ppix, NOUVEAU_BO_RD);
 
-	BEGIN_NV04(push, NV50_3D(CB_DEF_ADDRESS_HIGH), 3);
-	PUSH_DATA (push, (pNv->tesla_scratch->offset + TIC_OFFSET) >> 32);
-	PUSH_DATA (push, (pNv->tesla_scratch->offset + TIC_OFFSET));
-	PUSH_DATA (push, (CB_TIC << NV50_3D_CB_DEF_SET_BUFFER__SHIFT) | 0x4000);
-	BEGIN_NV04(push, NV50_3D(CB_ADDR), 1);
-	PUSH_DATA (push, CB_TIC | ((unit * 8) << NV50_3D_CB_ADDR_ID__SHIFT));
-	BEGIN_NI04(push, NV50_3D(CB_DATA(0)), 8);
 	switch (ppict->format) {
 	case PICT_a8r8g8b8:
-		PUSH_DATA (push, _(B_C0, G_C1, R_C2, A_C3, 8_8_8_8));
+		desc[0] = _(B_C0, G_C1, R_C2, A_C3, 8_8_8_8);
 		break;
 	case PICT_a8b8g8r8:
-		PUSH_DATA (push, _(R_C0, G_C1, B_C2, A_C3, 8_8_8_8));
+		desc[0] = _(R_C0, G_C1, B_C2, A_C3, 8_8_8_8);
 		break;
 	case PICT_x8r8g8b8:
-		PUSH_DATA (push, _(B_C0, G_C1, R_C2, A_ONE, 8_8_8_8));
+		desc[0] = _(B_C0, G_C1, R_C2, A_ONE, 8_8_8_8);
 		break;
 	case PICT_x8b8g8r8:
-		PUSH_DATA (push, _(R_C0, G_C1, B_C2, A_ONE, 8_8_8_8));
+		desc[0] = _(R_C0, G_C1, B_C2, A_ONE, 8_8_8_8);
 		break;
 	case PICT_r5g6b5:
-		PUSH_DATA (push, _(B_C0, G_C1, R_C2, A_ONE, 5_6_5));
+		desc[0] = _(B_C0, G_C1, R_C2, A_ONE, 5_6_5);
 		break;
 	case PICT_a8:
-		PUSH_DATA (push, _(A_C0, B_ZERO, G_ZERO, R_ZERO, 8));
+		desc[0] = _(A_C0, B_ZERO, G_ZERO, R_ZERO, 8);
 		break;
 	case PICT_x1r5g5b5:
-		PUSH_DATA (push, _(B_C0, G_C1, R_C2, A_ONE, 1_5_5_5));
+		desc[0] = _(B_C0, G_C1, R_C2, A_ONE, 1_5_5_5);
 		break;
 	case PICT_x1b5g5r5:
-		PUSH_DATA (push, _(R_C0, G_C1, B_C2, A_ONE, 1_5_5_5));
+		desc[0] = _(R_C0, G_C1, B_C2, A_ONE, 1_5_5_5);
 		break;
 	case PICT_a1r5g5b5:
-		PUSH_DATA (push, _(B_C0, G_C1, R_C2, A_C3, 1_5_5_5));
+		desc[0] = _(B_C0, G_C1, R_C2, A_C3, 1_5_5_5);
 		break;
 	case PICT_a1b5g5r5:
-		PUSH_DATA (push, _(R_C0, G_C1, B_C2, A_C3, 1_5_5_5));
+		desc[0] = _(R_C0, G_C1, B_C2, A_C3, 1_5_5_5);
 		break;
 	case PICT_b5g6r5:
-		PUSH_DATA (push, _(R_C0, G_C1, B_C2, A_ONE, 5_6_5));
+		desc[0] = _(R_C0, G_C1, B_C2, A_ONE, 5_6_5);
 		break;
 	case PICT_b8g8r8x8:
-		PUSH_DATA (push, _(A_ONE, R_C1, G_C2, B_C3, 8_8_8_8));
+		desc[0] = _(A_ONE, R_C1, G_C2, B_C3, 8_8_8_8);
 		break;
 	case PICT_b8g8r8a8:
-		PUSH_DATA (push, _(A_C0, R_C1, G_C2, B_C3, 8_8_8_8));
+		desc[0] = _(A_C0, R_C1, G_C2, B_C3, 8_8_8_8);
 		break;
 	case PICT_a2b10g10r10:
-		PUSH_DATA (push, _(R_C0, G_C1, B_C2, A_C3, 2_10_10_10));
+		desc[0] = _(R_C0, G_C1, B_C2, A_C3, 2_10_10_10);
 		break;
 	case PICT_x2b10g10r10:
-		PUSH_DATA (push, _(R_C0, G_C1, B_C2, A_ONE, 2_10_10_10));
+		desc[0] = _(R_C0, G_C1, B_C2, A_ONE, 2_10_10_10);
 		break;
 	case PICT_x2r10g10b10:
-		PUSH_DATA (push, _(B_C0, G_C1, R_C2, A_ONE, 2_10_10_10));
+		desc[0] = _(B_C0, G_C1, R_C2, A_ONE, 2_10_10_10);
 		break;
 	case PICT_a2r10g10b10:
-		PUSH_DATA (push, _(B_C0, G_C1, R_C2, A_C3, 2_10_10_10));
+		desc[0] = _(B_C0, G_C1, R_C2, A_C3, 2_10_10_10);
 		break;
 	case PICT_x4r4g4b4:
-		PUSH_DATA (push, _(B_C0, G_C1, R_C2, A_ONE, 4_4_4_4));
+		desc[0] = _(B_C0, G_C1, R_C2, A_ONE, 4_4_4_4);
 		break;
 	case PICT_x4b4g4r4:
-		PUSH_DATA (push, _(R_C0, G_C1, B_C2, A_ONE, 4_4_4_4));
+		desc[0] = _(R_C0, G_C1, B_C2, A_ONE, 4_4_4_4);
 		break;
 	case PICT_a4r4g4b4:
-		PUSH_DATA (push, _(B_C0, G_C1, R_C2, A_C3, 4_4_4_4));
+		desc[0] = _(B_C0, G_C1, R_C2, A_C3, 4_4_4_4);
 		break;
 	case PICT_a4b4g4r4:
-		PUSH_DATA (push, _(R_C0, G_C1, B_C2, A_C3, 4_4_4_4));
+		desc[0] = _(R_C0, G_C1, B_C2, A_C3, 4_4_4_4);
 		break;
 	default:
 		NOUVEAU_FALLBACK("invalid picture format, this SHOULD NOT HAPPEN. Expect trouble.\n");
 	}
 #undef _
 
-	PUSH_DATA (push, bo->offset);
-	PUSH_DATA (push, (bo->offset >> 32) |
-			 (bo->config.nv50.tile_mode << 18) |
-			 0xd0005000);
-	PUSH_DATA (push, 0x00300000);
-	PUSH_DATA (push, ppix->drawable.width);
-	PUSH_DATA (push, (1 << NV50TIC_0_5_DEPTH_SHIFT) | ppix->drawable.height);
-	PUSH_DATA (push, 0x03000000);
-	PUSH_DATA (push, 0x00000000);
-
-	BEGIN_NV04(push, NV50_3D(CB_DEF_ADDRESS_HIGH), 3);
-	PUSH_DATA (push, (pNv->tesla_scratch->offset + TSC_OFFSET) >> 32);
-	PUSH_DATA (push, (pNv->tesla_scratch->offset + TSC_OFFSET));
-	PUSH_DATA (push, (CB_TSC << NV50_3D_CB_DEF_SET_BUFFER__SHIFT) | 0x4000);
-	BEGIN_NV04(push, NV50_3D(CB_ADDR), 1);
-	PUSH_DATA (push, CB_TSC | ((unit * 8) << NV50_3D_CB_ADDR_ID__SHIFT));
-	BEGIN_NI04(push, NV50_3D(CB_DATA(0)), 8);
-	if (ppict->repeat) {
-		switch (ppict->repeatType) {
-		case RepeatPad:
-			PUSH_DATA (push, NV50TSC_1_0_WRAPS_CLAMP |
-				 NV50TSC_1_0_WRAPT_CLAMP |
-				 NV50TSC_1_0_WRAPR_CLAMP | 0x00024000);
-			break;
-		case RepeatReflect:
-			PUSH_DATA (push, NV50TSC_1_0_WRAPS_MIRROR_REPEAT |
-				 NV50TSC_1_0_WRAPT_MIRROR_REPEAT |
-				 NV50TSC_1_0_WRAPR_MIRROR_REPEAT | 0x00024000);
-			break;
-		case RepeatNormal:
-		default:
-			PUSH_DATA (push, NV50TSC_1_0_WRAPS_REPEAT |
-				 NV50TSC_1_0_WRAPT_REPEAT |
-				 NV50TSC_1_0_WRAPR_REPEAT | 0x00024000);
-			break;
-		}
+	desc[1] = addr;
+	if (nv50_style_tiled_pixmap(ppix)) {
+		desc[2] = (addr >> 32) | (bo->config.nv50.tile_mode << 18) |
+			  0xd0001000 | NV50TIC_0_2_TARGET_2D;
+		desc[3] = 0x00300000;
+		desc[6] = 0x03000000;
 	} else {
-		PUSH_DATA (push, NV50TSC_1_0_WRAPS_CLAMP_TO_BORDER |
-			 NV50TSC_1_0_WRAPT_CLAMP_TO_BORDER |
-			 NV50TSC_1_0_WRAPR_CLAMP_TO_BORDER | 0x00024000);
+		/* scanout and other pitch-linear buffers, the coordinates
+		 * stay normalised, the pitch replaces the tiling info
+		 */
+		desc[2] = (addr >> 32) | 0xd0001000 |
+			  NV50TIC_0_2_TARGET_RECT | NV50TIC_0_2_LINEAR;
+		desc[3] = exaGetPixmapPitch(ppix);
+		desc[6] = 0x00000000;
 	}
+	desc[4] = ppix->drawable.width;
+	desc[5] = (1 << NV50TIC_0_5_DEPTH_SHIFT) | ppix->drawable.height;
+	desc[7] = 0x00000000;
+
+	desc[8] = NV50EXAWrap(ppict);
 	if (ppict->filter == PictFilterBilinear) {
-		PUSH_DATA (push, NV50TSC_1_1_MAGF_LINEAR |
-			 NV50TSC_1_1_MINF_LINEAR |
-			 NV50TSC_1_1_MIPF_NONE);
+		desc[9] = NV50TSC_1_1_MAGF_LINEAR |
+			  NV50TSC_1_1_MINF_LINEAR |
+			  NV50TSC_1_1_MIPF_NONE;
 	} else {
-		PUSH_DATA (push, NV50TSC_1_1_MAGF_NEAREST |
-			 NV50TSC_1_1_MINF_NEAREST |
-			 NV50TSC_1_1_MIPF_NONE);
+		desc[9] = NV50TSC_1_1_MAGF_NEAREST |
+			  NV50TSC_1_1_MINF_NEAREST |
+			  NV50TSC_1_1_MIPF_NONE;
 	}
-	PUSH_DATA (push, 0x00000000);
-	PUSH_DATA (push, 0x00000000);
-	PUSH_DATA (push, 0x00000000);
-	PUSH_DATA (push, 0x00000000);
-	PUSH_DATA (push, 0x00000000);
-	PUSH_DATA (push, 0x00000000);
+	memset(&desc[10], 0, 6 * sizeof(uint32_t));
+	NV50EXATextureBind(pNv, unit, desc);
 
 	state->unit[unit].width = ppix->drawable.width;
 	state->unit[unit].height = ppix->drawable.height;
 	state->unit[unit].transform = ppict->transform;
+	state->unit[unit].gradient = NULL;
+	return TRUE;
+}
+
+/* A solid fill or gradient, from the ramp nouveau_gradient_get() put in
+ * state->grad[unit].  A radial one's table is mirrored about the centre.
+ */
+static Bool
+NV50EXAGradient(NVPtr pNv, PicturePtr ppict, unsigned unit)
+{
+	struct nv50_exa_state *state = &exa_state;
+	struct nouveau_gradient *grad = &state->grad[unit];
+	uint64_t addr = grad->bo->offset;
+	uint32_t desc[16];
+
+	desc[0] = NV50TIC_0_0_TYPER_UNORM | NV50TIC_0_0_TYPEG_UNORM |
+		  NV50TIC_0_0_TYPEB_UNORM | NV50TIC_0_0_TYPEA_UNORM |
+		  NV50TIC_0_0_MAPB_C0 | NV50TIC_0_0_MAPG_C1 |
+		  NV50TIC_0_0_MAPR_C2 | NV50TIC_0_0_MAPA_C3 |
+		  NV50TIC_0_0_FMT_8_8_8_8;
+	desc[1] = addr;
+	desc[2] = (addr >> 32) | 0xd0001000 |
+		  NV50TIC_0_2_TARGET_RECT | NV50TIC_0_2_LINEAR;
+	desc[3] = grad->pitch;
+	desc[4] = grad->width;
+	desc[5] = (1 << NV50TIC_0_5_DEPTH_SHIFT) | grad->height;
+	desc[6] = 0x00000000;
+	desc[7] = 0x00000000;
+
+	if (grad->radial) {
+		desc[8] = 0x00024000 |
+			  NV50TSC_1_0_WRAPS_MIRROR_CLAMP_TO_EDGE |
+			  NV50TSC_1_0_WRAPT_MIRROR_CLAMP_TO_EDGE |
+			  NV50TSC_1_0_WRAPR_MIRROR_CLAMP_TO_EDGE;
+	} else {
+		desc[8] = NV50EXAWrap(ppict);
+	}
+	/* the ramp's always interpolated, whatever the picture's filter */
+	desc[9] = NV50TSC_1_1_MAGF_LINEAR |
+		  NV50TSC_1_1_MINF_LINEAR |
+		  NV50TSC_1_1_MIPF_NONE;
+	memset(&desc[10], 0, 6 * sizeof(uint32_t));
+	NV50EXATextureBind(pNv, unit, desc);
+
+	state->unit[unit].transform = NULL;
+	state->unit[unit].gradient = grad;
 	return TRUE;
 }
 
@@ -719,19 +898,19 @@ NV50EXABlend(PixmapPtr ppix, PicturePtr ppict, int op, int component_alpha)
 	}
 
 	if (sblend == BF(ONE) && dblend == BF(ZERO)) {
-		BEGIN_NV04(push, NV50_3D(BLEND_ENABLE(0)), 1);
-		PUSH_DATA (push, 0);
+		PUSH_SHADOW_NV04(push, NV50_3D(BLEND_ENABLE(0)), (uint32_t []) {
+				 0 }, 1);
 	} else {
-		BEGIN_NV04(push, NV50_3D(BLEND_ENABLE(0)), 1);
-		PUSH_DATA (push, 1);
-		BEGIN_NV04(push, NV50_3D(BLEND_EQUATION_RGB), 5);
-		PUSH_DATA (push, NV50_3D_BLEND_EQUATION_RGB_FUNC_ADD);
-		PUSH_DATA (push, sblend);
-		PUSH_DATA (push, dblend);
-		PUSH_DATA (push, NV50_3D_BLEND_EQUATION_ALPHA_FUNC_ADD);
-		PUSH_DATA (push, sblend);
-		BEGIN_NV04(push, NV50_3D(BLEND_FUNC_DST_ALPHA), 1);
-		PUSH_DATA (push, dblend);
+		PUSH_SHADOW_NV04(push, NV50_3D(BLEND_ENABLE(0)), (uint32_t []) {
+				 1 }, 1);
+		PUSH_SHADOW_NV04(push, NV50_3D(BLEND_EQUATION_RGB),
+				 (uint32_t []) {
+				 NV50_3D_BLEND_EQUATION_RGB_FUNC_ADD,
+				 sblend, dblend,
+				 NV50_3D_BLEND_EQUATION_ALPHA_FUNC_ADD,
+				 sblend }, 5);
+		PUSH_SHADOW_NV04(push, NV50_3D(BLEND_FUNC_DST_ALPHA),
+				 (uint32_t []) { dblend }, 1);
 	}
 }
 
@@ -752,7 +931,8 @@ NV50EXACheckComposite(int op,
 		if (pmpict->componentAlpha &&
 		    PICT_FORMAT_RGB(pmpict->format) &&
 		    NV50EXABlendOp[op].src_alpha &&
-		    NV50EXABlendOp[op].src_blend != BF(ZERO))
+		    NV50EXABlendOp[op].src_blend != BF(ZERO) &&
+		    op != PictOpOver)
 			NOUVEAU_FALLBACK("component-alpha not supported\n");
 
 		if (!NV50EXACheckTexture(pmpict, pdpict, op))
@@ -767,28 +947,74 @@ NV50EXAPrepareComposite(int op,
 			PicturePtr pspict, PicturePtr pmpict, PicturePtr pdpict,
 			PixmapPtr pspix, PixmapPtr pmpix, PixmapPtr pdpix)
 {
-	NV50EXA_LOCALS(pspix);
-	struct nouveau_bo *src = nouveau_pixmap_bo(pspix);
+	NV50EXA_LOCALS(pdpix);
+	struct nouveau_bo *src = pspix ? nouveau_pixmap_bo(pspix) : NULL;
 	struct nouveau_bo *dst = nouveau_pixmap_bo(pdpix);
 	struct nouveau_bo *mask = pmpix ? nouveau_pixmap_bo(pmpix) : NULL;
 
 	if (!PUSH_SPACE(push, 256))
 		NOUVEAU_FALLBACK("space\n");
 
+	/* solid fill and gradient pictures, see nouveau_gradient.c */
+	if (!pspix) {
+		if (!nouveau_gradient_get(pNv, pspict, &state->grad[0]))
+			NOUVEAU_FALLBACK("src picture invalid\n");
+		if (state->grad[0].moved)
+			state->key.push_cur = NULL;
+	}
+	if (pmpict && !pmpix) {
+		if (!nouveau_gradient_get(pNv, pmpict, &state->grad[1]))
+			NOUVEAU_FALLBACK("mask picture invalid\n");
+		if (state->grad[1].moved)
+			state->key.push_cur = NULL;
+	}
+
+	if (nouveau_exa_composite_reuse(pNv, &state->key, op,
+					pspict, pmpict, pdpict,
+					pspix, pmpix, pdpix)) {
+		nouveau_exa_pixmap_gpu_access(pdpix, NOUVEAU_BO_RDWR);
+		/* the same transform, but maybe not where it was */
+		if (pspix) {
+			nouveau_exa_pixmap_gpu_access(pspix, NOUVEAU_BO_RD);
+			state->unit[0].transform = pspict->transform;
+		}
+		if (pmpix) {
+			nouveau_exa_pixmap_gpu_access(pmpix, NOUVEAU_BO_RD);
+			state->unit[1].transform = pmpict->transform;
+		}
+		goto flush;
+	}
+
+	/* the first of two passes, see NV50EXAComponentAlphaPass() */
+	state->ca_two_pass = pmpict && pmpict->componentAlpha &&
+			     PICT_FORMAT_RGB(pmpict->format) &&
+			     op == PictOpOver;
+	if (state->ca_two_pass)
+		op = PictOpOutReverse;
+
 	BEGIN_NV04(push, SUBC_2D(0x0110), 1);
 	PUSH_DATA (push, 0);
 
 	if (!NV50EXARenderTarget(pdpix, pdpict))
 		NOUVEAU_FALLBACK("render target invalid\n");
 
+	/* rects are drawn exactly, the scissor only needs to cover the
+	 * whole render target
+	 */
+	PUSH_SHADOW_NV04(push, NV50_3D(SCISSOR_HORIZ(0)), (uint32_t []) {
+			 pdpix->drawable.width << 16,
+			 pdpix->drawable.height << 16 }, 2);
+
 	NV50EXABlend(pdpix, pdpict, op, pmpict && pmpict->componentAlpha &&
 		     PICT_FORMAT_RGB(pmpict->format));
 
-	if (!NV50EXATexture(pspix, pspict, 0))
+	if (pspix ? !NV50EXATexture(pspix, pspict, 0) :
+		    !NV50EXAGradient(pNv, pspict, 0))
 		NOUVEAU_FALLBACK("src picture invalid\n");
 
 	if (pmpict) {
-		if (!NV50EXATexture(pmpix, pmpict, 1))
+		if (pmpix ? !NV50EXATexture(pmpix, pmpict, 1) :
+			    !NV50EXAGradient(pNv, pmpict, 1))
 			NOUVEAU_FALLBACK("mask picture invalid\n");
 		state->have_mask = TRUE;
 
@@ -816,20 +1042,29 @@ NV50EXAPrepareComposite(int op,
 			PUSH_DATA (push, PFP_S);
 	}
 
-	BEGIN_NV04(push, SUBC_3D(0x1334), 1);
-	PUSH_DATA (push, 0);
-
-	BEGIN_NV04(push, NV50_3D(BIND_TIC(2)), 1);
-	PUSH_DATA (push, 1);
-	BEGIN_NV04(push, NV50_3D(BIND_TIC(2)), 1);
-	PUSH_DATA (push, 0x203);
+flush:
+	if (state->tex_flush) {
+		BEGIN_NV04(push, SUBC_3D(0x1334), 1);
+		PUSH_DATA (push, 0);
+		state->tex_flush = FALSE;
+	}
 
 	PUSH_RESET(push);
 	PUSH_REFN (push, pNv->tesla_scratch, NOUVEAU_BO_VRAM | NOUVEAU_BO_RDWR);
-	PUSH_REFN (push, src, NOUVEAU_BO_VRAM | NOUVEAU_BO_RD);
-	PUSH_REFN (push, dst, NOUVEAU_BO_VRAM | NOUVEAU_BO_WR);
+	if (src)
+		PUSH_REFN (push, src,
+			   nouveau_pixmap_domain(pspix) | NOUVEAU_BO_RD);
+	else
+		PUSH_REFN (push, state->grad[0].bo,
+			   NOUVEAU_BO_GART | NOUVEAU_BO_RD);
+	PUSH_REFN (push, dst, nouveau_pixmap_domain(pdpix) | NOUVEAU_BO_WR);
+	if (mask)
+		PUSH_REFN (push, mask,
+			   nouveau_pixmap_domain(pmpix) | NOUVEAU_BO_RD);
+	else
 	if (pmpict)
-		PUSH_REFN (push, mask, NOUVEAU_BO_VRAM | NOUVEAU_BO_RD);
+		PUSH_REFN (push, state->grad[1].bo,
+			   NOUVEAU_BO_GART | NOUVEAU_BO_RD);
 
 	nouveau_pushbuf_bufctx(push, pNv->bufctx);
 	if (nouveau_pushbuf_validate(push)) {
@@ -837,6 +1072,12 @@ NV50EXAPrepareComposite(int op,
 		NOUVEAU_FALLBACK("validate\n");
 	}
 
+	state->ca_pix = pdpix;
+	state->ca_pict = pdpict;
+	state->ca_rects = 0;
+	state->failed = FALSE;
+	if (state->ca_two_pass)
+		pNv->composite_two_pass++;
 	return TRUE;
 }
 
@@ -861,73 +1102,201 @@ NV50EXATransform(PictTransformPtr t, int x, int y, float sx, float sy,
 	}
 }
 
+static inline void
+NV50EXATexCoord(int unit, int x, int y, float *x_ret, float *y_ret)
+{
+	struct nv50_exa_state *state = &exa_state;
+
+	if (state->unit[unit].gradient) {
+		nouveau_gradient_coord(state->unit[unit].gradient, x, y,
+				       x_ret, y_ret);
+	} else {
+		NV50EXATransform(state->unit[unit].transform, x, y,
+				 state->unit[unit].width,
+				 state->unit[unit].height, x_ret, y_ret);
+	}
+}
+
+static void
+NV50EXAVertices(NVPtr pNv, struct nv50_vertex *v)
+{
+	int i;
+
+	for (i = 0; i < 4; i++, v++) {
+		if (exa_state.have_mask) {
+			VTX2s(pNv, v->src[0], v->src[1], v->mask[0], v->mask[1],
+			      v->dx, v->dy);
+		} else {
+			VTX1s(pNv, v->src[0], v->src[1], v->dx, v->dy);
+		}
+	}
+}
+
+/* Over with a component-alpha mask needs both the source colour and the
+ * source alpha times the mask as blend factors, and the blender only has
+ * the one.  It's done in two passes over the same rects, OutReverse with
+ * src.a * mask, then Add with src * mask.  The first pass is set up by
+ * PrepareComposite, and the rects are kept until the draw's closed off,
+ * see NV50EXADrawTwoPass().
+ */
+static void
+NV50EXAComponentAlphaPass(NVPtr pNv, int op)
+{
+	struct nouveau_pushbuf *push = pNv->pushbuf;
+	struct nv50_exa_state *state = &exa_state;
+
+	NV50EXABlend(state->ca_pix, state->ca_pict, op, TRUE);
+	BEGIN_NV04(push, NV50_3D(FP_START_ID), 1);
+	if (state->ca_pict->format == PICT_a8)
+		PUSH_DATA (push, PFP_C_A8);
+	else
+	if (op == PictOpOutReverse)
+		PUSH_DATA (push, PFP_CCASA);
+	else
+		PUSH_DATA (push, PFP_CCA);
+}
+
+static void
+NV50EXADrawRects(NVPtr pNv)
+{
+	struct nouveau_pushbuf *push = pNv->pushbuf;
+	struct nv50_exa_state *state = &exa_state;
+	int i;
+
+	BEGIN_NV04(push, NV50_3D(VERTEX_BEGIN_GL), 1);
+	PUSH_DATA (push, NV50_3D_VERTEX_BEGIN_GL_PRIMITIVE_QUADS);
+	for (i = 0; i < state->ca_rects; i++)
+		NV50EXAVertices(pNv, &state->ca_vtx[i * 4]);
+	BEGIN_NV04(push, NV50_3D(VERTEX_END_GL), 1);
+	PUSH_DATA (push, 0);
+	pNv->composite_draws++;
+}
+
+/* Component-alpha rects are kept back and drawn in both passes at once,
+ * with room for all of it made first.  Were the push buffer to run out
+ * in between, the destination would be left with only the first pass.
+ */
+static void
+NV50EXADrawTwoPass(NVPtr pNv)
+{
+	struct nouveau_pushbuf *push = pNv->pushbuf;
+	struct nv50_exa_state *state = &exa_state;
+	uint32_t size = 2 * (state->ca_rects * NV50_CA_RECT_DWORDS + 4 +
+			     NV50_CA_PASS_DWORDS);
+
+	if (!PUSH_SPACE_RETRY(push, size)) {
+		state->failed = TRUE;
+		state->ca_rects = 0;
+		return;
+	}
+
+	NV50EXADrawRects(pNv);
+	NV50EXAComponentAlphaPass(pNv, PictOpAdd);
+	NV50EXADrawRects(pNv);
+	NV50EXAComponentAlphaPass(pNv, PictOpOutReverse);
+	state->ca_rects = 0;
+}
+
+/* Rects are batched up into a single draw of quads, closed off by
+ * DoneComposite, or before the pushbuf runs out of space.
+ */
+static void
+NV50EXAEndDraw(NVPtr pNv)
+{
+	struct nouveau_pushbuf *push = pNv->pushbuf;
+	struct nv50_exa_state *state = &exa_state;
+
+	if (state->in_draw) {
+		BEGIN_NV04(push, NV50_3D(VERTEX_END_GL), 1);
+		PUSH_DATA (push, 0);
+		state->in_draw = FALSE;
+	}
+
+	if (state->ca_rects)
+		NV50EXADrawTwoPass(pNv);
+}
+
+/* How many component-alpha rects are kept back, both passes of them have
+ * to fit in one push buffer
+ */
+static int
+NV50EXATwoPassRects(NVPtr pNv)
+{
+	struct nouveau_pushbuf_priv *priv = pNv->pushbuf->user_priv;
+	int rects = (priv->words / 2 - 64) / NV50_CA_RECT_DWORDS;
+
+	return rects < NV50_CA_RECTS ? rects : NV50_CA_RECTS;
+}
+
 void
 NV50EXAComposite(PixmapPtr pdpix, int sx, int sy, int mx, int my,
 		 int dx, int dy, int w, int h)
 {
 	NV50EXA_LOCALS(pdpix);
-	float sX0, sX1, sX2, sY0, sY1, sY2;
-
-	if (!PUSH_SPACE(push, 64))
-		return;
-
-	BEGIN_NV04(push, NV50_3D(SCISSOR_HORIZ(0)), 2);
-	PUSH_DATA (push, (dx + w) << 16 | dx);
-	PUSH_DATA (push, (dy + h) << 16 | dy);
-	BEGIN_NV04(push, NV50_3D(VERTEX_BEGIN_GL), 1);
-	PUSH_DATA (push, NV50_3D_VERTEX_BEGIN_GL_PRIMITIVE_TRIANGLES);
-
-	NV50EXATransform(state->unit[0].transform, sx, sy + (h * 2),
-			 state->unit[0].width, state->unit[0].height,
-			 &sX0, &sY0);
-	NV50EXATransform(state->unit[0].transform, sx, sy,
-			 state->unit[0].width, state->unit[0].height,
-			 &sX1, &sY1);
-	NV50EXATransform(state->unit[0].transform, sx + (w * 2), sy,
-			 state->unit[0].width, state->unit[0].height,
-			 &sX2, &sY2);
-
-	if (state->have_mask) {
-		float mX0, mX1, mX2, mY0, mY1, mY2;
-
-		NV50EXATransform(state->unit[1].transform, mx, my + (h * 2),
-				 state->unit[1].width, state->unit[1].height,
-				 &mX0, &mY0);
-		NV50EXATransform(state->unit[1].transform, mx, my,
-				 state->unit[1].width, state->unit[1].height,
-				 &mX1, &mY1);
-		NV50EXATransform(state->unit[1].transform, mx + (w * 2), my,
-				 state->unit[1].width, state->unit[1].height,
-				 &mX2, &mY2);
-
-		VTX2s(pNv, sX0, sY0, mX0, mY0, dx, dy + (h * 2));
-		VTX2s(pNv, sX1, sY1, mX1, mY1, dx, dy);
-		VTX2s(pNv, sX2, sY2, mX2, mY2, dx + (w * 2), dy);
+	static const int cx[4] = { 0, 1, 1, 0 };
+	static const int cy[4] = { 0, 0, 1, 1 };
+	struct nv50_vertex vtx[4], *v = vtx;
+	int i;
+
+	if (state->ca_two_pass) {
+		if (state->ca_rects >= NV50EXATwoPassRects(pNv))
+			NV50EXAEndDraw(pNv);
+		v = &state->ca_vtx[state->ca_rects++ * 4];
 	} else {
-		VTX1s(pNv, sX0, sY0, dx, dy + (h * 2));
-		VTX1s(pNv, sX1, sY1, dx, dy);
-		VTX1s(pNv, sX2, sY2, dx + (w * 2), dy);
+		if (PUSH_AVAIL(push) < 64) {
+			if (state->in_draw)
+				NV50EXAEndDraw(pNv);
+			if (!PUSH_SPACE_RETRY(push, 64)) {
+				state->failed = TRUE;
+				return;
+			}
+		}
+
+		if (!state->in_draw) {
+			BEGIN_NV04(push, NV50_3D(VERTEX_BEGIN_GL), 1);
+			PUSH_DATA (push,
+				   NV50_3D_VERTEX_BEGIN_GL_PRIMITIVE_QUADS);
+			state->in_draw = TRUE;
+			pNv->composite_draws++;
+		}
 	}
 
-	BEGIN_NV04(push, NV50_3D(VERTEX_END_GL), 1);
-	PUSH_DATA (push, 0);
+	for (i = 0; i < 4; i++) {
+		NV50EXATexCoord(0, sx + cx[i] * w, sy + cy[i] * h,
+				&v[i].src[0], &v[i].src[1]);
+
+		if (state->have_mask) {
+			NV50EXATexCoord(1, mx + cx[i] * w, my + cy[i] * h,
+					&v[i].mask[0], &v[i].mask[1]);
+		}
+
+		v[i].dx = dx + cx[i] * w;
+		v[i].dy = dy + cy[i] * h;
+	}
+	if (!state->ca_two_pass)
+		NV50EXAVertices(pNv, v);
+	pNv->composite_rects++;
 }
 
 void
 NV50EXADoneComposite(PixmapPtr pdpix)
 {
 	NV50EXA_LOCALS(pdpix);
+
+	NV50EXAEndDraw(pNv);
+	if (state->failed)
+		nouveau_exa_composite_failed(pNv);
 	nouveau_pushbuf_bufctx(push, NULL);
+	state->key.push_cur = push->cur;
 }
 
 Bool
-NV50EXARectM2MF(NVPtr pNv, int w, int h, int cpp,
+NV50EXARectM2MF(struct nouveau_pushbuf *push, int w, int h, int cpp,
 		struct nouveau_bo *src, uint32_t src_off, int src_dom,
 		int src_pitch, int src_h, int src_x, int src_y,
 		struct nouveau_bo *dst, uint32_t dst_off, int dst_dom,
 		int dst_pitch, int dst_h, int dst_x, int dst_y)
 {
-	struct nouveau_pushbuf *push = pNv->pushbuf;
 	struct nouveau_pushbuf_refn refs[] = {
 		{ src, src_dom | NOUVEAU_BO_RD },
 		{ dst, dst_dom | NOUVEAU_BO_WR },
@@ -973,8 +1342,8 @@ NV50EXARectM2MF(NVPtr pNv, int w, int h, int cpp,
 		if (line_count > 2047)
 			line_count = 2047;
 
-		if (nouveau_pushbuf_space(push, 32, 0, 0) ||
-		    nouveau_pushbuf_refn (push, refs, 2))
+		if (!PUSH_SPACE(push, 32) ||
+		    PUSH_REFS(push, refs, 2))
 			return FALSE;
 
 		BEGIN_NV04(push, NV50_M2MF(OFFSET_IN_HIGH), 2);
@@ -1011,3 +1380,27 @@ NV50EXARectM2MF(NVPtr pNv, int w, int h, int cpp,
 
 	return TRUE;
 }
+
+/* Have the 3D engine write a report holding the GPU's timestamp to bo at
+ * offset, see nouveau_profile.c
+ */
+Bool
+NV50EXAQueryTimestamp(NVPtr pNv, struct nouveau_bo *bo, uint32_t offset,
+		      uint32_t sequence)
+{
+	struct nouveau_pushbuf *push = pNv->pushbuf;
+
+	if (!PUSH_SPACE(push, 8) ||
+	    PUSH_REFS(push, &(struct nouveau_pushbuf_refn) {
+				bo, NOUVEAU_BO_GART | NOUVEAU_BO_WR
+			  }, 1))
+		return FALSE;
+
+	BEGIN_NV04(push, NV50_3D(QUERY_ADDRESS_HIGH), 4);
+	PUSH_DATA (push, (bo->offset + offset) >> 32);
+	PUSH_DATA (push, (bo->offset + offset));
+	PUSH_DATA (push, sequence);
+	PUSH_DATA (push, NV50_3D_QUERY_GET_UNIT_STRMOUT |
+			 NV50_3D_QUERY_GET_MODE_WRITE_UNK2);
+	return TRUE;
+}
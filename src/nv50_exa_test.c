@@ -0,0 +1,410 @@
+/*
+ * Copyright 2012 Nouveau Project
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF
+ * OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/* Method streams the NV50 acceleration code sends, checked against
+ * nouveau_mock.c's decoding of the push buffer.
+ */
+
+#include "nv_include.h"
+#include "nv50_accel.h"
+#include "nouveau_mock.h"
+
+static int failures;
+
+#define CHECK(cond, ...) do {						\
+	if (!(cond)) {							\
+		fprintf(stderr, "%s:%d: ", __func__, __LINE__);		\
+		fprintf(stderr, __VA_ARGS__);				\
+		fprintf(stderr, "\n");					\
+		failures++;						\
+	}								\
+} while (0)
+
+static Bool
+test_is(struct nouveau_mock_mthd *m, int subc, uint32_t mthd)
+{
+	return m->subc == subc && m->mthd == mthd;
+}
+
+static float
+test_float(uint32_t data)
+{
+	union { float f; uint32_t i; } d = { .i = data };
+
+	return d.f;
+}
+
+#define BF(f) NV50_BLEND_FACTOR_##f
+
+/* Blend state and fragment program at the time of a draw */
+struct test_pass {
+	uint32_t sblend, dblend, fp;
+};
+
+/* Over with a component-alpha mask is drawn twice, OutReverse and then
+ * Add, with the blend state put back for the next batch.  Nothing else
+ * gets a second pass, component-alpha or not.
+ */
+static void
+test_component_alpha(ScrnInfoPtr pScrn)
+{
+	NVPtr pNv = NVPTR(pScrn);
+	const struct {
+		int op;
+		Bool ca;
+		int passes;
+		struct test_pass pass[2];
+	} tests[] = {
+		{ PictOpOver, TRUE, 2, {
+			{ BF(ZERO), BF(ONE_MINUS_SRC_COLOR), PFP_CCASA },
+			{ BF(ONE), BF(ONE), PFP_CCA } } },
+		{ PictOpOver, FALSE, 1, {
+			{ BF(ONE), BF(ONE_MINUS_SRC_ALPHA), PFP_C } } },
+		{ PictOpAdd, TRUE, 1, {
+			{ BF(ONE), BF(ONE), PFP_CCA } } },
+		{ PictOpOutReverse, TRUE, 1, {
+			{ BF(ZERO), BF(ONE_MINUS_SRC_COLOR), PFP_CCASA } } },
+	};
+	ExaDriverPtr exa = pNv->EXADriverPtr;
+	PixmapPtr pspix = nouveau_mock_pixmap(pScrn, 64, 64, 32, 0);
+	PixmapPtr pmpix = nouveau_mock_pixmap(pScrn, 64, 64, 32, 0);
+	PixmapPtr pdpix = nouveau_mock_pixmap(pScrn, 256, 256, 32, 0);
+	PicturePtr pspict = nouveau_mock_picture(pspix, PICT_a8r8g8b8);
+	PicturePtr pmpict = nouveau_mock_picture(pmpix, PICT_a8r8g8b8);
+	PicturePtr pdpict = nouveau_mock_picture(pdpix, PICT_a8r8g8b8);
+	struct nouveau_mock_mthd *m;
+	struct test_pass pass[3], cur = {};
+	unsigned t, two_pass;
+	int i, nr, n;
+
+	for (t = 0; t < sizeof(tests) / sizeof(tests[0]); t++) {
+		/* all of the state's emitted, not just what changed */
+		PUSH_KICK(pNv->pushbuf);
+		PUSH_SHADOW_RESET(pNv->pushbuf);
+		nouveau_mock_reset();
+		two_pass = pNv->composite_two_pass;
+
+		pmpict->componentAlpha = tests[t].ca;
+		CHECK(exa->CheckComposite(tests[t].op, pspict, pmpict,
+					  pdpict) &&
+		      exa->PrepareComposite(tests[t].op, pspict, pmpict,
+					    pdpict, pspix, pmpix, pdpix),
+		      "op %d prepare failed", tests[t].op);
+		exa->Composite(pdpix, 0, 0, 0, 0, 8, 8, 16, 16);
+		exa->DoneComposite(pdpix);
+		nr = nouveau_mock_mthds(pNv->pushbuf, &m);
+
+		for (i = n = 0; i < nr; i++) {
+			if (test_is(&m[i], NV50_3D(BLEND_FUNC_SRC_RGB)))
+				cur.sblend = m[i].data;
+			if (test_is(&m[i], NV50_3D(BLEND_FUNC_DST_RGB)))
+				cur.dblend = m[i].data;
+			if (test_is(&m[i], NV50_3D(FP_START_ID)))
+				cur.fp = m[i].data;
+			if (test_is(&m[i], NV50_3D(VERTEX_BEGIN_GL)) &&
+			    n < 3)
+				pass[n++] = cur;
+		}
+
+		CHECK(n == tests[t].passes, "op %d ca %d: %d passes, "
+		      "expected %d", tests[t].op, tests[t].ca, n,
+		      tests[t].passes);
+		CHECK(pNv->composite_two_pass - two_pass == (n == 2),
+		      "op %d ca %d: two pass count", tests[t].op,
+		      tests[t].ca);
+		for (i = 0; i < n && i < tests[t].passes; i++) {
+			CHECK(!memcmp(&pass[i], &tests[t].pass[i],
+				      sizeof(pass[i])),
+			      "op %d ca %d pass %d: blend 0x%x 0x%x fp 0x%x",
+			      tests[t].op, tests[t].ca, i, pass[i].sblend,
+			      pass[i].dblend, pass[i].fp);
+		}
+		CHECK(!memcmp(&cur, &tests[t].pass[0], sizeof(cur)),
+		      "op %d ca %d: first pass state not restored",
+		      tests[t].op, tests[t].ca);
+		free(m);
+	}
+
+	nouveau_mock_picture_destroy(pspict);
+	nouveau_mock_picture_destroy(pmpict);
+	nouveau_mock_picture_destroy(pdpict);
+	nouveau_mock_pixmap_destroy(pspix);
+	nouveau_mock_pixmap_destroy(pmpix);
+	nouveau_mock_pixmap_destroy(pdpix);
+}
+
+/* Pitch-linear pixmaps, like a scanout buffer that isn't tiled, are
+ * sampled through a RECT TIC with the pitch in place of the tiling.
+ * Their pitch has to be 32-byte aligned and fit the TIC.
+ */
+static void
+test_linear_texture(ScrnInfoPtr pScrn)
+{
+	NVPtr pNv = NVPTR(pScrn);
+	ExaDriverPtr exa = pNv->EXADriverPtr;
+	PixmapPtr pspix, pdpix = nouveau_mock_pixmap(pScrn, 256, 256, 32, 0);
+	PicturePtr pspict, pdpict = nouveau_mock_picture(pdpix, PICT_a8r8g8b8);
+	struct nouveau_mock_mthd *m;
+	uint32_t desc[7];
+	uint64_t addr;
+	int pitch, i, j, nr;
+
+	pNv->tiled_scanout = FALSE;
+	pspix = nouveau_mock_pixmap(pScrn, 100, 50, 32,
+				    NOUVEAU_CREATE_PIXMAP_SCANOUT);
+	pNv->tiled_scanout = TRUE;
+	pspict = nouveau_mock_picture(pspix, PICT_a8r8g8b8);
+	pitch = pspix->devKind;
+	CHECK(!nv50_style_tiled_pixmap(pspix), "scanout pixmap is tiled");
+
+	addr = nouveau_pixmap_bo(pspix)->offset + nouveau_pixmap_offset(pspix);
+	desc[0] = addr;
+	desc[1] = (addr >> 32) | 0xd0001000 | NV50TIC_0_2_TARGET_RECT |
+		  NV50TIC_0_2_LINEAR;
+	desc[2] = pitch;
+	desc[3] = 100;
+	desc[4] = (1 << NV50TIC_0_5_DEPTH_SHIFT) | 50;
+	desc[5] = 0;
+	desc[6] = 0;
+
+	PUSH_KICK(pNv->pushbuf);
+	nouveau_mock_reset();
+	CHECK(exa->CheckComposite(PictOpSrc, pspict, NULL, pdpict) &&
+	      exa->PrepareComposite(PictOpSrc, pspict, NULL, pdpict,
+				    pspix, NULL, pdpix), "prepare failed");
+	exa->Composite(pdpix, 0, 0, 0, 0, 0, 0, 100, 50);
+	exa->DoneComposite(pdpix);
+	nr = nouveau_mock_mthds(pNv->pushbuf, &m);
+
+	/* the TIC's words after the format, wherever they were written */
+	for (i = 0; i < nr; i++) {
+		for (j = 0; j < 7 && i + j < nr; j++) {
+			if (m[i + j].data != desc[j])
+				break;
+		}
+		if (j == 7)
+			break;
+	}
+	CHECK(i < nr, "no linear TIC for pitch %d", pitch);
+	free(m);
+
+	pspix->devKind = 416;
+	CHECK(exa->CheckComposite(PictOpSrc, pspict, NULL, pdpict),
+	      "32-byte aligned pitch rejected");
+	pspix->devKind = 408;
+	CHECK(!exa->CheckComposite(PictOpSrc, pspict, NULL, pdpict),
+	      "unaligned pitch accepted");
+	pspix->devKind = NV50TIC_0_3_PITCH_MASK + 1;
+	CHECK(!exa->CheckComposite(PictOpSrc, pspict, NULL, pdpict),
+	      "pitch too large for the TIC accepted");
+	pspix->devKind = pitch;
+
+	nouveau_mock_picture_destroy(pspict);
+	nouveau_mock_picture_destroy(pdpict);
+	nouveau_mock_pixmap_destroy(pspix);
+	nouveau_mock_pixmap_destroy(pdpix);
+}
+
+/* An upload is counted towards the submission scheduler by its size */
+static void
+test_sifc_queued(ScrnInfoPtr pScrn)
+{
+	NVPtr pNv = NVPTR(pScrn);
+	struct nouveau_pushbuf_priv *priv = pNv->pushbuf->user_priv;
+	PixmapPtr pdpix = nouveau_mock_pixmap(pScrn, 64, 64, 32, 0);
+	uint32_t data[8 * 4] = {};
+
+	PUSH_KICK(pNv->pushbuf);
+	CHECK(NV50EXAUploadSIFC((char *)data, 8 * 4, pdpix, 1, 2, 8, 4, 4),
+	      "upload failed");
+	CHECK(priv->pixels == 8 * 4, "%u pixels queued, expected %d",
+	      priv->pixels, 8 * 4);
+
+	nouveau_mock_pixmap_destroy(pdpix);
+}
+
+/* Both passes of a component-alpha batch are drawn, or neither is and
+ * it's reported.  It's never left with just the first.
+ */
+static void
+test_two_pass_space(ScrnInfoPtr pScrn)
+{
+	NVPtr pNv = NVPTR(pScrn);
+	struct nouveau_pushbuf *push = pNv->pushbuf;
+	ExaDriverPtr exa = pNv->EXADriverPtr;
+	PixmapPtr pspix = nouveau_mock_pixmap(pScrn, 64, 64, 32, 0);
+	PixmapPtr pmpix = nouveau_mock_pixmap(pScrn, 64, 64, 32, 0);
+	PixmapPtr pdpix = nouveau_mock_pixmap(pScrn, 256, 256, 32, 0);
+	PicturePtr pspict = nouveau_mock_picture(pspix, PICT_a8r8g8b8);
+	PicturePtr pmpict = nouveau_mock_picture(pmpix, PICT_a8r8g8b8);
+	PicturePtr pdpict = nouveau_mock_picture(pdpix, PICT_a8r8g8b8);
+	struct nouveau_mock_mthd *m;
+	int fail, i, nr, draws, vertices;
+	unsigned failed;
+
+	pmpict->componentAlpha = TRUE;
+	for (fail = 1; fail <= 2; fail++) {
+		PUSH_KICK(push);
+		nouveau_mock_reset();
+		failed = pNv->composite_failed;
+
+		CHECK(exa->PrepareComposite(PictOpOver, pspict, pmpict, pdpict,
+					    pspix, pmpix, pdpix),
+		      "prepare failed");
+		for (i = 0; i < 3; i++)
+			exa->Composite(pdpix, 0, 0, 0, 0, i * 16, 0, 16, 16);
+
+		/* leave room for one pass of 3 rects, 7 dwords a vertex, but
+		 * not both
+		 */
+		while (PUSH_AVAIL(push) >= 3 * 4 * 7 + 32)
+			PUSH_DATA (push, 0);
+		nouveau_mock_fail_space(fail);
+		exa->DoneComposite(pdpix);
+		nouveau_mock_fail_space(0);
+		nr = nouveau_mock_mthds(push, &m);
+
+		for (i = draws = vertices = 0; i < nr; i++) {
+			if (test_is(&m[i], NV50_3D(VERTEX_BEGIN_GL)))
+				draws++;
+			if (test_is(&m[i], NV50_3D(VTX_ATTR_2I(0))))
+				vertices++;
+		}
+
+		if (fail == 1) {
+			CHECK(draws == 2 && vertices == 2 * 3 * 4,
+			      "%d draws of %d vertices after submitting",
+			      draws, vertices);
+			CHECK(pNv->composite_failed == failed,
+			      "batch reported as failed");
+		} else {
+			CHECK(!draws, "%d draws of %d vertices without space",
+			      draws, vertices);
+			CHECK(pNv->composite_failed == failed + 1,
+			      "failed batch not reported");
+		}
+		free(m);
+	}
+
+	nouveau_mock_picture_destroy(pspict);
+	nouveau_mock_picture_destroy(pmpict);
+	nouveau_mock_picture_destroy(pdpict);
+	nouveau_mock_pixmap_destroy(pspix);
+	nouveau_mock_pixmap_destroy(pmpix);
+	nouveau_mock_pixmap_destroy(pdpix);
+}
+
+/* A run of composites only keeps its state while the pictures it was set
+ * up for are unchanged.  A new transform isn't, even in place, and nor is
+ * a new picture that happens to be where a destroyed one was.  One with
+ * the same transform at a new address is, but it's that one that's used.
+ */
+static void
+test_reuse_transform(ScrnInfoPtr pScrn)
+{
+	NVPtr pNv = NVPTR(pScrn);
+	ExaDriverPtr exa = pNv->EXADriverPtr;
+	PixmapPtr pspix = nouveau_mock_pixmap(pScrn, 64, 64, 32, 0);
+	PixmapPtr pdpix = nouveau_mock_pixmap(pScrn, 256, 256, 32, 0);
+	PicturePtr pspict = nouveau_mock_picture(pspix, PICT_a8r8g8b8);
+	PicturePtr pdpict = nouveau_mock_picture(pdpix, PICT_a8r8g8b8);
+	PictTransform t[2] = {
+		{ { { xFixed1, 0, 0 }, { 0, xFixed1, 0 }, { 0, 0, xFixed1 } } },
+		{ { { xFixed1, 0, 0 }, { 0, xFixed1, 0 }, { 0, 0, xFixed1 } } },
+	};
+	const struct {
+		int tx;        /* translation of the transform in use */
+		Bool moved;    /* to the other copy of it */
+		Bool new_dst;  /* destination picture destroyed and replaced */
+		Bool reuse;
+	} tests[] = {
+		{  8, FALSE, FALSE, FALSE },
+		{  8, FALSE, FALSE, TRUE },
+		{ 16, FALSE, FALSE, FALSE },
+		{ 16, TRUE, FALSE, TRUE },
+		{ 16, FALSE, TRUE, FALSE },
+	};
+	struct nouveau_mock_mthd *m;
+	unsigned i, reused;
+	int nr, cur = 0;
+
+	pspict->transform = &t[cur];
+	for (i = 0; i < sizeof(tests) / sizeof(tests[0]); i++) {
+		if (tests[i].moved) {
+			/* and what's left where it was isn't to be used */
+			t[!cur] = t[cur];
+			t[cur].matrix[0][2] = IntToxFixed(32);
+			cur = !cur;
+			pspict->transform = &t[cur];
+		}
+		t[cur].matrix[0][2] = IntToxFixed(tests[i].tx);
+
+		if (tests[i].new_dst) {
+			nouveau_mock_picture_destroy(pdpict);
+			pdpict = nouveau_mock_picture(pdpix, PICT_a8r8g8b8);
+		}
+
+		PUSH_KICK(pNv->pushbuf);
+		nouveau_mock_reset();
+		reused = pNv->composite_reused;
+		CHECK(exa->PrepareComposite(PictOpSrc, pspict, NULL, pdpict,
+					    pspix, NULL, pdpix),
+		      "%d: prepare failed", i);
+		exa->Composite(pdpix, 0, 0, 0, 0, 0, 0, 16, 16);
+		exa->DoneComposite(pdpix);
+		nr = nouveau_mock_mthds(pNv->pushbuf, &m);
+
+		CHECK(pNv->composite_reused - reused == tests[i].reuse,
+		      "%d: state %sreused", i, tests[i].reuse ? "not " : "");
+
+		/* the first vertex's source coordinates */
+		nr = nouveau_mock_find(m, nr, 0, NV50_3D(VTX_ATTR_2F_X(8)));
+		CHECK(nr >= 0 && test_float(m[nr].data) == tests[i].tx / 64.0f,
+		      "%d: texcoord %f, expected %f", i,
+		      nr >= 0 ? test_float(m[nr].data) : 0.0f,
+		      tests[i].tx / 64.0f);
+		free(m);
+	}
+
+	nouveau_mock_picture_destroy(pspict);
+	nouveau_mock_picture_destroy(pdpict);
+	nouveau_mock_pixmap_destroy(pspix);
+	nouveau_mock_pixmap_destroy(pdpix);
+}
+
+int
+main(int argc, char *argv[])
+{
+	ScrnInfoPtr pScrn = nouveau_mock_screen_init(0x84, 1024, 768);
+
+	/* leave out the channel setup */
+	PUSH_KICK(NVPTR(pScrn)->pushbuf);
+	nouveau_mock_record(TRUE);
+	test_component_alpha(pScrn);
+	test_linear_texture(pScrn);
+	test_reuse_transform(pScrn);
+	test_sifc_queued(pScrn);
+	test_two_pass_space(pScrn);
+	nouveau_mock_screen_fini(pScrn);
+
+	return failures ? 1 : 0;
+}
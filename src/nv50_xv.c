@@ -71,13 +71,15 @@ nv50_xv_image_put(ScrnInfoPtr pScrn,
 {
 	NVPtr pNv = NVPTR(pScrn);
 	struct nouveau_bo *dst = nouveau_pixmap_bo(ppix);
+	uint64_t dst_addr = dst->offset + nouveau_pixmap_offset(ppix);
 	struct nouveau_pushbuf *push = pNv->pushbuf;
 	struct nouveau_pushbuf_refn refs[] = {
 		{ pNv->tesla_scratch, NOUVEAU_BO_VRAM | NOUVEAU_BO_RDWR },
 		{ src, NOUVEAU_BO_VRAM | NOUVEAU_BO_RD },
-		{ dst, NOUVEAU_BO_VRAM | NOUVEAU_BO_WR },
+		{ dst, nouveau_pixmap_domain(ppix) | NOUVEAU_BO_WR },
 	};
 	uint32_t mode = 0xd0005000 | (src->config.nv50.tile_mode << 18);
+	uint32_t format = 0;
 	float X1, X2, Y1, Y2;
 	BoxPtr pbox;
 	int nbox;
@@ -88,25 +90,23 @@ nv50_xv_image_put(ScrnInfoPtr pScrn,
 	if (!PUSH_SPACE(push, 256))
 		return BadImplementation;
 
-	BEGIN_NV04(push, NV50_3D(RT_ADDRESS_HIGH(0)), 5);
-	PUSH_DATA (push, dst->offset >> 32);
-	PUSH_DATA (push, dst->offset);
 	switch (ppix->drawable.bitsPerPixel) {
-	case 32: PUSH_DATA (push, NV50_SURFACE_FORMAT_BGRA8_UNORM); break;
-	case 24: PUSH_DATA (push, NV50_SURFACE_FORMAT_BGRX8_UNORM); break;
-	case 16: PUSH_DATA (push, NV50_SURFACE_FORMAT_B5G6R5_UNORM); break;
-	case 15: PUSH_DATA (push, NV50_SURFACE_FORMAT_BGR5_X1_UNORM); break;
+	case 32: format = NV50_SURFACE_FORMAT_BGRA8_UNORM; break;
+	case 24: format = NV50_SURFACE_FORMAT_BGRX8_UNORM; break;
+	case 16: format = NV50_SURFACE_FORMAT_B5G6R5_UNORM; break;
+	case 15: format = NV50_SURFACE_FORMAT_BGR5_X1_UNORM; break;
 	}
-	PUSH_DATA (push, dst->config.nv50.tile_mode);
-	PUSH_DATA (push, 0);
-	BEGIN_NV04(push, NV50_3D(RT_HORIZ(0)), 2);
-	PUSH_DATA (push, ppix->drawable.width);
-	PUSH_DATA (push, ppix->drawable.height);
-	BEGIN_NV04(push, NV50_3D(RT_ARRAY_MODE), 1);
-	PUSH_DATA (push, 1);
 
-	BEGIN_NV04(push, NV50_3D(BLEND_ENABLE(0)), 1);
-	PUSH_DATA (push, 0);
+	PUSH_SHADOW_NV04(push, NV50_3D(RT_ADDRESS_HIGH(0)), (uint32_t []) {
+			 dst_addr >> 32, dst_addr, format,
+			 dst->config.nv50.tile_mode, 0 }, 5);
+	PUSH_SHADOW_NV04(push, NV50_3D(RT_HORIZ(0)), (uint32_t []) {
+			 ppix->drawable.width, ppix->drawable.height }, 2);
+	PUSH_SHADOW_NV04(push, NV50_3D(RT_ARRAY_MODE), (uint32_t []) {
+			 1 }, 1);
+
+	PUSH_SHADOW_NV04(push, NV50_3D(BLEND_ENABLE(0)), (uint32_t []) {
+			 0 }, 1);
 
 	BEGIN_NV04(push, NV50_3D(CB_DEF_ADDRESS_HIGH), 3);
 	PUSH_DATA (push, (pNv->tesla_scratch->offset + TIC_OFFSET) >> 32);
@@ -252,17 +252,17 @@ nv50_xv_image_put(ScrnInfoPtr pScrn,
 		ty1 = ty1 / height;
 		ty2 = ty2 / height;
 
-		if (nouveau_pushbuf_space(push, 64, 0, 0) ||
-		    nouveau_pushbuf_refn (push, refs, 3))
+		if (!PUSH_SPACE(push, 64) ||
+		    PUSH_REFS(push, refs, 3))
 			return BadImplementation;
 
 		/* NV50_3D_SCISSOR_VERT_T_SHIFT is wrong, because it was deducted with
 		* origin lying at the bottom left. This will be changed to _MIN_ and _MAX_
 		* later, because it is origin dependent.
 		*/
-		BEGIN_NV04(push, NV50_3D(SCISSOR_HORIZ(0)), 2);
-		PUSH_DATA (push, sx2 << NV50_3D_SCISSOR_HORIZ_MAX__SHIFT | sx1);
-		PUSH_DATA (push, sy2 << NV50_3D_SCISSOR_VERT_MAX__SHIFT | sy1 );
+		PUSH_SHADOW_NV04(push, NV50_3D(SCISSOR_HORIZ(0)), (uint32_t []) {
+				 sx2 << NV50_3D_SCISSOR_HORIZ_MAX__SHIFT | sx1,
+				 sy2 << NV50_3D_SCISSOR_VERT_MAX__SHIFT | sy1 }, 2);
 
 		BEGIN_NV04(push, NV50_3D(VERTEX_BEGIN_GL), 1);
 		PUSH_DATA (push, NV50_3D_VERTEX_BEGIN_GL_PRIMITIVE_TRIANGLES);
@@ -336,8 +336,8 @@ nv50_xv_csc_update(ScrnInfoPtr pScrn, NVPortPrivPtr pPriv)
 		return;
 	}
 
-	if (nouveau_pushbuf_space(push, 64, 0, 0) ||
-	    nouveau_pushbuf_refn (push, &(struct nouveau_pushbuf_refn) {
+	if (!PUSH_SPACE(push, 64) ||
+	    PUSH_REFS(push, &(struct nouveau_pushbuf_refn) {
 					pNv->tesla_scratch, NOUVEAU_BO_WR |
 					NOUVEAU_BO_VRAM }, 1))
 		return;
@@ -28,34 +28,35 @@
 #include "hwdefs/nv50_2d.xml.h"
 #include "nv04_accel.h"
 
-Bool
-nouveau_allocate_surface(ScrnInfoPtr scrn, int width, int height, int bpp,
-			 int usage_hint, int *pitch, struct nouveau_bo **bo)
+void
+nouveau_surface_layout(ScrnInfoPtr scrn, int width, int height, int bpp,
+		       int usage_hint, struct nouveau_surface *surf)
 {
 	NVPtr pNv = NVPTR(scrn);
 	Bool scanout = (usage_hint & NOUVEAU_CREATE_PIXMAP_SCANOUT);
 	Bool tiled = (usage_hint & NOUVEAU_CREATE_PIXMAP_TILED);
 	union nouveau_bo_config cfg = {};
 	int flags = NOUVEAU_BO_MAP | (bpp >= 8 ? NOUVEAU_BO_VRAM : 0);
-	int cpp = bpp / 8, ret;
+	int cpp = bpp / 8;
+	int pitch;
 
 	if (pNv->Architecture >= NV_ARCH_50) {
 		if (scanout) {
 			if (pNv->tiled_scanout) {
 				tiled = TRUE;
-				*pitch = NOUVEAU_ALIGN(width * cpp, 64);
+				pitch = NOUVEAU_ALIGN(width * cpp, 64);
 			} else {
-				*pitch = NOUVEAU_ALIGN(width * cpp, 256);
+				pitch = NOUVEAU_ALIGN(width * cpp, 256);
 			}
 		} else {
 			if (bpp >= 8)
 				tiled = TRUE;
-			*pitch = NOUVEAU_ALIGN(width * cpp, 64);
+			pitch = NOUVEAU_ALIGN(width * cpp, 64);
 		}
 	} else {
 		if (scanout && pNv->tiled_scanout)
 			tiled = TRUE;
-		*pitch = NOUVEAU_ALIGN(width * cpp, 64);
+		pitch = NOUVEAU_ALIGN(width * cpp, 64);
 	}
 
 	if (tiled) {
@@ -92,10 +93,10 @@ nouveau_allocate_surface(ScrnInfoPtr scrn, int width, int height, int bpp,
 		} else {
 			int pitch_align = max(
 				pNv->dev->chipset >= 0x40 ? 1024 : 256,
-				round_down_pow2(*pitch / 4));
+				round_down_pow2(pitch / 4));
 
-			*pitch = NOUVEAU_ALIGN(*pitch, pitch_align);
-			cfg.nv04.surf_pitch = *pitch;
+			pitch = NOUVEAU_ALIGN(pitch, pitch_align);
+			cfg.nv04.surf_pitch = pitch;
 		}
 	}
 
@@ -111,12 +112,30 @@ nouveau_allocate_surface(ScrnInfoPtr scrn, int width, int height, int bpp,
 	if (usage_hint & NOUVEAU_CREATE_PIXMAP_SCANOUT)
 		flags |= NOUVEAU_BO_CONTIG;
 
-	ret = nouveau_bo_new(pNv->dev, flags, 0, *pitch * height, &cfg, bo);
+	surf->flags = flags;
+	surf->pitch = pitch;
+	surf->height = height;
+	surf->cfg = cfg;
+}
+
+Bool
+nouveau_allocate_surface(ScrnInfoPtr scrn, int width, int height, int bpp,
+			 int usage_hint, int *pitch, struct nouveau_bo **bo)
+{
+	NVPtr pNv = NVPTR(scrn);
+	struct nouveau_surface surf;
+	int ret;
+
+	nouveau_surface_layout(scrn, width, height, bpp, usage_hint, &surf);
+
+	ret = nouveau_bo_new(pNv->dev, surf.flags, 0, surf.pitch * surf.height,
+			     &surf.cfg, bo);
 	if (ret) {
 		ErrorF("%d\n", ret);
 		return FALSE;
 	}
 
+	*pitch = surf.pitch;
 	return TRUE;
 }
 
@@ -651,6 +670,11 @@ NVAccelCommonInit(ScrnInfoPtr pScrn)
 		break;
 	}
 
+	/* the methods above went out behind the state shadow's back */
+	PUSH_SHADOW_RESET(pNv->pushbuf);
+	NVInitDmaTransfer(pScrn);
+	nouveau_capture_objects(pScrn);
+	nouveau_profile_init(pScrn);
 	return TRUE;
 }
 
@@ -677,8 +701,11 @@ void NVAccelFree(ScrnInfoPtr pScrn)
 	nouveau_object_del(&pNv->Nv2D);
 	nouveau_object_del(&pNv->NvMemFormat);
 	nouveau_object_del(&pNv->NvSW);
+	nouveau_object_del(&pNv->NvCopy);
 	nouveau_object_del(&pNv->Nv3D);
 
 	nouveau_bo_ref(NULL, &pNv->tesla_scratch);
 	nouveau_bo_ref(NULL, &pNv->shader_mem);
+	nouveau_bo_ref(NULL, &pNv->vtx_stream[0]);
+	nouveau_bo_ref(NULL, &pNv->vtx_stream[1]);
 }
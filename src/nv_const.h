@@ -16,6 +16,13 @@ typedef enum {
     OPTION_ZAPHOD_HEADS,
     OPTION_PAGE_FLIP,
     OPTION_SWAP_LIMIT,
+    OPTION_INLINE_UPLOAD_LIMIT,
+    OPTION_SLAB_PIXMAP_SIZE,
+    OPTION_PUSH_BUFFERS,
+    OPTION_PUSH_BUFFER_CAPTURE,
+    OPTION_GPU_PROFILE,
+    OPTION_TRANSFER_CHANNEL,
+    OPTION_SHADOW_CACHE_SIZE,
 } NVOpts;
 
 
@@ -30,6 +37,13 @@ static const OptionInfoRec NVOptions[] = {
     { OPTION_ZAPHOD_HEADS,	"ZaphodHeads",	OPTV_STRING,	{0}, FALSE },
     { OPTION_PAGE_FLIP,		"PageFlip",	OPTV_BOOLEAN,	{0}, FALSE },
     { OPTION_SWAP_LIMIT,	"SwapLimit",	OPTV_INTEGER,	{0}, FALSE },
+    { OPTION_INLINE_UPLOAD_LIMIT, "InlineUploadLimit", OPTV_INTEGER, {0}, FALSE },
+    { OPTION_SLAB_PIXMAP_SIZE,	"SlabPixmapSize", OPTV_INTEGER,	{0}, FALSE },
+    { OPTION_PUSH_BUFFERS,	"PushBuffers",	OPTV_STRING,	{0}, FALSE },
+    { OPTION_PUSH_BUFFER_CAPTURE, "PushBufferCapture", OPTV_STRING, {0}, FALSE },
+    { OPTION_GPU_PROFILE,	"GPUProfile",	OPTV_BOOLEAN,	{0}, FALSE },
+    { OPTION_TRANSFER_CHANNEL,	"TransferChannel", OPTV_BOOLEAN, {0}, FALSE },
+    { OPTION_SHADOW_CACHE_SIZE,	"ShadowCacheSize", OPTV_INTEGER, {0}, FALSE },
     { -1,                       NULL,           OPTV_NONE,      {0}, FALSE }
 };
 
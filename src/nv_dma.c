@@ -24,16 +24,235 @@
 #include <errno.h>
 #include "nv_include.h"
 
-Bool
-NVInitDma(ScrnInfoPtr pScrn)
+/* Push buffer configurations, from an idle desktop up to a busy one.
+ * The count is how many can be queued to the GPU before we have to wait
+ * for it to get through one, the size how much can be built up before
+ * running out of space forces a submission.
+ */
+static const struct {
+	int nr;
+	int size;
+} pushbuf_levels[] = {
+	{ 2,  16 * 1024 },
+	{ 4,  32 * 1024 },
+	{ 4,  64 * 1024 },
+	{ 8, 128 * 1024 },
+};
+
+#define PUSHBUF_LEVELS (sizeof(pushbuf_levels) / sizeof(pushbuf_levels[0]))
+
+/* Resize checks are made at most this often, a bigger configuration is
+ * picked if buffers filled up more than PUSHBUF_GROW_WRAPS times since
+ * the last check, a smaller one once PUSHBUF_SHRINK_CHECKS checks in a
+ * row saw no wraps and nothing that wouldn't have fit in a quarter of
+ * a buffer.
+ */
+#define PUSHBUF_CHECK_MS      1000
+#define PUSHBUF_GROW_WRAPS    8
+#define PUSHBUF_SHRINK_CHECKS 10
+
+static void
+NVDmaKickNotify(struct nouveau_pushbuf *push)
+{
+	struct nouveau_pushbuf_priv *priv = push->user_priv;
+
+	if (priv->capture)
+		nouveau_capture_push(push, !priv->kicking);
+
+	if (priv->kicking)
+		return;
+
+	/* libdrm also submits by itself, to wait on or map a bo that's
+	 * referenced, which says nothing about how big the buffers are
+	 */
+	if (priv->spacing)
+		priv->wraps++;
+	else
+		priv->implicit++;
+	priv->start = NULL;
+	priv->busy = TRUE;
+	priv->submitted = nouveau_time_usec();
+	priv->pixels = 0;
+}
+
+static Bool
+NVDmaPushbufNew(ScrnInfoPtr pScrn, int nr, int size)
 {
 	NVPtr pNv = NVPTR(pScrn);
+	struct nouveau_pushbuf_priv *priv = &pNv->pushbuf_priv;
+	struct nouveau_pushbuf *push;
+	int ret;
+
+	ret = nouveau_pushbuf_new(pNv->client, pNv->channel, nr, size,
+				  true, &push);
+	if (ret) {
+		xf86DrvMsg(pScrn->scrnIndex, X_ERROR,
+			   "Error allocating DMA push buffer: %d\n",ret);
+		return FALSE;
+	}
+
+	nouveau_pushbuf_del(&pNv->pushbuf);
+	pNv->pushbuf = push;
+	pNv->pushbuf_nr = nr;
+	pNv->pushbuf_size = size;
+
+	priv->bufctx = pNv->bufctx;
+	priv->start = push->cur;
+	priv->words = size / 4;
+	priv->kicking = FALSE;
+	priv->spacing = FALSE;
+	priv->captured = push->cur;
+	priv->captured_end = push->end;
+	push->user_priv = priv;
+	push->kick_notify = NVDmaKickNotify;
+	return TRUE;
+}
+
+static void
+NVDmaPushbufConfig(ScrnInfoPtr pScrn)
+{
+	NVPtr pNv = NVPTR(pScrn);
+	const char *s;
+	int nr, size;
+
+	s = xf86GetOptValString(pNv->Options, OPTION_PUSH_BUFFERS);
+	if (s) {
+		if (sscanf(s, "%dx%d", &nr, &size) == 2 &&
+		    nr >= 1 && nr <= 16 && size >= 4 && size <= 1024) {
+			pNv->pushbuf_pinned = TRUE;
+			pNv->pushbuf_nr = nr;
+			pNv->pushbuf_size = size * 1024;
+			xf86DrvMsg(pScrn->scrnIndex, X_CONFIG,
+				   "Using %d push buffers of %dKiB\n",
+				   nr, size);
+			return;
+		}
+
+		xf86DrvMsg(pScrn->scrnIndex, X_WARNING,
+			   "Invalid PushBuffers \"%s\", expected "
+			   "<count>x<KiB>\n", s);
+	}
+
+	/* Fermi's methods are bigger, and it's usually given more to do */
+	pNv->pushbuf_pinned = FALSE;
+	pNv->pushbuf_level = pNv->Architecture >= NV_ARCH_C0 ? 2 : 1;
+	pNv->pushbuf_nr = pushbuf_levels[pNv->pushbuf_level].nr;
+	pNv->pushbuf_size = pushbuf_levels[pNv->pushbuf_level].size;
+}
+
+/* Called from the block handler, once everything queued has been kicked
+ * off, to grow the push buffers if they keep filling up or shrink them
+ * if they've been idle for a while.
+ */
+void
+NVDmaAdapt(ScrnInfoPtr pScrn)
+{
+	NVPtr pNv = NVPTR(pScrn);
+	struct nouveau_pushbuf_priv *priv = &pNv->pushbuf_priv;
+	CARD32 now = GetTimeInMillis();
+	unsigned wraps;
+	int level;
+
+	if (pNv->pushbuf_pinned ||
+	    (CARD32)(now - pNv->pushbuf_checked) < PUSHBUF_CHECK_MS)
+		return;
+
+	wraps = priv->wraps - pNv->pushbuf_check_wraps;
+	level = pNv->pushbuf_level;
+
+	if (wraps > PUSHBUF_GROW_WRAPS) {
+		pNv->pushbuf_idle_checks = 0;
+		if (level + 1 < PUSHBUF_LEVELS)
+			level++;
+	} else
+	if (!wraps && priv->peak < priv->words / 4) {
+		if (++pNv->pushbuf_idle_checks >= PUSHBUF_SHRINK_CHECKS) {
+			pNv->pushbuf_idle_checks = 0;
+			if (level > 0)
+				level--;
+		}
+	} else {
+		pNv->pushbuf_idle_checks = 0;
+	}
+
+	if (level != pNv->pushbuf_level &&
+	    NVDmaPushbufNew(pScrn, pushbuf_levels[level].nr,
+			    pushbuf_levels[level].size)) {
+		xf86DrvMsgVerb(pScrn->scrnIndex, X_INFO, 4,
+			       "Push buffers resized to %dx%dKiB\n",
+			       pushbuf_levels[level].nr,
+			       pushbuf_levels[level].size / 1024);
+		pNv->pushbuf_level = level;
+		pNv->pushbuf_resizes++;
+	}
+
+	pNv->pushbuf_checked = now;
+	pNv->pushbuf_check_wraps = priv->wraps;
+	priv->peak = 0;
+}
+
+/* Submission policy for acceleration hooks that queue work one operation
+ * at a time.  Nothing's submitted until at least SUBMIT_MIN_PIXELS worth
+ * of work is queued, after that it goes straight away if the GPU has
+ * nothing left to do.  While it's still busy with earlier work, there's
+ * no hurry, so more is batched up until either a quarter of a push buffer
+ * has been used or SUBMIT_MAX_USECS have passed since the last submission.
+ * Whatever's left is submitted from the block handler.
+ */
+#define SUBMIT_MIN_PIXELS 512
+#define SUBMIT_MAX_USECS  2000
+#define SUBMIT_POLL_USECS 250
+
+static Bool
+NVDmaBusy(struct nouveau_pushbuf *push, uint64_t now)
+{
+	struct nouveau_pushbuf_priv *priv = push->user_priv;
+
+	if (!priv->busy || !priv->fence)
+		return FALSE;
+
+	if (now - priv->polled < SUBMIT_POLL_USECS)
+		return TRUE;
+	priv->polled = now;
+
+	if (nouveau_bo_wait(priv->fence, NOUVEAU_BO_RDWR | NOUVEAU_BO_NOBLOCK,
+			    push->client))
+		return TRUE;
+
+	priv->busy = FALSE;
+	return FALSE;
+}
+
+/* Called after queueing an operation touching roughly this many pixels,
+ * submits it if it's time to.
+ */
+void
+NVDmaQueued(struct nouveau_pushbuf *push, unsigned pixels)
+{
+	struct nouveau_pushbuf_priv *priv = push->user_priv;
+	uint64_t now;
+
+	priv->pixels += pixels;
+	if (priv->pixels < SUBMIT_MIN_PIXELS)
+		return;
+
+	now = nouveau_time_usec();
+	if (NVDmaBusy(push, now) &&
+	    now - priv->submitted < SUBMIT_MAX_USECS &&
+	    priv->start && push->cur - priv->start < priv->words / 4)
+		return;
+
+	PUSH_SUBMIT(push, &priv->queued);
+}
+
+static int
+NVDmaChannelNew(NVPtr pNv, struct nouveau_object **pchan)
+{
 	struct nv04_fifo nv04_data = { .vram = NvDmaFB,
 				       .gart = NvDmaTT };
 	struct nvc0_fifo nvc0_data = { };
 	struct nouveau_object *device = &pNv->dev->object;
-	struct nouveau_fifo *fifo;
-	int size, ret;
+	int size;
 	void *data;
 
 	if (pNv->Architecture < NV_ARCH_C0) {
@@ -44,8 +263,18 @@ NVInitDma(ScrnInfoPtr pScrn)
 		size = sizeof(nvc0_data);
 	}
 
-	ret = nouveau_object_new(device, 0, NOUVEAU_FIFO_CHANNEL_CLASS,
-				 data, size, &pNv->channel);
+	return nouveau_object_new(device, 0, NOUVEAU_FIFO_CHANNEL_CLASS,
+				  data, size, pchan);
+}
+
+Bool
+NVInitDma(ScrnInfoPtr pScrn)
+{
+	NVPtr pNv = NVPTR(pScrn);
+	struct nouveau_fifo *fifo;
+	int ret;
+
+	ret = NVDmaChannelNew(pNv, &pNv->channel);
 	if (ret) {
 		xf86DrvMsg(pScrn->scrnIndex, X_ERROR,
 			   "Error creating GPU channel: %d\n", ret);
@@ -57,39 +286,177 @@ NVInitDma(ScrnInfoPtr pScrn)
 	xf86DrvMsg(pScrn->scrnIndex, X_INFO,
 		   "Opened GPU channel %d\n", fifo->channel);
 
-	ret = nouveau_pushbuf_new(pNv->client, pNv->channel, 4, 32 * 1024,
-				  true, &pNv->pushbuf);
+	ret = nouveau_bufctx_new(pNv->client, 1, &pNv->bufctx);
 	if (ret) {
-		xf86DrvMsg(pScrn->scrnIndex, X_ERROR,
-			   "Error allocating DMA push buffer: %d\n",ret);
 		NVTakedownDma(pScrn);
 		return FALSE;
 	}
 
-	ret = nouveau_bufctx_new(pNv->client, 1, &pNv->bufctx);
-	if (ret) {
+	memset(&pNv->pushbuf_priv, 0, sizeof(pNv->pushbuf_priv));
+	if (nouveau_bo_new(pNv->dev, NOUVEAU_BO_GART, 0, 4096, NULL,
+			   &pNv->pushbuf_priv.fence))
+		pNv->pushbuf_priv.fence = NULL;
+	pNv->pushbuf_created = nouveau_time_usec();
+
+	/* only the NV50 and NVC0 paths emit state through the shadow */
+	if (pNv->Architecture >= NV_ARCH_50)
+		pNv->pushbuf_priv.shadow = calloc(1, sizeof(struct nouveau_shadow));
+
+	NVDmaPushbufConfig(pScrn);
+	if (!NVDmaPushbufNew(pScrn, pNv->pushbuf_nr, pNv->pushbuf_size)) {
 		NVTakedownDma(pScrn);
 		return FALSE;
 	}
 
-	pNv->pushbuf->user_priv = pNv->bufctx;
+	pNv->pushbuf_checked = GetTimeInMillis();
+	pNv->pushbuf_check_wraps = 0;
+	pNv->pushbuf_idle_checks = 0;
+	pNv->pushbuf_resizes = 0;
+	nouveau_capture_init(pScrn);
 	return TRUE;
 }
 
+static void
+NVTakedownDmaTransfer(ScrnInfoPtr pScrn)
+{
+	NVPtr pNv = NVPTR(pScrn);
+	struct nouveau_fifo *fifo;
+
+	if (!pNv->xfer_channel)
+		return;
+	fifo = pNv->xfer_channel->data;
+
+	if (pNv->xfer_pushbuf) {
+		xf86DrvMsgVerb(pScrn->scrnIndex, X_INFO, 3,
+			       "Transfer channel: %u copies, %u kicks\n",
+			       pNv->xfer_copies, pNv->xfer_priv.kicks);
+	}
+
+	nouveau_object_del(&pNv->NvXfer);
+	nouveau_pushbuf_del(&pNv->xfer_pushbuf);
+	xf86DrvMsg(pScrn->scrnIndex, X_INFO,
+		   "Closed GPU channel %d\n", fifo->channel);
+	nouveau_object_del(&pNv->xfer_channel);
+}
+
+/* Option "TransferChannel": copies between GART and VRAM, for uploads,
+ * downloads, readbacks, Xv and moving pixmaps around, get a channel of
+ * their own so that a big one doesn't hold up the 2D/3D work queued
+ * after it.  Both push buffers belong to the same client, and libdrm
+ * kicks one when the other is about to use a buffer it has commands
+ * queued for.  The kernel then has the channel wait on a semaphore for
+ * the other one to be done with any buffers they share, so the two are
+ * only ever ordered where there's actually a dependency.
+ *
+ * Nothing is written to the main push buffer when a pixmap is moved this
+ * way, so state kept on the main channel can't assume its cursor not
+ * moving means nothing changed, see nouveau_exa_pixmap_moved().
+ *
+ * Cross-channel semaphores need an NV84 or later, older chipsets would
+ * have the kernel wait for the other channel on the CPU.
+ */
+void
+NVInitDmaTransfer(ScrnInfoPtr pScrn)
+{
+	NVPtr pNv = NVPTR(pScrn);
+	struct nouveau_pushbuf_priv *priv = &pNv->xfer_priv;
+	struct nouveau_pushbuf *push;
+	struct nouveau_fifo *fifo;
+	Bool ret;
+
+	if (!xf86ReturnOptValBool(pNv->Options, OPTION_TRANSFER_CHANNEL, FALSE))
+		return;
+
+	if (pNv->dev->chipset < 0x84) {
+		xf86DrvMsg(pScrn->scrnIndex, X_WARNING,
+			   "TransferChannel isn't supported on this chipset\n");
+		return;
+	}
+
+	if (NVDmaChannelNew(pNv, &pNv->xfer_channel) ||
+	    nouveau_pushbuf_new(pNv->client, pNv->xfer_channel, 2, 32 * 1024,
+				true, &push)) {
+		xf86DrvMsg(pScrn->scrnIndex, X_WARNING,
+			   "Error creating transfer channel\n");
+		NVTakedownDmaTransfer(pScrn);
+		return;
+	}
+	fifo = pNv->xfer_channel->data;
+
+	memset(priv, 0, sizeof(*priv));
+	priv->start = push->cur;
+	priv->words = 32 * 1024 / 4;
+	push->user_priv = priv;
+	pNv->xfer_pushbuf = push;
+	pNv->xfer_copies = 0;
+
+	if (pNv->Architecture >= NV_ARCH_C0)
+		ret = NVAccelInitTransfer_NVC0(pScrn);
+	else
+		ret = NVAccelInitTransfer_NV50(pScrn);
+	if (!ret) {
+		xf86DrvMsg(pScrn->scrnIndex, X_WARNING,
+			   "Error initialising transfer channel\n");
+		NVTakedownDmaTransfer(pScrn);
+		return;
+	}
+
+	PUSH_KICK(push);
+	xf86DrvMsg(pScrn->scrnIndex, X_CONFIG,
+		   "Using GPU channel %d for transfers\n", fifo->channel);
+}
+
 void
 NVTakedownDma(ScrnInfoPtr pScrn)
 {
 	NVPtr pNv = NVPTR(pScrn);
+
+	NVTakedownDmaTransfer(pScrn);
 	if (pNv->channel) {
+		struct nouveau_pushbuf_priv *priv = &pNv->pushbuf_priv;
 		struct nouveau_fifo *fifo = pNv->channel->data;
 		int chid = fifo->channel;
 
+		if (pNv->pushbuf) {
+			uint64_t usecs = nouveau_time_usec() -
+					 pNv->pushbuf_created;
+			unsigned total = priv->wraps + priv->kicks +
+					 priv->idle + priv->queued +
+					 priv->implicit;
+
+			xf86DrvMsgVerb(pScrn->scrnIndex, X_INFO, 3,
+				       "Push buffers: %dx%dKiB, %u resizes, "
+				       "%u wraps, %u forced kicks, %u idle kicks, "
+				       "%u scheduled kicks, %u by libdrm\n",
+				       pNv->pushbuf_nr, pNv->pushbuf_size / 1024,
+				       pNv->pushbuf_resizes, priv->wraps,
+				       priv->kicks, priv->idle, priv->queued,
+				       priv->implicit);
+			xf86DrvMsgVerb(pScrn->scrnIndex, X_INFO, 3,
+				       "Submissions: %.1f/s, %llu dwords average\n",
+				       usecs ? total * 1000000.0 / usecs : 0.0,
+				       priv->fill_kicks ? (unsigned long long)
+				       (priv->fill / priv->fill_kicks) : 0ULL);
+			if (priv->shadow) {
+				xf86DrvMsgVerb(pScrn->scrnIndex, X_INFO, 3,
+					       "State shadow: %llu dwords emitted, "
+					       "%llu skipped\n",
+					       (unsigned long long)
+					       priv->shadow->emitted,
+					       (unsigned long long)
+					       priv->shadow->skipped);
+			}
+		}
+
 		nouveau_bufctx_del(&pNv->bufctx);
 		nouveau_pushbuf_del(&pNv->pushbuf);
+		nouveau_capture_fini(pScrn);
+		nouveau_bo_ref(NULL, &priv->fence);
+		free(priv->shadow);
+		priv->shadow = NULL;
 		nouveau_object_del(&pNv->channel);
 
 		xf86DrvMsg(pScrn->scrnIndex, X_INFO,
 			   "Closed GPU channel %d\n", chid);
 	}
 }
-
@@ -342,6 +342,10 @@ NVEnterVT(int scrnIndex, int flags)
 	if (!xf86SetDesiredModes(pScrn))
 		return FALSE;
 
+	/* don't trust that the channel's state survived */
+	if (!pNv->NoAccel)
+		PUSH_SHADOW_RESET(pNv->pushbuf);
+
 	if (pNv->overlayAdaptor && pNv->Architecture != NV_ARCH_04)
 		NV10WriteOverlayParameters(pScrn);
 
@@ -375,7 +379,7 @@ NVFlushCallback(CallbackListPtr *list, pointer user_data, pointer call_data)
 	NVPtr pNv = NVPTR(pScrn);
 
 	if (pScrn->vtSema && !pNv->NoAccel)
-		nouveau_pushbuf_kick(pNv->pushbuf, pNv->pushbuf->channel);
+		PUSH_SUBMIT(pNv->pushbuf, &pNv->pushbuf_priv.idle);
 }
 
 static void 
@@ -394,8 +398,13 @@ NVBlockHandler (
 	(*pScreen->BlockHandler) (i, blockData, pTimeout, pReadmask);
 	pScreen->BlockHandler = NVBlockHandler;
 
-	if (pScrn->vtSema && !pNv->NoAccel)
-		nouveau_pushbuf_kick(pNv->pushbuf, pNv->pushbuf->channel);
+	if (pScrn->vtSema && !pNv->NoAccel) {
+		PUSH_SUBMIT(pNv->pushbuf, &pNv->pushbuf_priv.idle);
+		NVDmaAdapt(pScrn);
+		nouveau_bo_cache_trim(pScrn);
+		nouveau_fallback_report(pScrn, FALSE);
+		nouveau_profile_collect(pScrn);
+	}
 
 	if (pNv->VideoTimerCallback) 
 		(*pNv->VideoTimerCallback)(pScrn, currentTime.milliseconds);
@@ -420,6 +429,7 @@ NVCreateScreenResources(ScreenPtr pScreen)
 	if (!pNv->NoAccel) {
 		ppix = pScreen->GetScreenPixmap(pScreen);
 		nouveau_bo_ref(pNv->scanout, &nouveau_pixmap(ppix)->bo);
+		nouveau_exa_calibrate(pScreen);
 	}
 
 	return TRUE;
@@ -449,6 +459,14 @@ NVCloseScreen(int scrnIndex, ScreenPtr pScreen)
 		pScrn->vtSema = FALSE;
 	}
 
+	if (!pNv->NoAccel) {
+		nouveau_exa_dump_stats(pScrn);
+		nouveau_fallback_report(pScrn, TRUE);
+		nouveau_profile_fini(pScrn);
+		nouveau_gradient_fini(pScrn);
+	}
+	nouveau_slab_fini(pScrn);
+	nouveau_bo_cache_fini(pScrn);
 	NVAccelFree(pScrn);
 	NVTakedownVideo(pScrn);
 	NVTakedownDma(pScrn);
@@ -479,6 +497,7 @@ NVCloseScreen(int scrnIndex, ScreenPtr pScreen)
 		pNv->textureAdaptor[1] = NULL;
 	}
 	if (pNv->EXADriverPtr) {
+		nouveau_exa_fini(pScreen);
 		exaDriverFini(pScreen);
 		free(pNv->EXADriverPtr);
 		pNv->EXADriverPtr = NULL;
@@ -941,7 +960,7 @@ NVMapMem(ScrnInfoPtr pScrn)
 {
 	NVPtr pNv = NVPTR(pScrn);
 	struct nouveau_device *dev = pNv->dev;
-	int ret, pitch, size;
+	int ret, pitch, size, i;
 
 	ret = nouveau_allocate_surface(pScrn, pScrn->virtualX, pScrn->virtualY,
 				       pScrn->bitsPerPixel,
@@ -977,6 +996,26 @@ NVMapMem(ScrnInfoPtr pScrn)
 			   (unsigned int)(pNv->GART->size >> 20));
 	}
 
+	/* separate buffers so that the CPU can fill one while the GPU is
+	 * still copying from another, each is fenced by the kernel
+	 */
+	size = pNv->GART ? pNv->GART->size / 8 : 0;
+	for (i = 0; size && i < NV_STAGING_SLOTS; i++) {
+		if (nouveau_bo_new(dev, NOUVEAU_BO_GART | NOUVEAU_BO_MAP,
+				   0, size, NULL, &pNv->staging[i])) {
+			xf86DrvMsg(pScrn->scrnIndex, X_WARNING,
+				   "Unable to allocate GART staging buffers\n");
+			while (i--)
+				nouveau_bo_ref(NULL, &pNv->staging[i]);
+			break;
+		}
+	}
+	if (pNv->staging[0]) {
+		xf86DrvMsg(pScrn->scrnIndex, X_INFO,
+			   "GART: Allocated %d %dKiB staging buffers\n",
+			   NV_STAGING_SLOTS, size >> 10);
+	}
+
 	return TRUE;
 }
 
@@ -988,12 +1027,17 @@ static Bool
 NVUnmapMem(ScrnInfoPtr pScrn)
 {
 	NVPtr pNv = NVPTR(pScrn);
+	int i;
 
 	drmmode_remove_fb(pScrn);
 
 	nouveau_bo_ref(NULL, &pNv->scanout);
 	nouveau_bo_ref(NULL, &pNv->offscreen);
 	nouveau_bo_ref(NULL, &pNv->GART);
+	for (i = 0; i < NV_STAGING_SLOTS; i++)
+		nouveau_bo_ref(NULL, &pNv->staging[i]);
+	nouveau_bo_ref(NULL, &pNv->readback.bo);
+	pNv->readback.nvpix = NULL;
 	return TRUE;
 }
 
@@ -51,6 +51,7 @@
 #include "xf86DDC.h"
 
 #include "region.h"
+#include "damage.h"
 
 #include <X11/extensions/randr.h>
 
@@ -19,10 +19,60 @@ Bool NVAccelGetCtxSurf2DFormatFromPicture(PicturePtr pPix, int *fmt_ret);
 PixmapPtr NVGetDrawablePixmap(DrawablePtr pDraw);
 void NVAccelFree(ScrnInfoPtr pScrn);
 void NV11SyncToVBlank(PixmapPtr ppix, BoxPtr box);
+void nouveau_surface_layout(ScrnInfoPtr scrn, int width, int height, int bpp,
+			    int usage_hint, struct nouveau_surface *surf);
 Bool nouveau_allocate_surface(ScrnInfoPtr scrn, int width, int height,
 			      int bpp, int usage_hint, int *pitch,
 			      struct nouveau_bo **bo);
 
+/* in nouveau_bo_cache.c */
+Bool nouveau_bo_cache_init(ScrnInfoPtr pScrn);
+void nouveau_bo_cache_fini(ScrnInfoPtr pScrn);
+Bool nouveau_bo_cache_new(ScrnInfoPtr pScrn, struct nouveau_surface *surf,
+			  struct nouveau_bo **pbo);
+void nouveau_bo_cache_put(ScrnInfoPtr pScrn, struct nouveau_surface *surf,
+			  struct nouveau_bo **pbo);
+void nouveau_bo_cache_trim(ScrnInfoPtr pScrn);
+
+/* in nouveau_slab.c */
+void nouveau_slab_init(ScrnInfoPtr pScrn);
+void nouveau_slab_fini(ScrnInfoPtr pScrn);
+Bool nouveau_slab_new(ScrnInfoPtr pScrn, struct nouveau_pixmap *nvpix,
+		      int width, int height, int bpp, int usage_hint);
+void nouveau_slab_put(ScrnInfoPtr pScrn, struct nouveau_pixmap *nvpix);
+Bool nouveau_slab_detach(ScrnInfoPtr pScrn, struct nouveau_pixmap *nvpix);
+
+/* in nouveau_capture.c */
+void nouveau_capture_init(ScrnInfoPtr pScrn);
+void nouveau_capture_objects(ScrnInfoPtr pScrn);
+void nouveau_capture_fini(ScrnInfoPtr pScrn);
+
+/* in nouveau_fallback.c */
+void nouveau_fallback_context(uint32_t kind, uint32_t op, PicturePtr src,
+			      PicturePtr mask, PicturePtr dst);
+void nouveau_fallback_report(ScrnInfoPtr pScrn, Bool force);
+
+/* in nouveau_gradient.c */
+Bool nouveau_gradient_check(PicturePtr ppict);
+Bool nouveau_gradient_get(NVPtr pNv, PicturePtr ppict,
+			  struct nouveau_gradient *grad);
+void nouveau_gradient_fini(ScrnInfoPtr pScrn);
+
+/* in nouveau_profile.c */
+void nouveau_profile_init(ScrnInfoPtr pScrn);
+void nouveau_profile_begin(NVPtr pNv, int kind);
+void nouveau_profile_end(NVPtr pNv, Bool done);
+void nouveau_profile_collect(ScrnInfoPtr pScrn);
+void nouveau_profile_fini(ScrnInfoPtr pScrn);
+
+/* in nouveau_vram.c */
+void nouveau_vram_init(ScrnInfoPtr pScrn);
+Bool nouveau_vram_alloc(ScrnInfoPtr pScrn, struct nouveau_pixmap *nvpix,
+			Bool force);
+void nouveau_vram_track(ScrnInfoPtr pScrn, struct nouveau_pixmap *nvpix);
+void nouveau_vram_free(ScrnInfoPtr pScrn, struct nouveau_pixmap *nvpix);
+void nouveau_vram_touch(ScrnInfoPtr pScrn, struct nouveau_pixmap *nvpix);
+
 /* in nouveau_dri2.c */
 void nouveau_dri2_vblank_handler(int fd, unsigned int frame,
 				 unsigned int tv_sec, unsigned int tv_usec,
@@ -41,10 +91,26 @@ unsigned int nv_window_belongs_to_crtc(ScrnInfoPtr, int, int, int, int);
 /* in nv_dma.c */
 Bool  NVInitDma(ScrnInfoPtr pScrn);
 void  NVTakedownDma(ScrnInfoPtr pScrn);
+void  NVDmaAdapt(ScrnInfoPtr pScrn);
+void  NVInitDmaTransfer(ScrnInfoPtr pScrn);
+void  NVDmaQueued(struct nouveau_pushbuf *push, unsigned pixels);
 
 /* in nouveau_exa.c */
 Bool nouveau_exa_init(ScreenPtr pScreen);
+void nouveau_exa_fini(ScreenPtr pScreen);
 Bool nouveau_exa_pixmap_is_onscreen(PixmapPtr pPixmap);
+void nouveau_exa_pixmap_gpu_access(PixmapPtr ppix, uint32_t access);
+void nouveau_exa_pixmap_touch(PixmapPtr ppix);
+void nouveau_exa_pixmap_moved(NVPtr pNv);
+void nouveau_exa_dump_stats(ScrnInfoPtr pScrn);
+Bool nouveau_exa_prefetch(PixmapPtr ppix, int x, int y, int w, int h);
+void nouveau_exa_calibrate(ScreenPtr pScreen);
+Bool nouveau_exa_composite_reuse(NVPtr pNv, struct nouveau_composite_key *last,
+				 int op, PicturePtr pspict, PicturePtr pmpict,
+				 PicturePtr pdpict, PixmapPtr pspix,
+				 PixmapPtr pmpix, PixmapPtr pdpix);
+void nouveau_exa_composite_failed(NVPtr pNv);
+int nouveau_exa_texture_slot(NVPtr pNv, const uint32_t *desc, Bool *write);
 bool nv50_style_tiled_pixmap(PixmapPtr ppix);
 Bool NVAccelM2MF(NVPtr pNv, int w, int h, int cpp, uint32_t srco, uint32_t dsto,
 		 struct nouveau_bo *s, int sd, int sp, int sh, int sx, int sy,
@@ -143,12 +209,14 @@ int NV40SetTexturePortAttribute(ScrnInfoPtr, Atom, INT32, pointer);
 /* in nv50_accel.c */
 void NV50SyncToVBlank(PixmapPtr ppix, BoxPtr box);
 Bool NVAccelInitM2MF_NV50(ScrnInfoPtr pScrn);
+Bool NVAccelInitTransfer_NV50(ScrnInfoPtr pScrn);
 Bool NVAccelInit2D_NV50(ScrnInfoPtr pScrn);
 Bool NVAccelInitNV50TCL(ScrnInfoPtr pScrn);
 
 /* in nvc0_accel.c */
 Bool NVAccelInitM2MF_NVC0(ScrnInfoPtr pScrn);
 Bool NVAccelInitP2MF_NVE0(ScrnInfoPtr pScrn);
+Bool NVAccelInitTransfer_NVC0(ScrnInfoPtr pScrn);
 Bool NVAccelInit2D_NVC0(ScrnInfoPtr pScrn);
 Bool NVAccelInit3D_NVC0(ScrnInfoPtr pScrn);
 
@@ -166,9 +234,10 @@ void NV50EXAComposite(PixmapPtr, int, int, int, int, int, int, int, int);
 void NV50EXADoneComposite(PixmapPtr);
 Bool NV50EXAUploadSIFC(const char *src, int src_pitch,
 		       PixmapPtr pdPix, int x, int y, int w, int h, int cpp);
-Bool NV50EXARectM2MF(NVPtr pNv, int, int, int,
+Bool NV50EXARectM2MF(struct nouveau_pushbuf *, int, int, int,
 		     struct nouveau_bo *, uint32_t, int, int, int, int, int,
 		     struct nouveau_bo *, uint32_t, int, int, int, int, int);
+Bool NV50EXAQueryTimestamp(NVPtr pNv, struct nouveau_bo *, uint32_t, uint32_t);
 
 /* in nvc0_exa.c */
 Bool NVC0AccelUploadM2MF(PixmapPtr pdpix, int x, int y, int w, int h,
@@ -189,12 +258,17 @@ void NVC0EXAComposite(PixmapPtr, int, int, int, int, int, int, int, int);
 void NVC0EXADoneComposite(PixmapPtr);
 Bool NVC0EXAUploadSIFC(const char *src, int src_pitch,
 		       PixmapPtr pdPix, int x, int y, int w, int h, int cpp);
-Bool NVC0EXARectM2MF(NVPtr pNv, int, int, int,
+Bool NVC0EXARectM2MF(struct nouveau_pushbuf *, int, int, int,
+		     struct nouveau_bo *, uint32_t, int, int, int, int, int,
+		     struct nouveau_bo *, uint32_t, int, int, int, int, int);
+Bool NVC0EXACopyWait(NVPtr pNv);
+Bool NVC0EXARectCopy(struct nouveau_pushbuf *, int, int, int,
 		     struct nouveau_bo *, uint32_t, int, int, int, int, int,
 		     struct nouveau_bo *, uint32_t, int, int, int, int, int);
-Bool NVE0EXARectCopy(NVPtr pNv, int, int, int,
+Bool NVE0EXARectCopy(struct nouveau_pushbuf *, int, int, int,
 		     struct nouveau_bo *, uint32_t, int, int, int, int, int,
 		     struct nouveau_bo *, uint32_t, int, int, int, int, int);
+Bool NVC0EXAQueryTimestamp(NVPtr pNv, struct nouveau_bo *, uint32_t, uint32_t);
 
 /* nv50_xv.c */
 int nv50_xv_image_put(ScrnInfoPtr, struct nouveau_bo *, int, int, int, int,
@@ -26,6 +26,152 @@
 #define NV_ARCH_C0  0xc0
 #define NV_ARCH_E0  0xe0
 
+/* GART staging buffers used round-robin by EXA uploads */
+#define NV_STAGING_SLOTS 4
+
+/* Throughput of one direction of EXA transfers */
+struct nouveau_transfer_stats {
+	uint64_t bytes;
+	uint64_t usecs;
+};
+
+/* Ways of getting data into a pixmap, see nouveau_exa_upload_to_screen() */
+enum {
+	NV_UPLOAD_INLINE,
+	NV_UPLOAD_GART,
+	NV_UPLOAD_DIRECT,
+	NV_UPLOAD_PATHS
+};
+
+/* Cost model for one upload path, in usecs */
+struct nouveau_transfer_cost {
+	Bool valid;
+	double fixed;
+	double per_byte;
+	double per_line;
+	double scale; /* measured/predicted, tracked at runtime */
+};
+
+/* Region read back ahead of time by nouveau_exa_prefetch().  The last
+ * region DownloadFromScreen had to wait for is watched, and prefetched
+ * again whenever a batch renders to its pixmap.
+ */
+struct nouveau_readback {
+	struct nouveau_pixmap *nvpix; /* NULL if nothing valid */
+	struct nouveau_bo *bo;
+	int x, y, w, h;
+	int pitch;
+	Bool used;                    /* a download was served from it */
+
+	PixmapPtr watch;              /* NULL if nothing is watched */
+	struct nouveau_pixmap *watch_nvpix;
+	int wx, wy, ww, wh;
+	unsigned prefetches, hits;
+};
+
+/* Part of a pixmap a CPU access was given, see nouveau_exa_cpu_box().
+ * Shadowed pixmaps log what was copied in and back out, mapped ones the
+ * whole pixmap.
+ */
+#define NV_CPU_BOXES 16
+
+enum {
+	NV_CPU_BOX_MAP,
+	NV_CPU_BOX_IN,
+	NV_CPU_BOX_OUT,
+};
+
+struct nouveau_cpu_box {
+	int op;
+	Bool write;
+	int x, y, w, h;
+	int width, height; /* of the pixmap */
+};
+
+/* CPU time and commands spent on one kind of EXA operation, from its
+ * Prepare hook to its Done hook, see nouveau_exa_op_begin()
+ */
+struct nouveau_op_stats {
+	unsigned ops;
+	uint64_t rects;
+	uint64_t nsecs;
+	uint64_t dwords;
+	unsigned lost; /* ops whose dwords went over a new push buffer */
+};
+
+/* What nouveau_profile_begin() can time, EXA operations are timed as
+ * their NV_CAPTURE_OP_*
+ */
+enum {
+	NV_PROFILE_M2MF = NV_CAPTURE_OPS,
+	NV_PROFILE_XV,
+	NV_PROFILE_SWAP,
+	NV_PROFILE_KINDS
+};
+
+struct nouveau_profile;
+
+/* Everything PrepareComposite's state depends on, for NV50+ to tell
+ * when a run of identical composites can share it.
+ */
+struct nouveau_composite_key {
+	int op;
+	struct {
+		PixmapPtr pix;
+		struct nouveau_bo *bo;
+		uint64_t addr; /* in the GPU's address space */
+	} pix[3];
+	struct {
+		PicturePtr pict;
+		CARD32 format;
+		int repeat;
+		int repeat_type;
+		int filter;
+		int component_alpha;
+		Bool transformed;
+		PictTransform transform;
+	} pict[3];
+	unsigned cpu_access;
+	unsigned pixmap_moves;
+	unsigned shadow_resets;
+	uint32_t *push_cur; /* end of the last batch, NULL if invalid */
+};
+
+/* TIC/TSC descriptor pairs the NV50+ composite code keeps in tesla_scratch,
+ * see nouveau_exa_texture_slot().  Xv writes its own to slots 0 and 1.
+ */
+#define NV_TEX_SLOT_FIRST 2
+#define NV_TEX_SLOTS      16
+
+struct nouveau_tex_cache {
+	struct {
+		uint32_t desc[16]; /* TIC, then TSC */
+		uint32_t used;     /* LRU stamp, 0 if never written */
+	} slot[NV_TEX_SLOTS];
+	uint32_t stamp;
+	unsigned hits;
+	unsigned writes;
+};
+
+/* A solid fill or gradient picture as NV50+ composite samples it, from a
+ * ramp of colours in a GART buffer of its own, see nouveau_gradient.c
+ */
+#define NV_GRADIENT_WIDTH 1024 /* texels */
+#define NV_GRADIENT_PITCH (NV_GRADIENT_WIDTH * 4)
+#define NV_RADIAL_SIZE 256 /* texels each way, a quarter of the circles */
+#define NV_RADIAL_PITCH (NV_RADIAL_SIZE * 4)
+
+struct nouveau_gradient {
+	struct nouveau_bo *bo;
+	int width, height; /* texels */
+	int pitch;
+	Bool radial;     /* mirrored about the centre, whatever the repeat */
+	float st[2][3];  /* picture space to normalised ramp coordinates */
+	Bool moved;      /* not the ramp it had before */
+};
+
+struct nouveau_gradient_cache;
+
 /* NV50 */
 typedef struct _NVRec *NVPtr;
 typedef struct _NVRec {
@@ -40,6 +186,8 @@ typedef struct _NVRec {
     struct nouveau_bo * offscreen;
     void *              offscreen_map;
     struct nouveau_bo * GART;
+    struct nouveau_bo * staging[NV_STAGING_SLOTS];
+    int                 staging_next;
 
     Bool                NoAccel;
     Bool                HWCursor;
@@ -49,6 +197,35 @@ typedef struct _NVRec {
 
     ExaDriverPtr	EXADriverPtr;
     Bool                exa_force_cp;
+    uint32_t		exa_seq; /* current EXA batch, see MarkSync */
+    struct nouveau_transfer_stats upload;
+    struct nouveau_transfer_cost upload_cost[NV_UPLOAD_PATHS];
+    int                 inline_upload_max; /* -1 to use upload_cost */
+    struct nouveau_transfer_stats download;
+    struct nouveau_readback readback;
+    unsigned            cpu_access;       /* PrepareAccess calls */
+    uint64_t            cpu_access_bytes; /* moved for CPU access/uploads */
+    uint64_t            shadow_kept;      /* GART in shadows kept for it */
+    uint64_t            shadow_kept_max;
+    struct nouveau_cpu_box cpu_box[NV_CPU_BOXES]; /* ring of the latest */
+    unsigned            cpu_boxes;        /* logged, ever */
+    unsigned            pixmap_moves; /* see nouveau_exa_pixmap_moved() */
+    unsigned            composite_prepares;
+    unsigned            composite_reused; /* state kept from the last one */
+    unsigned            composite_draws;
+    unsigned            composite_rects;
+    unsigned            composite_vtx_wraps; /* vertex buffer switches */
+    unsigned            composite_two_pass;  /* component-alpha Over */
+    unsigned            composite_failed;    /* batches with rects lost */
+    struct nouveau_composite_key *composite_key; /* last one looked up */
+    struct nouveau_tex_cache tex_cache;
+    struct nouveau_op_stats op_stats[NV_CAPTURE_OPS];
+    int                 op_current; /* 0 outside Prepare..Done */
+    uint64_t            op_start;
+    uint32_t *          op_push_cur;
+    uint32_t *          op_push_end;
+    struct nouveau_profile *profile; /* NULL unless GPUProfile is on */
+    struct nouveau_gradient_cache *gradients; /* allocated on first use */
     Bool		wfb_enabled;
     Bool		tiled_scanout;
     Bool		glx_vblank;
@@ -59,6 +236,7 @@ typedef struct _NVRec {
     ScreenBlockHandlerProcPtr BlockHandler;
     CreateScreenResourcesProcPtr CreateScreenResources;
     CloseScreenProcPtr  CloseScreen;
+    DestroyPictureProcPtr DestroyPicture;
     void		(*VideoTimerCallback)(ScrnInfoPtr, Time);
     XF86VideoAdaptorPtr	overlayAdaptor;
     XF86VideoAdaptorPtr	blitAdaptor;
@@ -85,6 +263,7 @@ typedef struct _NVRec {
 	struct nouveau_object *channel;
 	struct nouveau_pushbuf *pushbuf;
 	struct nouveau_bufctx *bufctx;
+	struct nouveau_pushbuf_priv pushbuf_priv;
 	struct nouveau_object *notify0;
 	struct nouveau_object *vblank_sem;
 	struct nouveau_object *NvNull;
@@ -102,9 +281,55 @@ typedef struct _NVRec {
 	struct nouveau_object *Nv2D;
 	struct nouveau_object *Nv3D;
 	struct nouveau_object *NvSW;
+	struct nouveau_object *NvCopy; /* Fermi PCOPY, NULL if unavailable */
+	uint32_t copy_sequence; /* see NVC0EXACopyWait() */
 	struct nouveau_bo *tesla_scratch;
 	struct nouveau_bo *shader_mem;
 	struct nouveau_bo *xv_filtertable_mem;
+	struct nouveau_bo *vtx_stream[2]; /* NVC0 composite vertices */
+
+	/* Push buffer sizing, see nv_dma.c */
+	int pushbuf_level;
+	Bool pushbuf_pinned;
+	int pushbuf_nr;
+	int pushbuf_size;
+	CARD32 pushbuf_checked;      /* time of the last resize check */
+	unsigned pushbuf_check_wraps; /* wraps as of then */
+	int pushbuf_idle_checks;
+	unsigned pushbuf_resizes;
+	uint64_t pushbuf_created;
+
+	/* TransferChannel, see NVInitDmaTransfer() */
+	struct nouveau_object *xfer_channel;
+	struct nouveau_pushbuf *xfer_pushbuf; /* NULL if not in use */
+	struct nouveau_pushbuf_priv xfer_priv;
+	struct nouveau_object *NvXfer; /* M2MF or PCOPY, none on Kepler */
+	unsigned xfer_copies;
+
+	/* Recycled pixmap storage */
+	struct nouveau_bo_cache *bo_cache;
+	struct nouveau_slab_heap *slab_heap;
+
+	/* Pixmap VRAM budget, see nouveau_vram.c */
+	uint64_t vram_budget;
+	uint64_t vram_used;
+	struct nouveau_pixmap *vram_lru_head; /* most recently used */
+	struct nouveau_pixmap *vram_lru_tail;
+	unsigned vram_demotions;
+	unsigned vram_promotions;
+
+	/* Arch-specific EXA hooks, wrapped by nouveau_exa.c */
+	Bool (*PrepareSolid)(PixmapPtr, int, Pixel, Pixel);
+	Bool (*PrepareCopy)(PixmapPtr, PixmapPtr, int, int, int, Pixel);
+	Bool (*CheckComposite)(int, PicturePtr, PicturePtr, PicturePtr);
+	Bool (*PrepareComposite)(int, PicturePtr, PicturePtr, PicturePtr,
+				 PixmapPtr, PixmapPtr, PixmapPtr);
+	void (*Solid)(PixmapPtr, int, int, int, int);
+	void (*Copy)(PixmapPtr, int, int, int, int, int, int);
+	void (*Composite)(PixmapPtr, int, int, int, int, int, int, int, int);
+	void (*DoneSolid)(PixmapPtr);
+	void (*DoneCopy)(PixmapPtr);
+	void (*DoneComposite)(PixmapPtr);
 
 	/* Acceleration context */
 	PixmapPtr pspix, pmpix, pdpix;
@@ -159,10 +384,42 @@ typedef struct _NVPortPrivRec {
 #define NOUVEAU_CREATE_PIXMAP_TILED	0x20000000
 #define NOUVEAU_CREATE_PIXMAP_SCANOUT	0x40000000
 
+/* Layout of a surface, as decided by nouveau_surface_layout() */
+struct nouveau_surface {
+	uint32_t flags;
+	int pitch;
+	int height;
+	union nouveau_bo_config cfg;
+};
+
 struct nouveau_pixmap {
 	struct nouveau_bo *bo;
+	uint32_t offset; /* of the pixmap within bo, if it's in a slab */
+	struct nouveau_slab *slab;
 	void *linear;
 	unsigned size;
+	struct nouveau_surface surf;
+	Bool shared; /* bo exported, never recycle it */
+
+	/* EXA batch that last had the GPU read/write the pixmap, cleared
+	 * once the CPU has waited for it in PrepareAccess
+	 */
+	uint32_t gpu_read;
+	uint32_t gpu_write;
+
+	/* linear copy of a tiled pixmap for CPU access, kept in sync with it
+	 * between accesses if damage is set, see nouveau_exa_shadow_prepare()
+	 */
+	struct nouveau_bo *shadow;
+	DamagePtr damage; /* rendering since the shadow was last in sync */
+	Bool shadow_dirty;
+
+	/* VRAM budget LRU, not linked while demoted to GART */
+	struct nouveau_pixmap *lru_prev;
+	struct nouveau_pixmap *lru_next;
+	uint32_t lru_seq; /* EXA batch that last used it */
+	Bool demoted;
+	unsigned prepared; /* PrepareAccess without FinishAccess yet */
 };
 
 static inline struct nouveau_pixmap *
@@ -179,6 +436,33 @@ nouveau_pixmap_bo(PixmapPtr ppix)
 	return nvpix ? nvpix->bo : NULL;
 }
 
+static inline uint32_t
+nouveau_pixmap_offset(PixmapPtr ppix)
+{
+	struct nouveau_pixmap *nvpix = nouveau_pixmap(ppix);
+
+	return nvpix ? nvpix->offset : 0;
+}
+
+/* Domain to reference the pixmap's bo in, VRAM unless it's been demoted
+ * to GART and not brought back, see nouveau_vram_touch()
+ */
+static inline uint32_t
+nouveau_pixmap_domain(PixmapPtr ppix)
+{
+	struct nouveau_pixmap *nvpix = nouveau_pixmap(ppix);
+
+	return nvpix && nvpix->demoted ? NOUVEAU_BO_GART : NOUVEAU_BO_VRAM;
+}
+
+static inline void
+nouveau_gradient_coord(struct nouveau_gradient *grad, int x, int y,
+		       float *s, float *t)
+{
+	*s = grad->st[0][0] * x + grad->st[0][1] * y + grad->st[0][2];
+	*t = grad->st[1][0] * x + grad->st[1][1] * y + grad->st[1][2];
+}
+
 static inline uint32_t
 nv_pitch_align(NVPtr pNv, uint32_t width, int bpp)
 {
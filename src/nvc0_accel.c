@@ -49,6 +49,21 @@ NVAccelInitM2MF_NVC0(ScrnInfoPtr pScrn)
 	PUSH_DATA (push, (pNv->tesla_scratch->offset + NTFY_OFFSET));
 	PUSH_DATA (push, 0);
 
+	/* Transfers go through PCOPY where the kernel lets us have it, which
+	 * takes them off PGRAPH.  On this channel they still wait for the
+	 * 2D/3D work before them, see NVC0EXACopyWait().  M2MF is still
+	 * needed for inline uploads.
+	 */
+	ret = nouveau_object_new(pNv->channel, 0x000090b5, 0x90b5,
+				 NULL, 0, &pNv->NvCopy);
+	if (ret) {
+		xf86DrvMsg(pScrn->scrnIndex, X_INFO,
+			   "PCOPY unavailable, transfers will use M2MF\n");
+		return TRUE;
+	}
+
+	BEGIN_NVC0(push, NV01_SUBC(COPY, OBJECT), 1);
+	PUSH_DATA (push, pNv->NvCopy->handle);
 	return TRUE;
 }
 
@@ -76,6 +91,50 @@ NVAccelInitP2MF_NVE0(ScrnInfoPtr pScrn)
 	return TRUE;
 }
 
+/* Whatever NVAccelM2MF() will use for copies, on the transfer channel,
+ * see NVInitDmaTransfer()
+ */
+Bool
+NVAccelInitTransfer_NVC0(ScrnInfoPtr pScrn)
+{
+	NVPtr pNv = NVPTR(pScrn);
+	struct nouveau_pushbuf *push = pNv->xfer_pushbuf;
+	int ret;
+
+	if (!PUSH_SPACE(push, 8))
+		return FALSE;
+
+	if (pNv->Architecture >= NV_ARCH_E0) {
+		BEGIN_NVC0(push, NV01_SUBC(COPY, OBJECT), 1);
+		PUSH_DATA (push, 0x0000a0b5);
+		return TRUE;
+	}
+
+	if (pNv->NvCopy) {
+		ret = nouveau_object_new(pNv->xfer_channel, 0x000090b5, 0x90b5,
+					 NULL, 0, &pNv->NvXfer);
+		if (ret)
+			return FALSE;
+
+		BEGIN_NVC0(push, NV01_SUBC(COPY, OBJECT), 1);
+		PUSH_DATA (push, pNv->NvXfer->handle);
+		return TRUE;
+	}
+
+	ret = nouveau_object_new(pNv->xfer_channel, 0x00009039, 0x9039,
+				 NULL, 0, &pNv->NvXfer);
+	if (ret)
+		return FALSE;
+
+	BEGIN_NVC0(push, NV01_SUBC(M2MF, OBJECT), 1);
+	PUSH_DATA (push, pNv->NvXfer->handle);
+	BEGIN_NVC0(push, NVC0_M2MF(QUERY_ADDRESS_HIGH), 3);
+	PUSH_DATA (push, (pNv->tesla_scratch->offset + NTFY_OFFSET) >> 32);
+	PUSH_DATA (push, (pNv->tesla_scratch->offset + NTFY_OFFSET));
+	PUSH_DATA (push, 0);
+	return TRUE;
+}
+
 Bool
 NVAccelInit2D_NVC0(ScrnInfoPtr pScrn)
 {
@@ -142,8 +201,8 @@ NVAccelInit3D_NVC0(ScrnInfoPtr pScrn)
 	if (ret)
 		return FALSE;
 
-	if (nouveau_pushbuf_space(push, 512, 0, 0) ||
-	    nouveau_pushbuf_refn (push, &(struct nouveau_pushbuf_refn) {
+	if (!PUSH_SPACE(push, 512) ||
+	    PUSH_REFS(push, &(struct nouveau_pushbuf_refn) {
 					pNv->tesla_scratch, NOUVEAU_BO_VRAM |
 					NOUVEAU_BO_WR }, 1))
 		return FALSE;
@@ -186,6 +245,7 @@ NVAccelInit3D_NVC0(ScrnInfoPtr pScrn)
 	PUSH_DATA (push, 0);
 	BEGIN_NVC0(push, NVC0_3D(LINKED_TSC), 1);
 	PUSH_DATA (push, 1);
+	memset(pNv->tex_cache.slot, 0, sizeof(pNv->tex_cache.slot));
 	if (pNv->Architecture < NV_ARCH_E0) {
 		BEGIN_NVC0(push, NVC0_3D(TEX_LIMITS(4)), 1);
 		PUSH_DATA (push, 0x54);
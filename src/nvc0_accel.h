@@ -26,6 +26,7 @@
 #define TIC_OFFSET  0x02000 /* Texture Image Control */
 #define TSC_OFFSET  0x03000 /* Texture Sampler Control */
 #define NTFY_OFFSET 0x08000
+#define COPY_OFFSET 0x08010 /* semaphore, see NVC0EXACopyWait() */
 #define MISC_OFFSET 0x10000
 
 /* vertex/fragment programs */
@@ -51,6 +52,30 @@
 	 ((c) << NVC0_3D_VTX_ATTR_DEFINE_COMP__SHIFT) |	\
 	 ((s) << NVC0_3D_VTX_ATTR_DEFINE_SIZE__SHIFT))
 
+#define VTX_FORMAT(o, s, t)					\
+	(((o) << NVC0_3D_VERTEX_ATTRIB_FORMAT_OFFSET__SHIFT) |	\
+	 (NVC0_3D_VERTEX_ATTRIB_FORMAT_SIZE_##s) |		\
+	 (NVC0_3D_VERTEX_ATTRIB_FORMAT_TYPE_##t))
+
+/* EXA composite fetches its vertices from a buffer, put attributes 0-2
+ * back to taking their values from VTX_ATTR_DEFINE for VTX1s()/VTX2s()
+ */
+static __inline__ void
+VTXImmediate(NVPtr pNv)
+{
+	struct nouveau_pushbuf *push = pNv->pushbuf;
+
+	PUSH_SHADOW_NVC0(push, NVC0_3D(VERTEX_ARRAY_FETCH(0)), (uint32_t []) {
+			 0 }, 1);
+	PUSH_SHADOW_NVC0(push, NVC0_3D(VERTEX_ATTRIB_FORMAT(0)), (uint32_t []) {
+			 NVC0_3D_VERTEX_ATTRIB_FORMAT_CONST |
+			 VTX_FORMAT(0, 16_16, USCALED),
+			 NVC0_3D_VERTEX_ATTRIB_FORMAT_CONST |
+			 VTX_FORMAT(0, 32_32, FLOAT),
+			 NVC0_3D_VERTEX_ATTRIB_FORMAT_CONST |
+			 VTX_FORMAT(0, 32_32, FLOAT) }, 3);
+}
+
 static __inline__ void
 VTX1s(NVPtr pNv, float sx, float sy, unsigned dx, unsigned dy)
 {
@@ -123,4 +148,29 @@ PUSH_DATAu(struct nouveau_pushbuf *push, struct nouveau_bo *bo,
 	}
 }
 
+/* Point a fragment texture unit at a TIC/TSC slot, the TSC index is the
+ * TIC's as LINKED_TSC is set.  Kepler takes the index from the texture
+ * binding buffer.
+ */
+static __inline__ void
+TEXBind(NVPtr pNv, unsigned unit, unsigned slot)
+{
+	struct nouveau_pushbuf *push = pNv->pushbuf;
+	struct nouveau_bo *bo = pNv->tesla_scratch;
+
+	if (pNv->Architecture < NV_ARCH_E0) {
+		BEGIN_NVC0(push, NVC0_3D(BIND_TIC(4)), 1);
+		PUSH_DATA (push, (slot << NVC0_3D_BIND_TIC_TIC__SHIFT) |
+				 (unit << NVC0_3D_BIND_TIC_TEXTURE__SHIFT) |
+				 NVC0_3D_BIND_TIC_ACTIVE);
+	} else {
+		BEGIN_NVC0(push, NVC0_3D(CB_SIZE), 5);
+		PUSH_DATA (push, 256);
+		PUSH_DATA (push, (bo->offset + TB_OFFSET) >> 32);
+		PUSH_DATA (push, (bo->offset + TB_OFFSET));
+		PUSH_DATA (push, unit * 4);
+		PUSH_DATA (push, slot);
+	}
+}
+
 #endif
@@ -32,9 +32,25 @@ struct nvc0_exa_state {
 		PictTransformPtr transform;
 		float width;
 		float height;
+		struct nouveau_gradient *gradient; /* NULL for a pixmap */
 	} unit[2];
+	struct nouveau_gradient grad[2];
 
 	Bool have_mask;
+	Bool tex_flush;     /* TIC/TSC entries written since the last flush */
+	Bool ca_two_pass;   /* see NVC0EXAComponentAlphaPass() */
+	PixmapPtr ca_pix;   /* destination, for switching passes */
+	PicturePtr ca_pict;
+	int vtx;             /* vtx_stream[] being filled */
+	uint32_t vtx_stride; /* bytes per vertex in this batch */
+	uint32_t vtx_head;   /* where the next vertex goes */
+	uint32_t vtx_draw;   /* first vertex not drawn yet */
+	Bool failed;         /* rects were lost, see NVC0EXADoneComposite() */
+	struct nouveau_composite_key key;
+
+	Bool copy_self;    /* source and destination are the same storage */
+	BoxRec copy_dirty; /* written since the last serialise, if so */
+	BoxRec copy_read;  /* and read since then */
 };
 
 static struct nvc0_exa_state exa_state;
@@ -96,11 +112,8 @@ static void NVC0EXASetClip(PixmapPtr ppix, int x, int y, int w, int h)
 {
 	NVC0EXA_LOCALS(ppix);
 
-	BEGIN_NVC0(push, NV50_2D(CLIP_X), 4);
-	PUSH_DATA (push, x);
-	PUSH_DATA (push, y);
-	PUSH_DATA (push, w);
-	PUSH_DATA (push, h);
+	PUSH_SHADOW_NVC0(push, NV50_2D(CLIP_X), (uint32_t []) {
+			 x, y, w, h }, 4);
 }
 
 static void
@@ -108,32 +121,27 @@ NVC0EXAAcquireSurface2D(PixmapPtr ppix, int is_src, uint32_t fmt)
 {
 	NVC0EXA_LOCALS(ppix);
 	struct nouveau_bo *bo = nouveau_pixmap_bo(ppix);
+	uint64_t addr = bo->offset + nouveau_pixmap_offset(ppix);
 	int mthd = is_src ? NV50_2D_SRC_FORMAT : NV50_2D_DST_FORMAT;
 	uint32_t bo_flags;
 
-	bo_flags  = NOUVEAU_BO_VRAM;
+	bo_flags  = nouveau_pixmap_domain(ppix);
 	bo_flags |= is_src ? NOUVEAU_BO_RD : NOUVEAU_BO_WR;
+	nouveau_exa_pixmap_gpu_access(ppix, bo_flags);
 
 	if (!nv50_style_tiled_pixmap(ppix)) {
-		BEGIN_NVC0(push, SUBC_2D(mthd), 2);
-		PUSH_DATA (push, fmt);
-		PUSH_DATA (push, 1);
-		BEGIN_NVC0(push, SUBC_2D(mthd + 0x14), 1);
-		PUSH_DATA (push, (uint32_t)exaGetPixmapPitch(ppix));
+		PUSH_SHADOW_NVC0(push, SUBC_2D(mthd), (uint32_t []) {
+				 fmt, 1 }, 2);
+		PUSH_SHADOW_NVC0(push, SUBC_2D(mthd + 0x14), (uint32_t []) {
+				 exaGetPixmapPitch(ppix) }, 1);
 	} else {
-		BEGIN_NVC0(push, SUBC_2D(mthd), 5);
-		PUSH_DATA (push, fmt);
-		PUSH_DATA (push, 0);
-		PUSH_DATA (push, bo->config.nvc0.tile_mode);
-		PUSH_DATA (push, 1);
-		PUSH_DATA (push, 0);
+		PUSH_SHADOW_NVC0(push, SUBC_2D(mthd), (uint32_t []) {
+				 fmt, 0, bo->config.nvc0.tile_mode, 1, 0 }, 5);
 	}
 
-	BEGIN_NVC0(push, SUBC_2D(mthd + 0x18), 4);
-	PUSH_DATA (push, ppix->drawable.width);
-	PUSH_DATA (push, ppix->drawable.height);
-	PUSH_DATA (push, bo->offset >> 32);
-	PUSH_DATA (push, bo->offset);
+	PUSH_SHADOW_NVC0(push, SUBC_2D(mthd + 0x18), (uint32_t []) {
+			 ppix->drawable.width, ppix->drawable.height,
+			 addr >> 32, addr }, 4);
 
 	if (is_src == 0)
 		NVC0EXASetClip(ppix, 0, 0, ppix->drawable.width, ppix->drawable.height);
@@ -164,12 +172,13 @@ NVC0EXASetROP(PixmapPtr pdpix, int alu, Pixel planemask)
 	else
 		rop = NVROP[alu].copy;
 
-	BEGIN_NVC0(push, NV50_2D(OPERATION), 1);
 	if (alu == GXcopy && EXA_PM_IS_SOLID(&pdpix->drawable, planemask)) {
-		PUSH_DATA (push, NV50_2D_OPERATION_SRCCOPY);
+		PUSH_SHADOW_NVC0(push, NV50_2D(OPERATION), (uint32_t []) {
+				 NV50_2D_OPERATION_SRCCOPY }, 1);
 		return;
 	} else {
-		PUSH_DATA (push, NV50_2D_OPERATION_ROP);
+		PUSH_SHADOW_NVC0(push, NV50_2D(OPERATION), (uint32_t []) {
+				 NV50_2D_OPERATION_ROP }, 1);
 	}
 
 	BEGIN_NVC0(push, NV50_2D(PATTERN_COLOR_FORMAT), 2);
@@ -249,8 +258,7 @@ NVC0EXASolid(PixmapPtr pdpix, int x1, int y1, int x2, int y2)
 	PUSH_DATA (push, x2);
 	PUSH_DATA (push, y2);
 
-	if ((x2 - x1) * (y2 - y1) >= 512)
-		PUSH_KICK(push);
+	NVDmaQueued(push, (x2 - x1) * (y2 - y1));
 }
 
 void
@@ -280,6 +288,26 @@ NVC0EXAPrepareCopy(PixmapPtr pspix, PixmapPtr pdpix, int dx, int dy,
 	NVC0EXAAcquireSurface2D(pdpix, 0, dst);
 	NVC0EXASetROP(pdpix, alu, planemask);
 
+	/* the blits mustn't start before earlier rendering to the source
+	 * has landed, after that it only matters between the rects of a
+	 * copy within the one pixmap, see NVC0EXACopy()
+	 */
+	BEGIN_NVC0(push, SUBC_2D(NV50_GRAPH_SERIALIZE), 1);
+	PUSH_DATA (push, 0);
+	BEGIN_NVC0(push, NV50_2D(BLIT_CONTROL), 1);
+	PUSH_DATA (push, 0);
+	BEGIN_NVC0(push, NV50_2D(BLIT_DU_DX_FRACT), 4);
+	PUSH_DATA (push, 0);
+	PUSH_DATA (push, 1);
+	PUSH_DATA (push, 0);
+	PUSH_DATA (push, 1);
+
+	state->copy_self =
+		nouveau_pixmap_bo(pspix) == nouveau_pixmap_bo(pdpix) &&
+		nouveau_pixmap_offset(pspix) == nouveau_pixmap_offset(pdpix);
+	state->copy_dirty.x1 = state->copy_dirty.x2 = 0;
+	state->copy_read.x1 = state->copy_read.x2 = 0;
+
 	nouveau_pushbuf_bufctx(push, pNv->bufctx);
 	if (nouveau_pushbuf_validate(push)) {
 		nouveau_pushbuf_bufctx(push, NULL);
@@ -289,6 +317,28 @@ NVC0EXAPrepareCopy(PixmapPtr pspix, PixmapPtr pdpix, int dx, int dy,
 	return TRUE;
 }
 
+/* Boxes of copied rects, empty while x1 >= x2 */
+static Bool
+NVC0EXABoxOverlap(BoxPtr a, BoxPtr b)
+{
+	return a->x1 < a->x2 &&
+	       b->x1 < a->x2 && b->x2 > a->x1 &&
+	       b->y1 < a->y2 && b->y2 > a->y1;
+}
+
+static void
+NVC0EXABoxUnion(BoxPtr a, BoxPtr b)
+{
+	if (a->x1 < a->x2) {
+		a->x1 = min(a->x1, b->x1);
+		a->y1 = min(a->y1, b->y1);
+		a->x2 = max(a->x2, b->x2);
+		a->y2 = max(a->y2, b->y2);
+	} else {
+		*a = *b;
+	}
+}
+
 void
 NVC0EXACopy(PixmapPtr pdpix, int srcX , int srcY,
 			     int dstX , int dstY,
@@ -296,29 +346,40 @@ NVC0EXACopy(PixmapPtr pdpix, int srcX , int srcY,
 {
 	NVC0EXA_LOCALS(pdpix);
 
-	if (!PUSH_SPACE(push, 32))
+	if (!PUSH_SPACE(push, 16))
 		return;
 
-	BEGIN_NVC0(push, SUBC_2D(NV50_GRAPH_SERIALIZE), 1);
-	PUSH_DATA (push, 0);
-	BEGIN_NVC0(push, SUBC_2D(0x088c), 1);
-	PUSH_DATA (push, 0);
-	BEGIN_NVC0(push, NV50_2D(BLIT_DST_X), 12);
+	/* a rect reading what an earlier one wrote, or writing over what
+	 * an earlier one read, has to wait for it
+	 */
+	if (state->copy_self) {
+		BoxRec src = { srcX, srcY, srcX + width, srcY + height };
+		BoxRec dst = { dstX, dstY, dstX + width, dstY + height };
+
+		if (NVC0EXABoxOverlap(&state->copy_dirty, &src) ||
+		    NVC0EXABoxOverlap(&state->copy_read, &dst)) {
+			BEGIN_NVC0(push, SUBC_2D(NV50_GRAPH_SERIALIZE), 1);
+			PUSH_DATA (push, 0);
+			state->copy_dirty.x2 = state->copy_dirty.x1;
+			state->copy_read.x2 = state->copy_read.x1;
+		}
+
+		NVC0EXABoxUnion(&state->copy_dirty, &dst);
+		NVC0EXABoxUnion(&state->copy_read, &src);
+	}
+
+	BEGIN_NVC0(push, NV50_2D(BLIT_DST_X), 4);
 	PUSH_DATA (push, dstX);
 	PUSH_DATA (push, dstY);
 	PUSH_DATA (push, width);
 	PUSH_DATA (push, height);
-	PUSH_DATA (push, 0); /* DU,V_DX,Y_FRACT,INT */
-	PUSH_DATA (push, 1);
+	BEGIN_NVC0(push, NV50_2D(BLIT_SRC_X_FRACT), 4);
 	PUSH_DATA (push, 0);
-	PUSH_DATA (push, 1);
-	PUSH_DATA (push, 0); /* BLIT_SRC_X,Y_FRACT,INT */
 	PUSH_DATA (push, srcX);
 	PUSH_DATA (push, 0);
 	PUSH_DATA (push, srcY);
 
-	if (width * height >= 512)
-		PUSH_KICK(push);
+	NVDmaQueued(push, width * height);
 }
 
 void
@@ -333,8 +394,8 @@ NVC0EXAUploadSIFC(const char *src, int src_pitch,
 		  PixmapPtr pdpix, int x, int y, int w, int h, int cpp)
 {
 	NVC0EXA_LOCALS(pdpix);
-	ScreenPtr pScreen = pdpix->drawable.pScreen;
 	int line_dwords = (w * cpp + 3) / 4;
+	int ph;
 	uint32_t sifc_fmt;
 	Bool ret = FALSE;
 
@@ -348,8 +409,8 @@ NVC0EXAUploadSIFC(const char *src, int src_pitch,
 	NVC0EXAAcquireSurface2D(pdpix, 0, sifc_fmt);
 	NVC0EXASetClip(pdpix, x, y, w, h);
 
-	BEGIN_NVC0(push, NV50_2D(OPERATION), 1);
-	PUSH_DATA (push, NV50_2D_OPERATION_SRCCOPY);
+	PUSH_SHADOW_NVC0(push, NV50_2D(OPERATION), (uint32_t []) {
+			 NV50_2D_OPERATION_SRCCOPY }, 1);
 	BEGIN_NVC0(push, NV50_2D(SIFC_BITMAP_ENABLE), 2);
 	PUSH_DATA (push, 0);
 	PUSH_DATA (push, sifc_fmt);
@@ -369,7 +430,8 @@ NVC0EXAUploadSIFC(const char *src, int src_pitch,
 	if (nouveau_pushbuf_validate(push))
 		goto out;
 
-	while (h--) {
+	ph = h;
+	while (ph--) {
 		const char *ptr = src;
 		int count = line_dwords;
 
@@ -391,8 +453,7 @@ NVC0EXAUploadSIFC(const char *src, int src_pitch,
 	ret = TRUE;
 out:
 	nouveau_pushbuf_bufctx(push, NULL);
-	if (pdpix == pScreen->GetScreenPixmap(pScreen))
-		PUSH_KICK(push);
+	NVDmaQueued(push, w * h);
 	return ret;
 }
 
@@ -430,12 +491,15 @@ NVC0EXARenderTarget(PixmapPtr ppix, PicturePtr ppict)
 {
 	NVC0EXA_LOCALS(ppix);
 	struct nouveau_bo *bo = nouveau_pixmap_bo(ppix);
+	uint64_t addr = bo->offset + nouveau_pixmap_offset(ppix);
 	unsigned format;
 
 	/*XXX: Scanout buffer not tiled, someone needs to figure it out */
 	if (!nv50_style_tiled_pixmap(ppix))
 		NOUVEAU_FALLBACK("pixmap is scanout buffer\n");
 
+	nouveau_exa_pixmap_gpu_access(ppix, NOUVEAU_BO_RDWR);
+
 	switch (ppict->format) {
 	case PICT_a8r8g8b8: format = NV50_SURFACE_FORMAT_BGRA8_UNORM; break;
 	case PICT_x8r8g8b8: format = NV50_SURFACE_FORMAT_BGRX8_UNORM; break;
@@ -456,23 +520,34 @@ NVC0EXARenderTarget(PixmapPtr ppix, PicturePtr ppict)
 		NOUVEAU_FALLBACK("invalid picture format\n");
 	}
 
-	BEGIN_NVC0(push, NVC0_3D(RT_ADDRESS_HIGH(0)), 8);
-	PUSH_DATA (push, bo->offset >> 32);
-	PUSH_DATA (push, bo->offset);
-	PUSH_DATA (push, ppix->drawable.width);
-	PUSH_DATA (push, ppix->drawable.height);
-	PUSH_DATA (push, format);
-	PUSH_DATA (push, bo->config.nvc0.tile_mode);
-	PUSH_DATA (push, 0x00000001);
-	PUSH_DATA (push, 0x00000000);
+	PUSH_SHADOW_NVC0(push, NVC0_3D(RT_ADDRESS_HIGH(0)), (uint32_t []) {
+			 addr >> 32, addr,
+			 ppix->drawable.width, ppix->drawable.height,
+			 format, bo->config.nvc0.tile_mode,
+			 0x00000001, 0x00000000 }, 8);
 	return TRUE;
 }
 
+/* A linear texture's pitch goes in the TIC, which needs it 32-byte aligned
+ * and has 20 bits for it
+ */
+static Bool
+NVC0EXACheckPitch(PixmapPtr ppix)
+{
+	unsigned pitch = exaGetPixmapPitch(ppix);
+
+	if (nv50_style_tiled_pixmap(ppix))
+		return TRUE;
+	return !(pitch & 31) && pitch <= NV50TIC_0_3_PITCH_MASK;
+}
+
 static Bool
 NVC0EXACheckTexture(PicturePtr ppict, PicturePtr pdpict, int op)
 {
+	PixmapPtr ppix;
+
 	if (!ppict->pDrawable)
-		NOUVEAU_FALLBACK("Solid and gradient pictures unsupported.\n");
+		return nouveau_gradient_check(ppict);
 
 	if (ppict->pDrawable->width > 8192 ||
 	    ppict->pDrawable->height > 8192)
@@ -480,6 +555,12 @@ NVC0EXACheckTexture(PicturePtr ppict, PicturePtr pdpict, int op)
 				 ppict->pDrawable->width,
 				 ppict->pDrawable->height);
 
+	/* one that's not in a bo yet is checked again when it's bound */
+	ppix = NVGetDrawablePixmap(ppict->pDrawable);
+	if (nouveau_pixmap_bo(ppix) && !NVC0EXACheckPitch(ppix))
+		NOUVEAU_FALLBACK("linear pitch %lu\n",
+				 exaGetPixmapPitch(ppix));
+
 	switch (ppict->format) {
 	case PICT_a8r8g8b8:
 	case PICT_a8b8g8r8:
@@ -528,6 +609,59 @@ NVC0EXACheckTexture(PicturePtr ppict, PicturePtr pdpict, int op)
 	return TRUE;
 }
 
+static uint32_t
+NVC0EXAWrap(PicturePtr ppict)
+{
+	if (!ppict->repeat) {
+		return 0x00024000 |
+		       NV50TSC_1_0_WRAPS_CLAMP_TO_BORDER |
+		       NV50TSC_1_0_WRAPT_CLAMP_TO_BORDER |
+		       NV50TSC_1_0_WRAPR_CLAMP_TO_BORDER;
+	}
+
+	switch (ppict->repeatType) {
+	case RepeatPad:
+		return 0x00024000 |
+		       NV50TSC_1_0_WRAPS_CLAMP |
+		       NV50TSC_1_0_WRAPT_CLAMP |
+		       NV50TSC_1_0_WRAPR_CLAMP;
+	case RepeatReflect:
+		return 0x00024000 |
+		       NV50TSC_1_0_WRAPS_MIRROR_REPEAT |
+		       NV50TSC_1_0_WRAPT_MIRROR_REPEAT |
+		       NV50TSC_1_0_WRAPR_MIRROR_REPEAT;
+	case RepeatNormal:
+	default:
+		return 0x00024000 |
+		       NV50TSC_1_0_WRAPS_REPEAT |
+		       NV50TSC_1_0_WRAPT_REPEAT |
+		       NV50TSC_1_0_WRAPR_REPEAT;
+	}
+}
+
+/* desc is written, and the TIC/TSC caches flushed, only if it wasn't
+ * already in a slot
+ */
+static void
+NVC0EXATextureBind(NVPtr pNv, unsigned unit, const uint32_t *desc)
+{
+	struct nouveau_pushbuf *push = pNv->pushbuf;
+	Bool write;
+	int slot;
+
+	slot = nouveau_exa_texture_slot(pNv, desc, &write);
+	if (write) {
+		PUSH_DATAu(push, pNv->tesla_scratch,
+			   TIC_OFFSET + (slot * 32), 8);
+		PUSH_DATAp(push, &desc[0], 8);
+		PUSH_DATAu(push, pNv->tesla_scratch,
+			   TSC_OFFSET + (slot * 32), 8);
+		PUSH_DATAp(push, &desc[8], 8);
+		exa_state.tex_flush = TRUE;
+	}
+	TEXBind(pNv, unit, slot);
+}
+
 #define _(X1, X2, X3, X4, FMT)						\
 	(NV50TIC_0_0_TYPER_UNORM | NV50TIC_0_0_TYPEG_UNORM |		\
 	 NV50TIC_0_0_TYPEB_UNORM | NV50TIC_0_0_TYPEA_UNORM |		\
@@ -540,140 +674,163 @@ NVC0EXATexture(PixmapPtr ppix, PicturePtr ppict, unsigned unit)
 {
 	NVC0EXA_LOCALS(ppix);
 	struct nouveau_bo *bo = nouveau_pixmap_bo(ppix);
-	uint32_t mode;
+	uint64_t addr = bo->offset + nouveau_pixmap_offset(ppix);
+	uint32_t mode, desc[16];
 
-	/* XXX: maybe add support for linear textures at some point */
-	if (!nv50_style_tiled_pixmap(ppix))
-		NOUVEAU_FALLBACK("pixmap is scanout buffer\n");
+	if (!NVC0EXACheckPitch(ppix))
+		NOUVEAU_FALLBACK("linear pitch %lu\n",
+				 exaGetPixmapPitch(ppix));
+
+	nouveau_exa_pixmap_gpu_access(ppix, NOUVEAU_BO_RD);
 
-	PUSH_DATAu(push, pNv->tesla_scratch, TIC_OFFSET + (unit * 32), 8);
 	switch (ppict->format) {
 	case PICT_a8r8g8b8:
-		PUSH_DATA (push, _(B_C0, G_C1, R_C2, A_C3, 8_8_8_8));
+		desc[0] = _(B_C0, G_C1, R_C2, A_C3, 8_8_8_8);
 		break;
 	case PICT_a8b8g8r8:
-		PUSH_DATA (push, _(R_C0, G_C1, B_C2, A_C3, 8_8_8_8));
+		desc[0] = _(R_C0, G_C1, B_C2, A_C3, 8_8_8_8);
 		break;
 	case PICT_x8r8g8b8:
-		PUSH_DATA (push, _(B_C0, G_C1, R_C2, A_ONE, 8_8_8_8));
+		desc[0] = _(B_C0, G_C1, R_C2, A_ONE, 8_8_8_8);
 		break;
 	case PICT_x8b8g8r8:
-		PUSH_DATA (push, _(R_C0, G_C1, B_C2, A_ONE, 8_8_8_8));
+		desc[0] = _(R_C0, G_C1, B_C2, A_ONE, 8_8_8_8);
 		break;
 	case PICT_r5g6b5:
-		PUSH_DATA (push, _(B_C0, G_C1, R_C2, A_ONE, 5_6_5));
+		desc[0] = _(B_C0, G_C1, R_C2, A_ONE, 5_6_5);
 		break;
 	case PICT_a8:
-		PUSH_DATA (push, _(A_C0, B_ZERO, G_ZERO, R_ZERO, 8));
+		desc[0] = _(A_C0, B_ZERO, G_ZERO, R_ZERO, 8);
 		break;
 	case PICT_x1r5g5b5:
-		PUSH_DATA (push, _(B_C0, G_C1, R_C2, A_ONE, 1_5_5_5));
+		desc[0] = _(B_C0, G_C1, R_C2, A_ONE, 1_5_5_5);
 		break;
 	case PICT_x1b5g5r5:
-		PUSH_DATA (push, _(R_C0, G_C1, B_C2, A_ONE, 1_5_5_5));
+		desc[0] = _(R_C0, G_C1, B_C2, A_ONE, 1_5_5_5);
 		break;
 	case PICT_a1r5g5b5:
-		PUSH_DATA (push, _(B_C0, G_C1, R_C2, A_C3, 1_5_5_5));
+		desc[0] = _(B_C0, G_C1, R_C2, A_C3, 1_5_5_5);
 		break;
 	case PICT_a1b5g5r5:
-		PUSH_DATA (push, _(R_C0, G_C1, B_C2, A_C3, 1_5_5_5));
+		desc[0] = _(R_C0, G_C1, B_C2, A_C3, 1_5_5_5);
 		break;
 	case PICT_b5g6r5:
-		PUSH_DATA (push, _(R_C0, G_C1, B_C2, A_ONE, 5_6_5));
+		desc[0] = _(R_C0, G_C1, B_C2, A_ONE, 5_6_5);
 		break;
 	case PICT_b8g8r8x8:
-		PUSH_DATA (push, _(A_ONE, R_C1, G_C2, B_C3, 8_8_8_8));
+		desc[0] = _(A_ONE, R_C1, G_C2, B_C3, 8_8_8_8);
 		break;
 	case PICT_b8g8r8a8:
-		PUSH_DATA (push, _(A_C0, R_C1, G_C2, B_C3, 8_8_8_8));
+		desc[0] = _(A_C0, R_C1, G_C2, B_C3, 8_8_8_8);
 		break;
 	case PICT_a2b10g10r10:
-		PUSH_DATA (push, _(R_C0, G_C1, B_C2, A_C3, 2_10_10_10));
+		desc[0] = _(R_C0, G_C1, B_C2, A_C3, 2_10_10_10);
 		break;
 	case PICT_x2b10g10r10:
-		PUSH_DATA (push, _(R_C0, G_C1, B_C2, A_ONE, 2_10_10_10));
+		desc[0] = _(R_C0, G_C1, B_C2, A_ONE, 2_10_10_10);
 		break;
 	case PICT_x2r10g10b10:
-		PUSH_DATA (push, _(B_C0, G_C1, R_C2, A_ONE, 2_10_10_10));
+		desc[0] = _(B_C0, G_C1, R_C2, A_ONE, 2_10_10_10);
 		break;
 	case PICT_a2r10g10b10:
-		PUSH_DATA (push, _(B_C0, G_C1, R_C2, A_C3, 2_10_10_10));
+		desc[0] = _(B_C0, G_C1, R_C2, A_C3, 2_10_10_10);
 		break;
 	case PICT_x4r4g4b4:
-		PUSH_DATA (push, _(B_C0, G_C1, R_C2, A_ONE, 4_4_4_4));
+		desc[0] = _(B_C0, G_C1, R_C2, A_ONE, 4_4_4_4);
 		break;
 	case PICT_x4b4g4r4:
-		PUSH_DATA (push, _(R_C0, G_C1, B_C2, A_ONE, 4_4_4_4));
+		desc[0] = _(R_C0, G_C1, B_C2, A_ONE, 4_4_4_4);
 		break;
 	case PICT_a4r4g4b4:
-		PUSH_DATA (push, _(B_C0, G_C1, R_C2, A_C3, 4_4_4_4));
+		desc[0] = _(B_C0, G_C1, R_C2, A_C3, 4_4_4_4);
 		break;
 	case PICT_a4b4g4r4:
-		PUSH_DATA (push, _(R_C0, G_C1, B_C2, A_C3, 4_4_4_4));
+		desc[0] = _(R_C0, G_C1, B_C2, A_C3, 4_4_4_4);
 		break;
 	default:
 		NOUVEAU_FALLBACK("invalid picture format, this SHOULD NOT HAPPEN. Expect trouble.\n");
 	}
 #undef _
 
-	mode = 0xd0005000 | (bo->config.nvc0.tile_mode << (22 - 4));
-	PUSH_DATA (push, bo->offset);
-	PUSH_DATA (push, (bo->offset >> 32) | mode |
-			 (bo->config.nvc0.tile_mode << 18));
-	PUSH_DATA (push, 0x00300000);
-	PUSH_DATA (push, (1 << 31) | ppix->drawable.width);
-	PUSH_DATA (push, (1 << 16) | ppix->drawable.height);
-	PUSH_DATA (push, 0x03000000);
-	PUSH_DATA (push, 0x00000000);
-
-	PUSH_DATAu(push, pNv->tesla_scratch, TSC_OFFSET + (unit * 32), 8);
-	if (ppict->repeat) {
-		switch (ppict->repeatType) {
-		case RepeatPad:
-			PUSH_DATA (push, 0x00024000 |
-				   NV50TSC_1_0_WRAPS_CLAMP |
-				   NV50TSC_1_0_WRAPT_CLAMP |
-				   NV50TSC_1_0_WRAPR_CLAMP);
-			break;
-		case RepeatReflect:
-			PUSH_DATA (push, 0x00024000 |
-				   NV50TSC_1_0_WRAPS_MIRROR_REPEAT |
-				   NV50TSC_1_0_WRAPT_MIRROR_REPEAT |
-				   NV50TSC_1_0_WRAPR_MIRROR_REPEAT);
-			break;
-		case RepeatNormal:
-		default:
-			PUSH_DATA (push, 0x00024000 |
-				   NV50TSC_1_0_WRAPS_REPEAT |
-				   NV50TSC_1_0_WRAPT_REPEAT |
-				   NV50TSC_1_0_WRAPR_REPEAT);
-			break;
-		}
+	desc[1] = addr;
+	if (nv50_style_tiled_pixmap(ppix)) {
+		mode = 0xd0001000 | NV50TIC_0_2_TARGET_2D |
+		       (bo->config.nvc0.tile_mode << (22 - 4));
+		desc[2] = (addr >> 32) | mode |
+			  (bo->config.nvc0.tile_mode << 18);
+		desc[3] = 0x00300000;
+		desc[4] = (1 << 31) | ppix->drawable.width;
+		desc[6] = 0x03000000;
 	} else {
-		PUSH_DATA (push, 0x00024000 |
-			   NV50TSC_1_0_WRAPS_CLAMP_TO_BORDER |
-			   NV50TSC_1_0_WRAPT_CLAMP_TO_BORDER |
-			   NV50TSC_1_0_WRAPR_CLAMP_TO_BORDER);
+		/* same layout as NV50's linear TIC */
+		desc[2] = (addr >> 32) | 0xd0001000 |
+			  NV50TIC_0_2_TARGET_RECT | NV50TIC_0_2_LINEAR;
+		desc[3] = exaGetPixmapPitch(ppix);
+		desc[4] = ppix->drawable.width;
+		desc[6] = 0x00000000;
 	}
+	desc[5] = (1 << 16) | ppix->drawable.height;
+	desc[7] = 0x00000000;
+
+	desc[8] = NVC0EXAWrap(ppict);
 	if (ppict->filter == PictFilterBilinear) {
-		PUSH_DATA (push,
-			   NV50TSC_1_1_MAGF_LINEAR |
-			   NV50TSC_1_1_MINF_LINEAR | NV50TSC_1_1_MIPF_NONE);
+		desc[9] = NV50TSC_1_1_MAGF_LINEAR |
+			  NV50TSC_1_1_MINF_LINEAR | NV50TSC_1_1_MIPF_NONE;
 	} else {
-		PUSH_DATA (push,
-			   NV50TSC_1_1_MAGF_NEAREST |
-			   NV50TSC_1_1_MINF_NEAREST | NV50TSC_1_1_MIPF_NONE);
+		desc[9] = NV50TSC_1_1_MAGF_NEAREST |
+			  NV50TSC_1_1_MINF_NEAREST | NV50TSC_1_1_MIPF_NONE;
 	}
-	PUSH_DATA (push, 0x00000000);
-	PUSH_DATA (push, 0x00000000);
-	PUSH_DATAf(push, 0.0f);
-	PUSH_DATAf(push, 0.0f);
-	PUSH_DATAf(push, 0.0f);
-	PUSH_DATAf(push, 0.0f);
+	memset(&desc[10], 0, 6 * sizeof(uint32_t)); /* and a 0.0f border */
+	NVC0EXATextureBind(pNv, unit, desc);
 
 	state->unit[unit].width = ppix->drawable.width;
 	state->unit[unit].height = ppix->drawable.height;
 	state->unit[unit].transform = ppict->transform;
+	state->unit[unit].gradient = NULL;
+	return TRUE;
+}
+
+/* A solid fill or gradient, from the ramp nouveau_gradient_get() put in
+ * state->grad[unit].  A radial one's table is mirrored about the centre.
+ */
+static Bool
+NVC0EXAGradient(NVPtr pNv, PicturePtr ppict, unsigned unit)
+{
+	struct nvc0_exa_state *state = &exa_state;
+	struct nouveau_gradient *grad = &state->grad[unit];
+	uint64_t addr = grad->bo->offset;
+	uint32_t desc[16];
+
+	desc[0] = NV50TIC_0_0_TYPER_UNORM | NV50TIC_0_0_TYPEG_UNORM |
+		  NV50TIC_0_0_TYPEB_UNORM | NV50TIC_0_0_TYPEA_UNORM |
+		  NV50TIC_0_0_MAPB_C0 | NV50TIC_0_0_MAPG_C1 |
+		  NV50TIC_0_0_MAPR_C2 | NV50TIC_0_0_MAPA_C3 |
+		  NV50TIC_0_0_FMT_8_8_8_8;
+	desc[1] = addr;
+	desc[2] = (addr >> 32) | 0xd0001000 |
+		  NV50TIC_0_2_TARGET_RECT | NV50TIC_0_2_LINEAR;
+	desc[3] = grad->pitch;
+	desc[4] = grad->width;
+	desc[5] = (1 << 16) | grad->height;
+	desc[6] = 0x00000000;
+	desc[7] = 0x00000000;
+
+	if (grad->radial) {
+		desc[8] = 0x00024000 |
+			  NV50TSC_1_0_WRAPS_MIRROR_CLAMP_TO_EDGE |
+			  NV50TSC_1_0_WRAPT_MIRROR_CLAMP_TO_EDGE |
+			  NV50TSC_1_0_WRAPR_MIRROR_CLAMP_TO_EDGE;
+	} else {
+		desc[8] = NVC0EXAWrap(ppict);
+	}
+	/* the ramp's always interpolated, whatever the picture's filter */
+	desc[9] = NV50TSC_1_1_MAGF_LINEAR |
+		  NV50TSC_1_1_MINF_LINEAR | NV50TSC_1_1_MIPF_NONE;
+	memset(&desc[10], 0, 6 * sizeof(uint32_t));
+	NVC0EXATextureBind(pNv, unit, desc);
+
+	state->unit[unit].transform = NULL;
+	state->unit[unit].gradient = grad;
 	return TRUE;
 }
 
@@ -712,19 +869,19 @@ NVC0EXABlend(PixmapPtr ppix, PicturePtr ppict, int op, int component_alpha)
 	}
 
 	if (sblend == BF(ONE) && dblend == BF(ZERO)) {
-		BEGIN_NVC0(push, NVC0_3D(BLEND_ENABLE(0)), 1);
-		PUSH_DATA (push, 0);
+		PUSH_SHADOW_NVC0(push, NVC0_3D(BLEND_ENABLE(0)), (uint32_t []) {
+				 0 }, 1);
 	} else {
-		BEGIN_NVC0(push, NVC0_3D(BLEND_ENABLE(0)), 1);
-		PUSH_DATA (push, 1);
-		BEGIN_NVC0(push, NVC0_3D(BLEND_EQUATION_RGB), 5);
-		PUSH_DATA (push, NVC0_3D_BLEND_EQUATION_RGB_FUNC_ADD);
-		PUSH_DATA (push, sblend);
-		PUSH_DATA (push, dblend);
-		PUSH_DATA (push, NVC0_3D_BLEND_EQUATION_ALPHA_FUNC_ADD);
-		PUSH_DATA (push, sblend);
-		BEGIN_NVC0(push, NVC0_3D(BLEND_FUNC_DST_ALPHA), 1);
-		PUSH_DATA (push, dblend);
+		PUSH_SHADOW_NVC0(push, NVC0_3D(BLEND_ENABLE(0)), (uint32_t []) {
+				 1 }, 1);
+		PUSH_SHADOW_NVC0(push, NVC0_3D(BLEND_EQUATION_RGB),
+				 (uint32_t []) {
+				 NVC0_3D_BLEND_EQUATION_RGB_FUNC_ADD,
+				 sblend, dblend,
+				 NVC0_3D_BLEND_EQUATION_ALPHA_FUNC_ADD,
+				 sblend }, 5);
+		PUSH_SHADOW_NVC0(push, NVC0_3D(BLEND_FUNC_DST_ALPHA),
+				 (uint32_t []) { dblend }, 1);
 	}
 }
 
@@ -745,7 +902,8 @@ NVC0EXACheckComposite(int op,
 		if (pmpict->componentAlpha &&
 		    PICT_FORMAT_RGB(pmpict->format) &&
 		    NVC0EXABlendOp[op].src_alpha &&
-		    NVC0EXABlendOp[op].src_blend != BF(ZERO))
+		    NVC0EXABlendOp[op].src_blend != BF(ZERO) &&
+		    op != PictOpOver)
 			NOUVEAU_FALLBACK("component-alpha not supported\n");
 
 		if (!NVC0EXACheckTexture(pmpict, pdpict, op))
@@ -755,33 +913,147 @@ NVC0EXACheckComposite(int op,
 	return TRUE;
 }
 
+/* Composite vertices are streamed through a pair of GART buffers instead
+ * of being pushed with VTX_ATTR_DEFINE, which costs three method headers
+ * a vertex.  Rects are appended to the buffer in use, and drawn from it
+ * in one go at DoneComposite.  When it fills up, what's in it is drawn
+ * and we move to the other one, once the GPU's done with that, which it
+ * normally is by then.
+ */
+#define VTX_STREAM_SIZE 0x40000
+
+struct nvc0_vertex {
+	uint32_t pos;      /* attribute 0, y << 16 | x */
+	float src[2];      /* attribute 1 */
+	float mask[2];     /* attribute 2, not there without a mask */
+};
+
+#define VTX_STRIDE(m) ((m) ? 20 : 12)
+
+static Bool
+NVC0EXAVertexInit(NVPtr pNv)
+{
+	int i;
+
+	for (i = 0; i < 2; i++) {
+		if (nouveau_bo_new(pNv->dev, NOUVEAU_BO_GART | NOUVEAU_BO_MAP,
+				   0, VTX_STREAM_SIZE, NULL,
+				   &pNv->vtx_stream[i]) ||
+		    nouveau_bo_map(pNv->vtx_stream[i], NOUVEAU_BO_WR,
+				   pNv->client)) {
+			nouveau_bo_ref(NULL, &pNv->vtx_stream[0]);
+			nouveau_bo_ref(NULL, &pNv->vtx_stream[1]);
+			return FALSE;
+		}
+	}
+
+	exa_state.vtx = 0;
+	exa_state.vtx_head = 0;
+	exa_state.vtx_draw = 0;
+	return TRUE;
+}
+
+/* Point vertex array 0 at the buffer being filled, the state's shadowed
+ * so this is free unless something changed.
+ */
+static void
+NVC0EXAVertexArray(NVPtr pNv)
+{
+	struct nouveau_pushbuf *push = pNv->pushbuf;
+	struct nouveau_bo *bo = pNv->vtx_stream[exa_state.vtx];
+	uint64_t limit = bo->offset + bo->size - 1;
+
+	PUSH_SHADOW_NVC0(push, NVC0_3D(VERTEX_ATTRIB_FORMAT(0)), (uint32_t []) {
+			 VTX_FORMAT(0, 16_16, USCALED),
+			 VTX_FORMAT(4, 32_32, FLOAT),
+			 exa_state.have_mask ? VTX_FORMAT(12, 32_32, FLOAT) :
+			 NVC0_3D_VERTEX_ATTRIB_FORMAT_CONST |
+			 VTX_FORMAT(0, 32_32, FLOAT) }, 3);
+	PUSH_SHADOW_NVC0(push, NVC0_3D(VERTEX_ARRAY_FETCH(0)), (uint32_t []) {
+			 NVC0_3D_VERTEX_ARRAY_FETCH_ENABLE |
+			 exa_state.vtx_stride,
+			 bo->offset >> 32, bo->offset, 0 }, 4);
+	PUSH_SHADOW_NVC0(push, NVC0_3D(VERTEX_ARRAY_LIMIT_HIGH(0)),
+			 (uint32_t []) { limit >> 32, limit }, 2);
+}
+
 Bool
 NVC0EXAPrepareComposite(int op,
 			PicturePtr pspict, PicturePtr pmpict, PicturePtr pdpict,
 			PixmapPtr pspix, PixmapPtr pmpix, PixmapPtr pdpix)
 {
-	struct nouveau_bo *src = nouveau_pixmap_bo(pspix);
+	struct nouveau_bo *src = pspix ? nouveau_pixmap_bo(pspix) : NULL;
 	struct nouveau_bo *dst = nouveau_pixmap_bo(pdpix);
 	struct nouveau_bo *mask = pmpix ? nouveau_pixmap_bo(pmpix) : NULL;
-	NVC0EXA_LOCALS(pspix);
+	NVC0EXA_LOCALS(pdpix);
 
+	state->failed = FALSE;
 	if (!PUSH_SPACE(push, 256))
 		NOUVEAU_FALLBACK("space\n");
 
+	if (!pNv->vtx_stream[0] && !NVC0EXAVertexInit(pNv))
+		NOUVEAU_FALLBACK("vertex buffers\n");
+
+	/* solid fill and gradient pictures, see nouveau_gradient.c */
+	if (!pspix) {
+		if (!nouveau_gradient_get(pNv, pspict, &state->grad[0]))
+			NOUVEAU_FALLBACK("src picture invalid\n");
+		if (state->grad[0].moved)
+			state->key.push_cur = NULL;
+	}
+	if (pmpict && !pmpix) {
+		if (!nouveau_gradient_get(pNv, pmpict, &state->grad[1]))
+			NOUVEAU_FALLBACK("mask picture invalid\n");
+		if (state->grad[1].moved)
+			state->key.push_cur = NULL;
+	}
+
+	if (nouveau_exa_composite_reuse(pNv, &state->key, op,
+					pspict, pmpict, pdpict,
+					pspix, pmpix, pdpix)) {
+		nouveau_exa_pixmap_gpu_access(pdpix, NOUVEAU_BO_RDWR);
+		/* the same transform, but maybe not where it was */
+		if (pspix) {
+			nouveau_exa_pixmap_gpu_access(pspix, NOUVEAU_BO_RD);
+			state->unit[0].transform = pspict->transform;
+		}
+		if (pmpix) {
+			nouveau_exa_pixmap_gpu_access(pmpix, NOUVEAU_BO_RD);
+			state->unit[1].transform = pmpict->transform;
+		}
+		goto flush;
+	}
+
+	/* the first of two passes, see NVC0EXAComponentAlphaPass() */
+	state->ca_two_pass = pmpict && pmpict->componentAlpha &&
+			     PICT_FORMAT_RGB(pmpict->format) &&
+			     op == PictOpOver;
+	if (state->ca_two_pass)
+		op = PictOpOutReverse;
+
 	BEGIN_NVC0(push, SUBC_2D(NV50_GRAPH_SERIALIZE), 1);
 	PUSH_DATA (push, 0);
 
 	if (!NVC0EXARenderTarget(pdpix, pdpict))
 		NOUVEAU_FALLBACK("render target invalid\n");
 
+	/* rects are drawn exactly, the scissor only needs to cover the
+	 * whole render target
+	 */
+	PUSH_SHADOW_NVC0(push, NVC0_3D(SCISSOR_HORIZ(0)), (uint32_t []) {
+			 pdpix->drawable.width << 16,
+			 pdpix->drawable.height << 16 }, 2);
+
 	NVC0EXABlend(pdpix, pdpict, op, pmpict && pmpict->componentAlpha &&
 		     PICT_FORMAT_RGB(pmpict->format));
 
-	if (!NVC0EXATexture(pspix, pspict, 0))
+	if (pspix ? !NVC0EXATexture(pspix, pspict, 0) :
+		    !NVC0EXAGradient(pNv, pspict, 0))
 		NOUVEAU_FALLBACK("src picture invalid\n");
 
 	if (pmpict) {
-		if (!NVC0EXATexture(pmpix, pmpict, 1))
+		if (pmpix ? !NVC0EXATexture(pmpix, pmpict, 1) :
+			    !NVC0EXAGradient(pNv, pmpict, 1))
 			NOUVEAU_FALLBACK("mask picture invalid\n");
 		state->have_mask = TRUE;
 
@@ -809,19 +1081,38 @@ NVC0EXAPrepareComposite(int op,
 			PUSH_DATA (push, PFP_S);
 	}
 
-	BEGIN_NVC0(push, NVC0_3D(TSC_FLUSH), 1);
-	PUSH_DATA (push, 0);
-	BEGIN_NVC0(push, NVC0_3D(TIC_FLUSH), 1);
-	PUSH_DATA (push, 0);
+flush:
+	if (state->tex_flush) {
+		BEGIN_NVC0(push, NVC0_3D(TSC_FLUSH), 1);
+		PUSH_DATA (push, 0);
+		BEGIN_NVC0(push, NVC0_3D(TIC_FLUSH), 1);
+		PUSH_DATA (push, 0);
+		state->tex_flush = FALSE;
+	}
+	/* the textures' contents may have changed even if their descriptors
+	 * didn't
+	 */
 	BEGIN_NVC0(push, NVC0_3D(TEX_CACHE_CTL), 1);
 	PUSH_DATA (push, 0);
 
 	PUSH_RESET(push);
 	PUSH_REFN (push, pNv->tesla_scratch, NOUVEAU_BO_VRAM | NOUVEAU_BO_RDWR);
-	PUSH_REFN (push, src, NOUVEAU_BO_VRAM | NOUVEAU_BO_RD);
-	PUSH_REFN (push, dst, NOUVEAU_BO_VRAM | NOUVEAU_BO_WR);
+	if (src)
+		PUSH_REFN (push, src,
+			   nouveau_pixmap_domain(pspix) | NOUVEAU_BO_RD);
+	else
+		PUSH_REFN (push, state->grad[0].bo,
+			   NOUVEAU_BO_GART | NOUVEAU_BO_RD);
+	PUSH_REFN (push, dst, nouveau_pixmap_domain(pdpix) | NOUVEAU_BO_WR);
+	if (mask)
+		PUSH_REFN (push, mask,
+			   nouveau_pixmap_domain(pmpix) | NOUVEAU_BO_RD);
+	else
 	if (pmpict)
-		PUSH_REFN (push, mask, NOUVEAU_BO_VRAM | NOUVEAU_BO_RD);
+		PUSH_REFN (push, state->grad[1].bo,
+			   NOUVEAU_BO_GART | NOUVEAU_BO_RD);
+	PUSH_REFN (push, pNv->vtx_stream[state->vtx],
+		   NOUVEAU_BO_GART | NOUVEAU_BO_RD);
 
 	nouveau_pushbuf_bufctx(push, pNv->bufctx);
 	if (nouveau_pushbuf_validate(push)) {
@@ -829,6 +1120,17 @@ NVC0EXAPrepareComposite(int op,
 		NOUVEAU_FALLBACK("validate\n");
 	}
 
+	/* the batch's vertices start on a whole vertex of its own size */
+	state->vtx_stride = VTX_STRIDE(state->have_mask);
+	state->vtx_head += state->vtx_stride - 1;
+	state->vtx_head -= state->vtx_head % state->vtx_stride;
+	state->vtx_draw = state->vtx_head;
+	NVC0EXAVertexArray(pNv);
+
+	state->ca_pix = pdpix;
+	state->ca_pict = pdpict;
+	if (state->ca_two_pass)
+		pNv->composite_two_pass++;
 	return TRUE;
 }
 
@@ -854,68 +1156,169 @@ NVC0EXATransform(PictTransformPtr t, int x, int y, float sx, float sy,
 	}
 }
 
+static inline void
+NVC0EXATexCoord(int unit, int x, int y, float *x_ret, float *y_ret)
+{
+	struct nvc0_exa_state *state = &exa_state;
+
+	if (state->unit[unit].gradient) {
+		nouveau_gradient_coord(state->unit[unit].gradient, x, y,
+				       x_ret, y_ret);
+	} else {
+		NVC0EXATransform(state->unit[unit].transform, x, y,
+				 state->unit[unit].width,
+				 state->unit[unit].height, x_ret, y_ret);
+	}
+}
+
+/* Over with a component-alpha mask needs both the source colour and the
+ * source alpha times the mask as blend factors, and the blender only has
+ * the one.  It's done in two passes over the same vertices, OutReverse
+ * with src.a * mask, then Add with src * mask.  PrepareComposite sets up
+ * the first pass, and NVC0EXAEndDraw() switches to the second and back.
+ */
+static void
+NVC0EXAComponentAlphaPass(NVPtr pNv, int op)
+{
+	struct nouveau_pushbuf *push = pNv->pushbuf;
+	struct nvc0_exa_state *state = &exa_state;
+
+	NVC0EXABlend(state->ca_pix, state->ca_pict, op, TRUE);
+	BEGIN_NVC0(push, NVC0_3D(SP_START_ID(5)), 1);
+	if (state->ca_pict->format == PICT_a8)
+		PUSH_DATA (push, PFP_C_A8);
+	else
+	if (op == PictOpOutReverse)
+		PUSH_DATA (push, PFP_CCASA);
+	else
+		PUSH_DATA (push, PFP_CCA);
+}
+
+static void
+NVC0EXADrawArrays(NVPtr pNv, uint32_t first, uint32_t count)
+{
+	struct nouveau_pushbuf *push = pNv->pushbuf;
+
+	BEGIN_NVC0(push, NVC0_3D(VERTEX_BEGIN_GL), 1);
+	PUSH_DATA (push, NVC0_3D_VERTEX_BEGIN_GL_PRIMITIVE_QUADS);
+	BEGIN_NVC0(push, NVC0_3D(VERTEX_BUFFER_FIRST), 2);
+	PUSH_DATA (push, first);
+	PUSH_DATA (push, count);
+	BEGIN_NVC0(push, NVC0_3D(VERTEX_END_GL), 1);
+	PUSH_DATA (push, 0);
+}
+
+/* Draw what's been queued since the last draw.  If there's no room for
+ * it even after submitting, the vertices are left where they are and the
+ * batch marked as failed.
+ */
+static Bool
+NVC0EXAEndDraw(NVPtr pNv)
+{
+	struct nouveau_pushbuf *push = pNv->pushbuf;
+	struct nvc0_exa_state *state = &exa_state;
+	uint32_t first = state->vtx_draw / state->vtx_stride;
+	uint32_t count = (state->vtx_head - state->vtx_draw) / state->vtx_stride;
+
+	if (!count)
+		return TRUE;
+
+	if (!PUSH_SPACE_RETRY(push, 64)) {
+		state->failed = TRUE;
+		return FALSE;
+	}
+
+	BEGIN_NVC0(push, NVC0_3D(VERTEX_ARRAY_FLUSH), 1);
+	PUSH_DATA (push, 0);
+	NVC0EXADrawArrays(pNv, first, count);
+	if (state->ca_two_pass) {
+		NVC0EXAComponentAlphaPass(pNv, PictOpAdd);
+		NVC0EXADrawArrays(pNv, first, count);
+		NVC0EXAComponentAlphaPass(pNv, PictOpOutReverse);
+	}
+	state->vtx_draw = state->vtx_head;
+	pNv->composite_draws++;
+	return TRUE;
+}
+
+/* Draw what's in the full buffer and move to the other one */
+static Bool
+NVC0EXAVertexWrap(NVPtr pNv)
+{
+	struct nouveau_pushbuf *push = pNv->pushbuf;
+	struct nvc0_exa_state *state = &exa_state;
+	struct nouveau_bo *bo;
+
+	if (!NVC0EXAEndDraw(pNv))
+		return FALSE;
+
+	state->vtx ^= 1;
+	bo = pNv->vtx_stream[state->vtx];
+	if (nouveau_bo_wait(bo, NOUVEAU_BO_WR, pNv->client))
+		return FALSE;
+
+	PUSH_REFN(push, bo, NOUVEAU_BO_GART | NOUVEAU_BO_RD);
+	if (nouveau_pushbuf_validate(push) || !PUSH_SPACE_RETRY(push, 16))
+		return FALSE;
+
+	state->vtx_head = 0;
+	state->vtx_draw = 0;
+	NVC0EXAVertexArray(pNv);
+	pNv->composite_vtx_wraps++;
+	return TRUE;
+}
+
 void
 NVC0EXAComposite(PixmapPtr pdpix,
 		 int sx, int sy, int mx, int my,
 		 int dx, int dy, int w, int h)
 {
 	NVC0EXA_LOCALS(pdpix);
-	float sX0, sX1, sX2, sY0, sY1, sY2;
-
-	if (!PUSH_SPACE(push, 64))
+	static const int cx[4] = { 0, 1, 1, 0 };
+	static const int cy[4] = { 0, 0, 1, 1 };
+	struct nvc0_vertex *vtx;
+	char *map;
+	int i;
+
+	if (state->vtx_head + 4 * state->vtx_stride > VTX_STREAM_SIZE &&
+	    !NVC0EXAVertexWrap(pNv)) {
+		state->failed = TRUE;
 		return;
-
-	BEGIN_NVC0(push, NVC0_3D(SCISSOR_HORIZ(0)), 2);
-	PUSH_DATA (push, ((dx + w) << 16) | dx);
-	PUSH_DATA (push, ((dy + h) << 16) | dy);
-	BEGIN_NVC0(push, NVC0_3D(VERTEX_BEGIN_GL), 1);
-	PUSH_DATA (push, NVC0_3D_VERTEX_BEGIN_GL_PRIMITIVE_TRIANGLES);
-
-	NVC0EXATransform(state->unit[0].transform, sx, sy + (h * 2),
-			 state->unit[0].width, state->unit[0].height,
-			 &sX0, &sY0);
-	NVC0EXATransform(state->unit[0].transform, sx, sy,
-			 state->unit[0].width, state->unit[0].height,
-			 &sX1, &sY1);
-	NVC0EXATransform(state->unit[0].transform, sx + (w * 2), sy,
-			 state->unit[0].width, state->unit[0].height,
-			 &sX2, &sY2);
-
-	if (state->have_mask) {
-		float mX0, mX1, mX2, mY0, mY1, mY2;
-
-		NVC0EXATransform(state->unit[1].transform, mx, my + (h * 2),
-				 state->unit[1].width, state->unit[1].height,
-				 &mX0, &mY0);
-		NVC0EXATransform(state->unit[1].transform, mx, my,
-				 state->unit[1].width, state->unit[1].height,
-				 &mX1, &mY1);
-		NVC0EXATransform(state->unit[1].transform, mx + (w * 2), my,
-				 state->unit[1].width, state->unit[1].height,
-				 &mX2, &mY2);
-
-		VTX2s(pNv, sX0, sY0, mX0, mY0, dx, dy + (h * 2));
-		VTX2s(pNv, sX1, sY1, mX1, mY1, dx, dy);
-		VTX2s(pNv, sX2, sY2, mX2, mY2, dx + (w * 2), dy);
-	} else {
-		VTX1s(pNv, sX0, sY0, dx, dy + (h * 2));
-		VTX1s(pNv, sX1, sY1, dx, dy);
-		VTX1s(pNv, sX2, sY2, dx + (w * 2), dy);
 	}
 
-	BEGIN_NVC0(push, NVC0_3D(VERTEX_END_GL), 1);
-	PUSH_DATA (push, 0);
+	map = (char *)pNv->vtx_stream[state->vtx]->map + state->vtx_head;
+	for (i = 0; i < 4; i++) {
+		vtx = (struct nvc0_vertex *)(map + i * state->vtx_stride);
+
+		NVC0EXATexCoord(0, sx + cx[i] * w, sy + cy[i] * h,
+				&vtx->src[0], &vtx->src[1]);
+
+		if (state->have_mask) {
+			NVC0EXATexCoord(1, mx + cx[i] * w, my + cy[i] * h,
+					&vtx->mask[0], &vtx->mask[1]);
+		}
+
+		vtx->pos = ((dy + cy[i] * h) << 16) |
+			   ((dx + cx[i] * w) & 0xffff);
+	}
+	state->vtx_head += 4 * state->vtx_stride;
+	pNv->composite_rects++;
 }
 
 void
 NVC0EXADoneComposite(PixmapPtr pdpix)
 {
 	NVC0EXA_LOCALS(pdpix);
+
+	NVC0EXAEndDraw(pNv);
+	if (state->failed)
+		nouveau_exa_composite_failed(pNv);
 	nouveau_pushbuf_bufctx(push, NULL);
+	state->key.push_cur = push->cur;
 }
 
 Bool
-NVC0EXARectM2MF(NVPtr pNv, int w, int h, int cpp,
+NVC0EXARectM2MF(struct nouveau_pushbuf *push, int w, int h, int cpp,
 		struct nouveau_bo *src, uint32_t src_off, int src_dom,
 		int src_pitch, int src_h, int src_x, int src_y,
 		struct nouveau_bo *dst, uint32_t dst_off, int dst_dom,
@@ -925,7 +1328,6 @@ NVC0EXARectM2MF(NVPtr pNv, int w, int h, int cpp,
 		{ src, src_dom | NOUVEAU_BO_RD },
 		{ dst, dst_dom | NOUVEAU_BO_WR },
 	};
-	struct nouveau_pushbuf *push = pNv->pushbuf;
 	unsigned exec = 0;
 
 	if (!PUSH_SPACE(push, 64))
@@ -966,8 +1368,8 @@ NVC0EXARectM2MF(NVPtr pNv, int w, int h, int cpp,
 		if (line_count > 2047)
 			line_count = 2047;
 
-		if (nouveau_pushbuf_space(push, 32, 0, 0) ||
-		    nouveau_pushbuf_refn (push, refs, 2))
+		if (!PUSH_SPACE(push, 32) ||
+		    PUSH_REFS(push, refs, 2))
 			return FALSE;
 
 		BEGIN_NVC0(push, NVC0_M2MF(OFFSET_OUT_HIGH), 2);
@@ -1007,22 +1409,113 @@ NVC0EXARectM2MF(NVPtr pNv, int w, int h, int cpp,
 	return TRUE;
 }
 
+/* The copy engine bound on the main channel doesn't wait for PGRAPH.  The
+ * channel hands it methods as soon as it reaches them, so a copy could
+ * read what 2D/3D are still writing, or overwrite what they're still
+ * reading.  PGRAPH releases a semaphore once everything before it is done,
+ * and the channel holds the copy back until it sees it.
+ */
 Bool
-NVE0EXARectCopy(NVPtr pNv, int w, int h, int cpp,
+NVC0EXACopyWait(NVPtr pNv)
+{
+	struct nouveau_pushbuf *push = pNv->pushbuf;
+	struct nouveau_bo *bo = pNv->tesla_scratch;
+	uint64_t addr = bo->offset + COPY_OFFSET;
+
+	if (!PUSH_SPACE(push, 16) ||
+	    PUSH_REFS(push, &(struct nouveau_pushbuf_refn) {
+				bo, NOUVEAU_BO_VRAM | NOUVEAU_BO_RDWR
+			  }, 1))
+		return FALSE;
+
+	pNv->copy_sequence++;
+	BEGIN_NVC0(push, NVC0_3D(QUERY_ADDRESS_HIGH), 4);
+	PUSH_DATA (push, addr >> 32);
+	PUSH_DATA (push, addr);
+	PUSH_DATA (push, pNv->copy_sequence);
+	PUSH_DATA (push, (0xf << NVC0_3D_QUERY_GET_UNIT__SHIFT) |
+			 NVC0_3D_QUERY_GET_FENCE | NVC0_3D_QUERY_GET_SHORT);
+	BEGIN_NVC0(push, SUBC_COPY(NV84_SUBCHAN_SEMAPHORE_ADDRESS_HIGH), 4);
+	PUSH_DATA (push, addr >> 32);
+	PUSH_DATA (push, addr);
+	PUSH_DATA (push, pNv->copy_sequence);
+	PUSH_DATA (push, NV84_SUBCHAN_SEMAPHORE_TRIGGER_ACQUIRE_EQUAL);
+	return TRUE;
+}
+
+Bool
+NVC0EXARectCopy(struct nouveau_pushbuf *push, int w, int h, int cpp,
 		struct nouveau_bo *src, uint32_t src_off, int src_dom,
 		int src_pitch, int src_h, int src_x, int src_y,
 		struct nouveau_bo *dst, uint32_t dst_off, int dst_dom,
 		int dst_pitch, int dst_h, int dst_x, int dst_y)
 {
-	struct nouveau_pushbuf *push = pNv->pushbuf;
 	struct nouveau_pushbuf_refn refs[] = {
 		{ src, src_dom | NOUVEAU_BO_RD },
 		{ dst, dst_dom | NOUVEAU_BO_WR },
 	};
 	unsigned exec;
 
-	if (nouveau_pushbuf_space(push, 64, 0, 0) ||
-	    nouveau_pushbuf_refn (push, refs, 2))
+	if (!PUSH_SPACE(push, 64) ||
+	    PUSH_REFS(push, refs, 2))
+		return FALSE;
+
+	exec = 0x00000000;
+	if (!src->config.nvc0.memtype) {
+		src_off += src_y * src_pitch + src_x * cpp;
+		exec |= 0x00000010;
+	}
+	if (!dst->config.nvc0.memtype) {
+		dst_off += dst_y * dst_pitch + dst_x * cpp;
+		exec |= 0x00000100;
+	}
+
+	BEGIN_NVC0(push, SUBC_COPY(0x0200), 7);
+	PUSH_DATA (push, src->config.nvc0.tile_mode);
+	PUSH_DATA (push, src_pitch);
+	PUSH_DATA (push, src_h);
+	PUSH_DATA (push, 1);
+	PUSH_DATA (push, 0);
+	PUSH_DATA (push, src_x * cpp);
+	PUSH_DATA (push, src_y);
+	BEGIN_NVC0(push, SUBC_COPY(0x0220), 7);
+	PUSH_DATA (push, dst->config.nvc0.tile_mode);
+	PUSH_DATA (push, dst_pitch);
+	PUSH_DATA (push, dst_h);
+	PUSH_DATA (push, 1);
+	PUSH_DATA (push, 0);
+	PUSH_DATA (push, dst_x * cpp);
+	PUSH_DATA (push, dst_y);
+	BEGIN_NVC0(push, SUBC_COPY(0x030c), 8);
+	PUSH_DATA (push, (src->offset + src_off) >> 32);
+	PUSH_DATA (push, (src->offset + src_off));
+	PUSH_DATA (push, (dst->offset + dst_off) >> 32);
+	PUSH_DATA (push, (dst->offset + dst_off));
+	PUSH_DATA (push, src_pitch);
+	PUSH_DATA (push, dst_pitch);
+	PUSH_DATA (push, w * cpp);
+	PUSH_DATA (push, h);
+	BEGIN_NVC0(push, SUBC_COPY(0x0300), 1);
+	PUSH_DATA (push, exec);
+
+	return TRUE;
+}
+
+Bool
+NVE0EXARectCopy(struct nouveau_pushbuf *push, int w, int h, int cpp,
+		struct nouveau_bo *src, uint32_t src_off, int src_dom,
+		int src_pitch, int src_h, int src_x, int src_y,
+		struct nouveau_bo *dst, uint32_t dst_off, int dst_dom,
+		int dst_pitch, int dst_h, int dst_x, int dst_y)
+{
+	struct nouveau_pushbuf_refn refs[] = {
+		{ src, src_dom | NOUVEAU_BO_RD },
+		{ dst, dst_dom | NOUVEAU_BO_WR },
+	};
+	unsigned exec;
+
+	if (!PUSH_SPACE(push, 64) ||
+	    PUSH_REFS(push, refs, 2))
 		return FALSE;
 
 	exec = 0x00000206;
@@ -1063,3 +1556,27 @@ NVE0EXARectCopy(NVPtr pNv, int w, int h, int cpp,
 
 	return TRUE;
 }
+
+/* Have the 3D engine write a report holding the GPU's timestamp to bo at
+ * offset, see nouveau_profile.c
+ */
+Bool
+NVC0EXAQueryTimestamp(NVPtr pNv, struct nouveau_bo *bo, uint32_t offset,
+		      uint32_t sequence)
+{
+	struct nouveau_pushbuf *push = pNv->pushbuf;
+
+	if (!PUSH_SPACE(push, 8) ||
+	    PUSH_REFS(push, &(struct nouveau_pushbuf_refn) {
+				bo, NOUVEAU_BO_GART | NOUVEAU_BO_WR
+			  }, 1))
+		return FALSE;
+
+	BEGIN_NVC0(push, NVC0_3D(QUERY_ADDRESS_HIGH), 4);
+	PUSH_DATA (push, (bo->offset + offset) >> 32);
+	PUSH_DATA (push, (bo->offset + offset));
+	PUSH_DATA (push, sequence);
+	PUSH_DATA (push, (5 << NVC0_3D_QUERY_GET_UNIT__SHIFT) |
+			 NVC0_3D_QUERY_GET_MODE_WRITE_UNK2);
+	return TRUE;
+}
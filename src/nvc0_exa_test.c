@@ -0,0 +1,1052 @@
+/*
+ * Copyright 2012 Nouveau Project
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF
+ * OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/* Method streams the NVC0 acceleration code sends, checked against
+ * nouveau_mock.c's decoding of the push buffer.
+ */
+
+#include "nv_include.h"
+#include "nvc0_accel.h"
+#include "nouveau_mock.h"
+
+static int failures;
+
+#define CHECK(cond, ...) do {						\
+	if (!(cond)) {							\
+		fprintf(stderr, "%s:%d: ", __func__, __LINE__);		\
+		fprintf(stderr, __VA_ARGS__);				\
+		fprintf(stderr, "\n");					\
+		failures++;						\
+	}								\
+} while (0)
+
+static Bool
+test_is(struct nouveau_mock_mthd *m, int subc, uint32_t mthd)
+{
+	return m->subc == subc && m->mthd == mthd;
+}
+
+/* Data of subc/mthd plus i, the first time it appears in the stream */
+static uint32_t
+test_data(struct nouveau_mock_mthd *m, int nr, int subc, uint32_t mthd,
+	  int i)
+{
+	int n = nouveau_mock_find(m, nr, 0, subc, mthd + i * 4);
+
+	CHECK(n >= 0, "no method %d:0x%04x", subc, mthd + i * 4);
+	return n >= 0 ? m[n].data : 0xdeadbeef;
+}
+
+static struct nouveau_bo *
+test_bo(NVPtr pNv, Bool tiled)
+{
+	union nouveau_bo_config cfg = {};
+	struct nouveau_bo *bo = NULL;
+
+	if (tiled) {
+		cfg.nvc0.memtype = 0xfe;
+		cfg.nvc0.tile_mode = 0x040;
+	}
+
+	if (nouveau_bo_new(pNv->dev, NOUVEAU_BO_VRAM, 0, 1024 * 1024, &cfg,
+			   &bo)) {
+		fprintf(stderr, "out of memory\n");
+		exit(1);
+	}
+
+	return bo;
+}
+
+/* NVC0EXARectCopy(), for each of linear and tiled on either side.  Linear
+ * surfaces are addressed from the first pixel, tiled ones from the start
+ * with the position in the tiling methods.  On the main channel the copy
+ * waits for PGRAPH first.
+ */
+static void
+test_pcopy(ScrnInfoPtr pScrn)
+{
+	NVPtr pNv = NVPTR(pScrn);
+	const int w = 16, h = 8, cpp = 4;
+	const int sp = 1024, sh = 64, sx = 3, sy = 5, so = 0x1000;
+	const int dp = 2048, dh = 32, dx = 7, dy = 9, dof = 0x2000;
+	uint64_t sema = pNv->tesla_scratch->offset + COPY_OFFSET;
+	struct nouveau_mock_mthd *m;
+	int i, nr, get, acq, launch;
+
+	CHECK(pNv->NvCopy, "PCOPY wasn't set up");
+	if (!pNv->NvCopy)
+		return;
+
+	for (i = 0; i < 4; i++) {
+		Bool src_tiled = i & 1, dst_tiled = i & 2;
+		struct nouveau_bo *src = test_bo(pNv, src_tiled);
+		struct nouveau_bo *dst = test_bo(pNv, dst_tiled);
+		uint64_t src_addr = src->offset + so;
+		uint64_t dst_addr = dst->offset + dof;
+		uint32_t exec = 0;
+
+		if (!src_tiled) {
+			src_addr += sy * sp + sx * cpp;
+			exec |= 0x00000010;
+		}
+		if (!dst_tiled) {
+			dst_addr += dy * dp + dx * cpp;
+			exec |= 0x00000100;
+		}
+
+		nouveau_mock_reset();
+		CHECK(NVAccelM2MF(pNv, w, h, cpp, so, dof,
+				  src, NOUVEAU_BO_VRAM, sp, sh, sx, sy,
+				  dst, NOUVEAU_BO_VRAM, dp, dh, dx, dy),
+		      "copy %d failed", i);
+		nr = nouveau_mock_mthds(pNv->pushbuf, &m);
+
+		CHECK(nouveau_mock_find(m, nr, 0, NVC0_M2MF(EXEC)) < 0,
+		      "copy %d went through M2MF", i);
+
+		CHECK(test_data(m, nr, SUBC_COPY(0x0200), 0) ==
+		      src->config.nvc0.tile_mode, "src tile mode");
+		CHECK(test_data(m, nr, SUBC_COPY(0x0200), 1) == sp,
+		      "src pitch");
+		CHECK(test_data(m, nr, SUBC_COPY(0x0200), 2) == sh,
+		      "src height");
+		CHECK(test_data(m, nr, SUBC_COPY(0x0200), 5) == sx * cpp,
+		      "src x");
+		CHECK(test_data(m, nr, SUBC_COPY(0x0200), 6) == sy, "src y");
+		CHECK(test_data(m, nr, SUBC_COPY(0x0220), 0) ==
+		      dst->config.nvc0.tile_mode, "dst tile mode");
+		CHECK(test_data(m, nr, SUBC_COPY(0x0220), 1) == dp,
+		      "dst pitch");
+		CHECK(test_data(m, nr, SUBC_COPY(0x0220), 2) == dh,
+		      "dst height");
+		CHECK(test_data(m, nr, SUBC_COPY(0x0220), 5) == dx * cpp,
+		      "dst x");
+		CHECK(test_data(m, nr, SUBC_COPY(0x0220), 6) == dy, "dst y");
+
+		CHECK(test_data(m, nr, SUBC_COPY(0x030c), 0) ==
+		      (uint32_t)(src_addr >> 32) &&
+		      test_data(m, nr, SUBC_COPY(0x030c), 1) ==
+		      (uint32_t)src_addr,
+		      "copy %d src address", i);
+		CHECK(test_data(m, nr, SUBC_COPY(0x030c), 2) ==
+		      (uint32_t)(dst_addr >> 32) &&
+		      test_data(m, nr, SUBC_COPY(0x030c), 3) ==
+		      (uint32_t)dst_addr,
+		      "copy %d dst address", i);
+		CHECK(test_data(m, nr, SUBC_COPY(0x030c), 4) == sp &&
+		      test_data(m, nr, SUBC_COPY(0x030c), 5) == dp,
+		      "copy %d pitches", i);
+		CHECK(test_data(m, nr, SUBC_COPY(0x030c), 6) == w * cpp &&
+		      test_data(m, nr, SUBC_COPY(0x030c), 7) == h,
+		      "copy %d size", i);
+		CHECK(test_data(m, nr, SUBC_COPY(0x0300), 0) == exec,
+		      "copy %d exec 0x%08x, expected 0x%08x", i,
+		      test_data(m, nr, SUBC_COPY(0x0300), 0), exec);
+
+		/* PGRAPH releases, the channel acquires, then the copy */
+		get = nouveau_mock_find(m, nr, 0, NVC0_3D(QUERY_GET));
+		acq = nouveau_mock_find(m, nr, 0, SUBC_COPY(
+					NV84_SUBCHAN_SEMAPHORE_TRIGGER));
+		launch = nouveau_mock_find(m, nr, 0, SUBC_COPY(0x0300));
+		CHECK(get >= 0 && acq > get && launch > acq,
+		      "copy %d doesn't wait for PGRAPH", i);
+		CHECK(test_data(m, nr, NVC0_3D(QUERY_ADDRESS_LOW), 0) ==
+		      (uint32_t)sema &&
+		      test_data(m, nr, SUBC_COPY(
+				NV84_SUBCHAN_SEMAPHORE_ADDRESS_LOW), 0) ==
+		      (uint32_t)sema, "copy %d semaphore address", i);
+		CHECK(test_data(m, nr, NVC0_3D(QUERY_SEQUENCE), 0) ==
+		      pNv->copy_sequence &&
+		      test_data(m, nr, SUBC_COPY(
+				NV84_SUBCHAN_SEMAPHORE_SEQUENCE), 0) ==
+		      pNv->copy_sequence, "copy %d semaphore sequence", i);
+		CHECK(acq >= 0 && m[acq].data ==
+		      NV84_SUBCHAN_SEMAPHORE_TRIGGER_ACQUIRE_EQUAL,
+		      "copy %d semaphore trigger", i);
+
+		free(m);
+		nouveau_bo_ref(NULL, &src);
+		nouveau_bo_ref(NULL, &dst);
+	}
+}
+
+/* Subchannel of SUBC_*(mthd) */
+static int
+test_subc(int subc, uint32_t mthd)
+{
+	return subc;
+}
+
+/* The copies from test_pcopy(), carried out by the mock, through M2MF and
+ * then PCOPY.  Both leave the same bytes in the destination, and only the
+ * copied rect has been written.
+ */
+static void
+test_pcopy_m2mf(ScrnInfoPtr pScrn)
+{
+	NVPtr pNv = NVPTR(pScrn);
+	struct nouveau_object *copy = pNv->NvCopy;
+	const int w = 16, h = 8, cpp = 4;
+	const int sp = 1024, sh = 64, sx = 3, sy = 5, so = 0x1000;
+	const int dp = 2048, dh = 32, dx = 7, dy = 9, dof = 0x2000;
+	struct nouveau_mock_mthd *m;
+	int i, e, nr, n;
+	uint8_t *map;
+
+	if (!copy)
+		return;
+
+	for (i = 0; i < 4; i++) {
+		Bool src_tiled = i & 1, dst_tiled = i & 2;
+		struct nouveau_bo *src = test_bo(pNv, src_tiled);
+		struct nouveau_bo *dst[2];
+
+		nouveau_bo_map(src, NOUVEAU_BO_WR, pNv->client);
+		for (n = 0, map = src->map; n < src->size; n++)
+			map[n] = 0x80 | (n % 127);
+
+		for (e = 0; e < 2; e++) {
+			dst[e] = test_bo(pNv, dst_tiled);
+			nouveau_bo_map(dst[e], NOUVEAU_BO_WR, pNv->client);
+
+			pNv->NvCopy = e ? copy : NULL;
+			nouveau_mock_reset();
+			CHECK(NVAccelM2MF(pNv, w, h, cpp, so, dof,
+					  src, NOUVEAU_BO_VRAM, sp, sh, sx, sy,
+					  dst[e], NOUVEAU_BO_VRAM, dp, dh,
+					  dx, dy),
+			      "copy %d failed on %s", i, e ? "PCOPY" : "M2MF");
+			nr = nouveau_mock_mthds(pNv->pushbuf, &m);
+			CHECK(!nouveau_mock_copy(m, nr, e ?
+						 test_subc(SUBC_COPY(0)) :
+						 test_subc(SUBC_M2MF(0)),
+						 e ? 0x90b5 : 0x9039),
+			      "copy %d on %s outside a buffer", i,
+			      e ? "PCOPY" : "M2MF");
+			free(m);
+
+			for (n = 0, map = dst[e]->map; map < (uint8_t *)
+			     dst[e]->map + dst[e]->size; map++)
+				n += *map != 0;
+			CHECK(n == w * h * cpp, "copy %d on %s wrote %d "
+			      "bytes, expected %d", i, e ? "PCOPY" : "M2MF",
+			      n, w * h * cpp);
+		}
+		pNv->NvCopy = copy;
+
+		CHECK(!memcmp(dst[0]->map, dst[1]->map, dst[0]->size),
+		      "copy %d: M2MF and PCOPY results differ", i);
+		if (!src_tiled && !dst_tiled) {
+			for (n = 0; n < h; n++) {
+				CHECK(!memcmp((uint8_t *)dst[1]->map + dof +
+					      (dy + n) * dp + dx * cpp,
+					      (uint8_t *)src->map + so +
+					      (sy + n) * sp + sx * cpp,
+					      w * cpp), "copy %d line %d", i, n);
+			}
+		}
+
+		nouveau_bo_ref(NULL, &src);
+		nouveau_bo_ref(NULL, &dst[0]);
+		nouveau_bo_ref(NULL, &dst[1]);
+	}
+}
+
+/* Rendering to ppix, as one batch */
+static void
+test_render(ExaDriverPtr exa, PixmapPtr ppix)
+{
+	CHECK(exa->PrepareSolid(ppix, GXcopy, ~0, 0), "prepare failed");
+	exa->Solid(ppix, 0, 0, 1, 1);
+	exa->DoneSolid(ppix);
+	exa->MarkSync(ppix->drawable.pScreen);
+}
+
+/* A download that had to read back from VRAM has its region watched.  The
+ * next batch rendering to the pixmap starts reading it back again from
+ * MarkSync, so the next download only waits for a copy that's already
+ * been submitted.
+ */
+static void
+test_readback_prefetch(ScrnInfoPtr pScrn)
+{
+	NVPtr pNv = NVPTR(pScrn);
+	ExaDriverPtr exa = pNv->EXADriverPtr;
+	struct nouveau_readback *rb = &pNv->readback;
+	PixmapPtr ppix = nouveau_mock_pixmap(pScrn, 64, 64, 32, 0);
+	struct nouveau_bo *bo = nouveau_pixmap_bo(ppix);
+	unsigned prefetches = rb->prefetches, hits = rb->hits;
+	struct nouveau_mock_stats before, after;
+	struct nouveau_mock_mthd *m;
+	char buf[16 * 16 * 4];
+	int i, nr, bad = 0;
+
+	test_render(exa, ppix);
+	CHECK(exa->DownloadFromScreen(ppix, 8, 8, 16, 16, buf, 16 * 4),
+	      "first download failed");
+	CHECK(rb->prefetches == prefetches && rb->watch == ppix,
+	      "%u prefetches before the first download, watching %p",
+	      rb->prefetches - prefetches, rb->watch);
+
+	/* what the GPU rendered this time */
+	nouveau_bo_map(bo, NOUVEAU_BO_WR, pNv->client);
+	memset((char *)bo->map + nouveau_pixmap_offset(ppix), 0x5a,
+	       exaGetPixmapPitch(ppix) * ppix->drawable.height);
+
+	nouveau_mock_reset();
+	test_render(exa, ppix);
+	nr = nouveau_mock_mthds(pNv->pushbuf, &m);
+	CHECK(rb->prefetches == prefetches + 1 &&
+	      rb->nvpix == nouveau_pixmap(ppix), "no prefetch from MarkSync");
+	CHECK(nouveau_mock_find(m, nr, 0, SUBC_COPY(0x0300)) >= 0,
+	      "no readback copy after the render");
+	CHECK(!nouveau_mock_copy(m, nr, test_subc(SUBC_COPY(0)), 0x90b5),
+	      "readback copy outside a buffer");
+	free(m);
+
+	/* served from the prefetch, nothing left to submit */
+	memset(buf, 0, sizeof(buf));
+	nouveau_mock_reset();
+	nouveau_mock_stats(&before);
+	CHECK(exa->DownloadFromScreen(ppix, 8, 8, 16, 16, buf, 16 * 4),
+	      "second download failed");
+	nouveau_mock_stats(&after);
+	nr = nouveau_mock_mthds(pNv->pushbuf, &m);
+	CHECK(rb->hits == hits + 1, "download wasn't served from the prefetch");
+	CHECK(nouveau_mock_find(m, nr, 0, SUBC_COPY(0x0300)) < 0,
+	      "download read back again");
+	CHECK(after.waits == before.waits && after.submits == before.submits,
+	      "download had to submit the readback itself");
+	for (i = 0; i < sizeof(buf); i++)
+		bad += buf[i] != 0x5a;
+	CHECK(!bad, "%d bytes downloaded wrong", bad);
+	free(m);
+
+	nouveau_mock_pixmap_destroy(ppix);
+	CHECK(!rb->watch && !rb->nvpix, "destroyed pixmap still watched");
+}
+
+/* Copies between a pixmap and its shadow in one CPU access, nr[0] in
+ * PrepareAccess and nr[1] in FinishAccess.  box[] is the last of each, in
+ * pixels, taken from the tiled side.
+ */
+static void
+test_shadow_access(ScrnInfoPtr pScrn, PixmapPtr ppix, int index,
+		   int nr[2], BoxRec box[2])
+{
+	NVPtr pNv = NVPTR(pScrn);
+	ExaDriverPtr exa = pNv->EXADriverPtr;
+	int cpp = ppix->drawable.bitsPerPixel >> 3;
+	struct nouveau_mock_mthd *m;
+	int i, n, nm, tiling;
+
+	memset(box, 0, 2 * sizeof(*box));
+	for (i = 0; i < 2; i++) {
+		nouveau_mock_reset();
+		if (!i)
+			CHECK(exa->PrepareAccess(ppix, index),
+			      "prepare failed");
+		else
+			exa->FinishAccess(ppix, index);
+		nm = nouveau_mock_mthds(pNv->pushbuf, &m);
+
+		tiling = i ? 0x0220 : 0x0200;
+		nr[i] = 0;
+		for (n = 0; n < nm; n++) {
+			if (test_is(&m[n], SUBC_COPY(tiling + 5 * 4)))
+				box[i].x1 = m[n].data / cpp;
+			if (test_is(&m[n], SUBC_COPY(tiling + 6 * 4)))
+				box[i].y1 = m[n].data;
+			if (test_is(&m[n], SUBC_COPY(0x030c + 6 * 4)))
+				box[i].x2 = box[i].x1 + m[n].data / cpp;
+			if (test_is(&m[n], SUBC_COPY(0x030c + 7 * 4)))
+				box[i].y2 = box[i].y1 + m[n].data;
+			if (test_is(&m[n], SUBC_COPY(0x0300)))
+				nr[i]++;
+		}
+		free(m);
+	}
+}
+
+static void
+test_box(BoxRec *box, int x1, int y1, int x2, int y2)
+{
+	CHECK(box->x1 == x1 && box->y1 == y1 && box->x2 == x2 &&
+	      box->y2 == y2, "copied %d,%d-%d,%d, expected %d,%d-%d,%d",
+	      box->x1, box->y1, box->x2, box->y2, x1, y1, x2, y2);
+}
+
+/* The shadow of a tiled pixmap is copied in and written back in full the
+ * first time.  After that it's kept, and only what was reported to Damage
+ * since goes either way.
+ */
+static void
+test_cpu_box(NVPtr pNv, unsigned back, int op, Bool write,
+	     int x, int y, int w, int h)
+{
+	struct nouveau_cpu_box *b;
+
+	b = &pNv->cpu_box[(pNv->cpu_boxes - back) % NV_CPU_BOXES];
+	CHECK(b->op == op && b->write == write && b->x == x && b->y == y &&
+	      b->w == w && b->h == h,
+	      "logged op %d write %d %dx%d+%d+%d, expected op %d write %d "
+	      "%dx%d+%d+%d", b->op, b->write, b->w, b->h, b->x, b->y,
+	      op, write, w, h, x, y);
+}
+
+/* 1MiB, bigger than a single access used to be allowed to shadow */
+static void
+test_shadow_region(ScrnInfoPtr pScrn)
+{
+	NVPtr pNv = NVPTR(pScrn);
+	ExaDriverPtr exa = pNv->EXADriverPtr;
+	PixmapPtr ppix = nouveau_mock_pixmap(pScrn, 512, 512, 32, 0);
+	PixmapPtr other;
+	uint64_t bytes;
+	BoxRec box[2];
+	int nr[2];
+
+	CHECK(nouveau_pixmap_bo(ppix)->config.nvc0.memtype,
+	      "pixmap isn't tiled");
+
+	test_shadow_access(pScrn, ppix, EXA_PREPARE_DEST, nr, box);
+	CHECK(nr[0] == 1 && nr[1] == 1, "first access: %d copies in, %d out",
+	      nr[0], nr[1]);
+	test_box(&box[0], 0, 0, 512, 512);
+	test_box(&box[1], 0, 0, 512, 512);
+	test_cpu_box(pNv, 2, NV_CPU_BOX_IN, TRUE, 0, 0, 512, 512);
+	test_cpu_box(pNv, 1, NV_CPU_BOX_OUT, TRUE, 0, 0, 512, 512);
+	CHECK(pNv->shadow_kept && nouveau_pixmap(ppix)->shadow,
+	      "shadow not kept");
+
+	/* a fallback drawing to part of it */
+	bytes = pNv->cpu_access_bytes;
+	nouveau_mock_damage(ppix, 10, 20, 16, 8);
+	test_shadow_access(pScrn, ppix, EXA_PREPARE_DEST, nr, box);
+	CHECK(nr[0] == 1 && nr[1] == 1, "fallback: %d copies in, %d out",
+	      nr[0], nr[1]);
+	test_box(&box[0], 10, 20, 26, 28);
+	test_box(&box[1], 10, 20, 26, 28);
+	test_cpu_box(pNv, 2, NV_CPU_BOX_IN, TRUE, 10, 20, 16, 8);
+	test_cpu_box(pNv, 1, NV_CPU_BOX_OUT, TRUE, 10, 20, 16, 8);
+	CHECK(pNv->cpu_access_bytes - bytes == 2 * 16 * 8 * 4,
+	      "fallback moved %llu bytes",
+	      (unsigned long long)(pNv->cpu_access_bytes - bytes));
+
+	/* nothing's been rendered to it since, the shadow's up to date */
+	test_shadow_access(pScrn, ppix, EXA_PREPARE_SRC, nr, box);
+	CHECK(nr[0] == 0 && nr[1] == 0, "read: %d copies in, %d out",
+	      nr[0], nr[1]);
+	test_cpu_box(pNv, 1, NV_CPU_BOX_IN, FALSE, 0, 0, 0, 0);
+
+	/* no room left to keep another one, that's left to EXA */
+	pNv->shadow_kept_max = pNv->shadow_kept;
+	other = nouveau_mock_pixmap(pScrn, 64, 64, 32, 0);
+	CHECK(!exa->PrepareAccess(other, EXA_PREPARE_SRC),
+	      "shadowed a pixmap over ShadowCacheSize");
+	CHECK(!nouveau_pixmap(other)->shadow, "shadow left behind");
+	nouveau_mock_pixmap_destroy(other);
+	pNv->shadow_kept_max = 64 * 1024 * 1024;
+
+	nouveau_mock_pixmap_destroy(ppix);
+	CHECK(!pNv->shadow_kept, "%llu bytes of shadows left",
+	      (unsigned long long)pNv->shadow_kept);
+}
+
+/* More than both vertex buffers' worth of rects in one batch.  Each time
+ * one fills up what's in it is drawn, and the other one is pointed at.
+ * Going back to the first means waiting for the GPU to be done with it,
+ * which needs the draws from it submitted first.
+ */
+static void
+test_vertex_wrap(ScrnInfoPtr pScrn)
+{
+	NVPtr pNv = NVPTR(pScrn);
+	ExaDriverPtr exa = pNv->EXADriverPtr;
+	PixmapPtr pspix = nouveau_mock_pixmap(pScrn, 64, 64, 32, 0);
+	PixmapPtr pdpix = nouveau_mock_pixmap(pScrn, 256, 256, 32, 0);
+	PicturePtr pspict = nouveau_mock_picture(pspix, PICT_a8r8g8b8);
+	PicturePtr pdpict = nouveau_mock_picture(pdpix, PICT_a8r8g8b8);
+	unsigned draws = pNv->composite_draws;
+	unsigned wraps = pNv->composite_vtx_wraps;
+	struct nouveau_mock_stats stats;
+	struct nouveau_mock_mthd *m;
+	uint32_t addr = 0, verts = 0;
+	int rects = 2 * (0x40000 / (4 * 12)) + 100;
+	int i, nr, n = 0;
+
+	nouveau_mock_reset();
+	CHECK(exa->CheckComposite(PictOpOver, pspict, NULL, pdpict) &&
+	      exa->PrepareComposite(PictOpOver, pspict, NULL, pdpict,
+				    pspix, NULL, pdpix), "prepare failed");
+	for (i = 0; i < rects; i++)
+		exa->Composite(pdpix, 0, 0, 0, 0, i & 0xff, i >> 8, 1, 1);
+	exa->DoneComposite(pdpix);
+	nouveau_mock_stats(&stats);
+	nr = nouveau_mock_mthds(pNv->pushbuf, &m);
+
+	CHECK(pNv->composite_vtx_wraps - wraps == 2, "%d wraps, expected 2",
+	      pNv->composite_vtx_wraps - wraps);
+	CHECK(pNv->composite_draws - draws == 3, "%d draws, expected 3",
+	      pNv->composite_draws - draws);
+	CHECK(stats.waits == 1 && stats.stalls >= 1,
+	      "%d kicks and %d stalls for the first buffer, expected 1",
+	      stats.waits, stats.stalls);
+
+	for (i = 0; i < nr; i++) {
+		if (test_is(&m[i], NVC0_3D(VERTEX_ARRAY_START_LOW(0))))
+			addr = m[i].data;
+		if (!test_is(&m[i], NVC0_3D(VERTEX_BUFFER_FIRST)))
+			continue;
+
+		CHECK(addr == (uint32_t)pNv->vtx_stream[n & 1]->offset,
+		      "draw %d from the wrong buffer", n);
+		CHECK(m[i].data == 0 && i + 1 < nr && m[i + 1].data,
+		      "draw %d isn't from the start of the buffer", n);
+		verts += m[i + 1].data;
+		n++;
+	}
+	CHECK(n == 3 && verts == 4 * rects, "%d vertices in %d draws, "
+	      "expected %d in 3", verts, n, 4 * rects);
+
+	free(m);
+	nouveau_mock_picture_destroy(pspict);
+	nouveau_mock_picture_destroy(pdpict);
+	nouveau_mock_pixmap_destroy(pspix);
+	nouveau_mock_pixmap_destroy(pdpix);
+}
+
+#define BF(f) NV50_BLEND_FACTOR_##f
+
+/* Blend state and fragment program at the time of a draw */
+struct test_pass {
+	uint32_t sblend, dblend, fp;
+};
+
+/* Over with a component-alpha mask is drawn twice, OutReverse and then
+ * Add, with the blend state put back for the next batch.  Nothing else
+ * gets a second pass, component-alpha or not.
+ */
+static void
+test_component_alpha(ScrnInfoPtr pScrn)
+{
+	NVPtr pNv = NVPTR(pScrn);
+	const struct {
+		int op;
+		Bool ca;
+		int passes;
+		struct test_pass pass[2];
+	} tests[] = {
+		{ PictOpOver, TRUE, 2, {
+			{ BF(ZERO), BF(ONE_MINUS_SRC_COLOR), PFP_CCASA },
+			{ BF(ONE), BF(ONE), PFP_CCA } } },
+		{ PictOpOver, FALSE, 1, {
+			{ BF(ONE), BF(ONE_MINUS_SRC_ALPHA), PFP_C } } },
+		{ PictOpAdd, TRUE, 1, {
+			{ BF(ONE), BF(ONE), PFP_CCA } } },
+		{ PictOpOutReverse, TRUE, 1, {
+			{ BF(ZERO), BF(ONE_MINUS_SRC_COLOR), PFP_CCASA } } },
+	};
+	ExaDriverPtr exa = pNv->EXADriverPtr;
+	PixmapPtr pspix = nouveau_mock_pixmap(pScrn, 64, 64, 32, 0);
+	PixmapPtr pmpix = nouveau_mock_pixmap(pScrn, 64, 64, 32, 0);
+	PixmapPtr pdpix = nouveau_mock_pixmap(pScrn, 256, 256, 32, 0);
+	PicturePtr pspict = nouveau_mock_picture(pspix, PICT_a8r8g8b8);
+	PicturePtr pmpict = nouveau_mock_picture(pmpix, PICT_a8r8g8b8);
+	PicturePtr pdpict = nouveau_mock_picture(pdpix, PICT_a8r8g8b8);
+	struct nouveau_mock_mthd *m;
+	struct test_pass pass[3], cur = {};
+	unsigned t, two_pass;
+	int i, nr, n;
+
+	for (t = 0; t < sizeof(tests) / sizeof(tests[0]); t++) {
+		/* all of the state's emitted, not just what changed */
+		PUSH_KICK(pNv->pushbuf);
+		PUSH_SHADOW_RESET(pNv->pushbuf);
+		nouveau_mock_reset();
+		two_pass = pNv->composite_two_pass;
+
+		pmpict->componentAlpha = tests[t].ca;
+		CHECK(exa->CheckComposite(tests[t].op, pspict, pmpict,
+					  pdpict) &&
+		      exa->PrepareComposite(tests[t].op, pspict, pmpict,
+					    pdpict, pspix, pmpix, pdpix),
+		      "op %d prepare failed", tests[t].op);
+		exa->Composite(pdpix, 0, 0, 0, 0, 8, 8, 16, 16);
+		exa->DoneComposite(pdpix);
+		nr = nouveau_mock_mthds(pNv->pushbuf, &m);
+
+		for (i = n = 0; i < nr; i++) {
+			if (test_is(&m[i], NVC0_3D(BLEND_FUNC_SRC_RGB)))
+				cur.sblend = m[i].data;
+			if (test_is(&m[i], NVC0_3D(BLEND_FUNC_DST_RGB)))
+				cur.dblend = m[i].data;
+			if (test_is(&m[i], NVC0_3D(SP_START_ID(5))))
+				cur.fp = m[i].data;
+			if (test_is(&m[i], NVC0_3D(VERTEX_BUFFER_FIRST)) &&
+			    n < 3)
+				pass[n++] = cur;
+		}
+
+		CHECK(n == tests[t].passes, "op %d ca %d: %d passes, "
+		      "expected %d", tests[t].op, tests[t].ca, n,
+		      tests[t].passes);
+		CHECK(pNv->composite_two_pass - two_pass == (n == 2),
+		      "op %d ca %d: two pass count", tests[t].op,
+		      tests[t].ca);
+		for (i = 0; i < n && i < tests[t].passes; i++) {
+			CHECK(!memcmp(&pass[i], &tests[t].pass[i],
+				      sizeof(pass[i])),
+			      "op %d ca %d pass %d: blend 0x%x 0x%x fp 0x%x",
+			      tests[t].op, tests[t].ca, i, pass[i].sblend,
+			      pass[i].dblend, pass[i].fp);
+		}
+		CHECK(!memcmp(&cur, &tests[t].pass[0], sizeof(cur)),
+		      "op %d ca %d: first pass state not restored",
+		      tests[t].op, tests[t].ca);
+		free(m);
+	}
+
+	nouveau_mock_picture_destroy(pspict);
+	nouveau_mock_picture_destroy(pmpict);
+	nouveau_mock_picture_destroy(pdpict);
+	nouveau_mock_pixmap_destroy(pspix);
+	nouveau_mock_pixmap_destroy(pmpix);
+	nouveau_mock_pixmap_destroy(pdpix);
+}
+
+/* Pitch-linear pixmaps, like a scanout buffer that isn't tiled, are
+ * sampled through a RECT TIC with the pitch in place of the tiling.
+ * Their pitch has to be 32-byte aligned and fit the TIC.
+ */
+static void
+test_linear_texture(ScrnInfoPtr pScrn)
+{
+	NVPtr pNv = NVPTR(pScrn);
+	ExaDriverPtr exa = pNv->EXADriverPtr;
+	PixmapPtr pspix, pdpix = nouveau_mock_pixmap(pScrn, 256, 256, 32, 0);
+	PicturePtr pspict, pdpict = nouveau_mock_picture(pdpix, PICT_a8r8g8b8);
+	struct nouveau_mock_mthd *m;
+	uint32_t desc[7];
+	uint64_t addr;
+	int pitch, i, j, nr;
+
+	pNv->tiled_scanout = FALSE;
+	pspix = nouveau_mock_pixmap(pScrn, 100, 50, 32,
+				    NOUVEAU_CREATE_PIXMAP_SCANOUT);
+	pNv->tiled_scanout = TRUE;
+	pspict = nouveau_mock_picture(pspix, PICT_a8r8g8b8);
+	pitch = pspix->devKind;
+	CHECK(!nv50_style_tiled_pixmap(pspix), "scanout pixmap is tiled");
+
+	addr = nouveau_pixmap_bo(pspix)->offset + nouveau_pixmap_offset(pspix);
+	desc[0] = addr;
+	desc[1] = (addr >> 32) | 0xd0001000 | NV50TIC_0_2_TARGET_RECT |
+		  NV50TIC_0_2_LINEAR;
+	desc[2] = pitch;
+	desc[3] = 100;
+	desc[4] = (1 << NV50TIC_0_5_DEPTH_SHIFT) | 50;
+	desc[5] = 0;
+	desc[6] = 0;
+
+	PUSH_KICK(pNv->pushbuf);
+	nouveau_mock_reset();
+	CHECK(exa->CheckComposite(PictOpSrc, pspict, NULL, pdpict) &&
+	      exa->PrepareComposite(PictOpSrc, pspict, NULL, pdpict,
+				    pspix, NULL, pdpix), "prepare failed");
+	exa->Composite(pdpix, 0, 0, 0, 0, 0, 0, 100, 50);
+	exa->DoneComposite(pdpix);
+	nr = nouveau_mock_mthds(pNv->pushbuf, &m);
+
+	/* the TIC's words after the format, wherever they were written */
+	for (i = 0; i < nr; i++) {
+		for (j = 0; j < 7 && i + j < nr; j++) {
+			if (m[i + j].data != desc[j])
+				break;
+		}
+		if (j == 7)
+			break;
+	}
+	CHECK(i < nr, "no linear TIC for pitch %d", pitch);
+	free(m);
+
+	pspix->devKind = 416;
+	CHECK(exa->CheckComposite(PictOpSrc, pspict, NULL, pdpict),
+	      "32-byte aligned pitch rejected");
+	pspix->devKind = 408;
+	CHECK(!exa->CheckComposite(PictOpSrc, pspict, NULL, pdpict),
+	      "unaligned pitch accepted");
+	pspix->devKind = NV50TIC_0_3_PITCH_MASK + 1;
+	CHECK(!exa->CheckComposite(PictOpSrc, pspict, NULL, pdpict),
+	      "pitch too large for the TIC accepted");
+	pspix->devKind = pitch;
+
+	nouveau_mock_picture_destroy(pspict);
+	nouveau_mock_picture_destroy(pdpict);
+	nouveau_mock_pixmap_destroy(pspix);
+	nouveau_mock_pixmap_destroy(pdpix);
+}
+
+/* A radial gradient with one centre is sampled from a table over a
+ * quarter of the plane, which the sampler mirrors about the centre.
+ * Texture coordinates are the offset from the centre, 1.0 a little past
+ * the larger circle.
+ */
+static void
+test_radial_gradient(ScrnInfoPtr pScrn)
+{
+	static PictGradientStop stops[2] = {
+		{ 0, { 0xffff, 0, 0, 0xffff } },
+		{ xFixed1, { 0, 0, 0xffff, 0xffff } },
+	};
+	NVPtr pNv = NVPTR(pScrn);
+	ExaDriverPtr exa = pNv->EXADriverPtr;
+	PixmapPtr pdpix = nouveau_mock_pixmap(pScrn, 256, 256, 32, 0);
+	PicturePtr pdpict = nouveau_mock_picture(pdpix, PICT_a8r8g8b8);
+	PicturePtr pspict = nouveau_mock_solid(0);
+	PictRadialGradient *radial = &pspict->pSourcePict->radial;
+	uint32_t wrap = 0x00024000 | NV50TSC_1_0_WRAPS_MIRROR_CLAMP_TO_EDGE |
+			NV50TSC_1_0_WRAPT_MIRROR_CLAMP_TO_EDGE |
+			NV50TSC_1_0_WRAPR_MIRROR_CLAMP_TO_EDGE;
+	struct nouveau_gradient grad = {};
+	struct nouveau_mock_mthd *m;
+	double size = 40.0 * NV_RADIAL_SIZE / (NV_RADIAL_SIZE - 2);
+	float s, t;
+	int i, nr, tic = 0, tsc = 0;
+
+	radial->type = SourcePictTypeRadial;
+	radial->nstops = 2;
+	radial->stops = stops;
+	radial->c1.x = radial->c2.x = IntToxFixed(100);
+	radial->c1.y = radial->c2.y = IntToxFixed(50);
+	radial->c1.radius = IntToxFixed(10);
+	radial->c2.radius = IntToxFixed(40);
+	pspict->repeat = 1;
+	pspict->repeatType = RepeatPad;
+
+	CHECK(exa->CheckComposite(PictOpSrc, pspict, NULL, pdpict),
+	      "radial gradient rejected");
+	CHECK(nouveau_gradient_get(pNv, pspict, &grad) && grad.radial,
+	      "no radial table");
+	nouveau_gradient_coord(&grad, 100, 50, &s, &t);
+	CHECK(fabs(s) < 1e-6 && fabs(t) < 1e-6, "centre at %f,%f", s, t);
+	nouveau_gradient_coord(&grad, 60, 90, &s, &t);
+	CHECK(fabs(s + 40 / size) < 1e-6 && fabs(t - 40 / size) < 1e-6,
+	      "-40,+40 from the centre at %f,%f", s, t);
+
+	nouveau_mock_reset();
+	CHECK(exa->PrepareComposite(PictOpSrc, pspict, NULL, pdpict,
+				    NULL, NULL, pdpix), "prepare failed");
+	exa->Composite(pdpix, 0, 0, 0, 0, 0, 0, 64, 64);
+	exa->DoneComposite(pdpix);
+	nr = nouveau_mock_mthds(pNv->pushbuf, &m);
+	for (i = 0; i + 2 < nr; i++) {
+		tic |= m[i].data == NV_RADIAL_PITCH &&
+		       m[i + 1].data == NV_RADIAL_SIZE &&
+		       m[i + 2].data == ((1 << 16) | NV_RADIAL_SIZE);
+		tsc |= m[i].data == wrap;
+	}
+	CHECK(tic, "no TIC for the radial table");
+	CHECK(tsc, "radial table isn't mirrored");
+	free(m);
+
+	/* what the table can't cover */
+	pspict->repeatType = RepeatNormal;
+	CHECK(!exa->CheckComposite(PictOpSrc, pspict, NULL, pdpict),
+	      "repeating radial gradient accepted");
+	pspict->repeatType = RepeatPad;
+	radial->c2.x = IntToxFixed(110);
+	CHECK(!exa->CheckComposite(PictOpSrc, pspict, NULL, pdpict),
+	      "radial gradient with two centres accepted");
+
+	nouveau_mock_picture_destroy(pspict);
+	nouveau_mock_picture_destroy(pdpict);
+	nouveau_mock_pixmap_destroy(pdpix);
+}
+
+/* An upload is counted towards the submission scheduler by its size */
+static void
+test_sifc_queued(ScrnInfoPtr pScrn)
+{
+	NVPtr pNv = NVPTR(pScrn);
+	struct nouveau_pushbuf_priv *priv = pNv->pushbuf->user_priv;
+	PixmapPtr pdpix = nouveau_mock_pixmap(pScrn, 64, 64, 32, 0);
+	uint32_t data[8 * 4] = {};
+
+	PUSH_KICK(pNv->pushbuf);
+	CHECK(NVC0EXAUploadSIFC((char *)data, 8 * 4, pdpix, 1, 2, 8, 4, 4),
+	      "upload failed");
+	CHECK(priv->pixels == 8 * 4, "%u pixels queued, expected %d",
+	      priv->pixels, 8 * 4);
+
+	nouveau_mock_pixmap_destroy(pdpix);
+}
+
+/* Only running out of push buffer space counts as a wrap.  Waiting on a
+ * bo that's referenced makes libdrm submit too, but that mustn't be
+ * taken for needing bigger buffers.
+ */
+static void
+test_pushbuf_wraps(ScrnInfoPtr pScrn)
+{
+	NVPtr pNv = NVPTR(pScrn);
+	struct nouveau_pushbuf *push = pNv->pushbuf;
+	struct nouveau_pushbuf_priv *priv = push->user_priv;
+	PixmapPtr pdpix = nouveau_mock_pixmap(pScrn, 64, 64, 32, 0);
+	struct nouveau_bo *bo = nouveau_pixmap_bo(pdpix);
+	unsigned wraps = priv->wraps, implicit = priv->implicit;
+
+	PUSH_KICK(push);
+	pNv->EXADriverPtr->PrepareSolid(pdpix, GXcopy, ~0, 0);
+	pNv->EXADriverPtr->Solid(pdpix, 0, 0, 8, 8);
+	pNv->EXADriverPtr->DoneSolid(pdpix);
+	nouveau_bo_wait(bo, NOUVEAU_BO_RD, pNv->client);
+	CHECK(priv->wraps == wraps && priv->implicit == implicit + 1,
+	      "bo wait counted as %u wraps, %u by libdrm",
+	      priv->wraps - wraps, priv->implicit - implicit);
+
+	/* something for the wrap to submit */
+	PUSH_DATA (push, 0);
+	CHECK(PUSH_SPACE(push, PUSH_AVAIL(push) + 1), "no space");
+	CHECK(priv->wraps == wraps + 1, "%u wraps for a full buffer",
+	      priv->wraps - wraps);
+
+	nouveau_mock_pixmap_destroy(pdpix);
+}
+
+/* A batch that finds the push buffer full when it's drawn submits what's
+ * queued and tries again.  If there's still no room it's reported, not
+ * dropped quietly.
+ */
+static void
+test_draw_space(ScrnInfoPtr pScrn)
+{
+	NVPtr pNv = NVPTR(pScrn);
+	struct nouveau_pushbuf *push = pNv->pushbuf;
+	ExaDriverPtr exa = pNv->EXADriverPtr;
+	PixmapPtr pspix = nouveau_mock_pixmap(pScrn, 64, 64, 32, 0);
+	PixmapPtr pdpix = nouveau_mock_pixmap(pScrn, 256, 256, 32, 0);
+	PicturePtr pspict = nouveau_mock_picture(pspix, PICT_a8r8g8b8);
+	PicturePtr pdpict = nouveau_mock_picture(pdpix, PICT_a8r8g8b8);
+	struct nouveau_mock_mthd *m;
+	unsigned failed;
+	int fail, i, n, nr;
+
+	for (fail = 1; fail <= 2; fail++) {
+		PUSH_KICK(push);
+		nouveau_mock_reset();
+		failed = pNv->composite_failed;
+
+		CHECK(exa->PrepareComposite(PictOpOver, pspict, NULL, pdpict,
+					    pspix, NULL, pdpix),
+		      "prepare failed");
+		for (i = 0; i < 3; i++)
+			exa->Composite(pdpix, 0, 0, 0, 0, i * 16, 0, 16, 16);
+
+		/* leave too little room for the draw */
+		while (PUSH_AVAIL(push) >= 64)
+			PUSH_DATA (push, 0);
+		nouveau_mock_fail_space(fail);
+		exa->DoneComposite(pdpix);
+		nouveau_mock_fail_space(0);
+		nr = nouveau_mock_mthds(push, &m);
+
+		n = nouveau_mock_find(m, nr, 0, NVC0_3D(VERTEX_BUFFER_FIRST));
+		if (fail == 1) {
+			CHECK(n >= 0 && n + 1 < nr && m[n + 1].data == 3 * 4,
+			      "rects not drawn after submitting");
+			CHECK(pNv->composite_failed == failed,
+			      "batch reported as failed");
+		} else {
+			CHECK(n < 0, "rects drawn without space");
+			CHECK(pNv->composite_failed == failed + 1,
+			      "failed batch not reported");
+		}
+		free(m);
+	}
+
+	nouveau_mock_picture_destroy(pspict);
+	nouveau_mock_picture_destroy(pdpict);
+	nouveau_mock_pixmap_destroy(pspix);
+	nouveau_mock_pixmap_destroy(pdpix);
+}
+
+/* A run of composites only keeps its state while the pictures it was set
+ * up for are unchanged.  A new transform isn't, even in place, and nor is
+ * a new picture that happens to be where a destroyed one was.  One with
+ * the same transform at a new address is, but it's that one that's used.
+ */
+static void
+test_reuse_transform(ScrnInfoPtr pScrn)
+{
+	NVPtr pNv = NVPTR(pScrn);
+	ExaDriverPtr exa = pNv->EXADriverPtr;
+	PixmapPtr pspix = nouveau_mock_pixmap(pScrn, 64, 64, 32, 0);
+	PixmapPtr pdpix = nouveau_mock_pixmap(pScrn, 256, 256, 32, 0);
+	PicturePtr pspict = nouveau_mock_picture(pspix, PICT_a8r8g8b8);
+	PicturePtr pdpict = nouveau_mock_picture(pdpix, PICT_a8r8g8b8);
+	PictTransform t[2] = {
+		{ { { xFixed1, 0, 0 }, { 0, xFixed1, 0 }, { 0, 0, xFixed1 } } },
+		{ { { xFixed1, 0, 0 }, { 0, xFixed1, 0 }, { 0, 0, xFixed1 } } },
+	};
+	const struct {
+		int tx;        /* translation of the transform in use */
+		Bool moved;    /* to the other copy of it */
+		Bool new_dst;  /* destination picture destroyed and replaced */
+		Bool reuse;
+	} tests[] = {
+		{  8, FALSE, FALSE, FALSE },
+		{  8, FALSE, FALSE, TRUE },
+		{ 16, FALSE, FALSE, FALSE },
+		{ 16, TRUE, FALSE, TRUE },
+		{ 16, FALSE, TRUE, FALSE },
+	};
+	unsigned i, reused;
+	int cur = 0;
+
+	pspict->transform = &t[cur];
+	for (i = 0; i < sizeof(tests) / sizeof(tests[0]); i++) {
+		if (tests[i].moved) {
+			/* and what's left where it was isn't to be used */
+			t[!cur] = t[cur];
+			t[cur].matrix[0][2] = IntToxFixed(32);
+			cur = !cur;
+			pspict->transform = &t[cur];
+		}
+		t[cur].matrix[0][2] = IntToxFixed(tests[i].tx);
+
+		if (tests[i].new_dst) {
+			nouveau_mock_picture_destroy(pdpict);
+			pdpict = nouveau_mock_picture(pdpix, PICT_a8r8g8b8);
+		}
+
+		PUSH_KICK(pNv->pushbuf);
+		nouveau_mock_reset();
+		reused = pNv->composite_reused;
+		CHECK(exa->PrepareComposite(PictOpSrc, pspict, NULL, pdpict,
+					    pspix, NULL, pdpix),
+		      "%d: prepare failed", i);
+		exa->Composite(pdpix, 0, 0, 0, 0, 0, 0, 16, 16);
+		exa->DoneComposite(pdpix);
+		CHECK(pNv->composite_reused - reused == tests[i].reuse,
+		      "%d: state %sreused", i, tests[i].reuse ? "not " : "");
+	}
+
+	nouveau_mock_picture_destroy(pspict);
+	nouveau_mock_picture_destroy(pdpict);
+	nouveau_mock_pixmap_destroy(pspix);
+	nouveau_mock_pixmap_destroy(pdpix);
+}
+
+/* A pixmap demoted to GART that can't be brought back, nothing else can
+ * be moved out to make room, is used by the GPU where it is.  Referencing
+ * it as VRAM would have the kernel refuse the submission.
+ */
+static void
+test_demoted(ScrnInfoPtr pScrn)
+{
+	NVPtr pNv = NVPTR(pScrn);
+	ExaDriverPtr exa = pNv->EXADriverPtr;
+	uint64_t budget = pNv->vram_budget;
+	unsigned prefetches = pNv->readback.prefetches;
+	PixmapPtr pdpix, pspix;
+	PicturePtr pdpict, pspict;
+	struct nouveau_mock_stats before, after;
+	static char buf[128 * 128 * 4];
+
+	pdpix = nouveau_mock_pixmap(pScrn, 256, 256, 32, 0);
+	exa->MarkSync(pScrn->pScreen);
+	pNv->vram_budget = 0;
+	pNv->exa_force_cp = TRUE;
+	pspix = nouveau_mock_pixmap(pScrn, 256, 256, 32, 0);
+	pNv->exa_force_cp = FALSE;
+	CHECK(nouveau_pixmap(pdpix)->demoted, "pixmap wasn't demoted");
+	pdpict = nouveau_mock_picture(pdpix, PICT_a8r8g8b8);
+	pspict = nouveau_mock_picture(pspix, PICT_a8r8g8b8);
+	nouveau_mock_stats(&before);
+
+	test_render(exa, pdpix);
+	CHECK(exa->PrepareCopy(pspix, pdpix, 1, 1, GXcopy, ~0),
+	      "copy to it failed");
+	exa->Copy(pdpix, 0, 0, 0, 0, 64, 64);
+	exa->DoneCopy(pdpix);
+	CHECK(exa->PrepareCopy(pdpix, pspix, 1, 1, GXcopy, ~0),
+	      "copy from it failed");
+	exa->Copy(pspix, 0, 0, 0, 0, 64, 64);
+	exa->DoneCopy(pspix);
+
+	/* linear render targets aren't supported, it can only be read */
+	CHECK(exa->CheckComposite(PictOpOver, pdpict, pdpict, pspict) &&
+	      exa->PrepareComposite(PictOpOver, pdpict, pdpict, pspict,
+				    pdpix, pdpix, pspix),
+	      "composite from it failed");
+	exa->Composite(pspix, 0, 0, 0, 0, 0, 0, 64, 64);
+	exa->DoneComposite(pspix);
+	exa->MarkSync(pScrn->pScreen);
+
+	CHECK(exa->UploadToScreen(pdpix, 0, 0, 128, 128, buf, 128 * 4),
+	      "upload failed");
+	CHECK(exa->DownloadFromScreen(pdpix, 0, 0, 128, 128, buf, 128 * 4),
+	      "download failed");
+	test_render(exa, pdpix);
+	CHECK(pNv->readback.prefetches == prefetches + 1,
+	      "no readback prefetch");
+
+	PUSH_KICK(pNv->pushbuf);
+	nouveau_mock_stats(&after);
+	CHECK(nouveau_pixmap(pdpix)->demoted, "pixmap was promoted");
+	CHECK(after.domains == before.domains,
+	      "%u references outside the bo's domain",
+	      after.domains - before.domains);
+
+	pNv->vram_budget = budget;
+	nouveau_mock_picture_destroy(pspict);
+	nouveau_mock_picture_destroy(pdpict);
+	nouveau_mock_pixmap_destroy(pspix);
+	nouveau_mock_pixmap_destroy(pdpix);
+}
+
+int
+main(int argc, char *argv[])
+{
+	ScrnInfoPtr pScrn = nouveau_mock_screen_init(0xc0, 1024, 768);
+
+	/* leave out the channel setup */
+	PUSH_KICK(NVPTR(pScrn)->pushbuf);
+	nouveau_mock_record(TRUE);
+	test_pcopy(pScrn);
+	test_pcopy_m2mf(pScrn);
+	test_readback_prefetch(pScrn);
+	test_shadow_region(pScrn);
+	test_vertex_wrap(pScrn);
+	test_component_alpha(pScrn);
+	test_linear_texture(pScrn);
+	test_radial_gradient(pScrn);
+	test_reuse_transform(pScrn);
+	test_sifc_queued(pScrn);
+	test_pushbuf_wraps(pScrn);
+	test_draw_space(pScrn);
+	test_demoted(pScrn);
+	nouveau_mock_screen_fini(pScrn);
+
+	return failures ? 1 : 0;
+}
@@ -68,13 +68,15 @@ nvc0_xv_image_put(ScrnInfoPtr pScrn,
 {
 	NVPtr pNv = NVPTR(pScrn);
 	struct nouveau_bo *dst = nouveau_pixmap_bo(ppix);
+	uint64_t dst_addr = dst->offset + nouveau_pixmap_offset(ppix);
 	struct nouveau_pushbuf_refn refs[] = {
 		{ pNv->tesla_scratch, NOUVEAU_BO_VRAM | NOUVEAU_BO_RDWR },
 		{ src, NOUVEAU_BO_VRAM | NOUVEAU_BO_RD },
-		{ dst, NOUVEAU_BO_VRAM | NOUVEAU_BO_WR },
+		{ dst, nouveau_pixmap_domain(ppix) | NOUVEAU_BO_WR },
 	};
 	struct nouveau_pushbuf *push = pNv->pushbuf;
 	uint32_t mode = 0xd0005000 | (src->config.nvc0.tile_mode << 18);
+	uint32_t format = 0;
 	float X1, X2, Y1, Y2;
 	BoxPtr pbox;
 	int nbox;
@@ -85,23 +87,20 @@ nvc0_xv_image_put(ScrnInfoPtr pScrn,
 	if (!PUSH_SPACE(push, 256))
 		return BadImplementation;
 
-	BEGIN_NVC0(push, NVC0_3D(RT_ADDRESS_HIGH(0)), 8);
-	PUSH_DATA (push, dst->offset >> 32);
-	PUSH_DATA (push, dst->offset);
-	PUSH_DATA (push, ppix->drawable.width);
-	PUSH_DATA (push, ppix->drawable.height);
 	switch (ppix->drawable.bitsPerPixel) {
-	case 32: PUSH_DATA (push, NV50_SURFACE_FORMAT_BGRA8_UNORM); break;
-	case 24: PUSH_DATA (push, NV50_SURFACE_FORMAT_BGRX8_UNORM); break;
-	case 16: PUSH_DATA (push, NV50_SURFACE_FORMAT_B5G6R5_UNORM); break;
-	case 15: PUSH_DATA (push, NV50_SURFACE_FORMAT_BGR5_X1_UNORM); break;
+	case 32: format = NV50_SURFACE_FORMAT_BGRA8_UNORM; break;
+	case 24: format = NV50_SURFACE_FORMAT_BGRX8_UNORM; break;
+	case 16: format = NV50_SURFACE_FORMAT_B5G6R5_UNORM; break;
+	case 15: format = NV50_SURFACE_FORMAT_BGR5_X1_UNORM; break;
 	}
-	PUSH_DATA (push, dst->config.nvc0.tile_mode);
-	PUSH_DATA (push, 1);
-	PUSH_DATA (push, 0);
 
-	BEGIN_NVC0(push, NVC0_3D(BLEND_ENABLE(0)), 1);
-	PUSH_DATA (push, 0);
+	PUSH_SHADOW_NVC0(push, NVC0_3D(RT_ADDRESS_HIGH(0)), (uint32_t []) {
+			 dst_addr >> 32, dst_addr,
+			 ppix->drawable.width, ppix->drawable.height,
+			 format, dst->config.nvc0.tile_mode, 1, 0 }, 8);
+
+	PUSH_SHADOW_NVC0(push, NVC0_3D(BLEND_ENABLE(0)), (uint32_t []) {
+			 0 }, 1);
 
 	PUSH_DATAu(push, pNv->tesla_scratch, TIC_OFFSET, 16);
 	if (id == FOURCC_YV12 || id == FOURCC_I420) {
@@ -198,6 +197,10 @@ nvc0_xv_image_put(ScrnInfoPtr pScrn,
 	PUSH_DATA (push, 0x00000000);
 	PUSH_DATA (push, 0x00000000);
 
+	/* EXA composite may have left the units on its own slots */
+	TEXBind(pNv, 0, 0);
+	TEXBind(pNv, 1, 1);
+
 	BEGIN_NVC0(push, NVC0_3D(SP_START_ID(5)), 1);
 	PUSH_DATA (push, PFP_NV12);
 
@@ -235,13 +238,14 @@ nvc0_xv_image_put(ScrnInfoPtr pScrn,
 		ty1 = ty1 / height;
 		ty2 = ty2 / height;
 
-		if (nouveau_pushbuf_space(push, 64, 0, 0) ||
-		    nouveau_pushbuf_refn (push, refs, 3))
+		if (!PUSH_SPACE(push, 64) ||
+		    PUSH_REFS(push, refs, 3))
 			return BadImplementation;
 
-		BEGIN_NVC0(push, NVC0_3D(SCISSOR_HORIZ(0)), 2);
-		PUSH_DATA (push, sx2 << NVC0_3D_SCISSOR_HORIZ_MAX__SHIFT | sx1);
-		PUSH_DATA (push, sy2 << NVC0_3D_SCISSOR_VERT_MAX__SHIFT | sy1 );
+		VTXImmediate(pNv);
+		PUSH_SHADOW_NVC0(push, NVC0_3D(SCISSOR_HORIZ(0)), (uint32_t []) {
+				 sx2 << NVC0_3D_SCISSOR_HORIZ_MAX__SHIFT | sx1,
+				 sy2 << NVC0_3D_SCISSOR_VERT_MAX__SHIFT | sy1 }, 2);
 
 		BEGIN_NVC0(push, NVC0_3D(VERTEX_BEGIN_GL), 1);
 		PUSH_DATA (push, NVC0_3D_VERTEX_BEGIN_GL_PRIMITIVE_TRIANGLES);
@@ -263,8 +267,8 @@ nvc0_xv_csc_update(NVPtr pNv, float yco, float *off, float *uco, float *vco)
 {
 	struct nouveau_pushbuf *push = pNv->pushbuf;
 
-	if (nouveau_pushbuf_space(push, 64, 0, 0) ||
-	    nouveau_pushbuf_refn (push, &(struct nouveau_pushbuf_refn) {
+	if (!PUSH_SPACE(push, 64) ||
+	    PUSH_REFS(push, &(struct nouveau_pushbuf_refn) {
 					pNv->tesla_scratch, NOUVEAU_BO_WR |
 					NOUVEAU_BO_VRAM }, 1))
 		return;